@@ -30,3 +30,12 @@ echo -e "${GREEN}[INFO] Benchmark test completed. Results saved to kv_server_ben
 kill $SERVER_PID
 wait $SERVER_PID 2>/dev/null
 echo -e "${GREEN}[INFO] gRPC service stopped${NC}"
+
+# In-process storage engine benchmarks (no server needed)
+bazelisk build //src/benchmark:storage_engine_benchmark
+rm -rf ./bin/benchmark/storage_engine_benchmark
+mv bazel-bin/src/benchmark/storage_engine_benchmark ./bin/benchmark/
+
+./bin/benchmark/storage_engine_benchmark --benchmark_out=./storage_engine_benchmark.json --benchmark_out_format=json
+
+echo -e "${GREEN}[INFO] Storage engine benchmark completed. Results saved to storage_engine_benchmark.json${NC}"
@@ -0,0 +1,214 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "src/common/cache.h"
+#include "src/common/zipfian_generator.h"
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace tiny_kv {
+
+namespace {
+
+constexpr uint64_t kKeyCount = 1 << 16;
+
+// The cache every thread of a run shares, one per cache type.
+template <typename Cache> std::unique_ptr<Cache> g_cache;
+
+// 90% Get, 10% Put on uniformly random keys below kKeyCount, against a
+// cache built from `args` and filled before the run. Thread 0 builds it;
+// the first iteration of every thread waits for it.
+template <typename Cache, typename... Args>
+void RunReadMostly(benchmark::State &state, Args &&...args) {
+  if (state.thread_index() == 0) {
+    g_cache<Cache> = std::make_unique<Cache>(std::forward<Args>(args)...);
+    for (uint64_t key = 0; key < kKeyCount; ++key) {
+      g_cache<Cache>->Put(key, key);
+    }
+  }
+
+  std::mt19937_64 rng(state.thread_index());
+  for (auto _ : state) {
+    uint64_t key = rng() % kKeyCount;
+    if (rng() % 10 == 0) {
+      g_cache<Cache>->Put(key, key);
+    } else {
+      auto value = g_cache<Cache>->Get(key);
+      benchmark::DoNotOptimize(value);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+constexpr uint64_t kTraceKeys = 1 << 20;
+
+// 1M Zipfian draws below kTraceKeys, built once. Fixed seed, so every cache
+// replays the same trace.
+const std::vector<uint64_t> &ZipfianTrace() {
+  static const std::vector<uint64_t> trace = [] {
+    ZipfianGenerator generator(0, kTraceKeys - 1, 0.99, 42);
+    std::vector<uint64_t> keys(1 << 20);
+    for (auto &key : keys) {
+      key = generator.Next();
+    }
+    return keys;
+  }();
+  return trace;
+}
+
+// ZipfianTrace() with a scan of range(1) keys that the Zipfian draws never
+// produce inserted every 64K draws, like a periodic full-table scan.
+std::vector<uint64_t> ScannedZipfianTrace(const benchmark::State &state) {
+  const std::vector<uint64_t> &zipfian = ZipfianTrace();
+  const size_t period = 1 << 16;
+  const size_t scan_length = state.range(1);
+  std::vector<uint64_t> trace;
+  trace.reserve(zipfian.size() + zipfian.size() / period * scan_length);
+  uint64_t next_scan_key = kTraceKeys;
+  for (size_t i = 0; i < zipfian.size(); ++i) {
+    if (i % period == period - 1) {
+      for (size_t j = 0; j < scan_length; ++j) {
+        trace.push_back(next_scan_key++);
+      }
+    }
+    trace.push_back(zipfian[i]);
+  }
+  return trace;
+}
+
+// Replays `trace` read-through (Get, then Put on a miss) against a cache of
+// range(0) entries, each thread starting at its own offset. Reports the
+// fraction of Gets that hit.
+template <typename Cache>
+void RunReadThrough(benchmark::State &state,
+                    const std::vector<uint64_t> &trace) {
+  if (state.thread_index() == 0) {
+    g_cache<Cache> = std::make_unique<Cache>(state.range(0));
+  }
+
+  size_t next = trace.size() / state.threads() * state.thread_index();
+  size_t hits = 0;
+  for (auto _ : state) {
+    uint64_t key = trace[next];
+    next = next + 1 == trace.size() ? 0 : next + 1;
+    if (g_cache<Cache>->Get(key)) {
+      hits++;
+    } else {
+      g_cache<Cache>->Put(key, key);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.counters["hit_ratio"] =
+      benchmark::Counter(static_cast<double>(hits) / state.iterations(),
+                         benchmark::Counter::kAvgThreads);
+}
+
+} // namespace
+
+/************************************************************************/
+/* BM_LRUCache_ReadMostly / BM_ShardedLRUCache_ReadMostly */
+/************************************************************************/
+// The one-lock cache flattens out after one thread; the sharded one should
+// keep scaling as long as there are cores for the threads.
+static void BM_LRUCache_ReadMostly(benchmark::State &state) {
+  RunReadMostly<LRUCache<uint64_t, uint64_t>>(state, kKeyCount);
+}
+
+static void BM_ShardedLRUCache_ReadMostly(benchmark::State &state) {
+  RunReadMostly<ShardedLRUCache<uint64_t, uint64_t>>(state, kKeyCount, 64);
+}
+
+/************************************************************************/
+/* BM_FlatLRUCache_ReadMostly / BM_FlatLRUCache_Zipfian */
+/************************************************************************/
+// Single-threaded counterparts of the LRUCache runs. The flat cache evicts
+// the same entries as LRUCache, so only the layout differs.
+static void BM_FlatLRUCache_ReadMostly(benchmark::State &state) {
+  RunReadMostly<FlatLRUCache<uint64_t, uint64_t>>(state, kKeyCount);
+}
+
+static void BM_FlatLRUCache_Zipfian(benchmark::State &state) {
+  RunReadThrough<FlatLRUCache<uint64_t, uint64_t>>(state, ZipfianTrace());
+}
+
+/************************************************************************/
+/* BM_LRUCache_Zipfian / BM_ClockCache_Zipfian */
+/************************************************************************/
+// range(0) = capacity. CLOCK should hit about as often as LRU while its
+// hits, which take only a shared lock, scale with threads.
+static void BM_LRUCache_Zipfian(benchmark::State &state) {
+  RunReadThrough<LRUCache<uint64_t, uint64_t>>(state, ZipfianTrace());
+}
+
+static void BM_ClockCache_Zipfian(benchmark::State &state) {
+  RunReadThrough<ClockCache<uint64_t, uint64_t>>(state, ZipfianTrace());
+}
+
+/************************************************************************/
+/* BM_LRUCache_ZipfianScans / BM_TinyLFUCache_ZipfianScans */
+/************************************************************************/
+// range(0) = capacity, range(1) = scan length. W-TinyLFU should hit more
+// often than LRU on the plain trace, and lose much less to the scans.
+static void BM_LRUCache_ZipfianScans(benchmark::State &state) {
+  RunReadThrough<LRUCache<uint64_t, uint64_t>>(state,
+                                               ScannedZipfianTrace(state));
+}
+
+static void BM_TinyLFUCache_ZipfianScans(benchmark::State &state) {
+  RunReadThrough<TinyLFUCache<uint64_t, uint64_t>>(
+      state, ScannedZipfianTrace(state));
+}
+
+BENCHMARK(BM_LRUCache_ReadMostly)->ThreadRange(1, 8)->UseRealTime();
+
+BENCHMARK(BM_ShardedLRUCache_ReadMostly)->ThreadRange(1, 8)->UseRealTime();
+
+BENCHMARK(BM_LRUCache_Zipfian)
+    ->Arg(1 << 10)
+    ->Arg(1 << 13)
+    ->Arg(1 << 16)
+    ->Arg(1 << 19)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+BENCHMARK(BM_ClockCache_Zipfian)
+    ->Arg(1 << 10)
+    ->Arg(1 << 13)
+    ->Arg(1 << 16)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+BENCHMARK(BM_FlatLRUCache_ReadMostly);
+
+BENCHMARK(BM_FlatLRUCache_Zipfian)
+    ->Arg(1 << 10)
+    ->Arg(1 << 13)
+    ->Arg(1 << 16)
+    ->Arg(1 << 19);
+
+BENCHMARK(BM_LRUCache_ZipfianScans)
+    ->Args({1 << 10, 0})
+    ->Args({1 << 10, 2 << 10})
+    ->Args({1 << 13, 0})
+    ->Args({1 << 13, 2 << 13})
+    ->Args({1 << 16, 0})
+    ->Args({1 << 16, 2 << 16});
+
+BENCHMARK(BM_TinyLFUCache_ZipfianScans)
+    ->Args({1 << 10, 0})
+    ->Args({1 << 10, 2 << 10})
+    ->Args({1 << 13, 0})
+    ->Args({1 << 13, 2 << 13})
+    ->Args({1 << 16, 0})
+    ->Args({1 << 16, 2 << 16});
+
+} // namespace tiny_kv
+
+BENCHMARK_MAIN();
@@ -0,0 +1,236 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "src/common/entry_table.h"
+#include "src/common/storage_engine.h"
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <malloc.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace tiny_kv {
+
+namespace {
+
+constexpr size_t kKeyCount = 100000;
+constexpr size_t kValueSize = 64;
+
+std::unique_ptr<MemoryStorage> g_storage;
+std::vector<std::string> g_keys;
+
+// Runs on thread 0 only; the first iteration of every thread waits for it.
+void SetupStorage(size_t num_shards) {
+  g_storage = std::make_unique<MemoryStorage>(num_shards);
+  g_keys.clear();
+  g_keys.reserve(kKeyCount);
+  for (size_t i = 0; i < kKeyCount; ++i) {
+    g_keys.push_back("key" + std::to_string(i));
+    g_storage->Put(g_keys.back(), std::string(kValueSize, 'v'));
+  }
+}
+
+constexpr size_t kInsertCount = 100000;
+
+// Bytes currently allocated from the heap, mmapped chunks included.
+size_t HeapBytes() {
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+}
+
+// `count` distinct keys of exactly `key_size` bytes (at least 8).
+std::vector<std::string> MakeKeys(size_t count, size_t key_size) {
+  std::vector<std::string> keys;
+  keys.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    std::string key = std::to_string(i);
+    key.insert(0, key_size > key.size() ? key_size - key.size() : 0, 'k');
+    keys.push_back(std::move(key));
+  }
+  return keys;
+}
+
+// Inserts kInsertCount entries into a fresh `Table` per iteration via
+// `put(table, key, value)`. Reports the insert rate and the heap bytes the
+// full table holds per entry.
+template <typename Table, typename Put>
+void RunInsertBenchmark(benchmark::State &state, Put &&put) {
+  const std::vector<std::string> keys =
+      MakeKeys(kInsertCount, state.range(0));
+  const std::string value(state.range(1), 'v');
+
+  size_t bytes = 0;
+  for (auto _ : state) {
+    size_t before = HeapBytes();
+    auto table = std::make_unique<Table>();
+    for (const auto &key : keys) {
+      put(table.get(), key, value);
+    }
+    state.PauseTiming();
+    bytes = HeapBytes() - before;
+    table.reset();
+    state.ResumeTiming();
+  }
+
+  state.SetItemsProcessed(state.iterations() * kInsertCount);
+  state.counters["bytes_per_entry"] =
+      static_cast<double>(bytes) / kInsertCount;
+  state.counters["payload_per_entry"] =
+      static_cast<double>(state.range(0) + state.range(1));
+}
+
+} // namespace
+
+/************************************************************************/
+/* BM_EntryTable_Insert / BM_KVMap_Insert */
+/************************************************************************/
+// range(0) = key size, range(1) = value size. The entry table backs each
+// MemoryStorage shard; KVMap is the string-pair map it replaced.
+static void BM_EntryTable_Insert(benchmark::State &state) {
+  RunInsertBenchmark<EntryTable>(
+      state, [](EntryTable *table, const std::string &key,
+                const std::string &value) {
+        table->Put(key, value, EntryTable::Hash(key));
+      });
+}
+
+static void BM_KVMap_Insert(benchmark::State &state) {
+  RunInsertBenchmark<KVMap>(state, [](KVMap *map, const std::string &key,
+                                      const std::string &value) {
+    (*map)[key] = value;
+  });
+}
+
+/************************************************************************/
+/* BM_MemoryStorage_Get */
+/************************************************************************/
+// range(0) = shard count. Throughput should grow with the thread count as
+// long as there are enough shards.
+static void BM_MemoryStorage_Get(benchmark::State &state) {
+  if (state.thread_index() == 0) {
+    SetupStorage(state.range(0));
+  }
+
+  std::mt19937 rng(state.thread_index());
+  std::uniform_int_distribution<size_t> dist(0, kKeyCount - 1);
+
+  for (auto _ : state) {
+    auto value = g_storage->Get(g_keys[dist(rng)]);
+    benchmark::DoNotOptimize(value);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+/************************************************************************/
+/* BM_MemoryStorage_ReadMostly */
+/************************************************************************/
+// range(0) = shard count, 90% reads / 10% writes.
+static void BM_MemoryStorage_ReadMostly(benchmark::State &state) {
+  if (state.thread_index() == 0) {
+    SetupStorage(state.range(0));
+  }
+
+  std::mt19937 rng(state.thread_index());
+  std::uniform_int_distribution<size_t> dist(0, kKeyCount - 1);
+  const std::string value(kValueSize, 'w');
+
+  for (auto _ : state) {
+    const std::string &key = g_keys[dist(rng)];
+    if (rng() % 10 == 0) {
+      g_storage->Put(key, value);
+    } else {
+      auto result = g_storage->Get(key);
+      benchmark::DoNotOptimize(result);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+/************************************************************************/
+/* BM_MemoryStorage_RangeScan / BM_MemoryStorage_RangeScanFullWalk */
+/************************************************************************/
+// range(0) = stored entries, range(1) = entries per range. The indexed
+// scan should not slow down as the store grows; the full walk (the
+// `StorageEngine` default that unordered engines use) grows linearly.
+template <typename ScanFn>
+void RunRangeScanBenchmark(benchmark::State &state, ScanFn &&scan) {
+  const size_t count = state.range(0);
+  const size_t limit = state.range(1);
+  MemoryStorage storage;
+  char key[32];
+  for (size_t i = 0; i < count; ++i) {
+    snprintf(key, sizeof(key), "key%08zu", i);
+    storage.Put(key, std::string(kValueSize, 'v'));
+  }
+
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<size_t> dist(0, count - limit);
+  ScanBatch batch;
+  for (auto _ : state) {
+    snprintf(key, sizeof(key), "key%08zu", dist(rng));
+    scan(&storage, key, limit, &batch);
+    benchmark::DoNotOptimize(batch.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * limit);
+}
+
+static void BM_MemoryStorage_RangeScan(benchmark::State &state) {
+  RunRangeScanBenchmark(state, [](MemoryStorage *storage, const char *start,
+                                  size_t limit, ScanBatch *batch) {
+    storage->Scan(start, "", limit, batch);
+  });
+}
+
+static void BM_MemoryStorage_RangeScanFullWalk(benchmark::State &state) {
+  RunRangeScanBenchmark(state, [](MemoryStorage *storage, const char *start,
+                                  size_t limit, ScanBatch *batch) {
+    storage->StorageEngine::Scan(start, "", limit, batch);
+  });
+}
+
+BENCHMARK(BM_EntryTable_Insert)
+    ->Args({8, 16})
+    ->Args({16, 64})
+    ->Args({32, 256})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_KVMap_Insert)
+    ->Args({8, 16})
+    ->Args({16, 64})
+    ->Args({32, 256})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_MemoryStorage_Get)
+    ->Arg(1)
+    ->Arg(16)
+    ->Arg(64)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+BENCHMARK(BM_MemoryStorage_ReadMostly)
+    ->Arg(1)
+    ->Arg(16)
+    ->Arg(64)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+BENCHMARK(BM_MemoryStorage_RangeScan)
+    ->Args({10000, 100})
+    ->Args({100000, 100})
+    ->Args({1000000, 100})
+    ->Args({1000000, 1000});
+
+BENCHMARK(BM_MemoryStorage_RangeScanFullWalk)
+    ->Args({10000, 100})
+    ->Args({100000, 100})
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace tiny_kv
+
+BENCHMARK_MAIN();
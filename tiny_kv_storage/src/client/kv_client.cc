@@ -4,6 +4,7 @@
 
 #include "kv_client.h"
 #include <arpa/inet.h>
+#include <cstdlib>
 #include <netinet/in.h>
 #include <sstream>
 #include <sys/socket.h>
@@ -63,8 +64,16 @@ std::pair<bool, std::string> KVClient::Get(const std::string &key) {
   return ExecuteCmd("GET", key);
 }
 
-bool KVClient::Put(const std::string &key, const std::string &value) {
-  auto[success, message] = ExecuteCmd("PUT", key, value);
+bool KVClient::Put(const std::string &key, const std::string &value,
+                   uint64_t ttl_seconds, const std::string &durability) {
+  std::string args = value;
+  if (ttl_seconds != 0) {
+    args += " EX " + std::to_string(ttl_seconds);
+  }
+  if (!durability.empty()) {
+    args += " DURABILITY " + durability;
+  }
+  auto[success, message] = ExecuteCmd("PUT", key, args);
   return success;
 }
 
@@ -73,6 +82,60 @@ bool KVClient::Delete(const std::string &key) {
   return success;
 }
 
+bool KVClient::CompareAndSet(const std::string &key,
+                             const std::string &expected,
+                             const std::string &value) {
+  auto[success, message] = ExecuteCmd("CAS", key, expected + " " + value);
+  if (!success) {
+    last_error_ = message;
+  }
+  return success;
+}
+
+bool KVClient::IncrementBy(const std::string &key, int64_t delta,
+                           int64_t *value) {
+  auto[success, result] = ExecuteCmd("INCRBY", key, std::to_string(delta));
+  if (!success) {
+    last_error_ = result;
+    return false;
+  }
+  *value = std::strtoll(result.c_str(), nullptr, 10);
+  return true;
+}
+
+bool KVClient::Append(const std::string &key, const std::string &suffix,
+                      uint64_t *length) {
+  auto[success, result] = ExecuteCmd("APPEND", key, suffix);
+  if (!success) {
+    last_error_ = result;
+    return false;
+  }
+  *length = std::strtoull(result.c_str(), nullptr, 10);
+  return true;
+}
+
+bool KVClient::CacheStats(uint64_t *hits, uint64_t *misses) {
+  // `STATS` answers `hits <n> misses <n>`
+  auto[success, result] = ExecuteMultiCmd("STATS", {});
+  if (!success) {
+    last_error_ = result;
+    return false;
+  }
+  std::istringstream iss(result);
+  std::string name;
+  *hits = *misses = 0;
+  while (iss >> name) {
+    uint64_t count = 0;
+    iss >> count;
+    if (name == "hits") {
+      *hits = count;
+    } else if (name == "misses") {
+      *misses = count;
+    }
+  }
+  return true;
+}
+
 std::string KVClient::GetLastError() const { return last_error_; }
 
 bool KVClient::EnsureConnect() {
@@ -191,6 +254,26 @@ bool KVClient::MultiDelete(const std::vector<std::string> &keys) {
   return success;
 }
 
+std::vector<std::pair<std::string, std::string>>
+KVClient::Scan(const std::string &start, const std::string &end,
+               size_t limit) {
+  // `SCAN <start> <end> <limit>`; empty bounds stay empty tokens
+  auto[success, response] =
+      ExecuteMultiCmd("SCAN", {start, end, std::to_string(limit)});
+  std::vector<std::pair<std::string, std::string>> result;
+
+  // an empty range leaves only the message
+  if (success && response != "success") {
+    std::istringstream iss(response);
+    std::string key, value;
+    while (iss >> key >> value) {
+      result.emplace_back(key, value);
+    }
+  }
+
+  return result;
+}
+
 std::pair<bool, std::string> KVClient::ExecuteMultiCmd(
     const std::string &command, const std::vector<std::string> &keys,
     const std::unordered_map<std::string, std::string> &values) {
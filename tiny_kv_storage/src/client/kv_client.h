@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <utility>
 #include <vector>
@@ -21,12 +22,30 @@ public:
 
   bool Connect();
   std::pair<bool, std::string> Get(const std::string &key);
-  bool Put(const std::string &key, const std::string &value);
+  // A nonzero `ttl_seconds` makes the key expire that long after the put.
+  // `durability` is "memory", "async" or "sync"; empty leaves it to the
+  // server's fsync policy.
+  bool Put(const std::string &key, const std::string &value,
+           uint64_t ttl_seconds = 0, const std::string &durability = "");
   bool Delete(const std::string &key);
+  // Atomic updates run by the server; on failure `GetLastError()` says why
+  // (e.g. "value mismatch").
+  bool CompareAndSet(const std::string &key, const std::string &expected,
+                     const std::string &value);
+  bool IncrementBy(const std::string &key, int64_t delta, int64_t *value);
+  bool Append(const std::string &key, const std::string &suffix,
+              uint64_t *length);
+  // Hit and miss counters of the server's read cache; fails if the server
+  // runs without one.
+  bool CacheStats(uint64_t *hits, uint64_t *misses);
 
   std::unordered_map<std::string, std::string> MultiGet(const std::vector<std::string> &keys);
   bool MultiPut(const std::unordered_map<std::string, std::string> &kv_pairs);
   bool MultiDelete(const std::vector<std::string> &keys);
+  // Pairs with keys in [start, end) in key order, at most `limit` of them
+  // (0 = no limit). An empty `end` is unbounded.
+  std::vector<std::pair<std::string, std::string>>
+  Scan(const std::string &start, const std::string &end, size_t limit = 0);
 
   std::string GetLastError() const;
 
@@ -26,6 +26,10 @@ Supported Client Commands:
   mget <key1> <key2> ...      Get multiple keys
   mput <key1> <value1> <key2> <value2> ...  Set multiple key-value pairs
   mdel <key1> <key2> ...      Delete multiple keys
+  scan <start> <end> [limit]  List keys in [start, end), "-" is an open bound
+  cas <key> <expected> <new>  Set a key only if it holds <expected>
+  incrby <key> <delta>        Add <delta> to an integer value
+  append <key> <suffix>       Append <suffix> to a value
   exit                        Exit the client
 )";
 
@@ -83,6 +87,10 @@ private:
     command_handlers_["mget"] = &CommandProcessor::HandleMultiGetCommand;
     command_handlers_["mput"] = &CommandProcessor::HandleMultiPutCommand;
     command_handlers_["mdel"] = &CommandProcessor::HandleMultiDelCommand;
+    command_handlers_["scan"] = &CommandProcessor::HandleScanCommand;
+    command_handlers_["cas"] = &CommandProcessor::HandleCasCommand;
+    command_handlers_["incrby"] = &CommandProcessor::HandleIncrByCommand;
+    command_handlers_["append"] = &CommandProcessor::HandleAppendCommand;
   }
 
   void HandleGetCommand(std::istringstream &iss) {
@@ -107,8 +115,14 @@ private:
       PrintUsage("put");
       return;
     }
+    std::string option;
+    uint64_t ttl_seconds = 0;
+    if (iss >> option && (option != "EX" || !(iss >> ttl_seconds))) {
+      PrintUsage("put");
+      return;
+    }
 
-    if (!client_->Put(key, value)) {
+    if (!client_->Put(key, value, ttl_seconds)) {
       printf("(error) %s\n", client_->GetLastError().c_str());
     } else {
       printf("OK\n");
@@ -192,14 +206,83 @@ private:
     }
   }
 
+  void HandleScanCommand(std::istringstream &iss) {
+    std::string start, end;
+    size_t limit = 0;
+    if (!(iss >> start >> end)) {
+      PrintUsage("scan");
+      return;
+    }
+    iss >> limit;
+
+    auto result = client_->Scan(start == "-" ? "" : start,
+                                end == "-" ? "" : end, limit);
+    if (result.empty()) {
+      printf("(empty result or error)\n");
+    } else {
+      for (const auto &[key, value] : result) {
+        printf("%s: %s\n", key.c_str(), value.c_str());
+      }
+    }
+  }
+
+  void HandleCasCommand(std::istringstream &iss) {
+    std::string key, expected, value;
+    if (!(iss >> key >> expected >> value)) {
+      PrintUsage("cas");
+      return;
+    }
+
+    if (!client_->CompareAndSet(key, expected, value)) {
+      printf("(error) %s\n", client_->GetLastError().c_str());
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  void HandleIncrByCommand(std::istringstream &iss) {
+    std::string key;
+    int64_t delta = 0;
+    if (!(iss >> key >> delta)) {
+      PrintUsage("incrby");
+      return;
+    }
+
+    int64_t value = 0;
+    if (!client_->IncrementBy(key, delta, &value)) {
+      printf("(error) %s\n", client_->GetLastError().c_str());
+    } else {
+      printf("(integer) %lld\n", static_cast<long long>(value));
+    }
+  }
+
+  void HandleAppendCommand(std::istringstream &iss) {
+    std::string key, suffix;
+    if (!(iss >> key >> suffix)) {
+      PrintUsage("append");
+      return;
+    }
+
+    uint64_t length = 0;
+    if (!client_->Append(key, suffix, &length)) {
+      printf("(error) %s\n", client_->GetLastError().c_str());
+    } else {
+      printf("(integer) %llu\n", static_cast<unsigned long long>(length));
+    }
+  }
+
   void PrintUsage(const std::string &cmd) {
     static const std::unordered_map<std::string, std::string> usage_map = {
         {"get", "Usage: get <key>"},
-        {"put", "Usage: put <key> <value>"},
+        {"put", "Usage: put <key> <value> [EX <seconds>]"},
         {"del", "Usage: del <key>"},
         {"mget", "Usage: mget <key1> <key2> ..."},
         {"mput", "Usage: mput <key1> <value1> <key2> <value2> ..."},
-        {"mdel", "Usage: mdel <key1> <key2> ..."}};
+        {"mdel", "Usage: mdel <key1> <key2> ..."},
+        {"scan", "Usage: scan <start|-> <end|-> [limit]"},
+        {"cas", "Usage: cas <key> <expected> <new value>"},
+        {"incrby", "Usage: incrby <key> <delta>"},
+        {"append", "Usage: append <key> <suffix>"}};
 
     auto it = usage_map.find(cmd);
     if (it != usage_map.end()) {
@@ -0,0 +1,543 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "async_io.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <linux/io_uring.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace tiny_kv {
+
+namespace {
+
+// Writes all of `op` and syncs it, blocking.
+int RunBlocking(AsyncIo::WriteOp op) {
+  while (op.size > 0) {
+    ssize_t n = pwrite(op.fd, op.data, op.size, op.offset);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    op.data += n;
+    op.size -= n;
+    op.offset += n;
+  }
+  if (op.sync && fdatasync(op.fd) != 0) {
+    return errno;
+  }
+  return 0;
+}
+
+/************************************************************************/
+/* ThreadPoolIo */
+/************************************************************************/
+class ThreadPoolIo : public AsyncIo {
+public:
+  explicit ThreadPoolIo(size_t threads) {
+    for (size_t i = 0; i < threads; ++i) {
+      workers_.emplace_back(&ThreadPoolIo::WorkLoop, this);
+    }
+  }
+
+  // Runs what was submitted before returning.
+  ~ThreadPoolIo() override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto &worker : workers_) {
+      worker.join();
+    }
+  }
+
+  const char *Name() const override { return "threads"; }
+
+  void Submit(const WriteOp &op, Callback done) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.emplace_back(op, std::move(done));
+    }
+    cv_.notify_one();
+  }
+
+private:
+  void WorkLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      cv_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      auto [ op, done ] = std::move(queue_.front());
+      queue_.pop_front();
+
+      lock.unlock();
+      done(RunBlocking(op));
+      lock.lock();
+    }
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::pair<WriteOp, Callback>> queue_;
+  bool stop_ = false;
+  std::vector<std::thread> workers_;
+};
+
+/************************************************************************/
+/* UringIo */
+/************************************************************************/
+// io_uring through the raw system calls. Each WriteOp is a task that moves
+// through a write (resubmitted after a short write) and an optional
+// fdatasync; one thread reaps completions and advances the tasks.
+class UringIo : public AsyncIo {
+public:
+  // nullptr if the kernel does not allow io_uring.
+  static std::shared_ptr<UringIo> Create(unsigned queue_depth);
+  ~UringIo() override;
+
+  const char *Name() const override { return "io_uring"; }
+  void Submit(const WriteOp &op, Callback done) override;
+  int RegisterBuffer(const char *data, size_t size) override;
+  void UnregisterBuffer(int buffer) override;
+
+private:
+  struct Task {
+    WriteOp op;
+    Callback done;
+    bool syncing = false; // written, the fdatasync is under way
+  };
+
+  // registered buffer slots; a sparse table filled on demand
+  static constexpr unsigned kMaxBuffers = 64;
+
+  UringIo() = default;
+  bool Init(unsigned queue_depth);
+  // Hands the next step of `task` to the kernel. `task == nullptr` submits
+  // a no-op that only wakes the completion thread. Requires
+  // `submit_mutex_`. Returns 0, or the errno of a failure that left nothing
+  // queued; the caller then finishes the task without the lock.
+  int SubmitStep(Task *task);
+  void Advance(Task *task, int result);
+  // Runs the callback of `task` with `error` and frees its place.
+  void Finish(Task *task, int error);
+  void FailAll(int error);
+  void CompletionLoop();
+
+private:
+  int ring_fd_ = -1;
+  void *sq_ring_ = MAP_FAILED;
+  size_t sq_ring_size_ = 0;
+  void *cq_ring_ = MAP_FAILED;
+  size_t cq_ring_size_ = 0;
+  io_uring_sqe *sqes_ = static_cast<io_uring_sqe *>(MAP_FAILED);
+  size_t sqes_size_ = 0;
+
+  unsigned *sq_tail_ = nullptr;
+  unsigned *sq_mask_ = nullptr;
+  unsigned *sq_array_ = nullptr;
+  unsigned *cq_head_ = nullptr;
+  unsigned *cq_tail_ = nullptr;
+  unsigned *cq_mask_ = nullptr;
+  io_uring_cqe *cqes_ = nullptr;
+
+  // Guards the submission queue. Tasks in flight are capped at the queue
+  // depth so the completion queue (twice as deep) never overflows; the
+  // completion thread itself is exempt, it must never wait on itself.
+  std::mutex submit_mutex_;
+  std::condition_variable space_cv_;
+  size_t in_flight_ = 0;
+  size_t max_in_flight_ = 0;
+  // every task in flight, so they can be failed if the ring stops working
+  std::unordered_set<Task *> tasks_;
+  bool broken_ = false; // the completion thread has given up
+
+  std::mutex buffers_mutex_;
+  std::vector<bool> buffer_used_; // empty without registered buffers
+
+  std::atomic<bool> stop_{false};
+  std::thread completion_thread_;
+};
+
+int IoUringSetup(unsigned entries, io_uring_params *params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int IoUringEnter(int fd, unsigned to_submit, unsigned min_complete,
+                 unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+                                  min_complete, flags, nullptr, 0));
+}
+
+int IoUringRegister(int fd, unsigned opcode, const void *arg, unsigned size) {
+  return static_cast<int>(
+      syscall(__NR_io_uring_register, fd, opcode, arg, size));
+}
+
+std::shared_ptr<UringIo> UringIo::Create(unsigned queue_depth) {
+  std::shared_ptr<UringIo> io(new UringIo());
+  if (!io->Init(std::max(queue_depth, 1u))) {
+    return nullptr;
+  }
+  io->completion_thread_ = std::thread(&UringIo::CompletionLoop, io.get());
+  return io;
+}
+
+bool UringIo::Init(unsigned queue_depth) {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd_ = IoUringSetup(queue_depth, &params);
+  // Without NODROP a burst of completions could be lost; RW_CUR_POS came
+  // with IORING_OP_WRITE (5.6).
+  if (ring_fd_ < 0 || !(params.features & IORING_FEAT_NODROP) ||
+      !(params.features & IORING_FEAT_RW_CUR_POS)) {
+    return false;
+  }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    return false;
+  }
+  if (!single_mmap) {
+    cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      return false;
+    }
+  }
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  sqes_ = static_cast<io_uring_sqe *>(
+      mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+  if (sqes_ == MAP_FAILED) {
+    return false;
+  }
+
+  char *sq = static_cast<char *>(sq_ring_);
+  char *cq = static_cast<char *>(single_mmap ? sq_ring_ : cq_ring_);
+  sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  sq_mask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  cq_mask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+  max_in_flight_ = params.sq_entries;
+
+  // registered buffers are optional (kernels before 5.19 lack sparse tables)
+  io_uring_rsrc_register reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.nr = kMaxBuffers;
+  reg.flags = IORING_RSRC_REGISTER_SPARSE;
+  if (IoUringRegister(ring_fd_, IORING_REGISTER_BUFFERS2, &reg,
+                      sizeof(reg)) == 0) {
+    buffer_used_.assign(kMaxBuffers, false);
+  }
+  return true;
+}
+
+// Waits for what was submitted before returning.
+UringIo::~UringIo() {
+  if (completion_thread_.joinable()) {
+    stop_ = true;
+    {
+      std::lock_guard<std::mutex> lock(submit_mutex_);
+      SubmitStep(nullptr);
+    }
+    completion_thread_.join();
+  }
+
+  if (sqes_ != MAP_FAILED) {
+    munmap(sqes_, sqes_size_);
+  }
+  if (cq_ring_ != MAP_FAILED) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  if (sq_ring_ != MAP_FAILED) {
+    munmap(sq_ring_, sq_ring_size_);
+  }
+  if (ring_fd_ >= 0) {
+    close(ring_fd_);
+  }
+}
+
+void UringIo::Submit(const WriteOp &op, Callback done) {
+  auto *task = new Task{op, std::move(done)};
+  task->syncing = op.size == 0 && op.sync;
+
+  std::unique_lock<std::mutex> lock(submit_mutex_);
+  if (std::this_thread::get_id() != completion_thread_.get_id()) {
+    space_cv_.wait(lock, [this]() {
+      return broken_ || in_flight_ < max_in_flight_;
+    });
+  }
+  if (broken_) {
+    lock.unlock();
+    task->done(EIO);
+    delete task;
+    return;
+  }
+  ++in_flight_;
+  tasks_.insert(task);
+  int error = SubmitStep(task);
+  if (error != 0) {
+    lock.unlock();
+    Finish(task, error);
+  }
+}
+
+int UringIo::SubmitStep(Task *task) {
+  const unsigned tail = *sq_tail_;
+  const unsigned index = tail & *sq_mask_;
+  io_uring_sqe *sqe = &sqes_[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->user_data = reinterpret_cast<uint64_t>(task);
+
+  if (!task) {
+    sqe->opcode = IORING_OP_NOP;
+  } else if (task->syncing) {
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fd = task->op.fd;
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+  } else {
+    const WriteOp &op = task->op;
+    sqe->opcode = op.buffer >= 0 ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = op.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(op.data);
+    sqe->len = static_cast<uint32_t>(std::min<size_t>(op.size, 1u << 30));
+    sqe->off = op.offset;
+    if (op.buffer >= 0) {
+      sqe->buf_index = static_cast<uint16_t>(op.buffer);
+    }
+  }
+  sq_array_[index] = index;
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+
+  // Nothing else may be waiting to submit it, so an entry the kernel
+  // refused is taken back rather than left for a later enter.
+  while (IoUringEnter(ring_fd_, 1, 0, 0) < 0) {
+    if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      int error = errno;
+      std::cerr << "io_uring_enter failed: " << strerror(error) << std::endl;
+      __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+      return error;
+    }
+    std::this_thread::yield();
+  }
+  return 0;
+}
+
+void UringIo::Advance(Task *task, int result) {
+  int error = result < 0 ? -result : 0;
+  bool resubmit = result == -EINTR || result == -EAGAIN;
+  if (!resubmit && error == 0 && !task->syncing) {
+    WriteOp &op = task->op;
+    if (result == 0 && op.size > 0) {
+      error = EIO;
+    } else {
+      op.data += result;
+      op.size -= result;
+      op.offset += result;
+      if (op.size > 0 || op.sync) {
+        task->syncing = op.size == 0;
+        resubmit = true;
+      }
+    }
+  }
+
+  if (resubmit) {
+    {
+      std::lock_guard<std::mutex> lock(submit_mutex_);
+      error = SubmitStep(task);
+    }
+    if (error == 0) {
+      return;
+    }
+  }
+  Finish(task, error);
+}
+
+void UringIo::Finish(Task *task, int error) {
+  task->done(error);
+  {
+    std::lock_guard<std::mutex> lock(submit_mutex_);
+    tasks_.erase(task);
+    --in_flight_;
+  }
+  // only now, or a new task at the same address could be erased instead
+  delete task;
+  space_cv_.notify_one();
+}
+
+// The ring no longer delivers completions: every task in flight is failed
+// rather than left waiting, and later submissions fail at once.
+void UringIo::FailAll(int error) {
+  std::vector<Task *> tasks;
+  {
+    std::lock_guard<std::mutex> lock(submit_mutex_);
+    broken_ = true;
+    tasks.assign(tasks_.begin(), tasks_.end());
+  }
+  space_cv_.notify_all();
+  for (Task *task : tasks) {
+    Finish(task, error);
+  }
+}
+
+void UringIo::CompletionLoop() {
+  std::vector<std::pair<Task *, int>> completed;
+  while (true) {
+    unsigned head = *cq_head_;
+    const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+      if (stop_) {
+        std::lock_guard<std::mutex> lock(submit_mutex_);
+        if (in_flight_ == 0) {
+          return;
+        }
+      }
+      if (IoUringEnter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS) < 0 &&
+          errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        std::cerr << "io_uring_enter failed: " << strerror(errno)
+                  << std::endl;
+        FailAll(EIO);
+        return;
+      }
+      continue;
+    }
+
+    // free the completion queue before running callbacks that may submit
+    for (; head != tail; ++head) {
+      const io_uring_cqe &cqe = cqes_[head & *cq_mask_];
+      completed.emplace_back(reinterpret_cast<Task *>(cqe.user_data),
+                             cqe.res);
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    // The kernel already orders each submission before its completion.
+    // Every entry was submitted under `submit_mutex_`, so taking it once per
+    // batch spells that order out to tools that cannot see through the ring.
+    { std::lock_guard<std::mutex> lock(submit_mutex_); }
+    for (const auto & [ task, result ] : completed) {
+      if (task) {
+        Advance(task, result);
+      }
+    }
+    completed.clear();
+  }
+}
+
+int UringIo::RegisterBuffer(const char *data, size_t size) {
+  std::lock_guard<std::mutex> lock(buffers_mutex_);
+  auto slot = std::find(buffer_used_.begin(), buffer_used_.end(), false);
+  if (slot == buffer_used_.end()) {
+    return -1;
+  }
+
+  iovec iov{const_cast<char *>(data), size};
+  io_uring_rsrc_update2 update;
+  memset(&update, 0, sizeof(update));
+  update.offset = static_cast<uint32_t>(slot - buffer_used_.begin());
+  update.data = reinterpret_cast<uint64_t>(&iov);
+  update.nr = 1;
+  // fails past RLIMIT_MEMLOCK, among others
+  if (IoUringRegister(ring_fd_, IORING_REGISTER_BUFFERS_UPDATE, &update,
+                      sizeof(update)) != 1) {
+    return -1;
+  }
+  *slot = true;
+  return static_cast<int>(update.offset);
+}
+
+void UringIo::UnregisterBuffer(int buffer) {
+  std::lock_guard<std::mutex> lock(buffers_mutex_);
+  if (buffer < 0 || static_cast<size_t>(buffer) >= buffer_used_.size()) {
+    return;
+  }
+
+  // writes still in flight keep their reference to the old buffer
+  iovec iov{nullptr, 0};
+  io_uring_rsrc_update2 update;
+  memset(&update, 0, sizeof(update));
+  update.offset = static_cast<uint32_t>(buffer);
+  update.data = reinterpret_cast<uint64_t>(&iov);
+  update.nr = 1;
+  IoUringRegister(ring_fd_, IORING_REGISTER_BUFFERS_UPDATE, &update,
+                  sizeof(update));
+  buffer_used_[buffer] = false;
+}
+
+} // namespace
+
+bool ParseAsyncIoBackend(const std::string &name, AsyncIoBackend *backend) {
+  if (name == "auto") {
+    *backend = AsyncIoBackend::kAuto;
+  } else if (name == "threads") {
+    *backend = AsyncIoBackend::kThreads;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/************************************************************************/
+/* AsyncIo */
+/************************************************************************/
+int AsyncIo::RegisterBuffer(const char *, size_t) { return -1; }
+
+void AsyncIo::UnregisterBuffer(int) {}
+
+int AsyncIo::SubmitAndWait(const WriteOp &op) {
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool done = false;
+  int error = 0;
+  Submit(op, [&](int result) {
+    // notified under the lock: the waiter owns `cv`
+    std::lock_guard<std::mutex> lock(mutex);
+    error = result;
+    done = true;
+    cv.notify_one();
+  });
+
+  std::unique_lock<std::mutex> lock(mutex);
+  cv.wait(lock, [&done]() { return done; });
+  return error;
+}
+
+std::shared_ptr<AsyncIo> CreateAsyncIo(const AsyncIoOptions &options) {
+  if (options.backend == AsyncIoBackend::kAuto) {
+    if (auto io = UringIo::Create(options.queue_depth)) {
+      return io;
+    }
+  }
+  return std::make_shared<ThreadPoolIo>(std::max<size_t>(options.threads, 1));
+}
+
+} // namespace tiny_kv
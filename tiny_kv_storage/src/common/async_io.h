@@ -0,0 +1,70 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace tiny_kv {
+
+enum class AsyncIoBackend {
+  kAuto,    // io_uring where the kernel allows it, else kThreads
+  kThreads, // blocking write/fdatasync calls on a small thread pool
+};
+
+bool ParseAsyncIoBackend(const std::string &name, AsyncIoBackend *backend);
+
+struct AsyncIoOptions {
+  AsyncIoBackend backend = AsyncIoBackend::kAuto;
+  unsigned queue_depth = 64; // io_uring submission queue entries
+  size_t threads = 2;        // thread pool workers
+};
+
+/************************************************************************/
+/* AsyncIo */
+/************************************************************************/
+// Asynchronous writes and syncs for the durability paths. Callers submit
+// and carry on; the kernel work runs on io_uring or on a thread pool, never
+// on the submitting thread, and completions are reported on the backend's
+// own thread. Thread-safe.
+class AsyncIo {
+public:
+  struct WriteOp {
+    int fd = -1;
+    const char *data = nullptr;
+    size_t size = 0; // may be 0 to only sync
+    uint64_t offset = 0;
+    bool sync = false; // fdatasync once the data is written
+    int buffer = -1;   // registered buffer holding `data`, or -1
+  };
+  // 0, or the errno of the step that failed.
+  using Callback = std::function<void(int error)>;
+
+  virtual ~AsyncIo() = default;
+
+  virtual const char *Name() const = 0;
+
+  // Writes all of `op.data` and then syncs if asked. The data must stay
+  // valid until `done` runs. `done` runs on an I/O thread; it may submit
+  // more work but must not wait for it.
+  virtual void Submit(const WriteOp &op, Callback done) = 0;
+
+  // Registers `[data, data + size)` so writes from it skip the per-request
+  // page pinning of io_uring. Returns the buffer index, or -1 if the
+  // backend has no registered buffers (writes then work all the same).
+  // The memory must stay mapped until `UnregisterBuffer()`.
+  virtual int RegisterBuffer(const char *data, size_t size);
+  virtual void UnregisterBuffer(int buffer);
+
+  // Submits and waits; for threads that are allowed to block.
+  int SubmitAndWait(const WriteOp &op);
+};
+
+std::shared_ptr<AsyncIo> CreateAsyncIo(const AsyncIoOptions &options = {});
+
+} // namespace tiny_kv
@@ -0,0 +1,156 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "async_io.h"
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace tiny_kv {
+
+namespace {
+
+std::string ReadFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  std::stringstream buffer;
+  buffer << in.rdbuf();
+  return buffer.str();
+}
+
+// Runs every test against both backends; `kAuto` is io_uring unless the
+// kernel refuses it.
+class AsyncIoTest : public ::testing::TestWithParam<AsyncIoBackend> {
+protected:
+  void SetUp() override {
+    AsyncIoOptions options;
+    options.backend = GetParam();
+    options.queue_depth = 8; // small enough for the writes below to queue up
+    io_ = CreateAsyncIo(options);
+    path_ = std::string("async_io_test_") + io_->Name() + ".dat";
+    std::filesystem::remove(path_);
+    fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    ASSERT_GE(fd_, 0);
+  }
+
+  void TearDown() override {
+    io_.reset();
+    close(fd_);
+    std::filesystem::remove(path_);
+  }
+
+  std::shared_ptr<AsyncIo> io_;
+  std::string path_;
+  int fd_ = -1;
+};
+
+} // namespace
+
+TEST_P(AsyncIoTest, ConcurrentWritesAtOffsets) {
+  const size_t kBlocks = 64, kBlockSize = 4096;
+  std::vector<std::string> blocks;
+  for (size_t i = 0; i < kBlocks; ++i) {
+    blocks.emplace_back(kBlockSize, static_cast<char>('a' + i % 26));
+  }
+
+  std::mutex mutex;
+  std::condition_variable done_cv;
+  size_t done = 0;
+  std::atomic<int> errors{0};
+  for (size_t i = 0; i < kBlocks; ++i) {
+    AsyncIo::WriteOp op;
+    op.fd = fd_;
+    op.data = blocks[i].data();
+    op.size = blocks[i].size();
+    op.offset = i * kBlockSize;
+    op.sync = i % 8 == 0;
+    io_->Submit(op, [&](int error) {
+      if (error != 0) {
+        errors++;
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      done++;
+      done_cv.notify_all();
+    });
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock, [&] { return done == kBlocks; });
+  }
+
+  EXPECT_EQ(errors.load(), 0);
+  std::string expected;
+  for (const auto &block : blocks) {
+    expected += block;
+  }
+  EXPECT_EQ(ReadFile(path_), expected);
+}
+
+TEST_P(AsyncIoTest, RegisteredBuffer) {
+  std::string data(100000, 'x');
+  int buffer = io_->RegisterBuffer(data.data(), data.size());
+
+  AsyncIo::WriteOp op;
+  op.fd = fd_;
+  op.data = data.data() + 10; // any range of a registered buffer will do
+  op.size = data.size() - 10;
+  op.sync = true;
+  op.buffer = buffer;
+  EXPECT_EQ(io_->SubmitAndWait(op), 0);
+  io_->UnregisterBuffer(buffer);
+
+  EXPECT_EQ(ReadFile(path_), data.substr(10));
+}
+
+TEST_P(AsyncIoTest, SyncOnly) {
+  ASSERT_EQ(write(fd_, "abc", 3), 3);
+
+  AsyncIo::WriteOp op;
+  op.fd = fd_;
+  op.sync = true;
+  EXPECT_EQ(io_->SubmitAndWait(op), 0);
+  EXPECT_EQ(ReadFile(path_), "abc");
+}
+
+TEST_P(AsyncIoTest, ReportsErrors) {
+  AsyncIo::WriteOp op;
+  op.fd = fd_;
+  op.data = "abc";
+  op.size = 3;
+  op.sync = true;
+
+  int read_only = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  ASSERT_GE(read_only, 0);
+  op.fd = read_only;
+  EXPECT_EQ(io_->SubmitAndWait(op), EBADF);
+  close(read_only);
+
+  op.fd = fd_;
+  EXPECT_EQ(io_->SubmitAndWait(op), 0);
+  EXPECT_EQ(ReadFile(path_), "abc");
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, AsyncIoTest,
+                         ::testing::Values(AsyncIoBackend::kAuto,
+                                           AsyncIoBackend::kThreads));
+
+TEST(AsyncIoBackendTest, Parse) {
+  AsyncIoBackend backend = AsyncIoBackend::kAuto;
+  EXPECT_TRUE(ParseAsyncIoBackend("threads", &backend));
+  EXPECT_EQ(backend, AsyncIoBackend::kThreads);
+  EXPECT_TRUE(ParseAsyncIoBackend("auto", &backend));
+  EXPECT_EQ(backend, AsyncIoBackend::kAuto);
+  EXPECT_FALSE(ParseAsyncIoBackend("uring", &backend));
+  EXPECT_EQ(backend, AsyncIoBackend::kAuto);
+}
+
+} // namespace tiny_kv
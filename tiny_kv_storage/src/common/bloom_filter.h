@@ -0,0 +1,112 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tiny_kv {
+
+// 32-bit Murmur-style hash; stable across runs since filters live on disk.
+inline uint32_t BloomHash(std::string_view key) {
+  const uint32_t m = 0xc6a4a793;
+  const uint32_t seed = 0xbc9f1d34;
+  uint32_t h = seed ^ (static_cast<uint32_t>(key.size()) * m);
+
+  const char *data = key.data();
+  size_t size = key.size();
+  while (size >= 4) {
+    uint32_t w;
+    memcpy(&w, data, sizeof(w));
+    h += w;
+    h *= m;
+    h ^= (h >> 16);
+    data += 4;
+    size -= 4;
+  }
+
+  switch (size) {
+  case 3:
+    h += static_cast<uint8_t>(data[2]) << 16;
+    [[fallthrough]];
+  case 2:
+    h += static_cast<uint8_t>(data[1]) << 8;
+    [[fallthrough]];
+  case 1:
+    h += static_cast<uint8_t>(data[0]);
+    h *= m;
+    h ^= (h >> 24);
+    break;
+  }
+  return h;
+}
+
+/************************************************************************/
+/* BloomFilterBuilder */
+/************************************************************************/
+// Filter layout: [bit array][num_probes u8]. Probes use double hashing.
+class BloomFilterBuilder {
+public:
+  explicit BloomFilterBuilder(int bits_per_key) : bits_per_key_(bits_per_key) {}
+
+  void AddKey(std::string_view key) { hashes_.push_back(BloomHash(key)); }
+
+  std::string Finish() const {
+    // k = ln(2) * bits_per_key minimizes the false positive rate
+    int probes = static_cast<int>(bits_per_key_ * 0.69);
+    probes = probes < 1 ? 1 : (probes > 30 ? 30 : probes);
+
+    size_t bits = hashes_.size() * bits_per_key_;
+    bits = bits < 64 ? 64 : bits;
+    size_t bytes = (bits + 7) / 8;
+    bits = bytes * 8;
+
+    std::string filter(bytes, '\0');
+    for (uint32_t h : hashes_) {
+      uint32_t delta = (h >> 17) | (h << 15);
+      for (int i = 0; i < probes; ++i) {
+        uint32_t bit = h % bits;
+        filter[bit / 8] |= static_cast<char>(1 << (bit % 8));
+        h += delta;
+      }
+    }
+    filter.push_back(static_cast<char>(probes));
+    return filter;
+  }
+
+private:
+  int bits_per_key_;
+  std::vector<uint32_t> hashes_;
+};
+
+// Returns false only if `key` was definitely never added to `filter`.
+inline bool BloomFilterMayContain(std::string_view filter,
+                                  std::string_view key) {
+  if (filter.size() < 2) {
+    return true;
+  }
+
+  size_t bits = (filter.size() - 1) * 8;
+  int probes = static_cast<uint8_t>(filter.back());
+  if (probes > 30) {
+    return true;
+  }
+
+  uint32_t h = BloomHash(key);
+  uint32_t delta = (h >> 17) | (h << 15);
+  for (int i = 0; i < probes; ++i) {
+    uint32_t bit = h % bits;
+    if ((filter[bit / 8] & (1 << (bit % 8))) == 0) {
+      return false;
+    }
+    h += delta;
+  }
+  return true;
+}
+
+} // namespace tiny_kv
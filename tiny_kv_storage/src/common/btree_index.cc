@@ -0,0 +1,342 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "btree_index.h"
+#include <algorithm>
+
+namespace tiny_kv {
+
+// Both node kinds have room for one key over `kMaxKeys`: an insert lands
+// first and the node is split afterwards.
+struct BTreeIndex::Leaf : Node {
+  Leaf() : Node(true) {}
+
+  std::string keys[kMaxKeys + 1];
+  Leaf *next = nullptr;
+};
+
+struct BTreeIndex::Inner : Node {
+  Inner() : Node(false) {}
+
+  // children[i] holds the keys below keys[i], children[i + 1] the rest
+  std::string keys[kMaxKeys + 1];
+  Node *children[kMaxKeys + 2];
+};
+
+namespace {
+
+// A slot left behind by a shift may still own a heap buffer (libstdc++
+// hands buffers back on move assignment); release it.
+void ResetSlot(std::string *slot) { std::string().swap(*slot); }
+
+} // namespace
+
+/************************************************************************/
+/* BTreeIndex::Iterator */
+/************************************************************************/
+BTreeIndex::Iterator::Iterator(const Leaf *leaf, size_t index)
+    : leaf_(leaf), index_(index) {
+  // only the root leaf can be empty, every other leaf ends within a step
+  while (leaf_ != nullptr && index_ >= leaf_->count) {
+    leaf_ = leaf_->next;
+    index_ = 0;
+  }
+}
+
+std::string_view BTreeIndex::Iterator::key() const {
+  return leaf_->keys[index_];
+}
+
+void BTreeIndex::Iterator::Next() {
+  if (++index_ >= leaf_->count) {
+    leaf_ = leaf_->next;
+    index_ = 0;
+  }
+}
+
+/************************************************************************/
+/* BTreeIndex */
+/************************************************************************/
+BTreeIndex::BTreeIndex() : root_(new Leaf), leaves_(1) {}
+
+BTreeIndex::~BTreeIndex() { Destroy(root_); }
+
+void BTreeIndex::Destroy(Node *node) {
+  if (node->leaf) {
+    delete static_cast<Leaf *>(node);
+    return;
+  }
+  Inner *inner = static_cast<Inner *>(node);
+  for (size_t i = 0; i <= inner->count; ++i) {
+    Destroy(inner->children[i]);
+  }
+  delete inner;
+}
+
+size_t BTreeIndex::ChildIndex(const Inner *inner, std::string_view key) {
+  return std::upper_bound(inner->keys, inner->keys + inner->count, key) -
+         inner->keys;
+}
+
+size_t BTreeIndex::KeyBytes(const std::string &key) {
+  static const size_t kInlineCapacity = std::string().capacity();
+  return key.size() > kInlineCapacity ? key.size() + 1 : 0;
+}
+
+bool BTreeIndex::Insert(std::string_view key) {
+  std::string split_key;
+  Node *split = nullptr;
+  if (!InsertInto(root_, key, &split_key, &split)) {
+    return false;
+  }
+  ++size_;
+
+  if (split != nullptr) {
+    Inner *root = new Inner;
+    ++inners_;
+    root->keys[0] = std::move(split_key);
+    root->children[0] = root_;
+    root->children[1] = split;
+    root->count = 1;
+    root_ = root;
+  }
+  return true;
+}
+
+bool BTreeIndex::InsertInto(Node *node, std::string_view key,
+                            std::string *split_key, Node **split) {
+  if (node->leaf) {
+    Leaf *leaf = static_cast<Leaf *>(node);
+    std::string *end = leaf->keys + leaf->count;
+    std::string *pos = std::lower_bound(leaf->keys, end, key);
+    if (pos != end && *pos == key) {
+      return false;
+    }
+    std::move_backward(pos, end, end + 1);
+    pos->assign(key.data(), key.size());
+    key_bytes_ += KeyBytes(*pos);
+    ++leaf->count;
+
+    if (leaf->count > kMaxKeys) {
+      Leaf *right = new Leaf;
+      ++leaves_;
+      std::move(leaf->keys + kMinKeys, leaf->keys + leaf->count, right->keys);
+      right->count = leaf->count - kMinKeys;
+      leaf->count = kMinKeys;
+      right->next = leaf->next;
+      leaf->next = right;
+      *split_key = right->keys[0];
+      *split = right;
+    }
+    return true;
+  }
+
+  Inner *inner = static_cast<Inner *>(node);
+  const size_t i = ChildIndex(inner, key);
+  std::string child_key;
+  Node *child_split = nullptr;
+  if (!InsertInto(inner->children[i], key, &child_key, &child_split)) {
+    return false;
+  }
+  if (child_split == nullptr) {
+    return true;
+  }
+
+  std::move_backward(inner->keys + i, inner->keys + inner->count,
+                     inner->keys + inner->count + 1);
+  std::copy_backward(inner->children + i + 1,
+                     inner->children + inner->count + 1,
+                     inner->children + inner->count + 2);
+  inner->keys[i] = std::move(child_key);
+  inner->children[i + 1] = child_split;
+  ++inner->count;
+
+  if (inner->count > kMaxKeys) {
+    // the middle separator moves up, each half keeps `kMinKeys`
+    Inner *right = new Inner;
+    ++inners_;
+    std::move(inner->keys + kMinKeys + 1, inner->keys + inner->count,
+              right->keys);
+    std::copy(inner->children + kMinKeys + 1,
+              inner->children + inner->count + 1, right->children);
+    right->count = inner->count - kMinKeys - 1;
+    *split_key = std::move(inner->keys[kMinKeys]);
+    for (size_t k = kMinKeys; k < inner->count; ++k) {
+      ResetSlot(&inner->keys[k]);
+    }
+    inner->count = kMinKeys;
+    *split = right;
+  }
+  return true;
+}
+
+bool BTreeIndex::Erase(std::string_view key) {
+  if (!EraseFrom(root_, key)) {
+    return false;
+  }
+  --size_;
+
+  if (!root_->leaf && root_->count == 0) {
+    Inner *root = static_cast<Inner *>(root_);
+    root_ = root->children[0];
+    delete root;
+    --inners_;
+  }
+  return true;
+}
+
+bool BTreeIndex::EraseFrom(Node *node, std::string_view key) {
+  if (node->leaf) {
+    Leaf *leaf = static_cast<Leaf *>(node);
+    std::string *end = leaf->keys + leaf->count;
+    std::string *pos = std::lower_bound(leaf->keys, end, key);
+    if (pos == end || *pos != key) {
+      return false;
+    }
+    // separators equal to the erased key may stay: they still split the
+    // key space correctly
+    key_bytes_ -= KeyBytes(*pos);
+    std::move(pos + 1, end, pos);
+    --leaf->count;
+    ResetSlot(&leaf->keys[leaf->count]);
+    return true;
+  }
+
+  Inner *inner = static_cast<Inner *>(node);
+  const size_t i = ChildIndex(inner, key);
+  if (!EraseFrom(inner->children[i], key)) {
+    return false;
+  }
+  if (inner->children[i]->count < kMinKeys) {
+    Rebalance(inner, i);
+  }
+  return true;
+}
+
+void BTreeIndex::Rebalance(Inner *parent, size_t i) {
+  Node *node = parent->children[i];
+  Node *left = i > 0 ? parent->children[i - 1] : nullptr;
+  Node *right = i < parent->count ? parent->children[i + 1] : nullptr;
+
+  if (left != nullptr && left->count > kMinKeys) {
+    // take the largest entry of the left sibling
+    if (node->leaf) {
+      Leaf *leaf = static_cast<Leaf *>(node);
+      Leaf *from = static_cast<Leaf *>(left);
+      std::move_backward(leaf->keys, leaf->keys + leaf->count,
+                         leaf->keys + leaf->count + 1);
+      leaf->keys[0] = std::move(from->keys[from->count - 1]);
+      parent->keys[i - 1] = leaf->keys[0];
+    } else {
+      Inner *inner = static_cast<Inner *>(node);
+      Inner *from = static_cast<Inner *>(left);
+      std::move_backward(inner->keys, inner->keys + inner->count,
+                         inner->keys + inner->count + 1);
+      std::copy_backward(inner->children, inner->children + inner->count + 1,
+                         inner->children + inner->count + 2);
+      inner->keys[0] = std::move(parent->keys[i - 1]);
+      inner->children[0] = from->children[from->count];
+      parent->keys[i - 1] = std::move(from->keys[from->count - 1]);
+    }
+    ++node->count;
+    --left->count;
+    ResetSlot(left->leaf ? &static_cast<Leaf *>(left)->keys[left->count]
+                         : &static_cast<Inner *>(left)->keys[left->count]);
+    return;
+  }
+
+  if (right != nullptr && right->count > kMinKeys) {
+    // take the smallest entry of the right sibling
+    if (node->leaf) {
+      Leaf *leaf = static_cast<Leaf *>(node);
+      Leaf *from = static_cast<Leaf *>(right);
+      leaf->keys[leaf->count] = std::move(from->keys[0]);
+      std::move(from->keys + 1, from->keys + from->count, from->keys);
+      ResetSlot(&from->keys[from->count - 1]);
+      parent->keys[i] = from->keys[0];
+    } else {
+      Inner *inner = static_cast<Inner *>(node);
+      Inner *from = static_cast<Inner *>(right);
+      inner->keys[inner->count] = std::move(parent->keys[i]);
+      inner->children[inner->count + 1] = from->children[0];
+      parent->keys[i] = std::move(from->keys[0]);
+      std::move(from->keys + 1, from->keys + from->count, from->keys);
+      std::copy(from->children + 1, from->children + from->count + 1,
+                from->children);
+      ResetSlot(&from->keys[from->count - 1]);
+    }
+    ++node->count;
+    --right->count;
+    return;
+  }
+
+  // both siblings are at the minimum, so a merge fits in one node
+  MergeChildren(parent, left != nullptr ? i - 1 : i);
+}
+
+void BTreeIndex::MergeChildren(Inner *parent, size_t i) {
+  Node *left = parent->children[i];
+  Node *right = parent->children[i + 1];
+
+  if (left->leaf) {
+    Leaf *to = static_cast<Leaf *>(left);
+    Leaf *from = static_cast<Leaf *>(right);
+    std::move(from->keys, from->keys + from->count, to->keys + to->count);
+    to->count += from->count;
+    to->next = from->next;
+    delete from;
+    --leaves_;
+  } else {
+    // the separator comes down between the two halves
+    Inner *to = static_cast<Inner *>(left);
+    Inner *from = static_cast<Inner *>(right);
+    to->keys[to->count] = std::move(parent->keys[i]);
+    std::move(from->keys, from->keys + from->count, to->keys + to->count + 1);
+    std::copy(from->children, from->children + from->count + 1,
+              to->children + to->count + 1);
+    to->count += from->count + 1;
+    delete from;
+    --inners_;
+  }
+
+  std::move(parent->keys + i + 1, parent->keys + parent->count,
+            parent->keys + i);
+  std::copy(parent->children + i + 2, parent->children + parent->count + 1,
+            parent->children + i + 1);
+  --parent->count;
+  ResetSlot(&parent->keys[parent->count]);
+}
+
+bool BTreeIndex::Contains(std::string_view key) const {
+  Iterator it = LowerBound(key);
+  return it.Valid() && it.key() == key;
+}
+
+BTreeIndex::Iterator BTreeIndex::LowerBound(std::string_view key) const {
+  const Node *node = root_;
+  while (!node->leaf) {
+    const Inner *inner = static_cast<const Inner *>(node);
+    node = inner->children[ChildIndex(inner, key)];
+  }
+
+  // past the last key of this leaf, the next leaf starts above `key`
+  const Leaf *leaf = static_cast<const Leaf *>(node);
+  size_t index =
+      std::lower_bound(leaf->keys, leaf->keys + leaf->count, key) - leaf->keys;
+  return Iterator(leaf, index);
+}
+
+size_t BTreeIndex::Height() const {
+  size_t height = 1;
+  for (const Node *node = root_; !node->leaf; ++height) {
+    node = static_cast<const Inner *>(node)->children[0];
+  }
+  return height;
+}
+
+size_t BTreeIndex::MemoryUsage() const {
+  return leaves_ * sizeof(Leaf) + inners_ * sizeof(Inner) + key_bytes_;
+}
+
+} // namespace tiny_kv
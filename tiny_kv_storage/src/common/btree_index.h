@@ -0,0 +1,97 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace tiny_kv {
+
+/************************************************************************/
+/* BTreeIndex */
+/************************************************************************/
+// Ordered set of keys kept next to a hash table to answer range queries.
+// A B+tree: every key sits in a leaf, inner nodes only hold separators,
+// and the leaves are chained in key order, so a range read is one descent
+// plus a walk along the chain. Nodes are wide (32 keys) to keep the tree
+// shallow and each node a few cache lines of key headers.
+//
+// Not thread-safe; an iterator is invalidated by any write.
+class BTreeIndex {
+public:
+  static constexpr size_t kMaxKeys = 32;
+  static constexpr size_t kMinKeys = kMaxKeys / 2; // except at the root
+
+private:
+  struct Node {
+    explicit Node(bool is_leaf) : leaf(is_leaf) {}
+    bool leaf;
+    uint32_t count = 0;
+  };
+  struct Leaf;
+  struct Inner;
+
+public:
+  class Iterator {
+  public:
+    bool Valid() const { return leaf_ != nullptr; }
+    std::string_view key() const;
+    void Next();
+
+  private:
+    friend class BTreeIndex;
+    Iterator(const Leaf *leaf, size_t index);
+
+    const Leaf *leaf_;
+    size_t index_;
+  };
+
+  BTreeIndex();
+  ~BTreeIndex();
+  BTreeIndex(const BTreeIndex &) = delete;
+  BTreeIndex &operator=(const BTreeIndex &) = delete;
+
+  // Returns false if `key` was already present.
+  bool Insert(std::string_view key);
+  // Returns false if `key` was missing.
+  bool Erase(std::string_view key);
+  bool Contains(std::string_view key) const;
+
+  Iterator Begin() const { return LowerBound({}); }
+  // First key not less than `key`.
+  Iterator LowerBound(std::string_view key) const;
+
+  size_t Size() const { return size_; }
+  size_t Height() const;
+  // Bytes held by the nodes and by keys too long for the string's inline
+  // buffer; separators are counted only through their node.
+  size_t MemoryUsage() const;
+
+private:
+  // Returns true if `key` was added. A node that overflows is split and
+  // its upper half returned through `split` with the separator in
+  // `split_key`.
+  bool InsertInto(Node *node, std::string_view key, std::string *split_key,
+                  Node **split);
+  bool EraseFrom(Node *node, std::string_view key);
+  // Refills `parent->children[i]` below `kMinKeys` from a sibling, or merges
+  // it with one.
+  void Rebalance(Inner *parent, size_t i);
+  void MergeChildren(Inner *parent, size_t i); // children i and i + 1
+  static size_t ChildIndex(const Inner *inner, std::string_view key);
+  static size_t KeyBytes(const std::string &key);
+  void Destroy(Node *node);
+
+private:
+  Node *root_;
+  size_t size_ = 0;
+  size_t leaves_ = 0;
+  size_t inners_ = 0;
+  size_t key_bytes_ = 0; // heap bytes of leaf keys
+};
+
+} // namespace tiny_kv
@@ -0,0 +1,121 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "btree_index.h"
+#include <algorithm>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace tiny_kv {
+
+namespace {
+
+void ExpectSameKeys(const BTreeIndex &index,
+                    const std::set<std::string> &reference) {
+  ASSERT_EQ(index.Size(), reference.size());
+  auto expected = reference.begin();
+  for (auto it = index.Begin(); it.Valid(); it.Next(), ++expected) {
+    ASSERT_NE(expected, reference.end());
+    ASSERT_EQ(it.key(), *expected);
+  }
+  EXPECT_EQ(expected, reference.end());
+}
+
+} // namespace
+
+TEST(BTreeIndexTest, InsertEraseContains) {
+  BTreeIndex index;
+  EXPECT_FALSE(index.Begin().Valid());
+  EXPECT_FALSE(index.LowerBound("a").Valid());
+
+  EXPECT_TRUE(index.Insert("b"));
+  EXPECT_TRUE(index.Insert(""));
+  EXPECT_TRUE(index.Insert(std::string(40, 'z')));
+  EXPECT_FALSE(index.Insert("b"));
+  EXPECT_EQ(index.Size(), 3u);
+  EXPECT_TRUE(index.Contains(""));
+  EXPECT_TRUE(index.Contains("b"));
+  EXPECT_FALSE(index.Contains("a"));
+
+  EXPECT_TRUE(index.Erase("b"));
+  EXPECT_FALSE(index.Erase("b"));
+  EXPECT_FALSE(index.Contains("b"));
+  EXPECT_EQ(index.Size(), 2u);
+}
+
+TEST(BTreeIndexTest, LowerBound) {
+  BTreeIndex index;
+  for (int i = 0; i < 1000; i += 2) {
+    char key[16];
+    snprintf(key, sizeof(key), "key%04d", i);
+    index.Insert(key);
+  }
+  EXPECT_GT(index.Height(), 1u);
+
+  auto it = index.LowerBound("key0100");
+  ASSERT_TRUE(it.Valid());
+  EXPECT_EQ(it.key(), "key0100");
+  it = index.LowerBound("key0101");
+  ASSERT_TRUE(it.Valid());
+  EXPECT_EQ(it.key(), "key0102");
+  it.Next();
+  ASSERT_TRUE(it.Valid());
+  EXPECT_EQ(it.key(), "key0104");
+  EXPECT_EQ(index.LowerBound("a").key(), "key0000");
+  EXPECT_FALSE(index.LowerBound("key0999").Valid());
+}
+
+TEST(BTreeIndexTest, MatchesReferenceSet) {
+  BTreeIndex index;
+  std::set<std::string> reference;
+  std::mt19937 rng(7);
+
+  // grow, shrink to nothing and grow again, so splits, borrows, merges and
+  // root collapses all happen
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 20000; ++i) {
+      std::string key = "k" + std::to_string(rng() % 30000);
+      if (rng() % 4 == 0) {
+        key += std::string(20, 'x');
+      }
+      EXPECT_EQ(index.Insert(key), reference.insert(key).second);
+    }
+    ExpectSameKeys(index, reference);
+
+    std::string probe = "k" + std::to_string(rng() % 30000);
+    auto expected = reference.lower_bound(probe);
+    auto it = index.LowerBound(probe);
+    ASSERT_EQ(it.Valid(), expected != reference.end());
+    if (it.Valid()) {
+      EXPECT_EQ(it.key(), *expected);
+    }
+
+    std::vector<std::string> keys(reference.begin(), reference.end());
+    std::shuffle(keys.begin(), keys.end(), rng);
+    size_t keep = round == 1 ? 0 : keys.size() / 3;
+    for (size_t i = keep; i < keys.size(); ++i) {
+      EXPECT_TRUE(index.Erase(keys[i]));
+      reference.erase(keys[i]);
+    }
+    ExpectSameKeys(index, reference);
+  }
+
+  // after erasing everything the tree is one empty leaf again
+  std::vector<std::string> rest(reference.begin(), reference.end());
+  for (const auto &key : rest) {
+    EXPECT_TRUE(index.Erase(key));
+  }
+  EXPECT_EQ(index.Size(), 0u);
+  EXPECT_EQ(index.Height(), 1u);
+  EXPECT_FALSE(index.Begin().Valid());
+
+  BTreeIndex empty;
+  EXPECT_EQ(index.MemoryUsage(), empty.MemoryUsage());
+}
+
+} // namespace tiny_kv
@@ -4,19 +4,77 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
 #include <list>
+#include <memory>
 #include <mutex>
 #include <optional>
+#include <shared_mutex>
+#include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace tiny_kv {
 
+/************************************************************************/
+/* MixHash */
+/************************************************************************/
+// `Hash` of `key` through the splitmix64 finalizer, so that every bit of
+// the result depends on every bit of the hash: std::hash is the identity
+// for integers, and indices taken from its low bits would follow the keys.
+template <typename Hash, typename K> uint64_t MixHash(const K &key) {
+  uint64_t hash = static_cast<uint64_t>(Hash{}(key));
+  hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+  hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+  return hash ^ (hash >> 31);
+}
+
+/************************************************************************/
+/* Weighers */
+/************************************************************************/
+// A weigher gives each entry its share of the cache capacity.
+
+// Every entry weighs one, so the capacity is an entry count.
+struct UnitWeigher {
+  template <typename K, typename V>
+  size_t operator()(const K &, const V &) const {
+    return 1;
+  }
+};
+
+// Approximate bytes held per entry of `LRUCache`, so the capacity is a
+// memory budget: the key, which the map and the recency list each hold a
+// copy of, the value, and the node links and cached hash around them.
+// Strings count their characters on top of the object itself; other types
+// count only `sizeof`, so values that own heap memory need a weigher of
+// their own.
+struct ByteWeigher {
+  static constexpr size_t kNodeOverhead = 4 * sizeof(void *) + sizeof(size_t);
+
+  template <typename K, typename V>
+  size_t operator()(const K &key, const V &value) const {
+    return 2 * ByteSize(key) + ByteSize(value) + kNodeOverhead;
+  }
+
+  template <typename T> static size_t ByteSize(const T &) { return sizeof(T); }
+  static size_t ByteSize(const std::string &s) {
+    return sizeof(std::string) + s.size();
+  }
+};
+
 /************************************************************************/
 /* LRUCache */
 /************************************************************************/
-template <typename K, typename V> class LRUCache {
+// `Weigher` sets what the capacity counts: entries by default, or bytes
+// with `ByteWeigher`. Least recently used entries are evicted until a new
+// one fits, and an entry heavier than the whole capacity is not cached.
+template <typename K, typename V, typename Weigher = UnitWeigher>
+class LRUCache {
 public:
   explicit LRUCache(size_t capacity) : capacity_(capacity) {}
   ~LRUCache() { Clear(); }
@@ -32,33 +90,41 @@ public:
     return it->second.value;
   }
 
-  void Put(const K &key, const V &value) {
+  // Returns false, and drops any older value of `key`, if the entry
+  // weighs more than the capacity.
+  bool Put(const K &key, const V &value) {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    if (capacity_ == 0) {
-      return;
+    size_t weight = Weigher{}(key, value);
+    auto it = cache_map_.find(key);
+    if (weight > capacity_) {
+      if (it != cache_map_.end()) {
+        EraseLocked(it);
+      }
+      return false;
     }
 
-    auto it = cache_map_.find(key);
     if (it != cache_map_.end()) {
+      weight_ = weight_ - it->second.weight + weight;
       it->second.value = value;
+      it->second.weight = weight;
       cache_list_.splice(cache_list_.begin(), cache_list_,
                          it->second.list_iter);
-      return;
-    }
-
-    if (cache_list_.size() >= capacity_ && !cache_list_.empty()) {
-      const K &old_key = cache_list_.back();
-      cache_map_.erase(old_key);
-      cache_list_.pop_back();
+      // the entry itself is at the front and fits on its own
+      EvictLocked(0);
+      return true;
     }
 
+    EvictLocked(weight);
     cache_list_.push_front(key);
 
     CacheItem item;
     item.value = value;
+    item.weight = weight;
     item.list_iter = cache_list_.begin();
     cache_map_[key] = std::move(item);
+    weight_ += weight;
+    return true;
   }
 
   void Remove(const K &key) {
@@ -66,8 +132,7 @@ public:
 
     auto it = cache_map_.find(key);
     if (it != cache_map_.end()) {
-      cache_list_.erase(it->second.list_iter);
-      cache_map_.erase(it);
+      EraseLocked(it);
     }
   }
 
@@ -75,6 +140,7 @@ public:
     std::lock_guard<std::mutex> lock(mutex_);
     cache_list_.clear();
     cache_map_.clear();
+    weight_ = 0;
   }
 
   size_t Size() const {
@@ -82,17 +148,707 @@ public:
     return cache_list_.size();
   }
 
+  // Sum of the entries' weights, at most `Capacity()`.
+  size_t Weight() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return weight_;
+  }
+
   size_t Capacity() const { return capacity_; }
 
 private:
   struct CacheItem {
     V value;
+    size_t weight;
     typename std::list<K>::iterator list_iter;
   };
 
+  void EraseLocked(typename std::unordered_map<K, CacheItem>::iterator it) {
+    weight_ -= it->second.weight;
+    cache_list_.erase(it->second.list_iter);
+    cache_map_.erase(it);
+  }
+
+  // Evicts from the tail until `incoming` more weight fits.
+  void EvictLocked(size_t incoming) {
+    while (!cache_list_.empty() && weight_ + incoming > capacity_) {
+      EraseLocked(cache_map_.find(cache_list_.back()));
+    }
+  }
+
   size_t capacity_;
+  size_t weight_ = 0;
   std::list<K> cache_list_;
   std::unordered_map<K, CacheItem> cache_map_;
   mutable std::mutex mutex_;
 };
+
+/************************************************************************/
+/* ShardedLRUCache */
+/************************************************************************/
+// `LRUCache` striped over independently locked shards picked by key hash,
+// so threads touching different keys rarely share a lock or a cache line.
+// Each shard evicts its own least recently used entry, which makes the
+// cache as a whole only approximately LRU. Same API as `LRUCache`; with a
+// byte weigher each shard gets its share of the byte budget.
+template <typename K, typename V, typename Hash = std::hash<K>,
+          typename Weigher = UnitWeigher>
+class ShardedLRUCache {
+public:
+  static constexpr size_t kDefaultShards = 16;
+
+  // `num_shards` is rounded up to a power of two, then halved while it
+  // exceeds `capacity`, so no shard is left without room. The capacity is
+  // split over the shards exactly.
+  explicit ShardedLRUCache(size_t capacity,
+                           size_t num_shards = kDefaultShards)
+      : capacity_(capacity) {
+    size_t count = 1;
+    while (count < num_shards) {
+      count <<= 1;
+    }
+    while (count > 1 && count > capacity) {
+      count >>= 1;
+    }
+    shards_.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+      shards_.push_back(std::make_unique<Shard>(
+          capacity / count + (i < capacity % count ? 1 : 0)));
+    }
+    mask_ = count - 1;
+  }
+
+  std::optional<V> Get(const K &key) { return ShardFor(key).Get(key); }
+  bool Put(const K &key, const V &value) {
+    return ShardFor(key).Put(key, value);
+  }
+  void Remove(const K &key) { ShardFor(key).Remove(key); }
+
+  void Clear() {
+    for (auto &shard : shards_) {
+      shard->cache.Clear();
+    }
+  }
+
+  // Sums the shards one at a time, so it is not a snapshot under writes.
+  size_t Size() const {
+    size_t size = 0;
+    for (const auto &shard : shards_) {
+      size += shard->cache.Size();
+    }
+    return size;
+  }
+
+  size_t Weight() const {
+    size_t weight = 0;
+    for (const auto &shard : shards_) {
+      weight += shard->cache.Weight();
+    }
+    return weight;
+  }
+
+  size_t Capacity() const { return capacity_; }
+  size_t NumShards() const { return shards_.size(); }
+
+private:
+  // own cache lines, so a shard's lock never bounces with its neighbour's
+  struct alignas(64) Shard {
+    explicit Shard(size_t capacity) : cache(capacity) {}
+    LRUCache<K, V, Weigher> cache;
+  };
+
+  LRUCache<K, V, Weigher> &ShardFor(const K &key) {
+    // std::hash is the identity for integers; mix before masking
+    return shards_[(MixHash<Hash>(key) >> 32) & mask_]->cache;
+  }
+
+  size_t capacity_;
+  size_t mask_ = 0;
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+/************************************************************************/
+/* FlatLRUCache */
+/************************************************************************/
+// `LRUCache` laid out flat: entries live in one array of `capacity` slots
+// allocated up front, chained into the recency list by 32-bit slot
+// indices, and found through an open-addressing table of (hash, slot)
+// buckets at most half full. After construction no operation allocates
+// (beyond what copying a key or value allocates itself), and a hit reads
+// one bucket run and one slot instead of a map node and a list node.
+//
+// The capacity counts entries, as with the default weigher; K and V must
+// be default-constructible. Linear probing with backward-shift deletion
+// keeps the table free of tombstones.
+template <typename K, typename V, typename Hash = std::hash<K>>
+class FlatLRUCache {
+public:
+  // Slots are addressed by 32-bit links, one value of which means none.
+  static constexpr size_t kMaxCapacity = (size_t{1} << 31) - 1;
+
+  explicit FlatLRUCache(size_t capacity)
+      : slots_(capacity < kMaxCapacity ? capacity : kMaxCapacity) {
+    size_t bucket_count = 1;
+    while (bucket_count < 2 * slots_.size()) {
+      bucket_count <<= 1;
+    }
+    buckets_.resize(bucket_count);
+    mask_ = bucket_count - 1;
+    Clear();
+  }
+
+  std::optional<V> Get(const K &key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t bucket = FindLocked(key, Mix(key));
+    if (bucket == kNotFound) {
+      return std::nullopt;
+    }
+
+    uint32_t index = buckets_[bucket].slot;
+    Unlink(index);
+    PushFront(index);
+    return slots_[index].value;
+  }
+
+  // Returns false, caching nothing, only when the capacity is zero.
+  bool Put(const K &key, const V &value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (slots_.empty()) {
+      return false;
+    }
+
+    uint32_t hash = Mix(key);
+    size_t bucket = FindLocked(key, hash);
+    if (bucket != kNotFound) {
+      uint32_t index = buckets_[bucket].slot;
+      slots_[index].value = value;
+      Unlink(index);
+      PushFront(index);
+      return true;
+    }
+
+    uint32_t index = free_;
+    if (index != kNil) {
+      free_ = slots_[index].next;
+      size_++;
+    } else {
+      // full: reuse the least recently used slot
+      index = tail_;
+      Unlink(index);
+      EraseBucket(BucketOf(index));
+    }
+
+    Slot &slot = slots_[index];
+    slot.key = key;
+    slot.value = value;
+    slot.hash = hash;
+    PushFront(index);
+
+    bucket = hash & mask_;
+    while (buckets_[bucket].slot != kNil) {
+      bucket = (bucket + 1) & mask_;
+    }
+    buckets_[bucket] = Bucket{hash, index};
+    return true;
+  }
+
+  void Remove(const K &key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t bucket = FindLocked(key, Mix(key));
+    if (bucket == kNotFound) {
+      return;
+    }
+
+    uint32_t index = buckets_[bucket].slot;
+    EraseBucket(bucket);
+    Unlink(index);
+    // release what the entry holds now rather than on reuse
+    slots_[index].key = K();
+    slots_[index].value = V();
+    slots_[index].next = free_;
+    free_ = index;
+    size_--;
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Bucket &bucket : buckets_) {
+      bucket.slot = kNil;
+    }
+    // filled front to back
+    free_ = kNil;
+    for (size_t i = slots_.size(); i > 0; --i) {
+      Slot &slot = slots_[i - 1];
+      slot.key = K();
+      slot.value = V();
+      slot.next = free_;
+      free_ = static_cast<uint32_t>(i - 1);
+    }
+    head_ = tail_ = kNil;
+    size_ = 0;
+  }
+
+  size_t Size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+  }
+
+  // Every entry weighs one, so this is `Size()`.
+  size_t Weight() const { return Size(); }
+
+  size_t Capacity() const { return slots_.size(); }
+
+private:
+  static constexpr uint32_t kNil = UINT32_MAX;
+  static constexpr size_t kNotFound = SIZE_MAX;
+
+  struct Slot {
+    K key{};
+    V value{};
+    uint32_t hash = 0;
+    uint32_t prev = kNil;
+    uint32_t next = kNil; // the next free slot while unused
+  };
+
+  // Empty when `slot` is kNil. The hash spares a key comparison on most
+  // mismatches, and tells deletion where an entry wants to be.
+  struct Bucket {
+    uint32_t hash = 0;
+    uint32_t slot = kNil;
+  };
+
+  static uint32_t Mix(const K &key) {
+    return static_cast<uint32_t>(MixHash<Hash>(key));
+  }
+
+  size_t FindLocked(const K &key, uint32_t hash) const {
+    for (size_t bucket = hash & mask_; buckets_[bucket].slot != kNil;
+         bucket = (bucket + 1) & mask_) {
+      if (buckets_[bucket].hash == hash &&
+          slots_[buckets_[bucket].slot].key == key) {
+        return bucket;
+      }
+    }
+    return kNotFound;
+  }
+
+  // The bucket pointing at the occupied slot `index`, found by its stored
+  // hash without comparing keys.
+  size_t BucketOf(uint32_t index) const {
+    size_t bucket = slots_[index].hash & mask_;
+    while (buckets_[bucket].slot != index) {
+      bucket = (bucket + 1) & mask_;
+    }
+    return bucket;
+  }
+
+  // Empties `hole`, then shifts back every later bucket of the run that
+  // may live there, so no probe ever stops short of its key.
+  void EraseBucket(size_t hole) {
+    for (size_t bucket = (hole + 1) & mask_; buckets_[bucket].slot != kNil;
+         bucket = (bucket + 1) & mask_) {
+      size_t home = buckets_[bucket].hash & mask_;
+      // home is not cyclically within (hole, bucket]
+      if (((bucket - home) & mask_) >= ((bucket - hole) & mask_)) {
+        buckets_[hole] = buckets_[bucket];
+        hole = bucket;
+      }
+    }
+    buckets_[hole].slot = kNil;
+  }
+
+  void Unlink(uint32_t index) {
+    Slot &slot = slots_[index];
+    (slot.prev == kNil ? head_ : slots_[slot.prev].next) = slot.next;
+    (slot.next == kNil ? tail_ : slots_[slot.next].prev) = slot.prev;
+  }
+
+  void PushFront(uint32_t index) {
+    Slot &slot = slots_[index];
+    slot.prev = kNil;
+    slot.next = head_;
+    (head_ == kNil ? tail_ : slots_[head_].prev) = index;
+    head_ = index;
+  }
+
+  std::vector<Slot> slots_;
+  std::vector<Bucket> buckets_;
+  size_t mask_ = 0;
+  uint32_t head_ = kNil; // most recently used
+  uint32_t tail_ = kNil;
+  uint32_t free_ = kNil; // unused slots, chained by `next`
+  size_t size_ = 0;
+  mutable std::mutex mutex_;
+};
+
+/************************************************************************/
+/* ClockCache */
+/************************************************************************/
+// CLOCK approximation of LRU with the API of `LRUCache`. Entries sit in a
+// fixed ring of `capacity` slots, each with a reference bit. A hit only
+// sets that bit, with a relaxed store under the shared lock (and no store
+// at all if it is already set), so hits never exclude each other or touch
+// shared list links. When the ring is full, an insert sweeps a hand over
+// it: referenced entries lose their bit and survive, and the first
+// unreferenced one is replaced.
+template <typename K, typename V, typename Hash = std::hash<K>>
+class ClockCache {
+public:
+  explicit ClockCache(size_t capacity) : slots_(capacity) { Clear(); }
+
+  std::optional<V> Get(const K &key) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      return std::nullopt;
+    }
+
+    Slot &slot = slots_[it->second];
+    if (!slot.referenced.load(std::memory_order_relaxed)) {
+      slot.referenced.store(true, std::memory_order_relaxed);
+    }
+    return slot.entry->second;
+  }
+
+  // Returns false, caching nothing, only when the capacity is zero.
+  bool Put(const K &key, const V &value) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (slots_.empty()) {
+      return false;
+    }
+
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      Slot &slot = slots_[it->second];
+      slot.entry->second = value;
+      slot.referenced.store(true, std::memory_order_relaxed);
+      return true;
+    }
+
+    size_t victim = 0;
+    if (!free_.empty()) {
+      victim = free_.back();
+      free_.pop_back();
+    } else {
+      victim = Sweep();
+      index_.erase(slots_[victim].entry->first);
+    }
+    // new entries start unreferenced, so one that is never hit again goes
+    // on the next sweep
+    slots_[victim].entry.emplace(key, value);
+    slots_[victim].referenced.store(false, std::memory_order_relaxed);
+    index_.emplace(key, victim);
+    return true;
+  }
+
+  void Remove(const K &key) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      slots_[it->second].entry.reset();
+      free_.push_back(it->second);
+      index_.erase(it);
+    }
+  }
+
+  void Clear() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    index_.clear();
+    free_.clear();
+    // filled front to back
+    for (size_t i = slots_.size(); i > 0; --i) {
+      slots_[i - 1].entry.reset();
+      free_.push_back(i - 1);
+    }
+    hand_ = 0;
+  }
+
+  size_t Size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return index_.size();
+  }
+
+  // Every entry weighs one, so this is `Size()`.
+  size_t Weight() const { return Size(); }
+
+  size_t Capacity() const { return slots_.size(); }
+
+private:
+  struct Slot {
+    std::optional<std::pair<K, V>> entry;
+    std::atomic<bool> referenced{false};
+  };
+
+  // Requires the exclusive lock and a full ring. Returns the slot to
+  // replace, at most one full turn of clearing bits away.
+  size_t Sweep() {
+    while (true) {
+      Slot &slot = slots_[hand_];
+      size_t current = hand_;
+      hand_ = hand_ + 1 == slots_.size() ? 0 : hand_ + 1;
+      if (!slot.referenced.load(std::memory_order_relaxed)) {
+        return current;
+      }
+      slot.referenced.store(false, std::memory_order_relaxed);
+    }
+  }
+
+  std::vector<Slot> slots_;
+  std::unordered_map<K, size_t, Hash> index_;
+  std::vector<size_t> free_; // empty slots, taken from the back
+  size_t hand_ = 0;
+  mutable std::shared_mutex mutex_;
+};
+
+/************************************************************************/
+/* FrequencySketch */
+/************************************************************************/
+// Count-min sketch of recent access frequency, the admission policy of
+// `TinyLFUCache`: four rows of 4-bit saturating counters packed sixteen to
+// a word, four counters per row for each cached entry (eight bytes in
+// all) so that keys outside the cache rarely share every counter. After
+// every `10 * capacity` recorded accesses all counters are halved, so keys
+// that were hot long ago lose their weight. Not thread-safe; the cache's
+// lock covers it.
+//
+// An admission policy is built from the cache capacity and provides
+// `Record(key)` on every access, `Admit(candidate, victim)` to decide
+// whether a new entry may replace the main cache's eviction victim, and
+// `Clear()`.
+template <typename K, typename Hash = std::hash<K>> class FrequencySketch {
+public:
+  static constexpr int kMaxCount = 15;
+
+  explicit FrequencySketch(size_t capacity)
+      : sample_size_(10 * (capacity > 0 ? capacity : 1)) {
+    width_ = kCountersPerWord;
+    while (width_ < 4 * capacity) {
+      width_ <<= 1;
+    }
+    table_.assign(kRows * width_ / kCountersPerWord, 0);
+  }
+
+  void Record(const K &key) {
+    uint64_t hash = MixHash<Hash>(key);
+    for (size_t row = 0; row < kRows; ++row) {
+      size_t word = 0, shift = 0;
+      Locate(hash, row, &word, &shift);
+      if (((table_[word] >> shift) & 0xF) < kMaxCount) {
+        table_[word] += uint64_t{1} << shift;
+      }
+    }
+    if (++additions_ >= sample_size_) {
+      Age();
+    }
+  }
+
+  int Estimate(const K &key) const {
+    uint64_t hash = MixHash<Hash>(key);
+    int count = kMaxCount;
+    for (size_t row = 0; row < kRows; ++row) {
+      size_t word = 0, shift = 0;
+      Locate(hash, row, &word, &shift);
+      int counter = static_cast<int>((table_[word] >> shift) & 0xF);
+      count = counter < count ? counter : count;
+    }
+    return count;
+  }
+
+  // Ties go to the victim: a scan of keys seen once never displaces an
+  // entry that was seen as often.
+  bool Admit(const K &candidate, const K &victim) const {
+    return Estimate(candidate) > Estimate(victim);
+  }
+
+  void Clear() {
+    table_.assign(table_.size(), 0);
+    additions_ = 0;
+  }
+
+private:
+  static constexpr size_t kRows = 4;
+  static constexpr size_t kCountersPerWord = 16;
+
+  // Row `row` of the counter for `hash`, by double hashing the two halves.
+  void Locate(uint64_t hash, size_t row, size_t *word, size_t *shift) const {
+    uint64_t step = (hash >> 32) | 1;
+    size_t column = static_cast<size_t>(hash + row * step) & (width_ - 1);
+    size_t index = row * width_ + column;
+    *word = index / kCountersPerWord;
+    *shift = (index % kCountersPerWord) * 4;
+  }
+
+  // Halves every counter, four bits at a time.
+  void Age() {
+    for (auto &word : table_) {
+      word = (word >> 1) & 0x7777777777777777ull;
+    }
+    additions_ /= 2;
+  }
+
+  size_t width_; // counters per row, a power of two
+  size_t sample_size_;
+  size_t additions_ = 0;
+  std::vector<uint64_t> table_;
+};
+
+/************************************************************************/
+/* TinyLFUCache */
+/************************************************************************/
+// W-TinyLFU. New entries go to a small window LRU (1% of the capacity);
+// what falls out of the window may enter the main cache only if the
+// admission policy rates it above the main cache's own victim, so a scan
+// of one-off keys passes through the window without flushing the hot
+// set. The main cache is a segmented LRU: entries start in probation and
+// move to the protected segment (80% of the main cache) on their next
+// hit. Same API as `LRUCache`.
+template <typename K, typename V, typename Hash = std::hash<K>,
+          typename Admission = FrequencySketch<K, Hash>>
+class TinyLFUCache {
+public:
+  explicit TinyLFUCache(size_t capacity)
+      : capacity_(capacity), admission_(capacity) {
+    window_capacity_ = capacity / 100 > 0 ? capacity / 100 : 1;
+    main_capacity_ = capacity > window_capacity_ ? capacity - window_capacity_
+                                                 : 0;
+    protected_capacity_ = main_capacity_ * 8 / 10;
+  }
+
+  std::optional<V> Get(const K &key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = cache_map_.find(key);
+    if (it == cache_map_.end()) {
+      return std::nullopt;
+    }
+
+    admission_.Record(key);
+    Touch(&it->second);
+    return it->second.value;
+  }
+
+  // Returns false, caching nothing, only when the capacity is zero. A new
+  // entry always enters the window, though it may not be admitted past it.
+  bool Put(const K &key, const V &value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (capacity_ == 0) {
+      return false;
+    }
+
+    admission_.Record(key);
+    auto it = cache_map_.find(key);
+    if (it != cache_map_.end()) {
+      it->second.value = value;
+      Touch(&it->second);
+      return true;
+    }
+
+    window_.push_front(key);
+    CacheItem item;
+    item.value = value;
+    item.segment = kWindow;
+    item.list_iter = window_.begin();
+    cache_map_[key] = std::move(item);
+
+    if (window_.size() > window_capacity_) {
+      EvictFromWindow();
+    }
+    return true;
+  }
+
+  void Remove(const K &key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = cache_map_.find(key);
+    if (it != cache_map_.end()) {
+      ListOf(it->second.segment).erase(it->second.list_iter);
+      cache_map_.erase(it);
+    }
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    window_.clear();
+    probation_.clear();
+    protected_.clear();
+    cache_map_.clear();
+    admission_.Clear();
+  }
+
+  size_t Size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cache_map_.size();
+  }
+
+  // Every entry weighs one, so this is `Size()`.
+  size_t Weight() const { return Size(); }
+
+  size_t Capacity() const { return capacity_; }
+
+private:
+  enum Segment { kWindow, kProbation, kProtected };
+
+  struct CacheItem {
+    V value;
+    Segment segment;
+    typename std::list<K>::iterator list_iter;
+  };
+
+  std::list<K> &ListOf(Segment segment) {
+    return segment == kWindow      ? window_
+           : segment == kProbation ? probation_
+                                   : protected_;
+  }
+
+  // A hit: refresh recency, and promote out of probation.
+  void Touch(CacheItem *item) {
+    if (item->segment != kProbation) {
+      std::list<K> &list = ListOf(item->segment);
+      list.splice(list.begin(), list, item->list_iter);
+      return;
+    }
+
+    protected_.splice(protected_.begin(), probation_, item->list_iter);
+    item->segment = kProtected;
+    if (protected_.size() > protected_capacity_) {
+      // the protected segment's oldest entry gets another chance in
+      // probation
+      cache_map_.find(protected_.back())->second.segment = kProbation;
+      probation_.splice(probation_.begin(), protected_,
+                        std::prev(protected_.end()));
+    }
+  }
+
+  // The window is one over its capacity: its oldest entry either moves
+  // into probation or is dropped.
+  void EvictFromWindow() {
+    auto candidate = cache_map_.find(window_.back());
+    if (probation_.size() + protected_.size() >= main_capacity_) {
+      std::list<K> &victims = probation_.empty() ? protected_ : probation_;
+      if (victims.empty() ||
+          !admission_.Admit(candidate->first, victims.back())) {
+        cache_map_.erase(candidate);
+        window_.pop_back();
+        return;
+      }
+      cache_map_.erase(victims.back());
+      victims.pop_back();
+    }
+
+    probation_.splice(probation_.begin(), window_, std::prev(window_.end()));
+    candidate->second.segment = kProbation;
+  }
+
+  size_t capacity_;
+  size_t window_capacity_;
+  size_t main_capacity_;
+  size_t protected_capacity_;
+  std::list<K> window_;
+  std::list<K> probation_;
+  std::list<K> protected_;
+  std::unordered_map<K, CacheItem, Hash> cache_map_;
+  Admission admission_;
+  mutable std::mutex mutex_;
+};
+
 } // namespace tiny_kv
@@ -3,13 +3,79 @@
 //
 
 #include "cache.h"
+#include "zipfian_generator.h"
+#include <cstdint>
 #include <gtest/gtest.h>
+#include <random>
 #include <string>
 #include <thread>
 #include <vector>
 
 namespace tiny_kv {
 
+namespace {
+
+// Draws `count` keys below `key_count` with a Zipfian skew. Fixed seed, so
+// every cache replays the same trace.
+std::vector<uint64_t> ZipfianTrace(uint64_t key_count, size_t count) {
+  ZipfianGenerator generator(0, key_count - 1, 0.99, 42);
+  std::vector<uint64_t> trace(count);
+  for (auto &key : trace) {
+    key = generator.Next();
+  }
+  return trace;
+}
+
+// `trace` with a scan of `scan_length` keys that the Zipfian draws never
+// produce inserted every `period` draws, like a periodic full-table scan.
+std::vector<uint64_t> WithScans(const std::vector<uint64_t> &trace,
+                                uint64_t key_count, size_t period,
+                                size_t scan_length) {
+  std::vector<uint64_t> result;
+  uint64_t next_scan_key = key_count;
+  for (size_t i = 0; i < trace.size(); ++i) {
+    if (i % period == period - 1) {
+      for (size_t j = 0; j < scan_length; ++j) {
+        result.push_back(next_scan_key++);
+      }
+    }
+    result.push_back(trace[i]);
+  }
+  return result;
+}
+
+// Replays `trace` as a read-through workload (Get, then Put on a miss)
+// and returns the fraction of Gets that hit.
+template <typename Cache>
+double MeasureHitRatio(Cache *cache, const std::vector<uint64_t> &trace) {
+  size_t hits = 0;
+  for (uint64_t key : trace) {
+    if (cache->Get(key)) {
+      hits++;
+    } else {
+      cache->Put(key, key);
+    }
+  }
+  return static_cast<double>(hits) / trace.size();
+}
+
+// Weighs an entry by the length of its value.
+struct LengthWeigher {
+  size_t operator()(int, const std::string &value) const {
+    return value.size();
+  }
+};
+
+// Admission policy that lets nothing past the window.
+struct RejectAll {
+  explicit RejectAll(size_t) {}
+  void Record(int) {}
+  bool Admit(int, int) const { return false; }
+  void Clear() {}
+};
+
+} // namespace
+
 TEST(LRUCacheTest, BasicOperations) {
   LRUCache<std::string, int> cache(3);
 
@@ -148,4 +214,576 @@ TEST(LRUCacheTest, DifferentTypes) {
   EXPECT_EQ(result->value, 42);
 }
 
+TEST(LRUCacheTest, WeightedEviction) {
+  LRUCache<int, std::string, LengthWeigher> cache(10);
+  EXPECT_TRUE(cache.Put(1, "aaaa"));
+  EXPECT_TRUE(cache.Put(2, "bbb"));
+  EXPECT_TRUE(cache.Put(3, "cc"));
+  EXPECT_EQ(cache.Weight(), 9);
+
+  // 1 is the oldest but was just read, so 2 and then 3 make room
+  cache.Get(1);
+  EXPECT_TRUE(cache.Put(4, "dddddd"));
+  EXPECT_FALSE(cache.Get(2).has_value());
+  EXPECT_FALSE(cache.Get(3).has_value());
+  EXPECT_EQ(cache.Get(1), "aaaa");
+  EXPECT_EQ(cache.Weight(), 10);
+  EXPECT_EQ(cache.Size(), 2);
+
+  // growing an entry in place evicts others, never the entry itself
+  EXPECT_TRUE(cache.Put(4, "ddddddddd"));
+  EXPECT_FALSE(cache.Get(1).has_value());
+  EXPECT_EQ(cache.Weight(), 9);
+
+  cache.Remove(4);
+  EXPECT_EQ(cache.Weight(), 0);
+  cache.Put(5, "e");
+  cache.Clear();
+  EXPECT_EQ(cache.Weight(), 0);
+}
+
+TEST(LRUCacheTest, RejectsOversizedEntries) {
+  LRUCache<int, std::string, LengthWeigher> cache(10);
+  EXPECT_TRUE(cache.Put(1, "a"));
+  EXPECT_TRUE(cache.Put(2, "bbbbbbbbbb"));
+  EXPECT_FALSE(cache.Get(1).has_value());
+
+  // too big: nothing is evicted for it
+  EXPECT_TRUE(cache.Put(1, "a"));
+  EXPECT_FALSE(cache.Put(3, "ccccccccccc"));
+  EXPECT_FALSE(cache.Get(3).has_value());
+  EXPECT_EQ(cache.Get(1), "a");
+
+  // and an update that does not fit drops the stale value
+  EXPECT_FALSE(cache.Put(1, "aaaaaaaaaaa"));
+  EXPECT_FALSE(cache.Get(1).has_value());
+  EXPECT_EQ(cache.Weight(), 0);
+
+  LRUCache<int, int> zero(0);
+  EXPECT_FALSE(zero.Put(1, 1));
+}
+
+TEST(LRUCacheTest, ByteWeigher) {
+  ByteWeigher weigher;
+  std::string small_value(10, 'x'), large_value(1000, 'x');
+  EXPECT_EQ(weigher(std::string("key"), large_value) -
+                weigher(std::string("key"), small_value),
+            990);
+  EXPECT_EQ(weigher(1, 2),
+            2 * sizeof(int) + sizeof(int) + ByteWeigher::kNodeOverhead);
+
+  // the same byte budget holds many small values or a few large ones
+  const size_t budget = 64 * 1024;
+  LRUCache<int, std::string, ByteWeigher> cache(budget);
+  for (int i = 0; i < 1000; ++i) {
+    cache.Put(i, small_value);
+  }
+  size_t small_count = cache.Size();
+  for (int i = 0; i < 1000; ++i) {
+    cache.Put(i, large_value);
+  }
+  EXPECT_GT(small_count, 10 * cache.Size());
+  EXPECT_LE(cache.Weight(), budget);
+  EXPECT_GT(cache.Weight(), budget - weigher(0, large_value));
+}
+
+TEST(ShardedLRUCacheTest, BasicOperations) {
+  ShardedLRUCache<std::string, int> cache(64, 4);
+  EXPECT_EQ(cache.NumShards(), 4);
+
+  cache.Put("key1", 1);
+  cache.Put("key2", 2);
+  EXPECT_EQ(cache.Get("key1"), 1);
+  EXPECT_EQ(cache.Get("key2"), 2);
+  EXPECT_FALSE(cache.Get("key3").has_value());
+
+  cache.Put("key1", 100);
+  EXPECT_EQ(cache.Get("key1"), 100);
+  EXPECT_EQ(cache.Size(), 2);
+
+  cache.Remove("key1");
+  EXPECT_FALSE(cache.Get("key1").has_value());
+  EXPECT_EQ(cache.Size(), 1);
+
+  cache.Clear();
+  EXPECT_EQ(cache.Size(), 0);
+}
+
+TEST(ShardedLRUCacheTest, ShardsAndCapacity) {
+  // rounded up to a power of two, but never more shards than entries
+  EXPECT_EQ((ShardedLRUCache<int, int>(100, 5).NumShards()), 8);
+  EXPECT_EQ((ShardedLRUCache<int, int>(3, 16).NumShards()), 2);
+  EXPECT_EQ((ShardedLRUCache<int, int>(0, 16).NumShards()), 1);
+
+  ShardedLRUCache<int, int> cache(100, 8);
+  for (int i = 0; i < 1000; ++i) {
+    cache.Put(i, i);
+  }
+  EXPECT_LE(cache.Size(), 100);
+  EXPECT_GE(cache.Size(), 90); // every shard filled up
+  EXPECT_EQ(cache.Capacity(), 100);
+
+  // the most recent keys are in whichever shard they hashed to
+  EXPECT_EQ(cache.Get(999), 999);
+
+  // one shard is exactly LRU
+  ShardedLRUCache<int, int> single(2, 1);
+  single.Put(1, 1);
+  single.Put(2, 2);
+  single.Get(1);
+  single.Put(3, 3);
+  EXPECT_TRUE(single.Get(1).has_value());
+  EXPECT_FALSE(single.Get(2).has_value());
+}
+
+TEST(ShardedLRUCacheTest, Weighted) {
+  ShardedLRUCache<int, std::string, std::hash<int>, LengthWeigher> cache(
+      4000, 4);
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(cache.Put(i, std::string(10, 'x')));
+  }
+  EXPECT_LE(cache.Weight(), 4000);
+  EXPECT_EQ(cache.Weight(), 10 * cache.Size());
+  EXPECT_FALSE(cache.Put(0, std::string(1001, 'x')));
+}
+
+TEST(ShardedLRUCacheTest, ConcurrentAccess) {
+  // room for twice the keys, so that no shard fills up however unevenly
+  // the hash spreads them
+  ShardedLRUCache<int, int> cache(8192);
+  const int thread_count = 8;
+  const int keys_per_thread = 500;
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_count; ++t) {
+    threads.emplace_back([&cache, t]() {
+      for (int i = 0; i < keys_per_thread; ++i) {
+        int key = t * keys_per_thread + i;
+        cache.Put(key, key);
+        EXPECT_EQ(cache.Get(key), key);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(cache.Size(), thread_count * keys_per_thread);
+}
+
+TEST(FlatLRUCacheTest, BasicOperations) {
+  FlatLRUCache<std::string, int> cache(3);
+
+  EXPECT_TRUE(cache.Put("key1", 1));
+  EXPECT_TRUE(cache.Put("key2", 2));
+
+  EXPECT_EQ(cache.Get("key1"), 1);
+  EXPECT_EQ(cache.Get("key2"), 2);
+  EXPECT_FALSE(cache.Get("key3").has_value());
+
+  cache.Put("key1", 100);
+  EXPECT_EQ(cache.Get("key1"), 100);
+  EXPECT_EQ(cache.Size(), 2);
+  EXPECT_EQ(cache.Weight(), 2);
+
+  cache.Remove("key1");
+  EXPECT_FALSE(cache.Get("key1").has_value());
+  EXPECT_EQ(cache.Size(), 1);
+
+  cache.Clear();
+  EXPECT_EQ(cache.Size(), 0);
+  EXPECT_FALSE(cache.Get("key2").has_value());
+}
+
+TEST(FlatLRUCacheTest, LRUEviction) {
+  FlatLRUCache<std::string, int> cache(3);
+
+  cache.Put("key1", 1);
+  cache.Put("key2", 2);
+  cache.Put("key3", 3);
+  EXPECT_EQ(cache.Get("key1"), 1);
+
+  // [ key4->key1->key3 ]
+  cache.Put("key4", 4);
+  EXPECT_EQ(cache.Size(), 3);
+  EXPECT_FALSE(cache.Get("key2").has_value());
+  EXPECT_TRUE(cache.Get("key3").has_value());
+  EXPECT_TRUE(cache.Get("key4").has_value());
+  EXPECT_TRUE(cache.Get("key1").has_value());
+
+  // [ key5->key1->key4 ]
+  cache.Put("key5", 5);
+  EXPECT_EQ(cache.Size(), 3);
+  EXPECT_FALSE(cache.Get("key3").has_value());
+  EXPECT_EQ(cache.Get("key4"), 4);
+  EXPECT_EQ(cache.Get("key5"), 5);
+  EXPECT_EQ(cache.Get("key1"), 1);
+}
+
+TEST(FlatLRUCacheTest, ZeroCapacity) {
+  FlatLRUCache<std::string, int> cache(0);
+
+  EXPECT_FALSE(cache.Put("key1", 1));
+  EXPECT_FALSE(cache.Get("key1").has_value());
+  EXPECT_EQ(cache.Size(), 0);
+
+  cache.Remove("key1"); // Should not crash
+  cache.Clear();        // Should not crash
+  EXPECT_EQ(cache.Capacity(), 0);
+}
+
+// Every key in one probe run: removals and evictions in the middle of it
+// must leave the keys behind still reachable.
+TEST(FlatLRUCacheTest, CollidingKeys) {
+  struct SameHash {
+    size_t operator()(int) const { return 7; }
+  };
+  FlatLRUCache<int, int, SameHash> cache(8);
+  for (int key = 0; key < 8; ++key) {
+    cache.Put(key, key);
+  }
+  cache.Remove(3);
+  cache.Remove(0);
+  cache.Put(8, 8); // into a free slot
+  cache.Put(9, 9); // into the other free slot
+  cache.Put(10, 10); // evicts 1
+  for (int key : {2, 4, 5, 6, 7, 8, 9, 10}) {
+    EXPECT_EQ(cache.Get(key), key);
+  }
+  for (int key : {0, 1, 3}) {
+    EXPECT_FALSE(cache.Get(key).has_value());
+  }
+  EXPECT_EQ(cache.Size(), 8);
+}
+
+// Replays a random mix of operations on both caches: the flat layout must
+// keep exactly the entries `LRUCache` keeps.
+TEST(FlatLRUCacheTest, MatchesLRUCache) {
+  const int capacity = 64;
+  LRUCache<int, int> lru(capacity);
+  FlatLRUCache<int, int> flat(capacity);
+  std::mt19937 rng(7);
+  for (int i = 0; i < 100000; ++i) {
+    int key = rng() % (3 * capacity);
+    switch (rng() % 8) {
+    case 0:
+      lru.Remove(key);
+      flat.Remove(key);
+      break;
+    case 1:
+    case 2:
+    case 3:
+      lru.Put(key, i);
+      flat.Put(key, i);
+      break;
+    default:
+      ASSERT_EQ(flat.Get(key), lru.Get(key)) << "operation " << i;
+      break;
+    }
+    ASSERT_EQ(flat.Size(), lru.Size());
+  }
+}
+
+TEST(FlatLRUCacheTest, ThreadSafety) {
+  FlatLRUCache<int, int> cache(100);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&cache, t]() {
+      for (int i = 0; i < 10000; ++i) {
+        int key = (t * 31 + i) % 150;
+        if (i % 3 == 0) {
+          cache.Remove(key);
+        } else if (i % 3 == 1) {
+          cache.Put(key, key);
+        } else if (auto value = cache.Get(key)) {
+          EXPECT_EQ(*value, key);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_LE(cache.Size(), 100);
+}
+
+TEST(ClockCacheTest, BasicOperations) {
+  ClockCache<std::string, int> cache(3);
+  EXPECT_EQ(cache.Capacity(), 3);
+
+  EXPECT_TRUE(cache.Put("key1", 1));
+  EXPECT_TRUE(cache.Put("key2", 2));
+  EXPECT_EQ(cache.Get("key1"), 1);
+  EXPECT_EQ(cache.Get("key2"), 2);
+  EXPECT_FALSE(cache.Get("key3").has_value());
+  EXPECT_EQ(cache.Size(), 2);
+
+  EXPECT_TRUE(cache.Put("key1", 10));
+  EXPECT_EQ(cache.Get("key1"), 10);
+  EXPECT_EQ(cache.Size(), 2);
+  EXPECT_EQ(cache.Weight(), 2);
+
+  cache.Remove("key1");
+  EXPECT_FALSE(cache.Get("key1").has_value());
+  EXPECT_EQ(cache.Size(), 1);
+
+  // the freed slot is reused before anything is evicted
+  cache.Put("key3", 3);
+  cache.Put("key4", 4);
+  EXPECT_EQ(cache.Size(), 3);
+  EXPECT_EQ(cache.Get("key2"), 2);
+
+  cache.Clear();
+  EXPECT_EQ(cache.Size(), 0);
+  EXPECT_FALSE(cache.Get("key2").has_value());
+  cache.Put("key5", 5);
+  EXPECT_EQ(cache.Get("key5"), 5);
+}
+
+TEST(ClockCacheTest, SecondChance) {
+  ClockCache<int, int> cache(3);
+  cache.Put(1, 1);
+  cache.Put(2, 2);
+  cache.Put(3, 3);
+
+  // 1 and 3 are referenced, so the hand skips them and takes 2
+  cache.Get(1);
+  cache.Get(3);
+  cache.Put(4, 4);
+  EXPECT_FALSE(cache.Get(2).has_value());
+  EXPECT_EQ(cache.Get(1), 1);
+  EXPECT_EQ(cache.Get(3), 3);
+  EXPECT_EQ(cache.Get(4), 4);
+
+  // with every entry referenced, one full turn clears the bits and the
+  // hand's next stop goes
+  cache.Put(5, 5);
+  EXPECT_EQ(cache.Size(), 3);
+  EXPECT_EQ(cache.Get(5), 5);
+
+  // a new entry that is never hit goes before an older one that is
+  ClockCache<int, int> pair(2);
+  pair.Put(1, 1);
+  pair.Put(2, 2);
+  pair.Get(2);
+  pair.Put(3, 3); // evicts 1
+  pair.Get(2);
+  pair.Put(4, 4); // evicts 3
+  EXPECT_FALSE(pair.Get(1).has_value());
+  EXPECT_FALSE(pair.Get(3).has_value());
+  EXPECT_EQ(pair.Get(2), 2);
+  EXPECT_EQ(pair.Get(4), 4);
+}
+
+// CLOCK approximates LRU, so on a skewed trace it hits about as often.
+TEST(ClockCacheTest, HitRatioCloseToLRU) {
+  const std::vector<uint64_t> trace = ZipfianTrace(1 << 16, 1 << 17);
+  LRUCache<uint64_t, uint64_t> lru(1024);
+  ClockCache<uint64_t, uint64_t> clock(1024);
+  double lru_ratio = MeasureHitRatio(&lru, trace);
+  EXPECT_NEAR(MeasureHitRatio(&clock, trace), lru_ratio, 0.02);
+}
+
+TEST(ClockCacheTest, ZeroCapacity) {
+  ClockCache<int, int> cache(0);
+  EXPECT_FALSE(cache.Put(1, 1));
+  EXPECT_FALSE(cache.Get(1).has_value());
+  EXPECT_EQ(cache.Size(), 0);
+}
+
+TEST(ClockCacheTest, ConcurrentAccess) {
+  ClockCache<int, int> cache(1000);
+  const int thread_count = 8;
+  const int ops_per_thread = 5000;
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_count; ++t) {
+    threads.emplace_back([&cache, t]() {
+      std::mt19937 rng(t);
+      for (int i = 0; i < ops_per_thread; ++i) {
+        int key = rng() % 2000;
+        if (i % 4 == 0) {
+          cache.Put(key, key);
+        } else if (auto value = cache.Get(key)) {
+          EXPECT_EQ(*value, key);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_LE(cache.Size(), 1000);
+}
+
+TEST(FrequencySketchTest, CountsAndSaturates) {
+  FrequencySketch<int> sketch(1024);
+  EXPECT_EQ(sketch.Estimate(1), 0);
+
+  for (int i = 0; i < 3; ++i) {
+    sketch.Record(1);
+  }
+  EXPECT_EQ(sketch.Estimate(1), 3);
+  for (int i = 0; i < 100; ++i) {
+    sketch.Record(1);
+  }
+  EXPECT_EQ(sketch.Estimate(1), FrequencySketch<int>::kMaxCount);
+
+  sketch.Record(2);
+  EXPECT_TRUE(sketch.Admit(1, 2));
+  EXPECT_FALSE(sketch.Admit(2, 1));
+  EXPECT_FALSE(sketch.Admit(2, 2)); // ties keep the victim
+
+  sketch.Clear();
+  EXPECT_EQ(sketch.Estimate(1), 0);
+}
+
+TEST(FrequencySketchTest, Ages) {
+  FrequencySketch<int> sketch(1024);
+  const int sample_size = 10 * 1024;
+
+  for (int i = 0; i < 15; ++i) {
+    sketch.Record(1);
+  }
+  // the sample fills up on the last of these and every counter halves
+  for (int i = 15; i < sample_size; ++i) {
+    sketch.Record(2);
+  }
+  EXPECT_EQ(sketch.Estimate(1), 7);
+  EXPECT_EQ(sketch.Estimate(2), 7);
+}
+
+TEST(TinyLFUCacheTest, BasicOperations) {
+  TinyLFUCache<std::string, int> cache(100);
+  EXPECT_EQ(cache.Capacity(), 100);
+
+  cache.Put("key1", 1);
+  cache.Put("key2", 2);
+  EXPECT_EQ(cache.Get("key1"), 1);
+  EXPECT_EQ(cache.Get("key2"), 2);
+  EXPECT_FALSE(cache.Get("key3").has_value());
+  EXPECT_EQ(cache.Size(), 2);
+
+  cache.Put("key1", 10);
+  EXPECT_EQ(cache.Get("key1"), 10);
+
+  cache.Remove("key1");
+  EXPECT_FALSE(cache.Get("key1").has_value());
+  EXPECT_EQ(cache.Size(), 1);
+
+  cache.Clear();
+  EXPECT_EQ(cache.Size(), 0);
+  EXPECT_FALSE(cache.Get("key2").has_value());
+}
+
+TEST(TinyLFUCacheTest, BoundedByCapacity) {
+  TinyLFUCache<int, int> cache(100);
+  for (int i = 0; i < 1000; ++i) {
+    cache.Put(i, i);
+    cache.Get(i % 37);
+    EXPECT_LE(cache.Size(), 100);
+  }
+  EXPECT_EQ(cache.Size(), 100);
+  EXPECT_EQ(cache.Weight(), 100);
+
+  TinyLFUCache<int, int> zero(0);
+  EXPECT_FALSE(zero.Put(1, 1));
+  EXPECT_FALSE(zero.Get(1).has_value());
+
+  // all window, no main cache: plain LRU of one
+  TinyLFUCache<int, int> one(1);
+  EXPECT_TRUE(one.Put(1, 1));
+  EXPECT_TRUE(one.Put(2, 2));
+  EXPECT_FALSE(one.Get(1).has_value());
+  EXPECT_EQ(one.Get(2), 2);
+}
+
+// The frequency sketch pays off on a skewed trace, and more so once a
+// periodic scan twice the cache size is mixed in.
+TEST(TinyLFUCacheTest, HitRatioAtLeastLRU) {
+  const uint64_t key_count = 1 << 16;
+  const std::vector<uint64_t> zipfian = ZipfianTrace(key_count, 1 << 17);
+  const size_t capacity = 1024;
+  for (bool scans : {false, true}) {
+    std::vector<uint64_t> trace =
+        scans ? WithScans(zipfian, key_count, 1 << 13, 2 * capacity)
+              : zipfian;
+    LRUCache<uint64_t, uint64_t> lru(capacity);
+    TinyLFUCache<uint64_t, uint64_t> tiny_lfu(capacity);
+    double lru_ratio = MeasureHitRatio(&lru, trace);
+    EXPECT_GE(MeasureHitRatio(&tiny_lfu, trace), lru_ratio) << scans;
+  }
+}
+
+TEST(TinyLFUCacheTest, ScanResistance) {
+  const int capacity = 100, hot_keys = 50;
+  LRUCache<int, int> lru(capacity);
+  TinyLFUCache<int, int> tiny_lfu(capacity);
+  for (int round = 0; round < 10; ++round) {
+    for (int key = 0; key < hot_keys; ++key) {
+      if (!tiny_lfu.Get(key)) {
+        tiny_lfu.Put(key, key);
+      }
+      if (!lru.Get(key)) {
+        lru.Put(key, key);
+      }
+    }
+  }
+
+  // one pass over keys that are never read again
+  for (int key = 1000; key < 2000; ++key) {
+    tiny_lfu.Put(key, key);
+    lru.Put(key, key);
+  }
+
+  for (int key = 0; key < hot_keys; ++key) {
+    EXPECT_EQ(tiny_lfu.Get(key), key);
+    EXPECT_FALSE(lru.Get(key).has_value());
+  }
+}
+
+TEST(TinyLFUCacheTest, AdmissionPolicy) {
+  // a window of one in front of 99 main entries
+  TinyLFUCache<int, int, std::hash<int>, RejectAll> cache(100);
+  for (int key = 0; key < 100; ++key) {
+    cache.Put(key, key);
+  }
+  EXPECT_EQ(cache.Size(), 100);
+
+  // with the main cache full, nothing more is admitted past the window
+  cache.Put(100, 100);
+  cache.Put(101, 101);
+  EXPECT_EQ(cache.Size(), 100);
+  EXPECT_FALSE(cache.Get(99).has_value());
+  EXPECT_FALSE(cache.Get(100).has_value());
+  EXPECT_EQ(cache.Get(101), 101);
+  for (int key = 0; key < 99; ++key) {
+    EXPECT_EQ(cache.Get(key), key);
+  }
+}
+
+TEST(TinyLFUCacheTest, ThreadSafety) {
+  TinyLFUCache<int, int> cache(500);
+  const int thread_count = 8;
+  const int ops_per_thread = 5000;
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_count; ++t) {
+    threads.emplace_back([&cache, t]() {
+      std::mt19937 rng(t);
+      for (int i = 0; i < ops_per_thread; ++i) {
+        int key = rng() % 2000;
+        if (auto value = cache.Get(key)) {
+          EXPECT_EQ(*value, key);
+        } else {
+          cache.Put(key, key);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_LE(cache.Size(), 500);
+}
+
 } // namespace tiny_kv
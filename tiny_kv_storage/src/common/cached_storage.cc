@@ -0,0 +1,370 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "cached_storage.h"
+#include "cache.h"
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace tiny_kv {
+
+namespace {
+
+// The caches key on `std::string`, and C++17 maps cannot look one up by a
+// `std::string_view`; copying into a per-thread buffer makes the key
+// without allocating once the buffer has grown to fit.
+const std::string &KeyBuffer(std::string_view key) {
+  thread_local std::string buffer;
+  buffer.assign(key.data(), key.size());
+  return buffer;
+}
+
+} // namespace
+
+bool ParseCachePolicy(const std::string &name, CachePolicy *policy) {
+  if (name == "lru") {
+    *policy = CachePolicy::kLRU;
+  } else if (name == "clock") {
+    *policy = CachePolicy::kClock;
+  } else if (name == "tinylfu") {
+    *policy = CachePolicy::kTinyLFU;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/************************************************************************/
+/* CachedStorageEngine */
+/************************************************************************/
+class CachedStorageEngine::ValueCache {
+public:
+  virtual ~ValueCache() = default;
+  // null on a miss
+  virtual CachedValue Get(std::string_view key) = 0;
+  virtual void Put(std::string_view key, const CachedValue &value) = 0;
+  virtual void Remove(std::string_view key) = 0;
+};
+
+template <typename Cache>
+class CachedStorageEngine::PolicyCache : public ValueCache {
+public:
+  explicit PolicyCache(size_t entries) : cache_(entries) {}
+
+  CachedValue Get(std::string_view key) override {
+    return cache_.Get(KeyBuffer(key)).value_or(nullptr);
+  }
+  void Put(std::string_view key, const CachedValue &value) override {
+    cache_.Put(KeyBuffer(key), value);
+  }
+  void Remove(std::string_view key) override {
+    cache_.Remove(KeyBuffer(key));
+  }
+
+private:
+  Cache cache_;
+};
+
+// The completion of an async write, held back until the cache reflects
+// the write: a client answered from `done` must not then read the value
+// the write replaced. The engine may report before or after that point,
+// on any thread.
+struct CachedStorageEngine::PendingWrite {
+  explicit PendingWrite(WriteCallback done) : done(std::move(done)) {}
+
+  // The callback to give the engine.
+  WriteCallback Callback(const std::shared_ptr<PendingWrite> &self) {
+    return [self](bool success) {
+      {
+        std::lock_guard<std::mutex> lock(self->mutex);
+        if (!self->cached) {
+          self->result = success;
+          return;
+        }
+      }
+      self->done(success);
+    };
+  }
+
+  // Whether the engine has already reported a failure.
+  bool Failed() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return result.has_value() && !*result;
+  }
+
+  // The cache is up to date: answer now if the engine already has.
+  void Release() {
+    std::optional<bool> ready;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      cached = true;
+      ready = result;
+    }
+    if (ready) {
+      done(*ready);
+    }
+  }
+
+  WriteCallback done;
+  std::mutex mutex;
+  bool cached = false;
+  std::optional<bool> result; // set if the engine reported first
+};
+
+CachedStorageEngine::CachedStorageEngine(std::unique_ptr<StorageEngine> engine,
+                                         const CacheOptions &options)
+    : engine_(std::move(engine)), write_through_(options.write_through) {
+  using Key = std::string;
+  switch (options.policy) {
+  case CachePolicy::kClock:
+    cache_ = std::make_unique<PolicyCache<ClockCache<Key, CachedValue>>>(
+        options.entries);
+    break;
+  case CachePolicy::kTinyLFU:
+    cache_ = std::make_unique<PolicyCache<TinyLFUCache<Key, CachedValue>>>(
+        options.entries);
+    break;
+  default:
+    cache_ = std::make_unique<PolicyCache<ShardedLRUCache<Key, CachedValue>>>(
+        options.entries);
+    break;
+  }
+}
+
+CachedStorageEngine::~CachedStorageEngine() = default;
+
+CachedStorageEngine::Stripe &
+CachedStorageEngine::StripeFor(std::string_view key) {
+  return stripes_[std::hash<std::string_view>{}(key) % kStripes];
+}
+
+CachedStorageEngine::CachedValue
+CachedStorageEngine::Lookup(std::string_view key) {
+  CachedValue value = cache_->Get(key);
+  (value ? hits_ : misses_).fetch_add(1, std::memory_order_relaxed);
+  return value;
+}
+
+void CachedStorageEngine::Fill(std::string_view key, uint64_t version,
+                               CachedValue value) {
+  Stripe &stripe = StripeFor(key);
+  std::lock_guard<std::mutex> lock(stripe.mutex);
+  if (stripe.version.load(std::memory_order_relaxed) == version) {
+    cache_->Put(key, value);
+  }
+}
+
+void CachedStorageEngine::AfterWrite(std::string_view key, uint64_t version,
+                                     std::optional<std::string_view> value) {
+  // copy outside the lock; most of these are never used when raced
+  CachedValue copy;
+  if (write_through_ && value) {
+    copy = std::make_shared<const std::string>(*value);
+  }
+
+  Stripe &stripe = StripeFor(key);
+  std::lock_guard<std::mutex> lock(stripe.mutex);
+  bool raced = stripe.version.load(std::memory_order_relaxed) != version;
+  stripe.version.fetch_add(1, std::memory_order_release);
+  if (copy && !raced) {
+    cache_->Put(key, copy);
+  } else {
+    cache_->Remove(key);
+  }
+}
+
+CacheStats CachedStorageEngine::Stats() const {
+  CacheStats stats;
+  stats.hits = hits_.load(std::memory_order_relaxed);
+  stats.misses = misses_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+bool CachedStorageEngine::Put(std::string_view key, std::string_view value) {
+  uint64_t version = VersionOf(key);
+  bool success = engine_->Put(key, value);
+  AfterWrite(key, version,
+             success ? std::optional<std::string_view>(value) : std::nullopt);
+  return success;
+}
+
+std::optional<std::string> CachedStorageEngine::Get(std::string_view key) {
+  if (CachedValue cached = Lookup(key)) {
+    return *cached;
+  }
+
+  uint64_t version = VersionOf(key);
+  std::optional<std::string> value = engine_->Get(key);
+  if (value) {
+    Fill(key, version, std::make_shared<const std::string>(*value));
+  }
+  return value;
+}
+
+bool CachedStorageEngine::Delete(std::string_view key) {
+  uint64_t version = VersionOf(key);
+  bool success = engine_->Delete(key);
+  AfterWrite(key, version, std::nullopt);
+  return success;
+}
+
+bool CachedStorageEngine::PutWithTtl(std::string_view key,
+                                     std::string_view value, uint64_t ttl_ms) {
+  return ttl_ms == 0 && Put(key, value);
+}
+
+UpdateStatus CachedStorageEngine::Update(std::string_view key,
+                                         const Updater &updater) {
+  uint64_t version = VersionOf(key);
+  if (!write_through_) {
+    UpdateStatus status = engine_->Update(key, updater);
+    AfterWrite(key, version, std::nullopt);
+    return status;
+  }
+
+  std::optional<std::string> stored;
+  UpdateStatus status = engine_->Update(
+      key, [&](std::optional<std::string_view> current, std::string *value) {
+        UpdateStatus result = updater(current, value);
+        if (result == UpdateStatus::kOk) {
+          stored = *value;
+        }
+        return result;
+      });
+  AfterWrite(key, version,
+             status == UpdateStatus::kOk && stored
+                 ? std::optional<std::string_view>(*stored)
+                 : std::nullopt);
+  return status;
+}
+
+void CachedStorageEngine::Scan(ScanCursor *cursor, size_t batch_size,
+                               ScanBatch *batch) {
+  engine_->Scan(cursor, batch_size, batch);
+}
+
+void CachedStorageEngine::Scan(std::string_view start, std::string_view end,
+                               size_t limit, ScanBatch *batch) {
+  engine_->Scan(start, end, limit, batch);
+}
+
+bool CachedStorageEngine::Visit(std::string_view key,
+                                const ValueVisitor &visitor) {
+  CachedValue value = Lookup(key);
+  if (!value) {
+    uint64_t version = VersionOf(key);
+    if (!engine_->Visit(key, [&value](std::string_view stored) {
+          value = std::make_shared<const std::string>(stored);
+        })) {
+      return false;
+    }
+    Fill(key, version, value);
+  }
+
+  visitor(*value);
+  return true;
+}
+
+void CachedStorageEngine::MultiGet(
+    const KeyList &keys, std::vector<std::optional<std::string>> *values) {
+  values->assign(keys.size(), std::nullopt);
+  KeyList missing;
+  std::vector<size_t> slots;
+  std::vector<uint64_t> versions;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (CachedValue cached = Lookup(keys[i])) {
+      (*values)[i] = *cached;
+    } else {
+      missing.push_back(keys[i]);
+      slots.push_back(i);
+      versions.push_back(VersionOf(keys[i]));
+    }
+  }
+  if (missing.empty()) {
+    return;
+  }
+
+  std::vector<std::optional<std::string>> fetched;
+  engine_->MultiGet(missing, &fetched);
+  for (size_t i = 0; i < missing.size(); ++i) {
+    if (fetched[i]) {
+      Fill(missing[i], versions[i],
+           std::make_shared<const std::string>(*fetched[i]));
+      (*values)[slots[i]] = std::move(fetched[i]);
+    }
+  }
+}
+
+bool CachedStorageEngine::MultiPut(const KVPairList &kvs) {
+  std::vector<uint64_t> versions;
+  versions.reserve(kvs.size());
+  for (const auto &kv : kvs) {
+    versions.push_back(VersionOf(kv.first));
+  }
+
+  bool success = engine_->MultiPut(kvs);
+  for (size_t i = 0; i < kvs.size(); ++i) {
+    AfterWrite(kvs[i].first, versions[i],
+               success ? std::optional<std::string_view>(kvs[i].second)
+                       : std::nullopt);
+  }
+  return success;
+}
+
+bool CachedStorageEngine::MultiDelete(const KeyList &keys) {
+  std::vector<uint64_t> versions;
+  versions.reserve(keys.size());
+  for (std::string_view key : keys) {
+    versions.push_back(VersionOf(key));
+  }
+
+  bool success = engine_->MultiDelete(keys);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    AfterWrite(keys[i], versions[i], std::nullopt);
+  }
+  return success;
+}
+
+void CachedStorageEngine::PutAsync(std::string_view key,
+                                   std::string_view value, uint64_t ttl_ms,
+                                   Durability durability, WriteCallback done) {
+  if (ttl_ms != 0) {
+    done(false);
+    return;
+  }
+
+  uint64_t version = VersionOf(key);
+  auto pending = std::make_shared<PendingWrite>(std::move(done));
+  engine_->PutAsync(key, value, 0, durability, pending->Callback(pending));
+  // the engine has applied the write, unless it already said it failed
+  AfterWrite(key, version,
+             pending->Failed() ? std::nullopt
+                               : std::optional<std::string_view>(value));
+  pending->Release();
+}
+
+void CachedStorageEngine::MultiPutAsync(const KVPairList &kvs,
+                                        Durability durability,
+                                        WriteCallback done) {
+  std::vector<uint64_t> versions;
+  versions.reserve(kvs.size());
+  for (const auto &kv : kvs) {
+    versions.push_back(VersionOf(kv.first));
+  }
+
+  auto pending = std::make_shared<PendingWrite>(std::move(done));
+  engine_->MultiPutAsync(kvs, durability, pending->Callback(pending));
+  bool failed = pending->Failed();
+  for (size_t i = 0; i < kvs.size(); ++i) {
+    AfterWrite(kvs[i].first, versions[i],
+               failed ? std::nullopt
+                      : std::optional<std::string_view>(kvs[i].second));
+  }
+  pending->Release();
+}
+
+} // namespace tiny_kv
@@ -0,0 +1,110 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#pragma once
+
+#include "src/common/storage_engine.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace tiny_kv {
+
+struct CacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+};
+
+/************************************************************************/
+/* CachedStorageEngine */
+/************************************************************************/
+// Read cache in front of another engine, for the file-backed ones: a hot
+// key is answered from memory without reaching the engine's shard maps,
+// memtables or tables. `Get`, `Visit` and `MultiGet` fill the cache on a
+// miss. Writes go to the engine first and then either update the cached
+// value (`write_through`) or drop it; scans bypass the cache.
+//
+// A fill must not put back a value that a concurrent write has already
+// replaced. Keys are striped over `kStripes` locks, each with a version
+// bumped by every write under it: a read notes the version before it asks
+// the engine and fills only if the version is unchanged, under the stripe
+// lock that the write's cache update also takes. Two writes racing on a
+// stripe drop the key instead of guessing which of them the engine kept.
+//
+// Cached values carry no TTL, so expiring writes are refused: a nonzero
+// `ttl_ms` fails. `MultiGet` mixes cached and engine values and so is not
+// a snapshot.
+class CachedStorageEngine : public StorageEngine {
+public:
+  CachedStorageEngine(std::unique_ptr<StorageEngine> engine,
+                      const CacheOptions &options);
+  ~CachedStorageEngine() override;
+
+  bool Put(std::string_view key, std::string_view value) override;
+  std::optional<std::string> Get(std::string_view key) override;
+  bool Delete(std::string_view key) override;
+  bool PutWithTtl(std::string_view key, std::string_view value,
+                  uint64_t ttl_ms) override;
+  UpdateStatus Update(std::string_view key, const Updater &updater) override;
+  void Scan(ScanCursor *cursor, size_t batch_size, ScanBatch *batch) override;
+  void Scan(std::string_view start, std::string_view end, size_t limit,
+            ScanBatch *batch) override;
+  // Runs `visitor` on the cached copy, or on a copy made for the cache.
+  bool Visit(std::string_view key, const ValueVisitor &visitor) override;
+  void MultiGet(const KeyList &keys,
+                std::vector<std::optional<std::string>> *values) override;
+  bool MultiPut(const KVPairList &kvs) override;
+  bool MultiDelete(const KeyList &keys) override;
+  // `done` is held back until the cache reflects the write.
+  void PutAsync(std::string_view key, std::string_view value, uint64_t ttl_ms,
+                Durability durability, WriteCallback done) override;
+  void MultiPutAsync(const KVPairList &kvs, Durability durability,
+                     WriteCallback done) override;
+
+  // Lookups answered from the cache, and those that went to the engine.
+  CacheStats Stats() const;
+  StorageEngine *wrapped() const { return engine_.get(); }
+
+private:
+  static constexpr size_t kStripes = 256;
+
+  using CachedValue = std::shared_ptr<const std::string>;
+  class ValueCache; // the replacement policy, behind one interface
+  template <typename Cache> class PolicyCache;
+  struct PendingWrite;
+
+  struct alignas(64) Stripe {
+    std::mutex mutex;
+    std::atomic<uint64_t> version{0}; // changed only under `mutex`
+  };
+
+  Stripe &StripeFor(std::string_view key);
+  uint64_t VersionOf(std::string_view key) {
+    return StripeFor(key).version.load(std::memory_order_acquire);
+  }
+  // Counts a hit or a miss.
+  CachedValue Lookup(std::string_view key);
+  // Caches `value`, read from the engine while the stripe was at
+  // `version`, unless a write has come since.
+  void Fill(std::string_view key, uint64_t version, CachedValue value);
+  // After a write of `key` that began with the stripe at `version`: caches
+  // `value` if writing through and no other write raced, else drops the
+  // key. A nullopt `value` (a delete, or a failed write) always drops it.
+  void AfterWrite(std::string_view key, uint64_t version,
+                  std::optional<std::string_view> value);
+
+  std::unique_ptr<StorageEngine> engine_;
+  std::unique_ptr<ValueCache> cache_;
+  const bool write_through_;
+  std::array<Stripe, kStripes> stripes_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+};
+
+} // namespace tiny_kv
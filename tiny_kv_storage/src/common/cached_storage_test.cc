@@ -0,0 +1,291 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "cached_storage.h"
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tiny_kv {
+
+namespace {
+
+// Memory storage that counts the point reads reaching it. `Get` runs
+// `after_read` (once) between reading and returning, where a write can
+// overtake the fill that follows.
+class CountingStorage : public MemoryStorage {
+public:
+  std::optional<std::string> Get(std::string_view key) override {
+    reads++;
+    std::optional<std::string> value = MemoryStorage::Get(key);
+    if (after_read) {
+      std::function<void()> hook = std::move(after_read);
+      after_read = nullptr;
+      hook();
+    }
+    return value;
+  }
+  bool Visit(std::string_view key, const ValueVisitor &visitor) override {
+    reads++;
+    return MemoryStorage::Visit(key, visitor);
+  }
+  void MultiGet(const KeyList &keys,
+                std::vector<std::optional<std::string>> *values) override {
+    reads += keys.size();
+    MemoryStorage::MultiGet(keys, values);
+  }
+
+  std::atomic<size_t> reads{0};
+  std::function<void()> after_read;
+};
+
+struct Setup {
+  CachePolicy policy;
+  bool write_through;
+};
+
+std::string Name(const ::testing::TestParamInfo<Setup> &info) {
+  static const char *kPolicies[] = {"LRU", "Clock", "TinyLFU"};
+  return std::string(kPolicies[static_cast<int>(info.param.policy)]) +
+         (info.param.write_through ? "WriteThrough" : "Invalidate");
+}
+
+class CachedStorageTest : public ::testing::TestWithParam<Setup> {
+protected:
+  void SetUp() override {
+    auto engine = std::make_unique<CountingStorage>();
+    engine_ = engine.get();
+    CacheOptions options;
+    options.entries = 1000;
+    options.policy = GetParam().policy;
+    options.write_through = GetParam().write_through;
+    storage_ = std::make_unique<CachedStorageEngine>(std::move(engine),
+                                                     options);
+  }
+
+  // Runs a `PutAsync` and waits for its callback.
+  bool PutAndWait(std::string_view key, std::string_view value,
+                  uint64_t ttl_ms = 0) {
+    auto result = std::make_shared<std::promise<bool>>();
+    auto done = result->get_future();
+    storage_->PutAsync(key, value, ttl_ms, Durability::kDefault,
+                       [result](bool success) { result->set_value(success); });
+    return done.get();
+  }
+
+  CountingStorage *engine_;
+  std::unique_ptr<CachedStorageEngine> storage_;
+};
+
+} // namespace
+
+TEST_P(CachedStorageTest, ReadThrough) {
+  EXPECT_TRUE(storage_->Put("key", "value"));
+  engine_->reads = 0;
+
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(storage_->Get("key"), "value");
+  }
+  std::string visited;
+  EXPECT_TRUE(storage_->Visit(
+      "key", [&visited](std::string_view value) { visited = value; }));
+  EXPECT_EQ(visited, "value");
+  // at most the first read went to the engine
+  EXPECT_LE(engine_->reads.load(), 1);
+
+  EXPECT_FALSE(storage_->Get("missing").has_value());
+  EXPECT_FALSE(storage_->Visit("missing", [](std::string_view) {
+    ADD_FAILURE();
+  }));
+
+  CacheStats stats = storage_->Stats();
+  EXPECT_EQ(stats.hits + stats.misses, 13);
+  EXPECT_GE(stats.hits, 10);
+}
+
+TEST_P(CachedStorageTest, WritesAreSeen) {
+  EXPECT_TRUE(storage_->Put("key", "v1"));
+  EXPECT_EQ(storage_->Get("key"), "v1");
+  EXPECT_TRUE(storage_->Put("key", "v2"));
+  EXPECT_EQ(storage_->Get("key"), "v2");
+  EXPECT_TRUE(PutAndWait("key", "v3"));
+  EXPECT_EQ(storage_->Get("key"), "v3");
+
+  EXPECT_TRUE(storage_->Delete("key"));
+  EXPECT_FALSE(storage_->Get("key").has_value());
+  EXPECT_FALSE(storage_->Delete("key"));
+
+  int64_t sum = 0;
+  EXPECT_EQ(storage_->IncrementBy("counter", 5, &sum), UpdateStatus::kOk);
+  EXPECT_EQ(storage_->Get("counter"), "5");
+  EXPECT_EQ(storage_->IncrementBy("counter", 2, &sum), UpdateStatus::kOk);
+  EXPECT_EQ(storage_->Get("counter"), "7");
+  EXPECT_EQ(storage_->CompareAndSet("counter", "6", "x"),
+            UpdateStatus::kMismatch);
+  EXPECT_EQ(storage_->Get("counter"), "7");
+
+  EXPECT_TRUE(storage_->MultiPut({{"a", "1"}, {"b", "2"}}));
+  KeyList keys = {"a", "missing", "b", "counter"};
+  std::vector<std::optional<std::string>> values;
+  storage_->MultiGet(keys, &values);
+  ASSERT_EQ(values.size(), keys.size());
+  EXPECT_EQ(values[0], "1");
+  EXPECT_FALSE(values[1].has_value());
+  EXPECT_EQ(values[2], "2");
+  EXPECT_EQ(values[3], "7");
+
+  auto result = std::make_shared<std::promise<bool>>();
+  auto done = result->get_future();
+  storage_->MultiPutAsync(
+      {{"a", "3"}}, Durability::kDefault,
+      [result](bool success) { result->set_value(success); });
+  EXPECT_TRUE(done.get());
+  EXPECT_EQ(storage_->Get("a"), "3");
+
+  EXPECT_TRUE(storage_->MultiDelete({"a", "b"}));
+  EXPECT_FALSE(storage_->Get("a").has_value());
+  EXPECT_FALSE(storage_->Get("b").has_value());
+
+  ScanBatch batch;
+  storage_->Scan("", "", 0, &batch);
+  ASSERT_EQ(batch.size(), 1);
+  EXPECT_EQ(batch[0].first, "counter");
+}
+
+TEST_P(CachedStorageTest, WriteMode) {
+  EXPECT_TRUE(storage_->Put("key", "value"));
+  engine_->reads = 0;
+  EXPECT_EQ(storage_->Get("key"), "value");
+  // written through, the put already cached the value
+  EXPECT_EQ(engine_->reads.load(), GetParam().write_through ? 0 : 1);
+}
+
+TEST_P(CachedStorageTest, RefusesTtl) {
+  EXPECT_FALSE(storage_->PutWithTtl("key", "value", 1000));
+  EXPECT_FALSE(PutAndWait("key", "value", 1000));
+  EXPECT_FALSE(storage_->Get("key").has_value());
+  EXPECT_TRUE(storage_->PutWithTtl("key", "value", 0));
+  EXPECT_EQ(storage_->Get("key"), "value");
+}
+
+TEST_P(CachedStorageTest, FillLosesToOvertakingWrite) {
+  // straight into the engine, so the cache has nothing yet
+  EXPECT_TRUE(engine_->MemoryStorage::Put("key", "old"));
+
+  engine_->after_read = [this]() { EXPECT_TRUE(storage_->Put("key", "new")); };
+  EXPECT_EQ(storage_->Get("key"), "old");
+  EXPECT_EQ(storage_->Get("key"), "new");
+
+  EXPECT_TRUE(engine_->MemoryStorage::Put("other", "old"));
+  engine_->after_read = [this]() { EXPECT_TRUE(storage_->Delete("other")); };
+  EXPECT_EQ(storage_->Get("other"), "old");
+  EXPECT_FALSE(storage_->Get("other").has_value());
+}
+
+// Readers filling the cache race writers of the same keys; once they stop,
+// the cache must agree with the engine on every key.
+TEST_P(CachedStorageTest, ConcurrentFillsNeverGoStale) {
+  const int key_count = 8, writes_per_thread = 2000;
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 2; ++t) {
+    threads.emplace_back([this, &stop]() {
+      while (!stop) {
+        for (int key = 0; key < key_count; ++key) {
+          storage_->Get("key" + std::to_string(key));
+        }
+      }
+    });
+  }
+  std::vector<std::thread> writers;
+  for (int t = 0; t < 2; ++t) {
+    writers.emplace_back([this, t]() {
+      for (int i = 0; i < writes_per_thread; ++i) {
+        std::string key = "key" + std::to_string(i % key_count);
+        std::string value = std::to_string(t) + "_" + std::to_string(i);
+        if (i % 3 == 0) {
+          ASSERT_TRUE(PutAndWait(key, value));
+        } else {
+          ASSERT_TRUE(storage_->Put(key, value));
+        }
+      }
+    });
+  }
+  for (auto &writer : writers) {
+    writer.join();
+  }
+  stop = true;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  for (int key = 0; key < key_count; ++key) {
+    std::string name = "key" + std::to_string(key);
+    EXPECT_EQ(storage_->Get(name), engine_->MemoryStorage::Get(name)) << name;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Policies, CachedStorageTest,
+    ::testing::Values(Setup{CachePolicy::kLRU, false},
+                      Setup{CachePolicy::kLRU, true},
+                      Setup{CachePolicy::kClock, false},
+                      Setup{CachePolicy::kClock, true},
+                      Setup{CachePolicy::kTinyLFU, false},
+                      Setup{CachePolicy::kTinyLFU, true}),
+    Name);
+
+TEST(CachePolicyTest, Parse) {
+  CachePolicy policy = CachePolicy::kLRU;
+  EXPECT_TRUE(ParseCachePolicy("tinylfu", &policy));
+  EXPECT_EQ(policy, CachePolicy::kTinyLFU);
+  EXPECT_TRUE(ParseCachePolicy("clock", &policy));
+  EXPECT_EQ(policy, CachePolicy::kClock);
+  EXPECT_TRUE(ParseCachePolicy("lru", &policy));
+  EXPECT_EQ(policy, CachePolicy::kLRU);
+  EXPECT_FALSE(ParseCachePolicy("arc", &policy));
+  EXPECT_EQ(policy, CachePolicy::kLRU);
+}
+
+TEST(StorageEngineFactory, CreateCachedEngines) {
+  StorageOptions options;
+  options.cache.entries = 100;
+  options.cache.policy = CachePolicy::kTinyLFU;
+
+  EXPECT_EQ(dynamic_cast<CachedStorageEngine *>(
+                CreateStorageEngine("memory", "", options).get()),
+            nullptr);
+
+  const std::string path = "test_cached.db";
+  for (const std::string type : {"file", "lsm"}) {
+    std::filesystem::remove_all(path);
+    std::filesystem::remove(path + ".wal");
+    {
+      auto storage = CreateStorageEngine(type, path, options);
+      auto *cached = dynamic_cast<CachedStorageEngine *>(storage.get());
+      ASSERT_NE(cached, nullptr) << type;
+      EXPECT_NE(cached->wrapped(), nullptr) << type;
+
+      EXPECT_TRUE(storage->Put("key", "value")) << type;
+      EXPECT_EQ(storage->Get("key"), "value") << type;
+      EXPECT_EQ(storage->Get("key"), "value") << type;
+      EXPECT_EQ(cached->Stats().hits, 1) << type;
+    }
+    {
+      // the engine underneath has it all
+      auto storage = CreateStorageEngine(type, path);
+      EXPECT_EQ(storage->Get("key"), "value") << type;
+    }
+  }
+  std::filesystem::remove_all(path);
+  std::filesystem::remove(path + ".wal");
+}
+
+} // namespace tiny_kv
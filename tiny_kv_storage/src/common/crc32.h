@@ -0,0 +1,49 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace tiny_kv {
+
+/************************************************************************/
+/* Crc32 */
+/************************************************************************/
+namespace crc32_internal {
+
+// CRC-32C (Castagnoli) lookup table, reflected polynomial 0x82F63B78.
+inline constexpr std::array<uint32_t, 256> MakeTable() {
+  std::array<uint32_t, 256> table{};
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t crc = i;
+    for (int j = 0; j < 8; ++j) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78u : (crc >> 1);
+    }
+    table[i] = crc;
+  }
+  return table;
+}
+
+inline constexpr std::array<uint32_t, 256> kTable = MakeTable();
+
+} // namespace crc32_internal
+
+// Extends `crc` with `size` bytes from `data`. Start with `crc = 0`.
+inline uint32_t Crc32Extend(uint32_t crc, const void *data, size_t size) {
+  const auto *p = static_cast<const unsigned char *>(data);
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) {
+    crc = crc32_internal::kTable[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+inline uint32_t Crc32(const void *data, size_t size) {
+  return Crc32Extend(0, data, size);
+}
+
+} // namespace tiny_kv
@@ -0,0 +1,370 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "entry_table.h"
+#include <algorithm>
+#include <cstring>
+
+namespace tiny_kv {
+
+/************************************************************************/
+/* SlabAllocator */
+/************************************************************************/
+size_t SlabAllocator::ClassIndex(size_t size) {
+  if (size <= kMinClassSize) {
+    return 0;
+  }
+  // 2^p < size <= 2^(p+1) is split into four classes 2^p / 4 apart
+  int p = 63 - __builtin_clzll(size - 1);
+  size_t base = size_t(1) << p;
+  size_t step = (size - base + base / 4 - 1) / (base / 4);
+  return (p - 4) * 4 + step;
+}
+
+size_t SlabAllocator::ClassSize(size_t size) {
+  if (size > kMaxClassSize) {
+    return size;
+  }
+  size_t index = ClassIndex(size);
+  if (index == 0) {
+    return kMinClassSize;
+  }
+  size_t base = kMinClassSize << ((index - 1) / 4);
+  return base + ((index - 1) % 4 + 1) * (base / 4);
+}
+
+char *SlabAllocator::Allocate(size_t size) {
+  if (size > kMaxClassSize) {
+    large_bytes_ += size;
+    return new char[size];
+  }
+
+  size_t index = ClassIndex(size);
+  char *block = free_lists_[index];
+  if (block != nullptr) {
+    // a free block holds the next free block of its class
+    memcpy(&free_lists_[index], block, sizeof(char *));
+    return block;
+  }
+
+  size_t class_size = ClassSize(size);
+  if (page_left_ < class_size) {
+    // pages double with the total so small tables stay small; the tail of
+    // the previous page (less than one block) is left unused
+    size_t page_size =
+        std::min(std::max(page_bytes_, kMinPageSize), kMaxPageSize);
+    pages_.emplace_back(new char[page_size]);
+    page_cursor_ = pages_.back().get();
+    page_left_ = page_size;
+    page_bytes_ += page_size;
+  }
+
+  block = page_cursor_;
+  page_cursor_ += class_size;
+  page_left_ -= class_size;
+  return block;
+}
+
+void SlabAllocator::Free(char *block, size_t size) {
+  if (size > kMaxClassSize) {
+    large_bytes_ -= size;
+    delete[] block;
+    return;
+  }
+
+  size_t index = ClassIndex(size);
+  memcpy(block, &free_lists_[index], sizeof(char *));
+  free_lists_[index] = block;
+}
+
+/************************************************************************/
+/* EntryTable */
+/************************************************************************/
+uint64_t EntryTable::Entry::Deadline() const {
+  if (!HasDeadline()) {
+    return 0;
+  }
+  // blocks are not aligned past the value
+  uint64_t deadline;
+  memcpy(&deadline, block + KeyBytes() + ValueSize(), sizeof(deadline));
+  return deadline;
+}
+
+EntryTable::~EntryTable() {
+  for (size_t i = 0; i < capacity_; ++i) {
+    if (!(ctrl_[i] & kEmpty) && slots_[i].block != nullptr) {
+      slab_.Free(slots_[i].block, slots_[i].BlockSize());
+    }
+  }
+}
+
+size_t EntryTable::FindSlot(std::string_view key, size_t hash) const {
+  if (capacity_ == 0) {
+    return capacity_;
+  }
+
+  // the load factor (tombstones included) stays below 7/8, so an empty
+  // slot always ends the probe
+  const uint8_t control = ControlByte(hash);
+  const size_t mask = capacity_ - 1;
+  for (size_t pos = HomeSlot(hash);; pos = (pos + 1) & mask) {
+    if (ctrl_[pos] == kEmpty) {
+      return capacity_;
+    }
+    if (ctrl_[pos] == control && slots_[pos].Key() == key) {
+      return pos;
+    }
+  }
+}
+
+bool EntryTable::Find(std::string_view key, size_t hash,
+                      std::string_view *value, uint64_t *deadline,
+                      uint32_t clock) const {
+  size_t pos = FindSlot(key, hash);
+  if (pos == capacity_) {
+    return false;
+  }
+
+  *value = slots_[pos].Value();
+  if (deadline != nullptr) {
+    *deadline = slots_[pos].Deadline();
+  }
+  // the clock is coarse, so most reads find it current and leave the cache
+  // line clean
+  if (clock != 0 && clocks_[pos].load(std::memory_order_relaxed) != clock) {
+    clocks_[pos].store(clock, std::memory_order_relaxed);
+  }
+  return true;
+}
+
+size_t EntryTable::BlockCharge(size_t block_size) {
+  return sizeof(Entry) + 1 + sizeof(uint32_t) +
+         (block_size > 0 ? SlabAllocator::ClassSize(block_size) : 0);
+}
+
+size_t EntryTable::EntryCharge(size_t key_size, size_t value_size,
+                               bool has_deadline) {
+  return BlockCharge((key_size > kInlineKeySize ? key_size : 0) + value_size +
+                     (has_deadline ? sizeof(uint64_t) : 0));
+}
+
+void EntryTable::SetValue(Entry *entry, std::string_view key,
+                          std::string_view value, uint64_t deadline) {
+  const size_t key_bytes = entry->KeyBytes();
+  const size_t old_size = entry->block != nullptr ? entry->BlockSize() : 0;
+  const size_t new_size =
+      key_bytes + value.size() + (deadline != 0 ? sizeof(deadline) : 0);
+
+  entry_bytes_ += BlockCharge(new_size) - BlockCharge(old_size);
+  if (entry->block == nullptr ||
+      SlabAllocator::ClassSize(old_size) !=
+          SlabAllocator::ClassSize(new_size)) {
+    char *block = new_size > 0 ? slab_.Allocate(new_size) : nullptr;
+    if (key_bytes > 0) {
+      memcpy(block, key.data(), key_bytes);
+    }
+    if (entry->block != nullptr) {
+      slab_.Free(entry->block, old_size);
+    }
+    entry->block = block;
+  }
+
+  if (!value.empty()) {
+    memcpy(entry->block + key_bytes, value.data(), value.size());
+  }
+  entry->value_size = static_cast<uint32_t>(value.size());
+  if (deadline != 0) {
+    memcpy(entry->block + key_bytes + value.size(), &deadline,
+           sizeof(deadline));
+    entry->value_size |= kHasDeadline;
+  }
+}
+
+bool EntryTable::Put(std::string_view key, std::string_view value,
+                     size_t hash, uint64_t deadline, uint32_t clock) {
+  size_t pos = FindSlot(key, hash);
+  if (pos != capacity_) {
+    SetValue(&slots_[pos], key, value, deadline);
+    clocks_[pos].store(clock, std::memory_order_relaxed);
+    return false;
+  }
+
+  if ((size_ + deleted_ + 1) * 8 > capacity_ * 7) {
+    // mostly tombstones: clean up in place instead of growing
+    bool grow = (size_ + 1) * 16 > capacity_ * 7;
+    Rehash(grow ? std::max<size_t>(capacity_ * 2, 16) : capacity_);
+  }
+
+  const size_t mask = capacity_ - 1;
+  pos = HomeSlot(hash);
+  while (!(ctrl_[pos] & kEmpty)) {
+    pos = (pos + 1) & mask;
+  }
+  if (ctrl_[pos] == kDeleted) {
+    --deleted_;
+  }
+  ctrl_[pos] = ControlByte(hash);
+  clocks_[pos].store(clock, std::memory_order_relaxed);
+
+  Entry &entry = slots_[pos];
+  entry.key_size = static_cast<uint32_t>(key.size());
+  entry.value_size = 0;
+  entry.block = nullptr;
+  if (entry.KeyInline()) {
+    memcpy(entry.inline_key, key.data(), key.size());
+  }
+  entry_bytes_ += BlockCharge(0);
+  SetValue(&entry, key, value, deadline);
+  ++size_;
+  return true;
+}
+
+bool EntryTable::Erase(std::string_view key, size_t hash) {
+  size_t pos = FindSlot(key, hash);
+  if (pos == capacity_) {
+    return false;
+  }
+
+  Entry &entry = slots_[pos];
+  if (entry.block != nullptr) {
+    entry_bytes_ -= BlockCharge(entry.BlockSize());
+    slab_.Free(entry.block, entry.BlockSize());
+  } else {
+    entry_bytes_ -= BlockCharge(0);
+  }
+  --size_;
+
+  // no probe runs past an empty slot, so a slot followed by one can be
+  // emptied instead of leaving a tombstone
+  if (ctrl_[(pos + 1) & (capacity_ - 1)] == kEmpty) {
+    ctrl_[pos] = kEmpty;
+  } else {
+    ctrl_[pos] = kDeleted;
+    ++deleted_;
+  }
+  return true;
+}
+
+void EntryTable::Rehash(size_t capacity) {
+  std::unique_ptr<uint8_t[]> old_ctrl = std::move(ctrl_);
+  std::unique_ptr<Entry[]> old_slots = std::move(slots_);
+  std::unique_ptr<std::atomic<uint32_t>[]> old_clocks = std::move(clocks_);
+  const size_t old_capacity = capacity_;
+
+  ctrl_.reset(new uint8_t[capacity]);
+  memset(ctrl_.get(), kEmpty, capacity);
+  slots_.reset(new Entry[capacity]);
+  clocks_.reset(new std::atomic<uint32_t>[capacity]);
+  capacity_ = capacity;
+  shift_ = 64 - __builtin_ctzll(capacity);
+  deleted_ = 0;
+
+  const size_t mask = capacity_ - 1;
+  for (size_t i = 0; i < old_capacity; ++i) {
+    if (old_ctrl[i] & kEmpty) {
+      continue;
+    }
+    // blocks are owned through the slot, so moving the slot moves the entry
+    size_t hash = Hash(old_slots[i].Key());
+    size_t pos = HomeSlot(hash);
+    while (ctrl_[pos] != kEmpty) {
+      pos = (pos + 1) & mask;
+    }
+    ctrl_[pos] = ControlByte(hash);
+    slots_[pos] = old_slots[i];
+    clocks_[pos].store(old_clocks[i].load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+  }
+}
+
+void EntryTable::ForEach(const EntryVisitor &visitor, uint64_t now) const {
+  for (size_t i = 0; i < capacity_; ++i) {
+    if (!(ctrl_[i] & kEmpty) && !slots_[i].Expired(now)) {
+      visitor(slots_[i].Key(), slots_[i].Value());
+    }
+  }
+}
+
+bool EntryTable::Scan(uint64_t *position, size_t count,
+                      const EntryVisitor &visitor, uint64_t now) const {
+  if (capacity_ == 0) {
+    return true;
+  }
+
+  // `*position` is a hash prefix: entries whose home slot lies below it were
+  // visited. Growing the table only refines the slot grid, so a position
+  // taken at a smaller capacity still falls on a slot boundary.
+  const size_t start = *position >> shift_;
+  size_t visited = 0;
+  for (size_t pos = start; pos < capacity_; ++pos) {
+    if (ctrl_[pos] == kEmpty) {
+      // entries never sit past an empty slot following their home, so every
+      // entry homed in [start, pos) has been seen
+      if (visited >= count) {
+        *position = static_cast<uint64_t>(pos) << shift_;
+        return false;
+      }
+      continue;
+    }
+    if (ctrl_[pos] == kDeleted) {
+      continue;
+    }
+    const Entry &entry = slots_[pos];
+    size_t home = HomeSlot(Hash(entry.Key()));
+    if (home >= start && home <= pos && !entry.Expired(now)) {
+      visitor(entry.Key(), entry.Value());
+      ++visited;
+    }
+  }
+
+  // entries homed near the end whose probe wrapped to the front
+  for (size_t pos = 0; pos < capacity_ && ctrl_[pos] != kEmpty; ++pos) {
+    if (ctrl_[pos] == kDeleted) {
+      continue;
+    }
+    const Entry &entry = slots_[pos];
+    size_t home = HomeSlot(Hash(entry.Key()));
+    if (home >= start && home > pos && !entry.Expired(now)) {
+      visitor(entry.Key(), entry.Value());
+    }
+  }
+  return true;
+}
+
+bool EntryTable::SampleLeastRecent(size_t samples, uint64_t seed,
+                                   std::string_view *key) const {
+  if (size_ == 0) {
+    return false;
+  }
+
+  // each sample takes the first entry at or after a random slot
+  const size_t mask = capacity_ - 1;
+  size_t best = capacity_;
+  uint32_t best_clock = 0;
+  for (size_t i = 0; i < samples; ++i) {
+    // splitmix64 of the seed and sample number
+    uint64_t z = seed + (i + 1) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    size_t pos = (z ^ (z >> 31)) & mask;
+    while (ctrl_[pos] & kEmpty) {
+      pos = (pos + 1) & mask;
+    }
+    uint32_t clock = clocks_[pos].load(std::memory_order_relaxed);
+    if (best == capacity_ || clock < best_clock) {
+      best = pos;
+      best_clock = clock;
+    }
+  }
+
+  *key = slots_[best].Key();
+  return true;
+}
+
+size_t EntryTable::MemoryUsage() const {
+  return capacity_ * (sizeof(Entry) + 1 + sizeof(uint32_t)) +
+         slab_.MemoryUsage();
+}
+
+} // namespace tiny_kv
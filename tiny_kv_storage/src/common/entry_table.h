@@ -0,0 +1,191 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace tiny_kv {
+
+/************************************************************************/
+/* SlabAllocator */
+/************************************************************************/
+// Hands out blocks from large pages, rounded up to a size class (16, 20,
+// 24, 28, 32, 40, 48, ... 4096: four classes per power of two, so at most a
+// fifth of a block is slack). Freed blocks go on a per-class free list and
+// are reused; pages are only released by the destructor. Blocks above the
+// largest class come straight from the heap. Not thread-safe.
+class SlabAllocator {
+public:
+  static constexpr size_t kMinClassSize = 16;
+  static constexpr size_t kMaxClassSize = 4096;
+
+  SlabAllocator() = default;
+
+  SlabAllocator(const SlabAllocator &) = delete;
+  SlabAllocator &operator=(const SlabAllocator &) = delete;
+
+  char *Allocate(size_t size);
+  // `size` must be the size the block was allocated with.
+  void Free(char *block, size_t size);
+
+  // Bytes taken from the heap: every page plus the oversized blocks.
+  size_t MemoryUsage() const { return page_bytes_ + large_bytes_; }
+
+  // Number of bytes actually reserved for a `size` byte block.
+  static size_t ClassSize(size_t size);
+
+private:
+  static constexpr size_t kNumClasses = 33;
+  static constexpr size_t kMinPageSize = 16 << 10;
+  static constexpr size_t kMaxPageSize = 1 << 20;
+
+  static size_t ClassIndex(size_t size);
+
+private:
+  std::vector<std::unique_ptr<char[]>> pages_;
+  char *page_cursor_ = nullptr;
+  size_t page_left_ = 0;
+  size_t page_bytes_ = 0;
+  size_t large_bytes_ = 0;
+  char *free_lists_[kNumClasses] = {};
+};
+
+/************************************************************************/
+/* EntryTable */
+/************************************************************************/
+// Open-addressing string map that keeps an entry in a 32 byte slot plus at
+// most one slab block:
+//   slot  = [key_size u32][value_size u32][block ptr][inline key 16 bytes]
+//   block = [key, only if longer than 16 bytes][value][deadline u64, if any]
+// so a short key with a small value costs one slot and one small block
+// instead of two heap strings. A parallel array of control bytes holds 7
+// bits of each slot's hash, letting a probe skip most key compares, and
+// another holds each entry's last access clock for approximate LRU.
+//
+// Every call takes `hash = EntryTable::Hash(key)`; callers that shard on the
+// low 16 bits of the hash can reuse it. The home slot of an entry is taken
+// from the top of the hash (below the 7 control bits), so growing the table
+// keeps entries in home-slot order and a `Scan` position stays meaningful.
+// Value views stay valid until the entry is next written or erased.
+//
+// An entry may carry a deadline: an opaque nonzero number the owner compares
+// against its own clock (0 means none). The table never drops an entry by
+// itself; scans can skip entries whose deadline has passed.
+// Not thread-safe, except that concurrent const calls (including `Find`
+// recording an access) are.
+class EntryTable {
+public:
+  using EntryVisitor =
+      std::function<void(std::string_view key, std::string_view value)>;
+
+  EntryTable() = default;
+  ~EntryTable();
+
+  EntryTable(const EntryTable &) = delete;
+  EntryTable &operator=(const EntryTable &) = delete;
+
+  static size_t Hash(std::string_view key) {
+    return std::hash<std::string_view>{}(key);
+  }
+
+  // `deadline`, if given, is set to the entry's deadline or 0. A nonzero
+  // `clock` is recorded as the entry's last access.
+  bool Find(std::string_view key, size_t hash, std::string_view *value,
+            uint64_t *deadline = nullptr, uint32_t clock = 0) const;
+  // Returns true if `key` was added rather than overwritten. The entry's
+  // deadline is replaced too, so a plain overwrite clears it; `clock` is
+  // its access clock.
+  bool Put(std::string_view key, std::string_view value, size_t hash,
+           uint64_t deadline = 0, uint32_t clock = 0);
+  bool Erase(std::string_view key, size_t hash);
+  // Both walks skip entries whose deadline is at or before a nonzero `now`.
+  void ForEach(const EntryVisitor &visitor, uint64_t now = 0) const;
+  // Visits at least `count` entries (fewer at the end) after `*position`,
+  // which starts at 0, and advances it. Returns true once the whole table
+  // was visited. Entries are visited in hash order, so a scan interleaved
+  // with writes returns each entry at most once and never misses one that
+  // stays present.
+  bool Scan(uint64_t *position, size_t count, const EntryVisitor &visitor,
+            uint64_t now = 0) const;
+
+  // Approximate LRU: looks at the entries in `samples` slots picked by
+  // `seed` and sets `*key` to the one with the oldest access clock. Returns
+  // false if the table is empty.
+  bool SampleLeastRecent(size_t samples, uint64_t seed,
+                         std::string_view *key) const;
+
+  size_t Size() const { return size_; }
+  // Bytes held by the slots, control bytes and slab pages.
+  size_t MemoryUsage() const;
+  // Bytes charged to the live entries, `EntryCharge` each. Unlike
+  // `MemoryUsage` this drops as entries go, though the slab keeps pages.
+  size_t EntryBytes() const { return entry_bytes_; }
+  // An entry's slot with its control byte and clock plus the size class of
+  // its block.
+  static size_t EntryCharge(size_t key_size, size_t value_size,
+                            bool has_deadline);
+
+private:
+  static constexpr uint32_t kInlineKeySize = 16;
+  static constexpr uint8_t kEmpty = 0x80;
+  static constexpr uint8_t kDeleted = 0xFE;
+  // set in `Entry::value_size` when the block ends with a deadline
+  static constexpr uint32_t kHasDeadline = 1u << 31;
+
+  struct Entry {
+    uint32_t key_size;
+    uint32_t value_size; // | kHasDeadline
+    char *block;
+    char inline_key[kInlineKeySize];
+
+    bool KeyInline() const { return key_size <= kInlineKeySize; }
+    size_t KeyBytes() const { return KeyInline() ? 0 : key_size; }
+    size_t ValueSize() const { return value_size & ~kHasDeadline; }
+    bool HasDeadline() const { return value_size & kHasDeadline; }
+    size_t BlockSize() const {
+      return KeyBytes() + ValueSize() + (HasDeadline() ? sizeof(uint64_t) : 0);
+    }
+    std::string_view Key() const {
+      return {KeyInline() ? inline_key : block, key_size};
+    }
+    std::string_view Value() const { return {block + KeyBytes(), ValueSize()}; }
+    uint64_t Deadline() const;
+    bool Expired(uint64_t now) const {
+      return now != 0 && HasDeadline() && Deadline() <= now;
+    }
+  };
+
+  static uint8_t ControlByte(size_t hash) {
+    return static_cast<uint8_t>(hash >> 57);
+  }
+  size_t HomeSlot(size_t hash) const { return (hash << 7) >> shift_; }
+  static size_t BlockCharge(size_t block_size);
+  size_t FindSlot(std::string_view key, size_t hash) const;
+  // Stores `value` and `deadline` in `entry`, reusing its block when the
+  // size class fits.
+  void SetValue(Entry *entry, std::string_view key, std::string_view value,
+                uint64_t deadline);
+  void Rehash(size_t capacity);
+
+private:
+  std::unique_ptr<uint8_t[]> ctrl_;
+  std::unique_ptr<Entry[]> slots_;
+  // last access per slot; relaxed atomics, since readers write them
+  std::unique_ptr<std::atomic<uint32_t>[]> clocks_;
+  size_t capacity_ = 0; // 0 or a power of two
+  int shift_ = 64;       // 64 - log2(capacity_)
+  size_t size_ = 0;
+  size_t deleted_ = 0;
+  size_t entry_bytes_ = 0;
+  SlabAllocator slab_;
+};
+
+} // namespace tiny_kv
@@ -0,0 +1,246 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "entry_table.h"
+#include <gtest/gtest.h>
+#include <map>
+#include <set>
+#include <string>
+
+namespace tiny_kv {
+
+TEST(SlabAllocatorTest, SizeClasses) {
+  EXPECT_EQ(SlabAllocator::ClassSize(1), 16u);
+  EXPECT_EQ(SlabAllocator::ClassSize(16), 16u);
+  EXPECT_EQ(SlabAllocator::ClassSize(17), 20u);
+  EXPECT_EQ(SlabAllocator::ClassSize(25), 28u);
+  EXPECT_EQ(SlabAllocator::ClassSize(33), 40u);
+  EXPECT_EQ(SlabAllocator::ClassSize(288), 320u);
+  EXPECT_EQ(SlabAllocator::ClassSize(4000), 4096u);
+  EXPECT_EQ(SlabAllocator::ClassSize(5000), 5000u);
+  for (size_t size = 1; size <= SlabAllocator::kMaxClassSize; ++size) {
+    size_t class_size = SlabAllocator::ClassSize(size);
+    ASSERT_GE(class_size, size);
+    ASSERT_LE(class_size, size + size / 4 + SlabAllocator::kMinClassSize);
+  }
+}
+
+TEST(SlabAllocatorTest, FreedBlocksAreReused) {
+  SlabAllocator slab;
+  char *a = slab.Allocate(30);
+  char *b = slab.Allocate(30);
+  EXPECT_NE(a, b);
+  size_t usage = slab.MemoryUsage();
+
+  slab.Free(a, 30);
+  // same class (32 bytes), so the freed block comes back
+  EXPECT_EQ(slab.Allocate(29), a);
+  EXPECT_EQ(slab.MemoryUsage(), usage);
+
+  char *large = slab.Allocate(10000);
+  EXPECT_EQ(slab.MemoryUsage(), usage + 10000);
+  slab.Free(large, 10000);
+  EXPECT_EQ(slab.MemoryUsage(), usage);
+}
+
+TEST(EntryTableTest, PutFindErase) {
+  EntryTable table;
+  const std::string short_key = "short";
+  const std::string long_key(40, 'k');
+
+  EXPECT_TRUE(table.Put(short_key, "v1", EntryTable::Hash(short_key)));
+  EXPECT_TRUE(table.Put(long_key, "v2", EntryTable::Hash(long_key)));
+  table.Put("", "empty key", EntryTable::Hash(""));
+  table.Put("no_value", "", EntryTable::Hash("no_value"));
+  EXPECT_EQ(table.Size(), 4u);
+
+  std::string_view value;
+  ASSERT_TRUE(table.Find(short_key, EntryTable::Hash(short_key), &value));
+  EXPECT_EQ(value, "v1");
+  ASSERT_TRUE(table.Find(long_key, EntryTable::Hash(long_key), &value));
+  EXPECT_EQ(value, "v2");
+  ASSERT_TRUE(table.Find("", EntryTable::Hash(""), &value));
+  EXPECT_EQ(value, "empty key");
+  ASSERT_TRUE(table.Find("no_value", EntryTable::Hash("no_value"), &value));
+  EXPECT_EQ(value, "");
+  EXPECT_FALSE(table.Find("missing", EntryTable::Hash("missing"), &value));
+
+  // grow into a larger size class, then shrink back to nothing
+  const std::string big(5000, 'b');
+  EXPECT_FALSE(table.Put(long_key, big, EntryTable::Hash(long_key)));
+  ASSERT_TRUE(table.Find(long_key, EntryTable::Hash(long_key), &value));
+  EXPECT_EQ(value, big);
+  table.Put(long_key, "", EntryTable::Hash(long_key));
+  ASSERT_TRUE(table.Find(long_key, EntryTable::Hash(long_key), &value));
+  EXPECT_EQ(value, "");
+  EXPECT_EQ(table.Size(), 4u);
+
+  EXPECT_TRUE(table.Erase(short_key, EntryTable::Hash(short_key)));
+  EXPECT_FALSE(table.Erase(short_key, EntryTable::Hash(short_key)));
+  EXPECT_FALSE(table.Find(short_key, EntryTable::Hash(short_key), &value));
+  EXPECT_EQ(table.Size(), 3u);
+}
+
+TEST(EntryTableTest, MatchesReferenceMap) {
+  EntryTable table;
+  std::map<std::string, std::string> reference;
+
+  // enough churn to grow the table several times and recycle tombstones
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 5000; ++i) {
+      std::string key = "key" + std::to_string(i);
+      if (i % 3 == 0) {
+        key += std::string(20, 'x'); // stored in the block
+      }
+      std::string value((i * 7 + round) % 300,
+                        static_cast<char>('a' + i % 26));
+      table.Put(key, value, EntryTable::Hash(key));
+      reference[key] = value;
+    }
+    for (int i = round; i < 5000; i += 2) {
+      std::string key = "key" + std::to_string(i);
+      if (i % 3 == 0) {
+        key += std::string(20, 'x');
+      }
+      EXPECT_EQ(table.Erase(key, EntryTable::Hash(key)),
+                reference.erase(key) > 0);
+    }
+  }
+
+  EXPECT_EQ(table.Size(), reference.size());
+  size_t visited = 0;
+  table.ForEach([&](std::string_view key, std::string_view value) {
+    auto it = reference.find(std::string(key));
+    ASSERT_NE(it, reference.end());
+    EXPECT_EQ(value, it->second);
+    ++visited;
+  });
+  EXPECT_EQ(visited, reference.size());
+  EXPECT_GT(table.MemoryUsage(), 0u);
+}
+
+TEST(EntryTableTest, ScanSurvivesGrowth) {
+  EntryTable table;
+  for (int i = 0; i < 100; ++i) {
+    std::string key = "stable" + std::to_string(i);
+    table.Put(key, "v", EntryTable::Hash(key));
+  }
+
+  std::set<std::string> seen;
+  uint64_t position = 0;
+  bool done = false;
+  for (int round = 0; !done; ++round) {
+    done = table.Scan(&position, 3,
+                      [&](std::string_view key, std::string_view) {
+                        EXPECT_TRUE(seen.insert(std::string(key)).second)
+                            << key << " visited twice";
+                      });
+    // the table doubles several times during the scan
+    for (int i = 0; i < 50; ++i) {
+      std::string key = "added" + std::to_string(round * 50 + i);
+      table.Put(key, "v", EntryTable::Hash(key));
+    }
+    std::string erased = "added" + std::to_string(round * 50);
+    table.Erase(erased, EntryTable::Hash(erased));
+  }
+
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(seen.count("stable" + std::to_string(i)), 1u) << i;
+  }
+}
+
+TEST(EntryTableTest, Deadlines) {
+  EntryTable table;
+  const std::string short_key = "short";
+  const std::string long_key(40, 'k');
+  table.Put(short_key, "v1", EntryTable::Hash(short_key), 100);
+  table.Put(long_key, "v2", EntryTable::Hash(long_key), 200);
+  table.Put("plain", "v3", EntryTable::Hash("plain"));
+  table.Put("empty", "", EntryTable::Hash("empty"), 300);
+
+  std::string_view value;
+  uint64_t deadline = 0;
+  ASSERT_TRUE(
+      table.Find(long_key, EntryTable::Hash(long_key), &value, &deadline));
+  EXPECT_EQ(value, "v2");
+  EXPECT_EQ(deadline, 200u);
+  ASSERT_TRUE(table.Find("empty", EntryTable::Hash("empty"), &value,
+                         &deadline));
+  EXPECT_EQ(value, "");
+  EXPECT_EQ(deadline, 300u);
+  ASSERT_TRUE(table.Find("plain", EntryTable::Hash("plain"), &value,
+                         &deadline));
+  EXPECT_EQ(deadline, 0u);
+
+  // walks skip what has expired by `now`
+  auto visible = [&table](uint64_t now) {
+    std::set<std::string> keys;
+    table.ForEach(
+        [&keys](std::string_view key, std::string_view) {
+          keys.emplace(key);
+        },
+        now);
+    uint64_t position = 0;
+    size_t scanned = 0;
+    table.Scan(&position, 100,
+               [&scanned](std::string_view, std::string_view) { ++scanned; },
+               now);
+    EXPECT_EQ(scanned, keys.size());
+    return keys;
+  };
+  EXPECT_EQ(visible(0).size(), 4u);
+  EXPECT_EQ(visible(150),
+            (std::set<std::string>{long_key, "empty", "plain"}));
+  EXPECT_EQ(visible(1000), (std::set<std::string>{"plain"}));
+
+  // a plain overwrite clears the deadline, a longer value keeps it intact
+  table.Put(short_key, "v1", EntryTable::Hash(short_key));
+  table.Put(long_key, std::string(100, 'x'), EntryTable::Hash(long_key),
+            250);
+  ASSERT_TRUE(table.Find(short_key, EntryTable::Hash(short_key), &value,
+                         &deadline));
+  EXPECT_EQ(deadline, 0u);
+  ASSERT_TRUE(
+      table.Find(long_key, EntryTable::Hash(long_key), &value, &deadline));
+  EXPECT_EQ(value, std::string(100, 'x'));
+  EXPECT_EQ(deadline, 250u);
+  EXPECT_TRUE(table.Erase(long_key, EntryTable::Hash(long_key)));
+}
+
+TEST(EntryTableTest, EntryBytesAndLeastRecent) {
+  EntryTable table;
+  EXPECT_EQ(table.EntryBytes(), 0u);
+  std::string_view key;
+  EXPECT_FALSE(table.SampleLeastRecent(5, 1, &key));
+
+  const std::string long_key(40, 'k');
+  table.Put("a", "", EntryTable::Hash("a"));
+  table.Put(long_key, "value", EntryTable::Hash(long_key), 7);
+  EXPECT_EQ(table.EntryBytes(), EntryTable::EntryCharge(1, 0, false) +
+                                    EntryTable::EntryCharge(40, 5, true));
+  table.Put("a", std::string(100, 'x'), EntryTable::Hash("a"));
+  EXPECT_EQ(table.EntryBytes(), EntryTable::EntryCharge(1, 100, false) +
+                                    EntryTable::EntryCharge(40, 5, true));
+  table.Erase(long_key, EntryTable::Hash(long_key));
+  table.Erase("a", EntryTable::Hash("a"));
+  EXPECT_EQ(table.EntryBytes(), 0u);
+
+  // clocks survive growth; reads refresh them
+  for (uint32_t i = 0; i < 1000; ++i) {
+    std::string k = "k" + std::to_string(i);
+    table.Put(k, "v", EntryTable::Hash(k), 0, 1000 + i);
+  }
+  std::string_view value;
+  ASSERT_TRUE(table.Find("k0", EntryTable::Hash("k0"), &value, nullptr, 5000));
+  size_t old_half = 0;
+  for (uint64_t seed = 0; seed < 200; ++seed) {
+    ASSERT_TRUE(table.SampleLeastRecent(5, seed, &key));
+    EXPECT_NE(key, "k0");
+    old_half += std::stoi(std::string(key.substr(1))) < 500;
+  }
+  // the oldest of five samples is in the older half with p = 31/32
+  EXPECT_GT(old_half, 170u);
+}
+
+} // namespace tiny_kv
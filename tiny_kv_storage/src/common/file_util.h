@@ -0,0 +1,23 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace tiny_kv {
+
+// Thin POSIX helpers shared by the file-backed engines. All of them retry on
+// EINTR and short transfers, and return false on any other error.
+bool WriteFully(int fd, const char *data, size_t size);
+bool PreadFully(int fd, char *data, size_t size, uint64_t offset);
+
+// fsync()s the file at `path`.
+bool SyncFile(const std::string &path);
+// fsync()s the directory containing `path` so a rename/create is durable.
+bool SyncParentDir(const std::string &path);
+
+} // namespace tiny_kv
@@ -4,7 +4,9 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <utility>
 
@@ -17,6 +19,11 @@ enum OperationType {
   KMultiGet,
   KMultiPut,
   KMultiDelete,
+  KScan,
+  KCas,
+  KIncrBy,
+  KAppend,
+  KStats,
   Invalid,
 };
 
@@ -25,11 +32,22 @@ struct KeyValuePair {
   std::string value;
 };
 
+// Views into the request line, valid while the request is being handled.
+struct KeyValueView {
+  std::string_view key;
+  std::string_view value;
+};
+
 struct Request {
   OperationType op;
-  std::string key;
-  std::string value;
-  std::vector<KeyValuePair> kvs;  // for multi-key operations
+  std::string_view key;
+  std::string_view value;
+  std::vector<KeyValueView> kvs;  // for multi-key operations
+  size_t limit = 0;               // for scan, 0 = no limit
+  uint64_t ttl_ms = 0;            // for put, 0 = no expiry
+  std::string_view durability{};  // for put: "memory", "async" or "sync"
+  std::string_view expected{};    // for cas
+  int64_t delta = 0;              // for incrby
 };
 
 struct Response {
@@ -0,0 +1,1201 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "lsm_storage.h"
+#include "crc32.h"
+#include "file_util.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <queue>
+#include <unistd.h>
+
+namespace tiny_kv {
+
+namespace {
+
+constexpr size_t kEntryOverhead = 64; // rough std::map node cost
+
+template <typename T> void AppendFixed(std::string *dst, T value) {
+  dst->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename T> bool DecodeFixed(std::string_view *src, T *value) {
+  if (src->size() < sizeof(T)) {
+    return false;
+  }
+  memcpy(value, src->data(), sizeof(T));
+  src->remove_prefix(sizeof(T));
+  return true;
+}
+
+void AppendString(std::string *dst, const std::string &value) {
+  AppendFixed<uint32_t>(dst, static_cast<uint32_t>(value.size()));
+  dst->append(value);
+}
+
+bool DecodeString(std::string_view *src, std::string *value) {
+  uint32_t length = 0;
+  if (!DecodeFixed(src, &length) || src->size() < length) {
+    return false;
+  }
+  value->assign(src->data(), length);
+  src->remove_prefix(length);
+  return true;
+}
+
+bool Overlaps(const std::string &smallest, const std::string &largest,
+              const std::string &begin, const std::string &end) {
+  return !(largest < begin || end < smallest);
+}
+
+} // namespace
+
+/************************************************************************/
+/* LSMStorage */
+/************************************************************************/
+LSMStorage::TableFile::~TableFile() {
+  reader.reset();
+  if (obsolete) {
+    unlink(path.c_str());
+  }
+}
+
+LSMStorage::LSMStorage(const std::string &dir, const LSMOptions &options,
+                       const WalOptions &wal_options,
+                       const AsyncIoOptions &io_options)
+    : dir_(dir), options_(options), wal_options_(wal_options),
+      io_(CreateAsyncIo(io_options)),
+      mem_(std::make_shared<Memtable>()),
+      compact_pointer_(options.max_levels, 0) {
+  auto version = std::make_shared<Version>();
+  version->levels.resize(options_.max_levels);
+  version_ = version;
+
+  if (!Recover()) {
+    bg_error_ = true;
+  }
+  bg_thread_ = std::thread(&LSMStorage::BackgroundLoop, this);
+}
+
+LSMStorage::~LSMStorage() {
+  // memory-only writes are in no log, so their memtables must reach a table
+  bool unlogged = false;
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    unlogged = mem_->unlogged || (imm_ && imm_->unlogged);
+  }
+  if (unlogged) {
+    CompactAll();
+  }
+
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    shutting_down_ = true;
+  }
+  work_cv_.notify_all();
+  done_cv_.notify_all();
+  if (bg_thread_.joinable()) {
+    bg_thread_.join();
+  }
+  // otherwise the memtable stays in its log and is replayed on the next open
+}
+
+bool LSMStorage::Put(std::string_view key, std::string_view value) {
+  return Write({{key, value}});
+}
+
+bool LSMStorage::Delete(std::string_view key) { return EraseExisting({key}); }
+
+bool LSMStorage::MultiPut(const KVPairList &kvs) {
+  WriteBatch batch;
+  batch.reserve(kvs.size());
+  for (const auto & [ key, value ] : kvs) {
+    batch.emplace_back(key, value);
+  }
+  return Write(batch);
+}
+
+void LSMStorage::PutAsync(std::string_view key, std::string_view value,
+                          uint64_t ttl_ms, Durability durability,
+                          WriteCallback done) {
+  if (ttl_ms != 0) {
+    done(false);
+    return;
+  }
+  Write({{key, value}}, durability, std::move(done));
+}
+
+void LSMStorage::MultiPutAsync(const KVPairList &kvs, Durability durability,
+                               WriteCallback done) {
+  WriteBatch batch;
+  batch.reserve(kvs.size());
+  for (const auto & [ key, value ] : kvs) {
+    batch.emplace_back(key, value);
+  }
+  Write(batch, durability, std::move(done));
+}
+
+bool LSMStorage::MultiDelete(const KeyList &keys) {
+  return EraseExisting(keys);
+}
+
+// The lookups and the tombstones share one write lock, so a concurrent
+// write cannot land between them. As in `Update`, a key missing from the
+// memtable is looked up below it under that lock; the bloom filters spare
+// most absent keys the block read.
+bool LSMStorage::EraseExisting(const KeyList &keys) {
+  std::shared_ptr<WriteAheadLog> log;
+  uint64_t lsn = 0;
+  bool all_found = true;
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (!MakeRoomForWrite(lock)) {
+      return false;
+    }
+
+    WriteBatch batch;
+    for (std::string_view key : keys) {
+      auto it = mem_->entries.find(key);
+      bool found = it != mem_->entries.end()
+                       ? it->second.has_value()
+                       : GetFromImmutable(key, imm_.get(), *version_)
+                             .has_value();
+      if (found) {
+        batch.emplace_back(key, std::nullopt);
+      } else {
+        all_found = false;
+      }
+    }
+    if (batch.empty()) {
+      return all_found;
+    }
+    log = log_;
+    lsn = ApplyLocked(batch);
+  }
+
+  return log->Sync(lsn) && all_found;
+}
+
+// A batch goes into one memtable and shares one log sync, so a memtable may
+// overshoot `memtable_bytes` by up to one batch.
+bool LSMStorage::Write(const WriteBatch &batch) {
+  if (batch.empty()) {
+    return true;
+  }
+
+  std::shared_ptr<WriteAheadLog> log;
+  uint64_t lsn = 0;
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (!MakeRoomForWrite(lock)) {
+      return false;
+    }
+    log = log_;
+    lsn = ApplyLocked(batch);
+  }
+
+  return log->Sync(lsn);
+}
+
+void LSMStorage::Write(const WriteBatch &batch, Durability durability,
+                       WriteCallback done) {
+  if (batch.empty()) {
+    done(true);
+    return;
+  }
+
+  std::shared_ptr<WriteAheadLog> log;
+  uint64_t lsn = 0;
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (!MakeRoomForWrite(lock)) {
+      lock.unlock();
+      done(false);
+      return;
+    }
+    log = log_;
+    lsn = ApplyLocked(batch, durability != Durability::kMemory);
+  }
+
+  log->SyncAsync(lsn, durability, std::move(done));
+}
+
+uint64_t LSMStorage::ApplyLocked(const WriteBatch &batch, bool log) {
+  uint64_t lsn = 0;
+  mem_->unlogged = mem_->unlogged || !log;
+  for (const auto & [ key, value ] : batch) {
+    if (log) {
+      lsn = log_->Append(value ? WalRecordType::kPut : WalRecordType::kDelete,
+                         key, value ? *value : std::string_view());
+    }
+
+    auto it = mem_->entries.lower_bound(key);
+    if (it == mem_->entries.end() || it->first != key) {
+      it = mem_->entries.emplace_hint(it, std::string(key), std::nullopt);
+      // only a new node costs the key and overhead; rewrites swap values
+      mem_->bytes += key.size() + kEntryOverhead;
+    }
+    auto &slot = it->second;
+    mem_->bytes -= slot ? slot->size() : 0;
+    if (value) {
+      slot.emplace(value->data(), value->size());
+      mem_->bytes += value->size();
+    } else {
+      slot.reset();
+    }
+  }
+  return lsn;
+}
+
+// The engine has one memtable rather than shards, so the update holds the
+// engine-wide write lock; a miss in the memtable reads the tables under it.
+UpdateStatus LSMStorage::Update(std::string_view key,
+                                const Updater &updater) {
+  std::shared_ptr<WriteAheadLog> log;
+  uint64_t lsn = 0;
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (!MakeRoomForWrite(lock)) {
+      return UpdateStatus::kFailed;
+    }
+
+    std::optional<std::string> current;
+    auto it = mem_->entries.find(key);
+    if (it != mem_->entries.end()) {
+      current = it->second;
+    } else {
+      current = GetFromImmutable(key, imm_.get(), *version_);
+    }
+
+    std::string value;
+    UpdateStatus status = updater(
+        current ? std::optional<std::string_view>(*current) : std::nullopt,
+        &value);
+    if (status != UpdateStatus::kOk) {
+      return status;
+    }
+    log = log_;
+    lsn = ApplyLocked({{key, std::string_view(value)}});
+  }
+
+  return log->Sync(lsn) ? UpdateStatus::kOk : UpdateStatus::kFailed;
+}
+
+bool LSMStorage::MakeRoomForWrite(std::unique_lock<std::shared_mutex> &lock) {
+  while (true) {
+    if (bg_error_ || shutting_down_) {
+      return false;
+    }
+
+    if (version_->levels[0].size() >=
+        static_cast<size_t>(options_.l0_stop_writes_trigger)) {
+      // reads would have to probe too many overlapping tables
+      done_cv_.wait(lock);
+      continue;
+    }
+
+    if (mem_->bytes < options_.memtable_bytes) {
+      return true;
+    }
+
+    if (imm_) {
+      // the previous memtable is still being flushed
+      done_cv_.wait(lock);
+      continue;
+    }
+
+    uint64_t number = next_file_number_++;
+    auto log = OpenLog(number);
+    if (!log) {
+      bg_error_ = true;
+      return false;
+    }
+
+    imm_ = mem_;
+    imm_log_number_ = log_number_;
+    mem_ = std::make_shared<Memtable>();
+    log_ = log;
+    log_number_ = number;
+    work_cv_.notify_one();
+  }
+}
+
+std::optional<std::string> LSMStorage::Get(std::string_view key) {
+  std::shared_ptr<const Memtable> imm;
+  std::shared_ptr<const Version> version;
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = mem_->entries.find(key);
+    if (it != mem_->entries.end()) {
+      return it->second;
+    }
+    imm = imm_;
+    version = version_;
+  }
+
+  return GetFromImmutable(key, imm.get(), *version);
+}
+
+// Memtable hits are visited in place; values read from tables are already a
+// private copy.
+bool LSMStorage::Visit(std::string_view key, const ValueVisitor &visitor) {
+  std::shared_ptr<const Memtable> imm;
+  std::shared_ptr<const Version> version;
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = mem_->entries.find(key);
+    if (it != mem_->entries.end()) {
+      if (!it->second) {
+        return false;
+      }
+      visitor(*it->second);
+      return true;
+    }
+    imm = imm_;
+    version = version_;
+  }
+
+  auto value = GetFromImmutable(key, imm.get(), *version);
+  if (!value) {
+    return false;
+  }
+  visitor(*value);
+  return true;
+}
+
+void LSMStorage::MultiGet(const KeyList &keys,
+                          std::vector<std::optional<std::string>> *values) {
+  values->assign(keys.size(), std::nullopt);
+
+  // one pass over the memtable under a single lock, then the misses
+  std::vector<size_t> misses;
+  std::shared_ptr<const Memtable> imm;
+  std::shared_ptr<const Version> version;
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    for (size_t i = 0; i < keys.size(); ++i) {
+      auto it = mem_->entries.find(keys[i]);
+      if (it != mem_->entries.end()) {
+        (*values)[i] = it->second;
+      } else {
+        misses.push_back(i);
+      }
+    }
+    imm = imm_;
+    version = version_;
+  }
+
+  for (size_t i : misses) {
+    (*values)[i] = GetFromImmutable(keys[i], imm.get(), *version);
+  }
+}
+
+std::optional<std::string>
+LSMStorage::GetFromImmutable(std::string_view key, const Memtable *imm,
+                             const Version &version) const {
+  if (imm) {
+    auto it = imm->entries.find(key);
+    if (it != imm->entries.end()) {
+      return it->second;
+    }
+  }
+
+  std::string value;
+  auto lookup = [&](const TableFile &file) {
+    return file.reader->Get(key, &value);
+  };
+
+  // level 0 tables may overlap, newest first
+  for (const auto &file : version.levels[0]) {
+    if (key < file->smallest || key > file->largest) {
+      continue;
+    }
+    auto result = lookup(*file);
+    if (result == SSTableReader::LookupResult::kFound) {
+      return value;
+    }
+    if (result == SSTableReader::LookupResult::kDeleted) {
+      return std::nullopt;
+    }
+  }
+
+  for (size_t level = 1; level < version.levels.size(); ++level) {
+    const auto &files = version.levels[level];
+    auto it = std::lower_bound(files.begin(), files.end(), key,
+                               [](const std::shared_ptr<TableFile> &file,
+                                  std::string_view k) {
+                                 return file->largest < k;
+                               });
+    if (it == files.end() || key < (*it)->smallest) {
+      continue;
+    }
+    auto result = lookup(**it);
+    if (result == SSTableReader::LookupResult::kFound) {
+      return value;
+    }
+    if (result == SSTableReader::LookupResult::kDeleted) {
+      return std::nullopt;
+    }
+  }
+
+  return std::nullopt;
+}
+
+void LSMStorage::Scan(ScanCursor *cursor, size_t batch_size,
+                      ScanBatch *batch) {
+  struct Position {
+    bool started = false;
+    std::string last_key; // every key up to here was returned
+  };
+
+  batch->clear();
+  if (cursor->done) {
+    return;
+  }
+  if (!cursor->state) {
+    cursor->state = std::make_shared<Position>();
+  }
+  auto *position = static_cast<Position *>(cursor->state.get());
+
+  if (MergeRange(&position->last_key, position->started, {},
+                 std::max<size_t>(batch_size, 1), batch)) {
+    cursor->done = true;
+    cursor->state.reset();
+  } else {
+    position->started = true;
+  }
+}
+
+void LSMStorage::Scan(std::string_view start, std::string_view end,
+                      size_t limit, ScanBatch *batch) {
+  batch->clear();
+  std::string from(start);
+  bool after = false;
+  while (limit == 0 || batch->size() < limit) {
+    size_t chunk = kScanBatchSize;
+    if (limit != 0) {
+      chunk = std::min(chunk, limit - batch->size());
+    }
+    if (MergeRange(&from, after, end, chunk, batch)) {
+      return;
+    }
+    after = true;
+  }
+}
+
+bool LSMStorage::MergeRange(std::string *from, bool after,
+                            std::string_view end, size_t limit,
+                            ScanBatch *batch) {
+  auto below_end = [end](std::string_view key) {
+    return end.empty() || key < end;
+  };
+
+  // Copy at most `limit` entries of the mutable memtable; the immutable
+  // memtable and the tables are pinned by reference. Keys in the memtable
+  // past the copied slice are left to the next call.
+  Memtable mem_slice;
+  bool mem_truncated = false;
+  std::shared_ptr<const Memtable> imm;
+  std::shared_ptr<const Version> version;
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = after ? mem_->entries.upper_bound(*from)
+                    : mem_->entries.lower_bound(*from);
+    for (; it != mem_->entries.end() && below_end(it->first) &&
+           mem_slice.entries.size() < limit;
+         ++it) {
+      mem_slice.entries.emplace_hint(mem_slice.entries.end(), *it);
+    }
+    mem_truncated = it != mem_->entries.end() && below_end(it->first);
+    imm = imm_;
+    version = version_;
+  }
+
+  // k-way merge; lower rank means newer data and wins on equal keys
+  struct Source {
+    const Memtable *memtable = nullptr;
+    decltype(Memtable::entries)::const_iterator mem_it;
+    std::unique_ptr<SSTableReader::Iterator> table_it;
+    size_t rank = 0;
+
+    bool Valid() const {
+      return memtable ? mem_it != memtable->entries.end() : table_it->Valid();
+    }
+    std::string_view key() const {
+      return memtable ? std::string_view(mem_it->first) : table_it->key();
+    }
+    bool is_deletion() const {
+      return memtable ? !mem_it->second : table_it->is_deletion();
+    }
+    std::string_view value() const {
+      return memtable ? std::string_view(*mem_it->second) : table_it->value();
+    }
+    void Next() {
+      if (memtable) {
+        ++mem_it;
+      } else {
+        table_it->Next();
+      }
+    }
+  };
+  std::vector<Source> sources;
+  auto add_memtable = [&](const Memtable &memtable) {
+    Source source;
+    source.memtable = &memtable;
+    source.mem_it = after ? memtable.entries.upper_bound(*from)
+                          : memtable.entries.lower_bound(*from);
+    source.rank = sources.size();
+    sources.push_back(std::move(source));
+  };
+  auto add_table = [&](const TableFile &file) {
+    if ((after ? file.largest <= *from : file.largest < *from) ||
+        !below_end(file.smallest)) {
+      return;
+    }
+    Source source;
+    source.table_it = file.reader->NewIterator(*from);
+    if (after && source.table_it->Valid() &&
+        source.table_it->key() == *from) {
+      source.table_it->Next();
+    }
+    source.rank = sources.size();
+    sources.push_back(std::move(source));
+  };
+
+  add_memtable(mem_slice);
+  if (imm) {
+    add_memtable(*imm);
+  }
+  for (const auto &level : version->levels) {
+    for (const auto &file : level) {
+      add_table(*file);
+    }
+  }
+
+  auto greater = [&sources](size_t a, size_t b) {
+    int cmp = sources[a].key().compare(sources[b].key());
+    return cmp > 0 || (cmp == 0 && sources[a].rank > sources[b].rank);
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(
+      greater);
+  auto push = [&](size_t i) {
+    if (sources[i].Valid() && below_end(sources[i].key())) {
+      heap.push(i);
+    }
+  };
+  for (size_t i = 0; i < sources.size(); ++i) {
+    push(i);
+  }
+
+  const std::string slice_end =
+      mem_truncated ? mem_slice.entries.rbegin()->first : std::string();
+  size_t added = 0;
+  while (!heap.empty() && added < limit) {
+    size_t top = heap.top();
+    if (mem_truncated && sources[top].key() > slice_end) {
+      break;
+    }
+    heap.pop();
+
+    Source &source = sources[top];
+    from->assign(source.key().data(), source.key().size());
+    if (!source.is_deletion()) {
+      batch->emplace_back(*from, source.value());
+      ++added;
+    }
+
+    // skip the older versions of the key
+    source.Next();
+    push(top);
+    while (!heap.empty() && sources[heap.top()].key() == *from) {
+      size_t older = heap.top();
+      heap.pop();
+      sources[older].Next();
+      push(older);
+    }
+  }
+
+  if (mem_truncated) {
+    // the memtable slice ran out before the batch filled up
+    if (added < limit) {
+      *from = slice_end;
+    }
+    return false;
+  }
+  return heap.empty();
+}
+
+bool LSMStorage::CompactAll() {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  if (!mem_->entries.empty()) {
+    while (imm_ && !bg_error_) {
+      done_cv_.wait(lock);
+    }
+    uint64_t number = next_file_number_++;
+    auto log = OpenLog(number);
+    if (!log) {
+      bg_error_ = true;
+      return false;
+    }
+    imm_ = mem_;
+    imm_log_number_ = log_number_;
+    mem_ = std::make_shared<Memtable>();
+    log_ = log;
+    log_number_ = number;
+    work_cv_.notify_one();
+  }
+
+  while (!bg_error_ && (imm_ || NeedsCompaction(*version_))) {
+    done_cv_.wait(lock);
+  }
+  return !bg_error_;
+}
+
+std::vector<size_t> LSMStorage::NumFilesPerLevel() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  std::vector<size_t> result;
+  for (const auto &files : version_->levels) {
+    result.push_back(files.size());
+  }
+  return result;
+}
+
+uint64_t LSMStorage::TableBlockReads() const {
+  std::shared_ptr<const Version> version;
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    version = version_;
+  }
+  uint64_t reads = 0;
+  for (const auto &files : version->levels) {
+    for (const auto &file : files) {
+      reads += file->reader->BlockReads();
+    }
+  }
+  return reads;
+}
+
+/************************************************************************/
+/* Recovery */
+/************************************************************************/
+bool LSMStorage::Recover() {
+  std::error_code ec;
+  std::filesystem::create_directories(dir_, ec);
+  if (ec) {
+    return false;
+  }
+
+  auto version = std::make_shared<Version>();
+  version->levels.resize(options_.max_levels);
+  uint64_t manifest_log_number = 0;
+  uint64_t max_number = 0;
+
+  std::ifstream manifest(dir_ + "/MANIFEST", std::ios::binary);
+  if (manifest) {
+    std::string content((std::istreambuf_iterator<char>(manifest)),
+                        std::istreambuf_iterator<char>());
+    if (content.size() < sizeof(uint32_t)) {
+      return false;
+    }
+    uint32_t crc;
+    memcpy(&crc, content.data() + content.size() - sizeof(crc), sizeof(crc));
+    content.resize(content.size() - sizeof(crc));
+    if (Crc32(content.data(), content.size()) != crc) {
+      return false;
+    }
+
+    std::string_view input(content);
+    uint64_t next_file_number = 0;
+    uint32_t num_files = 0;
+    if (!DecodeFixed(&input, &next_file_number) ||
+        !DecodeFixed(&input, &manifest_log_number) ||
+        !DecodeFixed(&input, &num_files)) {
+      return false;
+    }
+    max_number = next_file_number;
+
+    for (uint32_t i = 0; i < num_files; ++i) {
+      uint32_t level = 0;
+      uint64_t number = 0;
+      uint64_t size = 0;
+      std::string smallest;
+      std::string largest;
+      if (!DecodeFixed(&input, &level) || !DecodeFixed(&input, &number) ||
+          !DecodeFixed(&input, &size) || !DecodeString(&input, &smallest) ||
+          !DecodeString(&input, &largest) ||
+          level >= version->levels.size()) {
+        return false;
+      }
+      auto file = OpenTable(number, size, smallest, largest);
+      if (!file) {
+        return false;
+      }
+      version->levels[level].push_back(file);
+    }
+  }
+
+  // level 0 newest first, deeper levels by key
+  std::sort(version->levels[0].begin(), version->levels[0].end(),
+            [](const auto &a, const auto &b) { return a->number > b->number; });
+  for (size_t level = 1; level < version->levels.size(); ++level) {
+    std::sort(version->levels[level].begin(), version->levels[level].end(),
+              [](const auto &a, const auto &b) {
+                return a->smallest < b->smallest;
+              });
+  }
+
+  // replay memtable logs that were not flushed yet, oldest first
+  std::vector<uint64_t> logs;
+  for (const auto &entry : std::filesystem::directory_iterator(dir_, ec)) {
+    const auto &path = entry.path();
+    const std::string stem = path.stem().string();
+    if (stem.empty() ||
+        stem.find_first_not_of("0123456789") != std::string::npos) {
+      continue;
+    }
+    uint64_t number = std::stoull(stem);
+    max_number = std::max(max_number, number + 1);
+    if (path.extension() == ".log" && number >= manifest_log_number) {
+      logs.push_back(number);
+    }
+  }
+  std::sort(logs.begin(), logs.end());
+  next_file_number_ = std::max<uint64_t>(max_number, 1);
+
+  auto recovered = std::make_shared<Memtable>();
+  for (uint64_t number : logs) {
+    WriteAheadLog log(LogPath(number), wal_options_, io_);
+    bool ok = log.Open([&recovered](WalRecordType type, std::string_view key,
+                                    std::string_view value) {
+      auto &slot = recovered->entries[std::string(key)];
+      if (type == WalRecordType::kPut) {
+        slot.emplace(value.data(), value.size());
+      } else {
+        slot.reset();
+      }
+      recovered->bytes += key.size() + value.size() + kEntryOverhead;
+    });
+    if (!ok) {
+      return false;
+    }
+  }
+
+  // fold recovered writes into a level 0 table so we start from one log
+  if (!recovered->entries.empty()) {
+    auto file = BuildTable(*recovered);
+    if (!file) {
+      return false;
+    }
+    version->levels[0].insert(version->levels[0].begin(), file);
+  }
+
+  log_number_ = next_file_number_++;
+  log_ = OpenLog(log_number_);
+  if (!log_ || !WriteManifest(*version, log_number_)) {
+    return false;
+  }
+  for (uint64_t number : logs) {
+    unlink(LogPath(number).c_str());
+  }
+
+  version_ = version;
+  return true;
+}
+
+/************************************************************************/
+/* Background work */
+/************************************************************************/
+void LSMStorage::BackgroundLoop() {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  while (!shutting_down_) {
+    if (bg_error_ || (!imm_ && !NeedsCompaction(*version_))) {
+      done_cv_.notify_all();
+      work_cv_.wait(lock);
+      continue;
+    }
+
+    bool ok = true;
+    if (imm_) {
+      lock.unlock();
+      ok = FlushImmutable();
+      lock.lock();
+    } else {
+      int level = PickCompactionLevel(*version_);
+      lock.unlock();
+      ok = DoCompaction(level);
+      lock.lock();
+    }
+
+    if (!ok) {
+      bg_error_ = true;
+    }
+    done_cv_.notify_all();
+  }
+}
+
+bool LSMStorage::NeedsCompaction(const Version &version) const {
+  return PickCompactionLevel(version) >= 0;
+}
+
+int LSMStorage::PickCompactionLevel(const Version &version) const {
+  if (version.levels[0].size() >=
+      static_cast<size_t>(options_.l0_compaction_trigger)) {
+    return 0;
+  }
+
+  for (size_t level = 1; level + 1 < version.levels.size(); ++level) {
+    uint64_t bytes = 0;
+    for (const auto &file : version.levels[level]) {
+      bytes += file->size;
+    }
+    if (bytes > MaxBytesForLevel(level)) {
+      return static_cast<int>(level);
+    }
+  }
+  return -1;
+}
+
+uint64_t LSMStorage::MaxBytesForLevel(int level) const {
+  uint64_t bytes = options_.level1_bytes;
+  for (int i = 1; i < level; ++i) {
+    bytes *= options_.level_size_multiplier;
+  }
+  return bytes;
+}
+
+bool LSMStorage::FlushImmutable() {
+  std::shared_ptr<const Memtable> imm;
+  std::shared_ptr<const Version> current;
+  uint64_t log_number = 0;
+  uint64_t obsolete_log = 0;
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    imm = imm_;
+    current = version_;
+    log_number = log_number_;
+    obsolete_log = imm_log_number_;
+  }
+
+  auto file = BuildTable(*imm);
+  if (!file) {
+    return false;
+  }
+
+  // only this thread installs versions, so `current` cannot go stale
+  auto version = std::make_shared<Version>(*current);
+  version->levels[0].insert(version->levels[0].begin(), file);
+  if (!WriteManifest(*version, log_number)) {
+    return false;
+  }
+
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    version_ = version;
+    imm_.reset();
+  }
+  unlink(LogPath(obsolete_log).c_str());
+  return true;
+}
+
+bool LSMStorage::DoCompaction(int level) {
+  std::shared_ptr<const Version> current;
+  uint64_t log_number = 0;
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    current = version_;
+    log_number = log_number_;
+  }
+
+  // pick inputs: all of L0 (its files overlap), or one file of Ln
+  TableList inputs;
+  if (level == 0) {
+    inputs = current->levels[0];
+  } else {
+    const auto &files = current->levels[level];
+    size_t index = compact_pointer_[level] % files.size();
+    compact_pointer_[level] = index + 1;
+    inputs.push_back(files[index]);
+  }
+
+  std::string begin = inputs.front()->smallest;
+  std::string end = inputs.front()->largest;
+  for (const auto &file : inputs) {
+    begin = std::min(begin, file->smallest);
+    end = std::max(end, file->largest);
+  }
+
+  TableList next_inputs;
+  for (const auto &file : current->levels[level + 1]) {
+    if (Overlaps(file->smallest, file->largest, begin, end)) {
+      next_inputs.push_back(file);
+    }
+  }
+
+  auto version = std::make_shared<Version>(*current);
+  auto remove_inputs = [&version](int from, const TableList &files) {
+    auto &list = version->levels[from];
+    for (const auto &file : files) {
+      list.erase(std::find(list.begin(), list.end(), file));
+    }
+  };
+  auto sort_level = [&version](int target) {
+    std::sort(version->levels[target].begin(), version->levels[target].end(),
+              [](const auto &a, const auto &b) {
+                return a->smallest < b->smallest;
+              });
+  };
+
+  if (level > 0 && next_inputs.empty()) {
+    // nothing to merge with: move the file down without rewriting it
+    remove_inputs(level, inputs);
+    version->levels[level + 1].push_back(inputs.front());
+    sort_level(level + 1);
+    if (!WriteManifest(*version, log_number)) {
+      return false;
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    version_ = version;
+    return true;
+  }
+
+  // tombstones can be dropped when nothing below the output level overlaps
+  bool drop_deletions = true;
+  for (size_t deeper = level + 2; deeper < current->levels.size(); ++deeper) {
+    for (const auto &file : current->levels[deeper]) {
+      if (Overlaps(file->smallest, file->largest, begin, end)) {
+        drop_deletions = false;
+      }
+    }
+  }
+
+  // k-way merge; lower rank means newer data and wins on equal keys
+  struct Source {
+    std::unique_ptr<SSTableReader::Iterator> it;
+    size_t rank;
+  };
+  std::vector<Source> sources;
+  for (const auto &file : inputs) {
+    sources.push_back({file->reader->NewIterator(), sources.size()});
+  }
+  for (const auto &file : next_inputs) {
+    sources.push_back({file->reader->NewIterator(), sources.size()});
+  }
+
+  auto greater = [&sources](size_t a, size_t b) {
+    int cmp = sources[a].it->key().compare(sources[b].it->key());
+    return cmp > 0 || (cmp == 0 && sources[a].rank > sources[b].rank);
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(
+      greater);
+  for (size_t i = 0; i < sources.size(); ++i) {
+    if (sources[i].it->Valid()) {
+      heap.push(i);
+    }
+  }
+
+  TableList outputs;
+  std::unique_ptr<SSTableBuilder> builder;
+  uint64_t builder_number = 0;
+  SSTableOptions table_options{options_.block_bytes,
+                               options_.bloom_bits_per_key};
+
+  auto finish_output = [&]() {
+    if (!builder) {
+      return true;
+    }
+    if (builder->NumEntries() == 0) {
+      builder.reset();
+      return true;
+    }
+    if (!builder->Finish()) {
+      return false;
+    }
+    auto file = OpenTable(builder_number, builder->FileSize(),
+                          builder->smallest_key(), builder->largest_key());
+    builder.reset();
+    if (!file) {
+      return false;
+    }
+    outputs.push_back(file);
+    return true;
+  };
+
+  std::string current_key;
+  while (!heap.empty()) {
+    size_t top = heap.top();
+    heap.pop();
+    auto &it = *sources[top].it;
+    current_key.assign(it.key().data(), it.key().size());
+
+    if (!(drop_deletions && it.is_deletion())) {
+      if (!builder) {
+        builder_number = next_file_number_++;
+        builder = std::make_unique<SSTableBuilder>(TablePath(builder_number),
+                                                   table_options);
+        if (!builder->Open()) {
+          return false;
+        }
+      }
+      std::optional<std::string_view> value;
+      if (!it.is_deletion()) {
+        value = it.value();
+      }
+      if (!builder->Add(current_key, value)) {
+        return false;
+      }
+      if (builder->FileSize() >= options_.target_file_bytes &&
+          !finish_output()) {
+        return false;
+      }
+    }
+
+    // skip older versions of the same key
+    it.Next();
+    if (!it.status()) {
+      return false;
+    }
+    if (it.Valid()) {
+      heap.push(top);
+    }
+    while (!heap.empty() && sources[heap.top()].it->key() == current_key) {
+      size_t older = heap.top();
+      heap.pop();
+      sources[older].it->Next();
+      if (!sources[older].it->status()) {
+        return false;
+      }
+      if (sources[older].it->Valid()) {
+        heap.push(older);
+      }
+    }
+  }
+  if (!finish_output()) {
+    return false;
+  }
+
+  remove_inputs(level, inputs);
+  remove_inputs(level + 1, next_inputs);
+  for (const auto &file : outputs) {
+    version->levels[level + 1].push_back(file);
+  }
+  sort_level(level + 1);
+  if (!WriteManifest(*version, log_number)) {
+    return false;
+  }
+
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    version_ = version;
+  }
+  for (const auto &file : inputs) {
+    file->obsolete = true;
+  }
+  for (const auto &file : next_inputs) {
+    file->obsolete = true;
+  }
+  return true;
+}
+
+std::shared_ptr<LSMStorage::TableFile>
+LSMStorage::BuildTable(const Memtable &memtable) {
+  uint64_t number = next_file_number_++;
+  SSTableBuilder builder(TablePath(number), {options_.block_bytes,
+                                             options_.bloom_bits_per_key});
+  if (!builder.Open()) {
+    return nullptr;
+  }
+  for (const auto & [ key, value ] : memtable.entries) {
+    std::optional<std::string_view> entry_value;
+    if (value) {
+      entry_value = *value;
+    }
+    if (!builder.Add(key, entry_value)) {
+      return nullptr;
+    }
+  }
+  if (!builder.Finish()) {
+    return nullptr;
+  }
+  return OpenTable(number, builder.FileSize(), builder.smallest_key(),
+                   builder.largest_key());
+}
+
+std::shared_ptr<LSMStorage::TableFile>
+LSMStorage::OpenTable(uint64_t number, uint64_t size,
+                      const std::string &smallest,
+                      const std::string &largest) {
+  auto file = std::make_shared<TableFile>();
+  file->number = number;
+  file->size = size;
+  file->smallest = smallest;
+  file->largest = largest;
+  file->path = TablePath(number);
+  file->reader = SSTableReader::Open(file->path);
+  if (!file->reader) {
+    return nullptr;
+  }
+  return file;
+}
+
+bool LSMStorage::WriteManifest(const Version &version, uint64_t log_number) {
+  std::string content;
+  uint32_t num_files = 0;
+  for (const auto &files : version.levels) {
+    num_files += static_cast<uint32_t>(files.size());
+  }
+  AppendFixed<uint64_t>(&content, next_file_number_.load());
+  AppendFixed<uint64_t>(&content, log_number);
+  AppendFixed<uint32_t>(&content, num_files);
+  for (size_t level = 0; level < version.levels.size(); ++level) {
+    for (const auto &file : version.levels[level]) {
+      AppendFixed<uint32_t>(&content, static_cast<uint32_t>(level));
+      AppendFixed<uint64_t>(&content, file->number);
+      AppendFixed<uint64_t>(&content, file->size);
+      AppendString(&content, file->smallest);
+      AppendString(&content, file->largest);
+    }
+  }
+  AppendFixed<uint32_t>(&content, Crc32(content.data(), content.size()));
+
+  const std::string path = dir_ + "/MANIFEST";
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    file.write(content.data(), content.size());
+    file.flush();
+    if (!file.good()) {
+      return false;
+    }
+  }
+  return SyncFile(tmp_path) &&
+         std::rename(tmp_path.c_str(), path.c_str()) == 0 &&
+         SyncParentDir(path);
+}
+
+std::shared_ptr<WriteAheadLog> LSMStorage::OpenLog(uint64_t number) {
+  auto log =
+      std::make_shared<WriteAheadLog>(LogPath(number), wal_options_, io_);
+  if (!log->Open([](WalRecordType, std::string_view, std::string_view) {})) {
+    return nullptr;
+  }
+  return log;
+}
+
+std::string LSMStorage::TablePath(uint64_t number) const {
+  char name[32];
+  snprintf(name, sizeof(name), "/%06" PRIu64 ".sst", number);
+  return dir_ + name;
+}
+
+std::string LSMStorage::LogPath(uint64_t number) const {
+  char name[32];
+  snprintf(name, sizeof(name), "/%06" PRIu64 ".log", number);
+  return dir_ + name;
+}
+
+} // namespace tiny_kv
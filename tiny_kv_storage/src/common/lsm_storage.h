@@ -0,0 +1,160 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#pragma once
+
+#include "src/common/sstable.h"
+#include "src/common/storage_engine.h"
+#include "src/common/wal.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace tiny_kv {
+
+/************************************************************************/
+/* LSMStorage */
+/************************************************************************/
+// Log-structured engine for data sets larger than memory. Writes go to a
+// WAL-backed sorted memtable; full memtables are flushed by a background
+// thread into immutable SSTables on level 0 and merged down by leveled
+// compaction (L0 -> L1 when it has `l0_compaction_trigger` files, Ln -> Ln+1
+// when Ln outgrows `level1_bytes * level_size_multiplier^(n-1)`).
+//
+// Directory layout: `MANIFEST` (live tables per level), `<n>.log` (memtable
+// logs) and `<n>.sst` (tables).
+class LSMStorage : public StorageEngine {
+public:
+  explicit LSMStorage(const std::string &dir,
+                      const LSMOptions &options = LSMOptions(),
+                      const WalOptions &wal_options = WalOptions(),
+                      const AsyncIoOptions &io_options = AsyncIoOptions());
+  ~LSMStorage() override;
+
+  bool Put(std::string_view key, std::string_view value) override;
+  std::optional<std::string> Get(std::string_view key) override;
+  bool Delete(std::string_view key) override;
+  // Merges the memtables and tables in key order; the cursor is the last
+  // key returned.
+  void Scan(ScanCursor *cursor, size_t batch_size, ScanBatch *batch) override;
+  // Seeks every source to `start`; a table whose key range misses
+  // [start, end) is skipped without being read.
+  void Scan(std::string_view start, std::string_view end, size_t limit,
+            ScanBatch *batch) override;
+  bool Visit(std::string_view key, const ValueVisitor &visitor) override;
+  void MultiGet(const KeyList &keys,
+                std::vector<std::optional<std::string>> *values) override;
+  bool MultiPut(const KVPairList &kvs) override;
+  bool MultiDelete(const KeyList &keys) override;
+  UpdateStatus Update(std::string_view key, const Updater &updater) override;
+  // A nonzero `ttl_ms` fails. Memory-only writes reach the tables, and so
+  // become durable, when their memtable is flushed (at the latest on
+  // shutdown). Like every write these still wait out a write stall.
+  void PutAsync(std::string_view key, std::string_view value, uint64_t ttl_ms,
+                Durability durability, WriteCallback done) override;
+  void MultiPutAsync(const KVPairList &kvs, Durability durability,
+                     WriteCallback done) override;
+
+  // Flushes the memtable and waits until no compaction is pending.
+  bool CompactAll();
+  std::vector<size_t> NumFilesPerLevel() const;
+  uint64_t TableBlockReads() const;
+
+private:
+  struct Memtable {
+    std::map<std::string, std::optional<std::string>, std::less<>> entries;
+    size_t bytes = 0;
+    bool unlogged = false; // holds memory-only writes, which no log has
+  };
+
+  struct TableFile {
+    ~TableFile();
+
+    uint64_t number = 0;
+    uint64_t size = 0;
+    std::string smallest;
+    std::string largest;
+    std::string path;
+    std::shared_ptr<SSTableReader> reader;
+    std::atomic<bool> obsolete{false}; // unlink once no version holds it
+  };
+  using TableList = std::vector<std::shared_ptr<TableFile>>;
+
+  struct Version {
+    std::vector<TableList> levels;
+  };
+
+  // nullopt value = deletion
+  using WriteBatch =
+      std::vector<std::pair<std::string_view, std::optional<std::string_view>>>;
+
+  bool Write(const WriteBatch &batch);
+  void Write(const WriteBatch &batch, Durability durability,
+             WriteCallback done);
+  // Deletes those of `keys` that exist; true if all of them did.
+  bool EraseExisting(const KeyList &keys);
+  // Applies `batch` to the memtable, logging it unless `log` is false;
+  // needs the write lock and room made for it. Returns the lsn of the last
+  // record, or 0 if nothing was logged.
+  uint64_t ApplyLocked(const WriteBatch &batch, bool log = true);
+  // Appends up to `limit` live entries below `end` (empty = no bound) in key
+  // order, starting at `*from` (just after it if `after`). Returns true once
+  // the range is exhausted; otherwise `*from` is the last key consumed.
+  bool MergeRange(std::string *from, bool after, std::string_view end,
+                  size_t limit, ScanBatch *batch);
+  // Looks `key` up in everything below the mutable memtable.
+  std::optional<std::string> GetFromImmutable(std::string_view key,
+                                              const Memtable *imm,
+                                              const Version &version) const;
+  bool MakeRoomForWrite(std::unique_lock<std::shared_mutex> &lock);
+  bool Recover();
+
+  void BackgroundLoop();
+  bool NeedsCompaction(const Version &version) const;
+  int PickCompactionLevel(const Version &version) const;
+  bool FlushImmutable();
+  bool DoCompaction(int level);
+
+  std::shared_ptr<TableFile> BuildTable(const Memtable &memtable);
+  std::shared_ptr<TableFile> OpenTable(uint64_t number, uint64_t size,
+                                       const std::string &smallest,
+                                       const std::string &largest);
+  bool WriteManifest(const Version &version, uint64_t log_number);
+  std::shared_ptr<WriteAheadLog> OpenLog(uint64_t number);
+
+  std::string TablePath(uint64_t number) const;
+  std::string LogPath(uint64_t number) const;
+  uint64_t MaxBytesForLevel(int level) const;
+
+private:
+  std::string dir_;
+  LSMOptions options_;
+  WalOptions wal_options_;
+  std::shared_ptr<AsyncIo> io_; // shared by every log
+
+  mutable std::shared_mutex mutex_;
+  std::condition_variable_any work_cv_; // wakes the background thread
+  std::condition_variable_any done_cv_; // background work finished
+  std::shared_ptr<Memtable> mem_;
+  std::shared_ptr<const Memtable> imm_; // being flushed
+  std::shared_ptr<WriteAheadLog> log_;
+  uint64_t log_number_ = 0;
+  uint64_t imm_log_number_ = 0;
+  std::shared_ptr<const Version> version_;
+  std::vector<size_t> compact_pointer_; // round-robin file pick per level
+  std::atomic<uint64_t> next_file_number_{1};
+  bool bg_error_ = false;
+  bool shutting_down_ = false;
+  std::thread bg_thread_;
+};
+
+} // namespace tiny_kv
@@ -0,0 +1,222 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "lsm_storage.h"
+#include "sstable.h"
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+
+namespace tiny_kv {
+
+namespace {
+
+LSMOptions SmallOptions() {
+  LSMOptions options;
+  options.memtable_bytes = 16 << 10;
+  options.block_bytes = 512;
+  options.level1_bytes = 64 << 10;
+  options.target_file_bytes = 16 << 10;
+  return options;
+}
+
+std::string Key(int i) {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "key%06d", i);
+  return buf;
+}
+
+} // namespace
+
+TEST(SSTableTest, BuildAndRead) {
+  const std::string path = "sstable_test.sst";
+  {
+    SSTableBuilder builder(path, SSTableOptions{256, 10});
+    ASSERT_TRUE(builder.Open());
+    for (int i = 0; i < 1000; i += 2) {
+      std::optional<std::string_view> value;
+      std::string v = "value" + std::to_string(i);
+      if (i % 10 != 0) {
+        value = v;
+      }
+      ASSERT_TRUE(builder.Add(Key(i), value));
+    }
+    ASSERT_TRUE(builder.Finish());
+    EXPECT_EQ(builder.NumEntries(), 500);
+    EXPECT_EQ(builder.smallest_key(), Key(0));
+    EXPECT_EQ(builder.largest_key(), Key(998));
+  }
+
+  auto table = SSTableReader::Open(path);
+  ASSERT_NE(table, nullptr);
+  EXPECT_EQ(table->NumEntries(), 500);
+
+  std::string value;
+  EXPECT_EQ(table->Get(Key(2), &value), SSTableReader::LookupResult::kFound);
+  EXPECT_EQ(value, "value2");
+  EXPECT_EQ(table->Get(Key(10), &value),
+            SSTableReader::LookupResult::kDeleted);
+  EXPECT_EQ(table->Get(Key(3), &value),
+            SSTableReader::LookupResult::kNotFound);
+  EXPECT_EQ(table->Get("zzz", &value), SSTableReader::LookupResult::kNotFound);
+
+  int count = 0;
+  std::string last;
+  for (auto it = table->NewIterator(); it->Valid(); it->Next()) {
+    EXPECT_LT(last, std::string(it->key()));
+    last = std::string(it->key());
+    ++count;
+  }
+  EXPECT_EQ(count, 500);
+
+  std::filesystem::remove(path);
+}
+
+TEST(LSMStorageTest, BasicOperations) {
+  const std::string dir = "lsm_test_basic";
+  std::filesystem::remove_all(dir);
+
+  auto storage = std::make_unique<LSMStorage>(dir, SmallOptions());
+  EXPECT_TRUE(storage->Put("key1", "value1"));
+  EXPECT_EQ(storage->Get("key1"), "value1");
+  EXPECT_FALSE(storage->Get("missing").has_value());
+
+  EXPECT_TRUE(storage->Delete("key1"));
+  EXPECT_FALSE(storage->Get("key1").has_value());
+  EXPECT_FALSE(storage->Delete("key1"));
+
+  storage.reset();
+  std::filesystem::remove_all(dir);
+}
+
+TEST(LSMStorageTest, FlushCompactAndRecover) {
+  const std::string dir = "lsm_test_recover";
+  std::filesystem::remove_all(dir);
+
+  std::map<std::string, std::string> expected;
+  std::mt19937 gen(42);
+  {
+    auto storage = std::make_unique<LSMStorage>(dir, SmallOptions());
+    for (int i = 0; i < 20000; ++i) {
+      int k = gen() % 5000;
+      if (gen() % 5 == 0) {
+        storage->Delete(Key(k));
+        expected.erase(Key(k));
+      } else {
+        std::string value = std::string(gen() % 40 + 1, 'a' + k % 26);
+        ASSERT_TRUE(storage->Put(Key(k), value));
+        expected[Key(k)] = value;
+      }
+    }
+
+    ASSERT_TRUE(storage->CompactAll());
+    auto files = storage->NumFilesPerLevel();
+    EXPECT_LT(files[0], static_cast<size_t>(SmallOptions().l0_compaction_trigger));
+    size_t deeper = 0;
+    for (size_t level = 1; level < files.size(); ++level) {
+      deeper += files[level];
+    }
+    EXPECT_GT(deeper, 0);
+
+    for (int k = 0; k < 5000; ++k) {
+      auto it = expected.find(Key(k));
+      auto value = storage->Get(Key(k));
+      if (it == expected.end()) {
+        EXPECT_FALSE(value.has_value()) << Key(k);
+      } else {
+        EXPECT_EQ(value, it->second) << Key(k);
+      }
+    }
+
+    // writes that only live in the memtable log
+    ASSERT_TRUE(storage->Put("tail", "in_log"));
+    expected["tail"] = "in_log";
+  }
+
+  auto storage = std::make_unique<LSMStorage>(dir, SmallOptions());
+  auto entries = storage->GetAllEntries();
+  EXPECT_EQ(entries.size(), expected.size());
+  for (const auto & [ key, value ] : expected) {
+    EXPECT_EQ(storage->Get(key), value) << key;
+  }
+
+  storage.reset();
+  std::filesystem::remove_all(dir);
+}
+
+TEST(LSMStorageTest, MissingKeysSkipDiskViaBloomFilter) {
+  const std::string dir = "lsm_test_bloom";
+  std::filesystem::remove_all(dir);
+
+  auto storage = std::make_unique<LSMStorage>(dir, SmallOptions());
+  for (int i = 0; i < 5000; ++i) {
+    ASSERT_TRUE(storage->Put(Key(i), "value"));
+  }
+  ASSERT_TRUE(storage->CompactAll());
+
+  uint64_t before = storage->TableBlockReads();
+  int misses = 1000;
+  for (int i = 0; i < misses; ++i) {
+    EXPECT_FALSE(storage->Get("absent" + std::to_string(i)).has_value());
+  }
+  // ~1% false positives at 10 bits per key
+  EXPECT_LT(storage->TableBlockReads() - before, misses / 20);
+
+  storage.reset();
+  std::filesystem::remove_all(dir);
+}
+
+TEST(LSMStorageTest, DeletesAndRewrites) {
+  const std::string dir = "lsm_test_deletes";
+  std::filesystem::remove_all(dir);
+
+  auto storage = std::make_unique<LSMStorage>(dir, SmallOptions());
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(storage->Put(Key(i), "value"));
+  }
+  ASSERT_TRUE(storage->CompactAll());
+
+  // deleting keys the memtable does not hold: absent ones mostly stop at
+  // the bloom filters
+  uint64_t before = storage->TableBlockReads();
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_FALSE(storage->Delete("absent" + std::to_string(i)));
+  }
+  EXPECT_LT(storage->TableBlockReads() - before, 50);
+  EXPECT_TRUE(storage->Delete(Key(1)));
+  EXPECT_FALSE(storage->Delete(Key(1)));
+  EXPECT_FALSE(storage->MultiDelete({Key(2), Key(1), Key(3)}));
+  EXPECT_FALSE(storage->Get(Key(2)).has_value());
+  EXPECT_FALSE(storage->Get(Key(3)).has_value());
+  EXPECT_TRUE(storage->MultiDelete({Key(4), Key(5)}));
+
+  // rewriting one key swaps its value in place and never fills the
+  // memtable
+  auto files = storage->NumFilesPerLevel();
+  for (int i = 0; i < 10000; ++i) {
+    ASSERT_TRUE(storage->Put("hot", "value"));
+  }
+  EXPECT_EQ(storage->NumFilesPerLevel(), files);
+
+  storage.reset();
+  std::filesystem::remove_all(dir);
+}
+
+TEST(StorageEngineFactory, CreateLSMEngine) {
+  const std::string dir = "lsm_test_factory";
+  std::filesystem::remove_all(dir);
+
+  auto storage = CreateStorageEngine("lsm", dir);
+  EXPECT_NE(dynamic_cast<LSMStorage *>(storage.get()), nullptr);
+  EXPECT_TRUE(storage->Put("key", "value"));
+  EXPECT_TRUE(storage->Get("key").has_value());
+
+  storage.reset();
+  std::filesystem::remove_all(dir);
+}
+
+} // namespace tiny_kv
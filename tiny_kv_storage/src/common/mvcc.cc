@@ -0,0 +1,65 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "mvcc.h"
+#include <thread>
+
+namespace tiny_kv {
+
+/************************************************************************/
+/* CommitSequence */
+/************************************************************************/
+// The atomics are sequentially consistent on purpose:
+// - A snapshot publishes its lower bound in `oldest_` before it reads
+//   `last_`, so a write numbered after the snapshot is also ordered after
+//   that store: it sees that it must retain, and no later `Collect` under
+//   the same lock drops what it kept.
+// - A write joins an epoch, checks that it is still current and only then
+//   takes its number. A snapshot reads `last_` before it ends the epoch,
+//   so every write numbered up to its sequence is counted in the epoch it
+//   ends, and one that joined the next epoch is numbered after it.
+CommitSequence::Write::Write(CommitSequence *sequence) : owner_(sequence) {
+  while (true) {
+    epoch_ = owner_->epoch_.load();
+    owner_->active_[epoch_ & 1].fetch_add(1);
+    if (owner_->epoch_.load() == epoch_) {
+      break;
+    }
+    // a snapshot ended that epoch meanwhile; join the next one
+    owner_->active_[epoch_ & 1].fetch_sub(1);
+  }
+  sequence_ = owner_->last_.fetch_add(1) + 1;
+  retain_ = owner_->oldest_.load() != kNoSnapshot;
+}
+
+CommitSequence::Write::~Write() { owner_->active_[epoch_ & 1].fetch_sub(1); }
+
+CommitSequence::Snapshot::Snapshot(CommitSequence *sequence)
+    : owner_(sequence) {
+  std::lock_guard<std::mutex> lock(owner_->mutex_);
+  uint64_t bound = owner_->last_.load();
+  if (bound < owner_->oldest_.load()) {
+    owner_->oldest_.store(bound);
+  }
+  sequence_ = owner_->last_.load();
+  owner_->snapshots_.insert(sequence_);
+  owner_->oldest_.store(*owner_->snapshots_.begin());
+
+  // Under the lock, so the epoch drained is the one this snapshot ended:
+  // the next snapshot can only end the following one.
+  uint64_t epoch = owner_->epoch_.fetch_add(1);
+  while (owner_->active_[epoch & 1].load() != 0) {
+    std::this_thread::yield();
+  }
+}
+
+CommitSequence::Snapshot::~Snapshot() {
+  std::lock_guard<std::mutex> lock(owner_->mutex_);
+  owner_->snapshots_.erase(owner_->snapshots_.find(sequence_));
+  owner_->oldest_.store(owner_->snapshots_.empty()
+                            ? kNoSnapshot
+                            : *owner_->snapshots_.begin());
+}
+
+} // namespace tiny_kv
@@ -0,0 +1,173 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace tiny_kv {
+
+/************************************************************************/
+/* CommitSequence */
+/************************************************************************/
+// Orders the writes of one engine and lets readers pick a point in that
+// order. Every write takes the next sequence number, and a snapshot at
+// sequence `s` means "every write up to `s` and none after it". Writers
+// never wait, on each other or on snapshots: they commit in any order, and
+// a snapshot opening at `s` waits instead for the writes still in flight
+// that are numbered up to `s`. While a snapshot is open, writers keep the
+// versions they replace in a `VersionHistory`, and snapshot readers look
+// there first.
+//
+// Writes in flight are counted per epoch rather than listed: opening a
+// snapshot starts a new epoch and drains the count of the previous one,
+// which holds every write numbered up to its sequence.
+//
+// Writers hold the locks of every key they write from `Write` construction
+// until it is destroyed, so the writes to one key are applied in sequence
+// order. Thread-safe.
+class CommitSequence {
+public:
+  static constexpr uint64_t kNoSnapshot = std::numeric_limits<uint64_t>::max();
+
+  // One write or batch, committed on destruction.
+  class Write {
+  public:
+    explicit Write(CommitSequence *sequence);
+    ~Write();
+    Write(const Write &) = delete;
+    Write &operator=(const Write &) = delete;
+
+    uint64_t sequence() const { return sequence_; }
+    // Whether a snapshot may need the versions this write replaces.
+    bool retain() const { return retain_; }
+
+  private:
+    CommitSequence *owner_;
+    uint64_t epoch_ = 0; // counted in `owner_->active_[epoch_ & 1]`
+    uint64_t sequence_ = 0;
+    bool retain_ = false;
+  };
+
+  // A consistent read point, released on destruction. Opening one waits
+  // for the writes already numbered to commit; those hold their locks for
+  // a few lookups only. Snapshots open one at a time.
+  class Snapshot {
+  public:
+    explicit Snapshot(CommitSequence *sequence);
+    ~Snapshot();
+    Snapshot(const Snapshot &) = delete;
+    Snapshot &operator=(const Snapshot &) = delete;
+
+    uint64_t sequence() const { return sequence_; }
+
+  private:
+    CommitSequence *owner_;
+    uint64_t sequence_;
+  };
+
+  // The oldest open snapshot, or kNoSnapshot. Versions replaced at or
+  // before it are no longer needed.
+  uint64_t Oldest() const { return oldest_.load(); }
+  uint64_t LastNumbered() const { return last_.load(); }
+
+private:
+  std::atomic<uint64_t> last_{0}; // last sequence handed out
+  std::atomic<uint64_t> epoch_{0};
+  // writes in flight, by the parity of the epoch they joined
+  std::array<std::atomic<uint64_t>, 2> active_{};
+  std::atomic<uint64_t> oldest_{kNoSnapshot};
+  std::mutex mutex_; // guards `snapshots_`; only readers take it
+  std::multiset<uint64_t> snapshots_;
+};
+
+/************************************************************************/
+/* VersionHistory */
+/************************************************************************/
+// The versions of keys that writes replaced while a snapshot was open,
+// each stamped with the sequence of the write that replaced it. A missing
+// key is a version too (nullopt), so a key created after a snapshot reads
+// as missing there. Empty and free whenever no snapshot is open. Not
+// thread-safe; it lives next to the data it shadows, under the same lock.
+template <typename V> class VersionHistory {
+public:
+  struct Version {
+    uint64_t replaced_at; // sequence of the write that replaced it
+    std::optional<V> value;
+  };
+  using Map = std::map<std::string, std::vector<Version>, std::less<>>;
+
+  bool Empty() const { return versions_.empty(); }
+  size_t Size() const { return order_.size(); }
+
+  // `previous` is what `key` held before the write numbered `replaced_at`.
+  // Writes to one key must come in sequence order.
+  void Record(std::string_view key, std::optional<V> previous,
+              uint64_t replaced_at) {
+    auto it = versions_.lower_bound(key);
+    if (it == versions_.end() || it->first != key) {
+      it = versions_.emplace_hint(it, std::string(key),
+                                  std::vector<Version>());
+    }
+    it->second.push_back({replaced_at, std::move(previous)});
+    order_.emplace_back(replaced_at, it);
+  }
+
+  // What `key` held at `snapshot`, or nullptr if the live data has it: no
+  // write after the snapshot replaced it.
+  const std::optional<V> *Find(std::string_view key, uint64_t snapshot) const {
+    auto it = versions_.find(key);
+    return it == versions_.end() ? nullptr : Find(it, snapshot);
+  }
+  const std::optional<V> *Find(typename Map::const_iterator it,
+                               uint64_t snapshot) const {
+    // the first write after the snapshot replaced the version it saw
+    for (const Version &version : it->second) {
+      if (version.replaced_at > snapshot) {
+        return &version.value;
+      }
+    }
+    return nullptr;
+  }
+
+  // Keys with versions, in order, for range reads that must also see keys
+  // deleted since the snapshot.
+  typename Map::const_iterator LowerBound(std::string_view key) const {
+    return versions_.lower_bound(key);
+  }
+  typename Map::const_iterator End() const { return versions_.end(); }
+
+  // Drops the versions replaced at or before `oldest`, which no snapshot
+  // can read any more. Oldest first, so this stops at the first one kept.
+  void Collect(uint64_t oldest) {
+    while (!order_.empty() && order_.front().first <= oldest) {
+      auto it = order_.front().second;
+      order_.pop_front();
+      it->second.erase(it->second.begin());
+      if (it->second.empty()) {
+        versions_.erase(it);
+      }
+    }
+  }
+
+private:
+  Map versions_;
+  // every version in the order it was recorded, which is sequence order
+  std::deque<std::pair<uint64_t, typename Map::iterator>> order_;
+};
+
+} // namespace tiny_kv
@@ -0,0 +1,131 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "mvcc.h"
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace tiny_kv {
+
+TEST(CommitSequenceTest, WritesRetainOnlyWhileSnapshotsAreOpen) {
+  CommitSequence sequence;
+  {
+    CommitSequence::Write write(&sequence);
+    EXPECT_EQ(write.sequence(), 1u);
+    EXPECT_FALSE(write.retain());
+  }
+  EXPECT_EQ(sequence.LastNumbered(), 1u);
+  EXPECT_EQ(sequence.Oldest(), CommitSequence::kNoSnapshot);
+
+  auto first = std::make_unique<CommitSequence::Snapshot>(&sequence);
+  EXPECT_EQ(first->sequence(), 1u);
+  {
+    CommitSequence::Write write(&sequence);
+    EXPECT_EQ(write.sequence(), 2u);
+    EXPECT_TRUE(write.retain());
+  }
+  {
+    CommitSequence::Snapshot second(&sequence);
+    EXPECT_EQ(second.sequence(), 2u);
+    EXPECT_EQ(sequence.Oldest(), 1u);
+    first.reset();
+    EXPECT_EQ(sequence.Oldest(), 2u);
+  }
+  EXPECT_EQ(sequence.Oldest(), CommitSequence::kNoSnapshot);
+}
+
+TEST(CommitSequenceTest, SnapshotWaitsForNumberedWrites) {
+  CommitSequence sequence;
+  auto write = std::make_unique<CommitSequence::Write>(&sequence);
+
+  std::atomic<bool> opened{false};
+  std::thread reader([&]() {
+    CommitSequence::Snapshot snapshot(&sequence);
+    EXPECT_EQ(snapshot.sequence(), 1u);
+    opened = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_FALSE(opened);
+
+  write.reset();
+  reader.join();
+  EXPECT_TRUE(opened);
+
+  // a write numbered after an open snapshot does not wait for it
+  CommitSequence::Snapshot snapshot(&sequence);
+  CommitSequence::Write later(&sequence);
+  EXPECT_EQ(later.sequence(), 2u);
+  EXPECT_TRUE(later.retain());
+}
+
+TEST(CommitSequenceTest, WritesNeverWaitForEachOther) {
+  CommitSequence sequence;
+  auto first = std::make_unique<CommitSequence::Write>(&sequence);
+  // numbered later, but commits while the first is still in flight
+  std::thread later([&]() {
+    CommitSequence::Write second(&sequence);
+    EXPECT_EQ(second.sequence(), 2u);
+  });
+  later.join();
+
+  std::atomic<bool> opened{false};
+  std::thread reader([&]() {
+    CommitSequence::Snapshot snapshot(&sequence);
+    EXPECT_EQ(snapshot.sequence(), 2u);
+    opened = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  // the snapshot takes in the second write, so it waits for the first
+  EXPECT_FALSE(opened);
+  first.reset();
+  reader.join();
+  EXPECT_TRUE(opened);
+}
+
+TEST(VersionHistoryTest, FindsTheVersionOfASnapshot) {
+  VersionHistory<std::string> history;
+  EXPECT_TRUE(history.Empty());
+  EXPECT_EQ(history.Find("key", 0), nullptr);
+
+  // created at 3, overwritten at 5 and deleted at 8
+  history.Record("key", std::nullopt, 3);
+  history.Record("key", std::string("v3"), 5);
+  history.Record("key", std::string("v5"), 8);
+  history.Record("other", std::string("o"), 6);
+
+  const std::optional<std::string> *version = history.Find("key", 2);
+  ASSERT_NE(version, nullptr);
+  EXPECT_FALSE(version->has_value());
+  for (uint64_t snapshot : {3, 4}) {
+    version = history.Find("key", snapshot);
+    ASSERT_NE(version, nullptr);
+    EXPECT_EQ(*version, "v3");
+  }
+  version = history.Find("key", 7);
+  ASSERT_NE(version, nullptr);
+  EXPECT_EQ(*version, "v5");
+  // nothing replaced it after 8: the live data has it
+  EXPECT_EQ(history.Find("key", 8), nullptr);
+
+  auto it = history.LowerBound("l");
+  ASSERT_NE(it, history.End());
+  EXPECT_EQ(it->first, "other");
+
+  // snapshots at 5 or later still need the versions replaced after 5
+  history.Collect(5);
+  EXPECT_EQ(history.Size(), 2u);
+  version = history.Find("key", 5);
+  ASSERT_NE(version, nullptr);
+  EXPECT_EQ(*version, "v5");
+
+  history.Collect(CommitSequence::kNoSnapshot);
+  EXPECT_TRUE(history.Empty());
+  EXPECT_EQ(history.Size(), 0u);
+}
+
+} // namespace tiny_kv
@@ -0,0 +1,380 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "snapshot.h"
+#include "crc32.h"
+#include "file_util.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace tiny_kv {
+
+namespace {
+
+constexpr uint64_t kMagic = 0x3170616e73766b74ULL; // "tkvsnap1"
+constexpr uint32_t kVersion = 2;
+constexpr uint32_t kMinVersion = 1; // raw values
+constexpr size_t kHeaderSize = sizeof(uint64_t) + 2 * sizeof(uint32_t);
+constexpr size_t kFooterSize = 6 * sizeof(uint64_t) + sizeof(uint32_t);
+constexpr size_t kChunkSize = 1 << 20; // blocks written at once
+constexpr uint64_t kManifestMagic = 0x3174736d73766b74ULL; // "tkvsmst1"
+constexpr size_t kManifestSize =
+    2 * sizeof(uint64_t) + 2 * sizeof(uint32_t);
+
+template <typename T> void AppendFixed(std::string *dst, T value) {
+  dst->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename T> T DecodeFixed(const char *src) {
+  T value;
+  memcpy(&value, src, sizeof(T));
+  return value;
+}
+
+} // namespace
+
+/************************************************************************/
+/* SnapshotWriter */
+/************************************************************************/
+SnapshotWriter::SnapshotWriter(const std::string &path, uint32_t block_size,
+                               AsyncIo *io)
+    : path_(path), block_size_(block_size), io_(io) {}
+
+SnapshotWriter::~SnapshotWriter() {
+  // a write in flight still reads `writing_`
+  WaitForWrite();
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool SnapshotWriter::Open() {
+  fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    return false;
+  }
+
+  std::string header;
+  AppendFixed<uint64_t>(&header, kMagic);
+  AppendFixed<uint32_t>(&header, kVersion);
+  AppendFixed<uint32_t>(&header, block_size_);
+  chunk_.reserve(kChunkSize + block_size_);
+  return Write(&header, false);
+}
+
+bool SnapshotWriter::Add(std::string_view key, std::string_view value) {
+  AppendFixed<uint32_t>(&index_, static_cast<uint32_t>(key.size()));
+  index_.append(key.data(), key.size());
+  AppendFixed<uint64_t>(&index_, value_offset_);
+  AppendFixed<uint32_t>(&index_, static_cast<uint32_t>(value.size()));
+  ++num_entries_;
+  value_offset_ += value.size();
+
+  while (!value.empty()) {
+    size_t used = chunk_.size() % block_size_;
+    size_t n = std::min<size_t>(value.size(), block_size_ - used);
+    chunk_.append(value.data(), n);
+    value.remove_prefix(n);
+    if (chunk_.size() % block_size_ == 0 && !FlushBlock()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SnapshotWriter::FlushBlock() {
+  size_t padded =
+      (chunk_.size() + block_size_ - 1) / block_size_ * block_size_;
+  chunk_.resize(padded, '\0');
+  AppendFixed<uint32_t>(
+      &crcs_, Crc32(chunk_.data() + padded - block_size_, block_size_));
+  ++num_blocks_;
+  return chunk_.size() < kChunkSize || Write(&chunk_, false);
+}
+
+bool SnapshotWriter::Finish() {
+  if (chunk_.size() % block_size_ != 0 && !FlushBlock()) {
+    return false;
+  }
+
+  uint64_t crcs_offset = kHeaderSize + num_blocks_ * block_size_;
+  uint64_t index_offset = crcs_offset + crcs_.size();
+
+  std::string footer;
+  AppendFixed<uint64_t>(&footer, crcs_offset);
+  AppendFixed<uint64_t>(&footer, index_offset);
+  AppendFixed<uint64_t>(&footer, index_.size());
+  AppendFixed<uint64_t>(&footer, num_blocks_);
+  AppendFixed<uint64_t>(&footer, num_entries_);
+  AppendFixed<uint32_t>(&footer, Crc32(index_.data(), index_.size()));
+  AppendFixed<uint64_t>(&footer, kMagic);
+
+  if (!Write(&chunk_, false) || !Write(&crcs_, false) ||
+      !Write(&index_, false) || !Write(&footer, true) || !WaitForWrite()) {
+    return false;
+  }
+
+  close(fd_);
+  fd_ = -1;
+  return true;
+}
+
+bool SnapshotWriter::Write(std::string *data, bool sync) {
+  if (data->empty() && !sync) {
+    return true;
+  }
+  if (!io_) {
+    bool ok = WriteFully(fd_, data->data(), data->size()) &&
+              (!sync || fsync(fd_) == 0);
+    file_offset_ += data->size();
+    data->clear();
+    return ok;
+  }
+
+  if (!WaitForWrite()) {
+    return false;
+  }
+  // hand over the bytes and keep the capacity of the last chunk written
+  writing_.swap(*data);
+  data->clear();
+
+  AsyncIo::WriteOp op;
+  op.fd = fd_;
+  op.data = writing_.data();
+  op.size = writing_.size();
+  op.offset = file_offset_;
+  op.sync = sync;
+  file_offset_ += writing_.size();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    in_flight_ = true;
+  }
+  io_->Submit(op, [this](int error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    in_flight_ = false;
+    if (error != 0) {
+      error_ = error;
+    }
+    written_cv_.notify_all();
+  });
+  return true;
+}
+
+bool SnapshotWriter::WaitForWrite() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  written_cv_.wait(lock, [this]() { return !in_flight_; });
+  return error_ == 0;
+}
+
+/************************************************************************/
+/* MappedSnapshot */
+/************************************************************************/
+bool MappedSnapshot::IsSnapshotFile(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  uint64_t magic = 0;
+  bool ok = PreadFully(fd, reinterpret_cast<char *>(&magic), sizeof(magic), 0);
+  close(fd);
+  return ok && magic == kMagic;
+}
+
+std::shared_ptr<MappedSnapshot> MappedSnapshot::Open(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<uint64_t>(st.st_size) < kHeaderSize + kFooterSize) {
+    close(fd);
+    return nullptr;
+  }
+
+  size_t size = st.st_size;
+  void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return nullptr;
+  }
+
+  std::shared_ptr<MappedSnapshot> snapshot(new MappedSnapshot());
+  snapshot->base_ = static_cast<const char *>(addr);
+  snapshot->mapped_size_ = size;
+
+  const char *base = snapshot->base_;
+  const char *footer = base + size - kFooterSize;
+  snapshot->version_ = DecodeFixed<uint32_t>(base + sizeof(uint64_t));
+  if (DecodeFixed<uint64_t>(base) != kMagic ||
+      snapshot->version_ < kMinVersion || snapshot->version_ > kVersion ||
+      DecodeFixed<uint64_t>(footer + kFooterSize - sizeof(uint64_t)) !=
+          kMagic) {
+    return nullptr;
+  }
+
+  snapshot->block_size_ = DecodeFixed<uint32_t>(base + sizeof(uint64_t) +
+                                                sizeof(uint32_t));
+  uint64_t crcs_offset = DecodeFixed<uint64_t>(footer);
+  uint64_t index_offset = DecodeFixed<uint64_t>(footer + 8);
+  snapshot->index_size_ = DecodeFixed<uint64_t>(footer + 16);
+  snapshot->num_blocks_ = DecodeFixed<uint64_t>(footer + 24);
+  snapshot->num_entries_ = DecodeFixed<uint64_t>(footer + 32);
+  uint32_t index_crc = DecodeFixed<uint32_t>(footer + 40);
+
+  if (snapshot->block_size_ == 0 ||
+      crcs_offset !=
+          kHeaderSize + snapshot->num_blocks_ * snapshot->block_size_ ||
+      index_offset != crcs_offset + snapshot->num_blocks_ * sizeof(uint32_t) ||
+      index_offset + snapshot->index_size_ != size - kFooterSize) {
+    return nullptr;
+  }
+
+  snapshot->blocks_ = base + kHeaderSize;
+  snapshot->crcs_ = base + crcs_offset;
+  snapshot->index_ = base + index_offset;
+  if (Crc32(snapshot->index_, snapshot->index_size_) != index_crc) {
+    return nullptr;
+  }
+
+  snapshot->block_state_ =
+      std::make_unique<std::atomic<uint8_t>[]>(snapshot->num_blocks_);
+  for (uint64_t i = 0; i < snapshot->num_blocks_; ++i) {
+    snapshot->block_state_[i].store(0, std::memory_order_relaxed);
+  }
+
+  // values are read at random once loaded
+  madvise(addr, size, MADV_RANDOM);
+  return snapshot;
+}
+
+MappedSnapshot::~MappedSnapshot() {
+  if (base_) {
+    munmap(const_cast<char *>(base_), mapped_size_);
+  }
+}
+
+bool MappedSnapshot::ForEachIndexEntry(const IndexVisitor &visitor) const {
+  const char *p = index_;
+  const char *end = index_ + index_size_;
+  uint64_t total_values = num_blocks_ * block_size_;
+
+  for (uint64_t i = 0; i < num_entries_; ++i) {
+    if (end - p < static_cast<ptrdiff_t>(sizeof(uint32_t))) {
+      return false;
+    }
+    uint32_t key_size = DecodeFixed<uint32_t>(p);
+    p += sizeof(uint32_t);
+    if (static_cast<uint64_t>(end - p) <
+        key_size + sizeof(uint64_t) + sizeof(uint32_t)) {
+      return false;
+    }
+
+    std::string_view key(p, key_size);
+    p += key_size;
+    uint64_t value_offset = DecodeFixed<uint64_t>(p);
+    p += sizeof(uint64_t);
+    uint32_t value_size = DecodeFixed<uint32_t>(p);
+    p += sizeof(uint32_t);
+
+    if (value_offset + value_size > total_values) {
+      return false;
+    }
+    visitor(key, value_offset, value_size);
+  }
+  return p == end;
+}
+
+bool MappedSnapshot::VerifyBlock(uint64_t block) const {
+  uint8_t state = block_state_[block].load(std::memory_order_acquire);
+  if (state == 0) {
+    const char *data = blocks_ + block * block_size_;
+    bool ok = Crc32(data, block_size_) ==
+              DecodeFixed<uint32_t>(crcs_ + block * sizeof(uint32_t));
+    state = ok ? 1 : 2;
+    block_state_[block].store(state, std::memory_order_release);
+  }
+  return state == 1;
+}
+
+bool MappedSnapshot::Read(uint64_t offset, uint32_t size,
+                          std::string_view *value) const {
+  if (size > 0) {
+    uint64_t first = offset / block_size_;
+    uint64_t last = (offset + size - 1) / block_size_;
+    for (uint64_t block = first; block <= last; ++block) {
+      if (!VerifyBlock(block)) {
+        return false;
+      }
+    }
+  }
+
+  *value = std::string_view(blocks_ + offset, size);
+  return true;
+}
+
+/************************************************************************/
+/* SnapshotManifest */
+/************************************************************************/
+bool SnapshotManifest::IsManifestFile(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  uint64_t magic = 0;
+  bool ok = PreadFully(fd, reinterpret_cast<char *>(&magic), sizeof(magic), 0);
+  close(fd);
+  return ok && magic == kManifestMagic;
+}
+
+bool SnapshotManifest::Read(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  char content[kManifestSize];
+  bool ok = PreadFully(fd, content, sizeof(content), 0);
+  close(fd);
+
+  const size_t crc_offset = kManifestSize - sizeof(uint32_t);
+  if (!ok || DecodeFixed<uint64_t>(content) != kManifestMagic ||
+      Crc32(content, crc_offset) !=
+          DecodeFixed<uint32_t>(content + crc_offset)) {
+    return false;
+  }
+  generation = DecodeFixed<uint64_t>(content + sizeof(uint64_t));
+  num_partitions = DecodeFixed<uint32_t>(content + 2 * sizeof(uint64_t));
+  return true;
+}
+
+bool SnapshotManifest::Write(const std::string &path) const {
+  std::string content;
+  AppendFixed<uint64_t>(&content, kManifestMagic);
+  AppendFixed<uint64_t>(&content, generation);
+  AppendFixed<uint32_t>(&content, num_partitions);
+  AppendFixed<uint32_t>(&content, Crc32(content.data(), content.size()));
+
+  const std::string tmp_path = path + ".tmp";
+  int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  bool ok = WriteFully(fd, content.data(), content.size()) && fsync(fd) == 0;
+  close(fd);
+  return ok && std::rename(tmp_path.c_str(), path.c_str()) == 0 &&
+         SyncParentDir(path);
+}
+
+std::string SnapshotManifest::PartitionPath(const std::string &path,
+                                            uint32_t i) const {
+  return path + "." + std::to_string(generation) + ".part" +
+         std::to_string(i);
+}
+
+} // namespace tiny_kv
@@ -0,0 +1,150 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#pragma once
+
+#include "src/common/async_io.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace tiny_kv {
+
+// Snapshot file layout:
+//   [header][block 0]...[block n-1][block crcs][index][footer]
+// header = [magic u64][version u32][block_size u32]
+//          version 2 values are encoded (value_codec.h), version 1 raw
+// blocks = the values, packed back to back and cut into fixed-size blocks
+//          (a value may straddle blocks; the last block is zero padded)
+// crcs   = one crc32 per block
+// index  = per entry [key_len u32][key][value_offset u64][value_size u32],
+//          value_offset is relative to the first block
+// footer = [crcs_offset u64][index_offset u64][index_size u64]
+//          [num_blocks u64][num_entries u64][index_crc u32][magic u64]
+//
+// Keys live only in the trailing index, so a loader reads key bytes and
+// never touches the blocks until a value is requested.
+//
+// A partitioned snapshot is a set of such files, one per partition, named
+// by a manifest (see SnapshotManifest) that is written last.
+
+/************************************************************************/
+/* SnapshotWriter */
+/************************************************************************/
+// Blocks are written in chunks of several blocks. With an `io` backend a
+// chunk is written while the next one fills, and `Finish()` syncs through
+// it too; without one the writer blocks on each chunk.
+class SnapshotWriter {
+public:
+  explicit SnapshotWriter(const std::string &path,
+                          uint32_t block_size = 64 << 10,
+                          AsyncIo *io = nullptr);
+  ~SnapshotWriter();
+
+  SnapshotWriter(const SnapshotWriter &) = delete;
+  SnapshotWriter &operator=(const SnapshotWriter &) = delete;
+
+  bool Open();
+  bool Add(std::string_view key, std::string_view value);
+  // Writes the block checksums, index and footer and fsyncs the file.
+  bool Finish();
+
+private:
+  // Pads the open block at the end of `chunk_` and checksums it.
+  bool FlushBlock();
+  // Writes `data` at the end of the file, syncing after it if `sync`. With
+  // `io_` only `data` of the previous call may still be in flight.
+  bool Write(std::string *data, bool sync);
+  // Waits for the write in flight, if any; false if a write failed.
+  bool WaitForWrite();
+
+private:
+  std::string path_;
+  uint32_t block_size_;
+  AsyncIo *io_;
+  int fd_ = -1;
+  uint64_t file_offset_ = 0;
+  std::string chunk_; // whole blocks, then the open block
+  std::string crcs_;
+  std::string index_;
+  uint64_t num_blocks_ = 0;
+  uint64_t num_entries_ = 0;
+  uint64_t value_offset_ = 0;
+
+  // the chunk being written through `io_`
+  std::string writing_;
+  std::mutex mutex_;
+  std::condition_variable written_cv_;
+  bool in_flight_ = false;
+  int error_ = 0;
+};
+
+/************************************************************************/
+/* MappedSnapshot */
+/************************************************************************/
+// Read-only mmap of a snapshot. Block checksums are verified lazily, the
+// first time a value stored in the block is read.
+class MappedSnapshot {
+public:
+  using IndexVisitor = std::function<void(std::string_view key,
+                                          uint64_t value_offset,
+                                          uint32_t value_size)>;
+
+  // Returns nullptr if the file is missing or not in this format.
+  static std::shared_ptr<MappedSnapshot> Open(const std::string &path);
+  static bool IsSnapshotFile(const std::string &path);
+  ~MappedSnapshot();
+
+  uint64_t NumEntries() const { return num_entries_; }
+  // Whether values were written encoded; older snapshots hold raw values.
+  bool EncodedValues() const { return version_ >= 2; }
+  bool ForEachIndexEntry(const IndexVisitor &visitor) const;
+  // Points `value` into the mapping. Fails if a covering block is corrupt.
+  bool Read(uint64_t offset, uint32_t size, std::string_view *value) const;
+
+private:
+  MappedSnapshot() = default;
+  bool VerifyBlock(uint64_t block) const;
+
+private:
+  const char *base_ = nullptr;
+  size_t mapped_size_ = 0;
+  const char *blocks_ = nullptr;
+  const char *crcs_ = nullptr;
+  const char *index_ = nullptr;
+  uint64_t index_size_ = 0;
+  uint32_t version_ = 0;
+  uint32_t block_size_ = 0;
+  uint64_t num_blocks_ = 0;
+  uint64_t num_entries_ = 0;
+  // 0 = unchecked, 1 = ok, 2 = corrupt
+  std::unique_ptr<std::atomic<uint8_t>[]> block_state_;
+};
+
+/************************************************************************/
+/* SnapshotManifest */
+/************************************************************************/
+// Names the partition files of a snapshot:
+//   [magic u64][generation u64][num_partitions u32][crc32 u32]
+// Every checkpoint writes a new generation of partitions and then swaps the
+// manifest in with a rename, so the manifest always names a complete set.
+struct SnapshotManifest {
+  uint64_t generation = 0;
+  uint32_t num_partitions = 0;
+
+  static bool IsManifestFile(const std::string &path);
+  // Fails if `path` is missing, not a manifest or corrupt.
+  bool Read(const std::string &path);
+  // Replaces `path` durably, through a temporary file and a rename.
+  bool Write(const std::string &path) const;
+  // `<path>.<generation>.part<i>`, next to the manifest at `path`.
+  std::string PartitionPath(const std::string &path, uint32_t i) const;
+};
+
+} // namespace tiny_kv
@@ -0,0 +1,100 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "snapshot.h"
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <map>
+#include <string>
+
+namespace tiny_kv {
+
+namespace {
+
+std::map<std::string, std::string> WriteSnapshot(const std::string &path) {
+  std::map<std::string, std::string> data;
+  SnapshotWriter writer(path, 64);
+  EXPECT_TRUE(writer.Open());
+  for (int i = 0; i < 100; ++i) {
+    std::string key = "key" + std::to_string(i);
+    // sizes 0..198 so values straddle several 64 byte blocks
+    std::string value(i * 2, static_cast<char>('a' + i % 26));
+    EXPECT_TRUE(writer.Add(key, value));
+    data[key] = value;
+  }
+  EXPECT_TRUE(writer.Finish());
+  return data;
+}
+
+} // namespace
+
+TEST(SnapshotTest, WriteAndMap) {
+  const std::string path = "snapshot_test.snap";
+  auto expected = WriteSnapshot(path);
+
+  ASSERT_TRUE(MappedSnapshot::IsSnapshotFile(path));
+  auto snapshot = MappedSnapshot::Open(path);
+  ASSERT_NE(snapshot, nullptr);
+  EXPECT_EQ(snapshot->NumEntries(), expected.size());
+
+  size_t count = 0;
+  EXPECT_TRUE(snapshot->ForEachIndexEntry(
+      [&](std::string_view key, uint64_t offset, uint32_t size) {
+        std::string_view value;
+        ASSERT_TRUE(snapshot->Read(offset, size, &value));
+        EXPECT_EQ(value, expected[std::string(key)]);
+        ++count;
+      }));
+  EXPECT_EQ(count, expected.size());
+
+  std::filesystem::remove(path);
+}
+
+TEST(SnapshotTest, CorruptBlockIsDetectedOnRead) {
+  const std::string path = "snapshot_test_corrupt.snap";
+  WriteSnapshot(path);
+
+  // flip a byte inside the first data block (right after the 16 byte header)
+  {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(16 + 10);
+    file.put('#');
+  }
+
+  auto snapshot = MappedSnapshot::Open(path);
+  ASSERT_NE(snapshot, nullptr);
+
+  int corrupt = 0;
+  int intact = 0;
+  snapshot->ForEachIndexEntry(
+      [&](std::string_view, uint64_t offset, uint32_t size) {
+        std::string_view value;
+        if (snapshot->Read(offset, size, &value)) {
+          ++intact;
+        } else {
+          ++corrupt;
+        }
+      });
+  EXPECT_GT(corrupt, 0);
+  EXPECT_GT(intact, corrupt);
+
+  std::filesystem::remove(path);
+}
+
+TEST(SnapshotTest, RejectsForeignFiles) {
+  const std::string path = "snapshot_test_foreign.snap";
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << std::string(128, 'x');
+  }
+
+  EXPECT_FALSE(MappedSnapshot::IsSnapshotFile(path));
+  EXPECT_EQ(MappedSnapshot::Open(path), nullptr);
+  EXPECT_EQ(MappedSnapshot::Open("snapshot_test_missing.snap"), nullptr);
+
+  std::filesystem::remove(path);
+}
+
+} // namespace tiny_kv
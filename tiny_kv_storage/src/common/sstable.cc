@@ -0,0 +1,368 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "sstable.h"
+#include "crc32.h"
+#include "file_util.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace tiny_kv {
+
+namespace {
+
+constexpr uint32_t kTombstone = 0xFFFFFFFF;
+constexpr uint64_t kMagic = 0x74696e796b76734cULL; // "tinykvsL"
+constexpr size_t kFooterSize = sizeof(uint64_t) * 6;
+constexpr size_t kTrailerSize = sizeof(uint32_t);
+
+template <typename T> void AppendFixed(std::string *dst, T value) {
+  dst->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename T> bool DecodeFixed(std::string_view *src, T *value) {
+  if (src->size() < sizeof(T)) {
+    return false;
+  }
+  memcpy(value, src->data(), sizeof(T));
+  src->remove_prefix(sizeof(T));
+  return true;
+}
+
+} // namespace
+
+/************************************************************************/
+/* SSTableBuilder */
+/************************************************************************/
+SSTableBuilder::SSTableBuilder(const std::string &path,
+                               const SSTableOptions &options)
+    : path_(path), options_(options), filter_(options.bloom_bits_per_key) {}
+
+SSTableBuilder::~SSTableBuilder() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  if (!finished_) {
+    unlink(path_.c_str());
+  }
+}
+
+bool SSTableBuilder::Open() {
+  fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  return fd_ >= 0;
+}
+
+bool SSTableBuilder::Add(std::string_view key,
+                         std::optional<std::string_view> value) {
+  if (num_entries_ == 0) {
+    smallest_key_.assign(key.data(), key.size());
+  }
+  largest_key_.assign(key.data(), key.size());
+  filter_.AddKey(key);
+  ++num_entries_;
+
+  AppendFixed<uint32_t>(&block_, static_cast<uint32_t>(key.size()));
+  AppendFixed<uint32_t>(&block_, value ? static_cast<uint32_t>(value->size())
+                                       : kTombstone);
+  block_.append(key.data(), key.size());
+  if (value) {
+    block_.append(value->data(), value->size());
+  }
+
+  if (block_.size() >= options_.block_bytes) {
+    return FlushBlock();
+  }
+  return true;
+}
+
+bool SSTableBuilder::FlushBlock() {
+  if (block_.empty()) {
+    return true;
+  }
+
+  uint64_t offset = 0;
+  uint64_t size = 0;
+  if (!WriteBlock(block_, &offset, &size)) {
+    return false;
+  }
+
+  AppendFixed<uint32_t>(&index_, static_cast<uint32_t>(largest_key_.size()));
+  index_.append(largest_key_);
+  AppendFixed<uint64_t>(&index_, offset);
+  AppendFixed<uint32_t>(&index_, static_cast<uint32_t>(size));
+  block_.clear();
+  return true;
+}
+
+bool SSTableBuilder::WriteBlock(const std::string &block, uint64_t *offset,
+                                uint64_t *size) {
+  uint32_t crc = Crc32(block.data(), block.size());
+  if (!WriteFully(fd_, block.data(), block.size()) ||
+      !WriteFully(fd_, reinterpret_cast<const char *>(&crc), sizeof(crc))) {
+    return false;
+  }
+
+  *offset = offset_;
+  *size = block.size();
+  offset_ += block.size() + kTrailerSize;
+  return true;
+}
+
+bool SSTableBuilder::Finish() {
+  if (!FlushBlock()) {
+    return false;
+  }
+
+  uint64_t filter_offset = 0;
+  uint64_t filter_size = 0;
+  uint64_t index_offset = 0;
+  uint64_t index_size = 0;
+  if (!WriteBlock(filter_.Finish(), &filter_offset, &filter_size) ||
+      !WriteBlock(index_, &index_offset, &index_size)) {
+    return false;
+  }
+
+  std::string footer;
+  AppendFixed<uint64_t>(&footer, filter_offset);
+  AppendFixed<uint64_t>(&footer, filter_size);
+  AppendFixed<uint64_t>(&footer, index_offset);
+  AppendFixed<uint64_t>(&footer, index_size);
+  AppendFixed<uint64_t>(&footer, num_entries_);
+  AppendFixed<uint64_t>(&footer, kMagic);
+  if (!WriteFully(fd_, footer.data(), footer.size()) || fdatasync(fd_) != 0) {
+    return false;
+  }
+  offset_ += footer.size();
+
+  close(fd_);
+  fd_ = -1;
+  finished_ = true;
+  return true;
+}
+
+/************************************************************************/
+/* SSTableReader */
+/************************************************************************/
+std::shared_ptr<SSTableReader> SSTableReader::Open(const std::string &path) {
+  std::shared_ptr<SSTableReader> table(new SSTableReader());
+  table->fd_ = open(path.c_str(), O_RDONLY);
+  if (table->fd_ < 0) {
+    return nullptr;
+  }
+
+  struct stat st;
+  if (fstat(table->fd_, &st) != 0 ||
+      static_cast<uint64_t>(st.st_size) < kFooterSize) {
+    return nullptr;
+  }
+
+  std::string footer(kFooterSize, '\0');
+  if (!PreadFully(table->fd_, &footer[0], kFooterSize,
+                  st.st_size - kFooterSize)) {
+    return nullptr;
+  }
+
+  std::string_view input(footer);
+  uint64_t filter_offset = 0, filter_size = 0, index_offset = 0;
+  uint64_t index_size = 0, magic = 0;
+  DecodeFixed(&input, &filter_offset);
+  DecodeFixed(&input, &filter_size);
+  DecodeFixed(&input, &index_offset);
+  DecodeFixed(&input, &index_size);
+  DecodeFixed(&input, &table->num_entries_);
+  DecodeFixed(&input, &magic);
+  if (magic != kMagic) {
+    return nullptr;
+  }
+
+  std::string index;
+  if (!table->ReadBlock(filter_offset, filter_size, &table->filter_) ||
+      !table->ReadBlock(index_offset, index_size, &index)) {
+    return nullptr;
+  }
+
+  input = index;
+  while (!input.empty()) {
+    uint32_t key_length = 0;
+    uint32_t size = 0;
+    IndexEntry entry;
+    if (!DecodeFixed(&input, &key_length) || input.size() < key_length) {
+      return nullptr;
+    }
+    entry.last_key.assign(input.data(), key_length);
+    input.remove_prefix(key_length);
+    if (!DecodeFixed(&input, &entry.offset) || !DecodeFixed(&input, &size)) {
+      return nullptr;
+    }
+    entry.size = size;
+    table->index_.push_back(std::move(entry));
+  }
+
+  table->block_reads_ = 0;
+  return table;
+}
+
+SSTableReader::~SSTableReader() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool SSTableReader::ReadBlock(uint64_t offset, uint64_t size,
+                              std::string *block) const {
+  block->resize(size + kTrailerSize);
+  if (!PreadFully(fd_, &(*block)[0], block->size(), offset)) {
+    return false;
+  }
+  ++block_reads_;
+
+  uint32_t crc;
+  memcpy(&crc, block->data() + size, sizeof(crc));
+  block->resize(size);
+  return Crc32(block->data(), size) == crc;
+}
+
+bool SSTableReader::MayContain(std::string_view key) const {
+  return BloomFilterMayContain(filter_, key);
+}
+
+SSTableReader::LookupResult SSTableReader::Get(std::string_view key,
+                                               std::string *value) const {
+  if (!MayContain(key)) {
+    return LookupResult::kNotFound;
+  }
+
+  // first block whose last key is >= key
+  auto it = std::lower_bound(
+      index_.begin(), index_.end(), key,
+      [](const IndexEntry &entry, std::string_view k) {
+        return std::string_view(entry.last_key) < k;
+      });
+  if (it == index_.end()) {
+    return LookupResult::kNotFound;
+  }
+
+  std::string block;
+  if (!ReadBlock(it->offset, it->size, &block)) {
+    return LookupResult::kNotFound;
+  }
+
+  std::string_view input(block);
+  while (!input.empty()) {
+    uint32_t key_length = 0;
+    uint32_t value_length = 0;
+    if (!DecodeFixed(&input, &key_length) ||
+        !DecodeFixed(&input, &value_length) || input.size() < key_length) {
+      break;
+    }
+    std::string_view entry_key = input.substr(0, key_length);
+    input.remove_prefix(key_length);
+
+    bool is_deletion = value_length == kTombstone;
+    size_t stored_length = is_deletion ? 0 : value_length;
+    if (input.size() < stored_length) {
+      break;
+    }
+
+    if (entry_key == key) {
+      if (is_deletion) {
+        return LookupResult::kDeleted;
+      }
+      value->assign(input.data(), stored_length);
+      return LookupResult::kFound;
+    }
+    if (entry_key > key) {
+      break;
+    }
+    input.remove_prefix(stored_length);
+  }
+
+  return LookupResult::kNotFound;
+}
+
+std::unique_ptr<SSTableReader::Iterator>
+SSTableReader::NewIterator(std::string_view start) const {
+  return std::make_unique<Iterator>(this, start);
+}
+
+/************************************************************************/
+/* SSTableReader::Iterator */
+/************************************************************************/
+SSTableReader::Iterator::Iterator(const SSTableReader *table,
+                                  std::string_view start)
+    : table_(table) {
+  // first block whose last key is >= start
+  auto it = std::lower_bound(
+      table_->index_.begin(), table_->index_.end(), start,
+      [](const IndexEntry &entry, std::string_view k) {
+        return std::string_view(entry.last_key) < k;
+      });
+  if (LoadBlock(it - table_->index_.begin())) {
+    ParseEntry();
+  }
+  while (valid_ && key_ < start) {
+    Next();
+  }
+}
+
+bool SSTableReader::Iterator::LoadBlock(size_t index) {
+  block_index_ = index;
+  pos_ = 0;
+  if (index >= table_->index_.size()) {
+    valid_ = false;
+    return false;
+  }
+
+  const auto &entry = table_->index_[index];
+  if (!table_->ReadBlock(entry.offset, entry.size, &block_)) {
+    ok_ = false;
+    valid_ = false;
+    return false;
+  }
+  return true;
+}
+
+void SSTableReader::Iterator::ParseEntry() {
+  std::string_view input(block_);
+  input.remove_prefix(pos_);
+
+  uint32_t key_length = 0;
+  uint32_t value_length = 0;
+  if (!DecodeFixed(&input, &key_length) ||
+      !DecodeFixed(&input, &value_length)) {
+    ok_ = false;
+    valid_ = false;
+    return;
+  }
+
+  is_deletion_ = value_length == kTombstone;
+  size_t stored_length = is_deletion_ ? 0 : value_length;
+  if (input.size() < key_length + stored_length) {
+    ok_ = false;
+    valid_ = false;
+    return;
+  }
+
+  key_ = input.substr(0, key_length);
+  value_ = input.substr(key_length, stored_length);
+  pos_ += 2 * sizeof(uint32_t) + key_length + stored_length;
+  valid_ = true;
+}
+
+void SSTableReader::Iterator::Next() {
+  if (!valid_) {
+    return;
+  }
+  if (pos_ >= block_.size()) {
+    if (!LoadBlock(block_index_ + 1)) {
+      return;
+    }
+  }
+  ParseEntry();
+}
+
+} // namespace tiny_kv
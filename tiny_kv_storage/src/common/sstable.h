@@ -0,0 +1,138 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#pragma once
+
+#include "src/common/bloom_filter.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tiny_kv {
+
+struct SSTableOptions {
+  size_t block_bytes = 4096;
+  int bloom_bits_per_key = 10;
+};
+
+// File layout:
+//   [data block]...[data block][filter block][index block][footer]
+// data block  = entries + crc32, entry = [key_len u32][value_len u32][key][value]
+//               (value_len == kTombstone marks a deletion)
+// index block = one [last_key_len u32][last_key][offset u64][size u32] per
+//               data block + crc32, i.e. a sparse index over the blocks
+// filter block = bloom filter over all keys + crc32
+// footer      = [filter_offset u64][filter_size u64][index_offset u64]
+//               [index_size u64][num_entries u64][magic u64]
+
+/************************************************************************/
+/* SSTableBuilder */
+/************************************************************************/
+class SSTableBuilder {
+public:
+  SSTableBuilder(const std::string &path, const SSTableOptions &options);
+  ~SSTableBuilder();
+
+  SSTableBuilder(const SSTableBuilder &) = delete;
+  SSTableBuilder &operator=(const SSTableBuilder &) = delete;
+
+  bool Open();
+  // Keys must arrive in strictly increasing order; `std::nullopt` is a
+  // deletion marker.
+  bool Add(std::string_view key, std::optional<std::string_view> value);
+  // Writes filter, index and footer and fsyncs the file.
+  bool Finish();
+
+  uint64_t FileSize() const { return offset_ + block_.size(); }
+  uint64_t NumEntries() const { return num_entries_; }
+  const std::string &smallest_key() const { return smallest_key_; }
+  const std::string &largest_key() const { return largest_key_; }
+
+private:
+  bool FlushBlock();
+  bool WriteBlock(const std::string &block, uint64_t *offset, uint64_t *size);
+
+private:
+  std::string path_;
+  SSTableOptions options_;
+  int fd_ = -1;
+  bool finished_ = false;
+  uint64_t offset_ = 0;
+  uint64_t num_entries_ = 0;
+  std::string block_;
+  std::string index_;
+  BloomFilterBuilder filter_;
+  std::string smallest_key_;
+  std::string largest_key_;
+};
+
+/************************************************************************/
+/* SSTableReader */
+/************************************************************************/
+// Keeps the sparse index and the bloom filter in memory; a lookup costs at
+// most one block read, and none when the filter rules the key out.
+class SSTableReader {
+public:
+  enum class LookupResult { kNotFound, kFound, kDeleted };
+
+  class Iterator {
+  public:
+    // Starts at the first key >= `start`.
+    explicit Iterator(const SSTableReader *table, std::string_view start = {});
+
+    bool Valid() const { return valid_; }
+    void Next();
+    std::string_view key() const { return key_; }
+    std::string_view value() const { return value_; }
+    bool is_deletion() const { return is_deletion_; }
+    bool status() const { return ok_; }
+
+  private:
+    bool LoadBlock(size_t index);
+    void ParseEntry();
+
+    const SSTableReader *table_;
+    size_t block_index_ = 0;
+    std::string block_;
+    size_t pos_ = 0;
+    bool valid_ = false;
+    bool ok_ = true;
+    std::string_view key_;
+    std::string_view value_;
+    bool is_deletion_ = false;
+  };
+
+  static std::shared_ptr<SSTableReader> Open(const std::string &path);
+  ~SSTableReader();
+
+  bool MayContain(std::string_view key) const;
+  LookupResult Get(std::string_view key, std::string *value) const;
+  std::unique_ptr<Iterator> NewIterator(std::string_view start = {}) const;
+
+  uint64_t NumEntries() const { return num_entries_; }
+  uint64_t BlockReads() const { return block_reads_.load(); }
+
+private:
+  struct IndexEntry {
+    std::string last_key;
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  SSTableReader() = default;
+  bool ReadBlock(uint64_t offset, uint64_t size, std::string *block) const;
+
+private:
+  int fd_ = -1;
+  uint64_t num_entries_ = 0;
+  std::string filter_;
+  std::vector<IndexEntry> index_;
+  mutable std::atomic<uint64_t> block_reads_{0};
+};
+
+} // namespace tiny_kv
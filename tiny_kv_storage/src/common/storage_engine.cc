@@ -3,82 +3,1414 @@
 //
 
 #include "storage_engine.h"
+#include "cached_storage.h"
+#include "file_util.h"
+#include "lsm_storage.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
 #include <filesystem>
 #include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <queue>
 
 namespace tiny_kv {
 
+namespace {
+
+size_t RoundUpToPowerOfTwo(size_t n) {
+  size_t power = 1;
+  while (power < n) {
+    power <<= 1;
+  }
+  return power;
+}
+
+// The shards touched by a batch in index order, each with the range of
+// `order` that holds its batch indices in batch order.
+struct ShardGroup {
+  size_t shard;
+  size_t begin;
+  size_t end;
+};
+
+std::vector<ShardGroup> GroupByShard(const std::vector<size_t> &shard_of,
+                                     size_t num_shards,
+                                     std::vector<size_t> *order) {
+  // counting sort keeps the batch order within a shard
+  std::vector<size_t> start(num_shards + 1, 0);
+  for (size_t shard : shard_of) {
+    ++start[shard + 1];
+  }
+  for (size_t shard = 1; shard <= num_shards; ++shard) {
+    start[shard] += start[shard - 1];
+  }
+  order->resize(shard_of.size());
+  for (size_t i = 0; i < shard_of.size(); ++i) {
+    (*order)[start[shard_of[i]]++] = i;
+  }
+
+  std::vector<ShardGroup> groups;
+  for (size_t begin = 0; begin < order->size();) {
+    size_t shard = shard_of[(*order)[begin]];
+    size_t end = begin + 1;
+    while (end < order->size() && shard_of[(*order)[end]] == shard) {
+      ++end;
+    }
+    groups.push_back({shard, begin, end});
+    begin = end;
+  }
+  return groups;
+}
+
+// Calls `fn(shard, begin, end)` once per shard touched by a batch, where
+// [begin, end) are the batch indices in that shard in batch order. Lets a
+// batch take every shard lock once.
+template <typename Fn>
+void ForEachShardGroup(const std::vector<size_t> &shard_of, size_t num_shards,
+                       Fn &&fn) {
+  std::vector<size_t> order;
+  for (const auto &group : GroupByShard(shard_of, num_shards, &order)) {
+    fn(group.shard, order.data() + group.begin, order.data() + group.end);
+  }
+}
+
+// Like `ForEachShardGroup` for a write batch, as one write of `sequence`:
+// `fn(shard, write, begin, end)` runs with the write lock of every shard in
+// the batch held, taken in index order, so snapshots see all of the batch
+// or none of it.
+template <typename Shards, typename Fn>
+void ApplyBatch(Shards &shards, const std::vector<size_t> &shard_of,
+                CommitSequence *sequence, Fn &&fn) {
+  std::vector<size_t> order;
+  auto groups = GroupByShard(shard_of, shards.size(), &order);
+  std::vector<std::unique_lock<std::shared_mutex>> locks;
+  locks.reserve(groups.size());
+  for (const auto &group : groups) {
+    locks.emplace_back(shards[group.shard].mutex);
+  }
+
+  CommitSequence::Write write(sequence);
+  for (const auto &group : groups) {
+    fn(shards[group.shard], write, order.data() + group.begin,
+       order.data() + group.end);
+  }
+}
+
+// Looks `key` up without allocating and copies it only when it is new.
+template <typename Map, typename Value>
+void InsertOrAssign(Map *map, std::string_view key, Value &&value) {
+  auto it = map->find(key);
+  if (it != map->end()) {
+    it->second = std::forward<Value>(value);
+  } else {
+    map->emplace(std::string(key), std::forward<Value>(value));
+  }
+}
+
+// `view` as a string; takes over `*scratch` when the view points into it.
+std::string TakeValue(std::string_view view, std::string *scratch) {
+  if (!scratch->empty() && view.data() == scratch->data()) {
+    return std::move(*scratch);
+  }
+  return std::string(view);
+}
+
+// Runs `fn(0)` ... `fn(count - 1)` on up to one thread per core. Each index
+// runs exactly once, on one thread.
+void ParallelFor(size_t count, const std::function<void(size_t)> &fn) {
+  size_t num_threads = std::min<size_t>(
+      count, std::max(1u, std::thread::hardware_concurrency()));
+  std::atomic<size_t> next{0};
+  auto run = [&]() {
+    for (size_t i = next++; i < count; i = next++) {
+      fn(i);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.emplace_back(run);
+  }
+  run();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+} // namespace
+
+const char *UpdateStatusMessage(UpdateStatus status) {
+  switch (status) {
+  case UpdateStatus::kOk:
+    return "success";
+  case UpdateStatus::kNotFound:
+    return "key not found";
+  case UpdateStatus::kMismatch:
+    return "value mismatch";
+  case UpdateStatus::kNotInteger:
+    return "value is not an integer or out of range";
+  default:
+    return "fail";
+  }
+}
+
+/************************************************************************/
+/* StorageEngine */
+/************************************************************************/
+KVMap StorageEngine::GetAllEntries() {
+  KVMap entries;
+  ScanCursor cursor;
+  ScanBatch batch;
+  while (!cursor.done) {
+    Scan(&cursor, kScanBatchSize, &batch);
+    for (auto &entry : batch) {
+      entries.insert_or_assign(std::move(entry.first),
+                               std::move(entry.second));
+    }
+  }
+  return entries;
+}
+
+void StorageEngine::Scan(std::string_view start, std::string_view end,
+                         size_t limit, ScanBatch *batch) {
+  // no order to seek in: walk everything, keeping the `limit` smallest keys
+  std::map<std::string, std::string> range;
+  ScanCursor cursor;
+  ScanBatch chunk;
+  while (!cursor.done) {
+    Scan(&cursor, kScanBatchSize, &chunk);
+    for (auto &entry : chunk) {
+      if (entry.first < start || (!end.empty() && entry.first >= end)) {
+        continue;
+      }
+      if (limit != 0 && range.size() == limit) {
+        if (entry.first >= range.rbegin()->first) {
+          continue;
+        }
+        range.erase(std::prev(range.end()));
+      }
+      range.emplace(std::move(entry.first), std::move(entry.second));
+    }
+  }
+
+  batch->clear();
+  batch->reserve(range.size());
+  while (!range.empty()) {
+    auto node = range.extract(range.begin());
+    batch->emplace_back(std::move(node.key()), std::move(node.mapped()));
+  }
+}
+
+bool StorageEngine::PutWithTtl(std::string_view key, std::string_view value,
+                               uint64_t ttl_ms) {
+  return ttl_ms == 0 && Put(key, value);
+}
+
+UpdateStatus StorageEngine::Update(std::string_view, const Updater &) {
+  return UpdateStatus::kFailed;
+}
+
+UpdateStatus StorageEngine::CompareAndSet(std::string_view key,
+                                          std::string_view expected,
+                                          std::string_view value) {
+  return Update(key, [expected, value](std::optional<std::string_view> current,
+                                       std::string *out) {
+    if (!current) {
+      return UpdateStatus::kNotFound;
+    }
+    if (*current != expected) {
+      return UpdateStatus::kMismatch;
+    }
+    out->assign(value);
+    return UpdateStatus::kOk;
+  });
+}
+
+UpdateStatus StorageEngine::IncrementBy(std::string_view key, int64_t delta,
+                                        int64_t *result) {
+  return Update(key, [delta, result](std::optional<std::string_view> current,
+                                     std::string *out) {
+    int64_t number = 0;
+    if (current) {
+      auto parsed = std::from_chars(current->data(),
+                                    current->data() + current->size(), number);
+      if (current->empty() || parsed.ec != std::errc() ||
+          parsed.ptr != current->data() + current->size()) {
+        return UpdateStatus::kNotInteger;
+      }
+    }
+    if ((delta > 0 && number > std::numeric_limits<int64_t>::max() - delta) ||
+        (delta < 0 && number < std::numeric_limits<int64_t>::min() - delta)) {
+      return UpdateStatus::kNotInteger;
+    }
+
+    *result = number + delta;
+    *out = std::to_string(*result);
+    return UpdateStatus::kOk;
+  });
+}
+
+UpdateStatus StorageEngine::Append(std::string_view key,
+                                   std::string_view suffix, size_t *length) {
+  return Update(key, [suffix, length](std::optional<std::string_view> current,
+                                      std::string *out) {
+    out->reserve((current ? current->size() : 0) + suffix.size());
+    out->assign(current ? *current : std::string_view());
+    out->append(suffix);
+    *length = out->size();
+    return UpdateStatus::kOk;
+  });
+}
+
+bool StorageEngine::Visit(std::string_view key,
+                          const ValueVisitor &visitor) {
+  auto value = Get(key);
+  if (!value) {
+    return false;
+  }
+  visitor(*value);
+  return true;
+}
+
+void StorageEngine::MultiGet(const KeyList &keys,
+                             std::vector<std::optional<std::string>> *values) {
+  values->clear();
+  values->reserve(keys.size());
+  for (std::string_view key : keys) {
+    values->push_back(Get(key));
+  }
+}
+
+bool StorageEngine::MultiPut(const KVPairList &kvs) {
+  bool success = true;
+  for (const auto & [ key, value ] : kvs) {
+    success = Put(key, value) && success;
+  }
+  return success;
+}
+
+bool StorageEngine::MultiDelete(const KeyList &keys) {
+  bool success = true;
+  for (std::string_view key : keys) {
+    success = Delete(key) && success;
+  }
+  return success;
+}
+
+void StorageEngine::PutAsync(std::string_view key, std::string_view value,
+                             uint64_t ttl_ms, Durability, WriteCallback done) {
+  done(ttl_ms != 0 ? PutWithTtl(key, value, ttl_ms) : Put(key, value));
+}
+
+void StorageEngine::MultiPutAsync(const KVPairList &kvs, Durability,
+                                  WriteCallback done) {
+  done(MultiPut(kvs));
+}
+
+std::string PrefixEnd(std::string_view prefix) {
+  // trailing 0xff bytes have no successor of the same length
+  std::string end(prefix);
+  while (!end.empty() && static_cast<uint8_t>(end.back()) == 0xff) {
+    end.pop_back();
+  }
+  if (!end.empty()) {
+    end.back() = static_cast<char>(static_cast<uint8_t>(end.back()) + 1);
+  }
+  return end;
+}
+
 /************************************************************************/
 /* MemoryStorage */
 /************************************************************************/
-bool MemoryStorage::Put(const std::string &key, const std::string &value) {
-  data_[key] = value;
+MemoryStorage::MemoryStorage(size_t num_shards, size_t max_memory_bytes,
+                             const CompressionOptions &compression)
+    : shards_(RoundUpToPowerOfTwo(std::max<size_t>(num_shards, 1))),
+      shard_mask_(shards_.size() - 1),
+      shard_budget_(max_memory_bytes == 0
+                        ? 0
+                        : std::max<size_t>(max_memory_bytes / shards_.size(),
+                                           1)),
+      encoder_(compression), epoch_(std::chrono::steady_clock::now()) {
+  expiry_thread_ = std::thread(&MemoryStorage::ExpiryLoop, this);
+}
+
+MemoryStorage::~MemoryStorage() {
+  {
+    std::lock_guard<std::mutex> lock(stop_mutex_);
+    stop_ = true;
+  }
+  stop_cv_.notify_all();
+  expiry_thread_.join();
+}
+
+uint64_t MemoryStorage::NowMs() const {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - epoch_)
+             .count() +
+         1;
+}
+
+std::string_view MemoryStorage::StoredValue(std::string_view value,
+                                           std::string *buffer) const {
+  if (!encoder_.Enabled()) {
+    return value;
+  }
+  encoder_.Encode(value, buffer);
+  return *buffer;
+}
+
+bool MemoryStorage::ReadValue(std::string_view stored, std::string *scratch,
+                              std::string_view *value) const {
+  if (!encoder_.Enabled()) {
+    *value = stored;
+    return true;
+  }
+  return ValueEncoder::View(stored, scratch, value);
+}
+
+bool MemoryStorage::Put(std::string_view key, std::string_view value) {
+  // compress before taking the lock
+  std::string buffer;
+  std::string_view stored = StoredValue(value, &buffer);
+  size_t hash = EntryTable::Hash(key);
+  Shard &shard = ShardFor(hash);
+  std::unique_lock<std::shared_mutex> lock(shard.mutex);
+  CommitSequence::Write write(&sequence_);
+  if (!MakeRoom(shard, write,
+                EntryTable::EntryCharge(key.size(), stored.size(), false))) {
+    return false;
+  }
+  KeepVersion(shard, write, key, hash);
+  if (shard.table.Put(key, stored, hash, 0, AccessClock())) {
+    shard.index.Insert(key);
+  }
+  return true;
+}
+
+bool MemoryStorage::PutWithTtl(std::string_view key, std::string_view value,
+                               uint64_t ttl_ms) {
+  if (ttl_ms == 0) {
+    return Put(key, value);
+  }
+
+  std::string buffer;
+  std::string_view stored = StoredValue(value, &buffer);
+  // capped so that neither the deadline nor its tick wraps; a TTL that
+  // long never expires in practice
+  static constexpr uint64_t kMaxDeadline =
+      std::numeric_limits<uint64_t>::max() - kExpiryTickMs;
+  const uint64_t now = NowMs();
+  const uint64_t deadline =
+      ttl_ms > kMaxDeadline - now ? kMaxDeadline : now + ttl_ms;
+  size_t hash = EntryTable::Hash(key);
+  Shard &shard = ShardFor(hash);
+  std::unique_lock<std::shared_mutex> lock(shard.mutex);
+  CommitSequence::Write write(&sequence_);
+  if (!MakeRoom(shard, write,
+                EntryTable::EntryCharge(key.size(), stored.size(), true))) {
+    return false;
+  }
+  KeepVersion(shard, write, key, hash);
+  if (shard.table.Put(key, stored, hash, deadline, AccessClock())) {
+    shard.index.Insert(key);
+  }
+  // the expiry loop skips an empty wheel, so bring it up to the current
+  // tick before it takes a timer
+  if (shard.wheel.Size() == 0) {
+    std::vector<std::string> none;
+    shard.wheel.Advance(now / kExpiryTickMs, 0, &none);
+  }
+  // the first tick at or after the deadline; a timer left behind by an
+  // overwrite finds the new deadline and is dropped
+  shard.wheel.Schedule(key, (deadline + kExpiryTickMs - 1) / kExpiryTickMs);
   return true;
 }
 
-std::optional<std::string> MemoryStorage::Get(const std::string &key) {
-  auto it = data_.find(key);
-  if (it != data_.end()) {
-    return it->second;
+UpdateStatus MemoryStorage::Update(std::string_view key,
+                                   const Updater &updater) {
+  size_t hash = EntryTable::Hash(key);
+  Shard &shard = ShardFor(hash);
+  std::string scratch;
+  std::string value;
+  std::string buffer;
+  std::unique_lock<std::shared_mutex> lock(shard.mutex);
+  CommitSequence::Write write(&sequence_);
+  std::string_view stored;
+  std::string_view current;
+  uint64_t deadline = 0;
+  bool found = shard.table.Find(key, hash, &stored, &deadline, AccessClock());
+  if (found && Expired(deadline)) {
+    EraseIfExpired(shard, key, hash, NowMs());
+    found = false;
+    deadline = 0;
   }
+  if (found && !ReadValue(stored, &scratch, &current)) {
+    return UpdateStatus::kFailed;
+  }
+
+  UpdateStatus status =
+      updater(found ? std::optional<std::string_view>(current) : std::nullopt,
+              &value);
+  if (status != UpdateStatus::kOk) {
+    return status;
+  }
+  // `current` may be evicted from here on
+  stored = StoredValue(value, &buffer);
+  if (!MakeRoom(shard, write,
+                EntryTable::EntryCharge(key.size(), stored.size(),
+                                        deadline != 0))) {
+    return UpdateStatus::kFailed;
+  }
+  KeepVersion(shard, write, key, hash);
+  if (shard.table.Put(key, stored, hash, deadline, AccessClock())) {
+    shard.index.Insert(key);
+  }
+  return UpdateStatus::kOk;
+}
+
+bool MemoryStorage::EraseIfExpired(Shard &shard, std::string_view key,
+                                   size_t hash, uint64_t now) {
+  std::string_view value;
+  uint64_t deadline = 0;
+  if (!shard.table.Find(key, hash, &value, &deadline) || deadline == 0 ||
+      deadline > now) {
+    return false;
+  }
+
+  shard.table.Erase(key, hash);
+  shard.index.Erase(key);
+  expired_keys_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void MemoryStorage::KeepVersion(Shard &shard,
+                                const CommitSequence::Write &write,
+                                std::string_view key, size_t hash) {
+  if (!shard.history.Empty()) {
+    shard.history.Collect(sequence_.Oldest());
+  }
+  if (!write.retain()) {
+    return;
+  }
+
+  std::optional<OldEntry> previous;
+  std::string_view stored;
+  uint64_t deadline = 0;
+  if (shard.table.Find(key, hash, &stored, &deadline)) {
+    previous = OldEntry{std::string(stored), deadline};
+  }
+  shard.history.Record(key, std::move(previous), write.sequence());
+}
+
+bool MemoryStorage::FindAt(const Shard &shard, std::string_view key,
+                           size_t hash, uint64_t snapshot,
+                           std::string_view *stored,
+                           uint64_t *deadline) const {
+  if (!shard.history.Empty()) {
+    if (const auto *version = shard.history.Find(key, snapshot)) {
+      if (!*version) {
+        return false;
+      }
+      *stored = (*version)->stored;
+      *deadline = (*version)->deadline;
+      return true;
+    }
+  }
+  return shard.table.Find(key, hash, stored, deadline, AccessClock());
+}
 
+bool MemoryStorage::MakeRoom(Shard &shard, const CommitSequence::Write &write,
+                             size_t bytes) {
+  if (shard_budget_ == 0) {
+    return true;
+  }
+  if (bytes > shard_budget_) {
+    return false;
+  }
+
+  while (ShardBytes(shard) + bytes > shard_budget_) {
+    std::string_view victim;
+    if (!shard.table.SampleLeastRecent(kEvictionSamples,
+                                       ++shard.eviction_seed, &victim)) {
+      return false;
+    }
+    // an open snapshot still reads the victim; `victim` points into the
+    // entry, so the index goes first
+    size_t hash = EntryTable::Hash(victim);
+    KeepVersion(shard, write, victim, hash);
+    shard.index.Erase(victim);
+    shard.table.Erase(victim, hash);
+    evicted_keys_.fetch_add(1, std::memory_order_relaxed);
+  }
+  return true;
+}
+
+void MemoryStorage::DropExpired(Shard &shard, std::string_view key,
+                                size_t hash) {
+  std::unique_lock<std::shared_mutex> lock(shard.mutex);
+  EraseIfExpired(shard, key, hash, NowMs());
+}
+
+std::optional<std::string> MemoryStorage::Get(std::string_view key) {
+  size_t hash = EntryTable::Hash(key);
+  Shard &shard = ShardFor(hash);
+  {
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    std::string_view stored;
+    uint64_t deadline = 0;
+    if (!shard.table.Find(key, hash, &stored, &deadline, AccessClock())) {
+      return std::nullopt;
+    }
+    if (!Expired(deadline)) {
+      std::string scratch;
+      std::string_view value;
+      if (!ReadValue(stored, &scratch, &value)) {
+        return std::nullopt;
+      }
+      return TakeValue(value, &scratch);
+    }
+  }
+
+  DropExpired(shard, key, hash);
   return std::nullopt;
 }
 
-bool MemoryStorage::Delete(const std::string &key) {
-  auto it = data_.find(key);
-  if (it != data_.end()) {
-    data_.erase(it);
+bool MemoryStorage::Visit(std::string_view key,
+                          const ValueVisitor &visitor) {
+  size_t hash = EntryTable::Hash(key);
+  Shard &shard = ShardFor(hash);
+  {
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    std::string_view stored;
+    uint64_t deadline = 0;
+    if (!shard.table.Find(key, hash, &stored, &deadline, AccessClock())) {
+      return false;
+    }
+    if (!Expired(deadline)) {
+      // raw values are handed out in place
+      std::string scratch;
+      std::string_view value;
+      if (!ReadValue(stored, &scratch, &value)) {
+        return false;
+      }
+      visitor(value);
+      return true;
+    }
+  }
+
+  DropExpired(shard, key, hash);
+  return false;
+}
+
+bool MemoryStorage::Delete(std::string_view key) {
+  size_t hash = EntryTable::Hash(key);
+  Shard &shard = ShardFor(hash);
+  std::unique_lock<std::shared_mutex> lock(shard.mutex);
+  if (EraseIfExpired(shard, key, hash, NowMs())) {
+    return false;
+  }
+  CommitSequence::Write write(&sequence_);
+  KeepVersion(shard, write, key, hash);
+  if (!shard.table.Erase(key, hash)) {
+    return false;
+  }
+  shard.index.Erase(key);
+  return true;
+}
+
+void MemoryStorage::MultiGet(const KeyList &keys,
+                             std::vector<std::optional<std::string>> *values) {
+  values->assign(keys.size(), std::nullopt);
+
+  std::vector<size_t> hashes(keys.size());
+  std::vector<size_t> shard_of(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    hashes[i] = EntryTable::Hash(keys[i]);
+    shard_of[i] = ShardIndex(hashes[i]);
+  }
+
+  // one shard lock at a time, yet every key as of the same write
+  CommitSequence::Snapshot snapshot(&sequence_);
+  ForEachShardGroup(shard_of, shards_.size(), [&](size_t shard_index,
+                                                  const size_t *begin,
+                                                  const size_t *end) {
+    Shard &shard = shards_[shard_index];
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    std::string scratch;
+    for (const size_t *i = begin; i != end; ++i) {
+      // expired keys read as missing and are left to the expiry thread
+      std::string_view stored;
+      std::string_view value;
+      uint64_t deadline = 0;
+      if (FindAt(shard, keys[*i], hashes[*i], snapshot.sequence(), &stored,
+                 &deadline) &&
+          !Expired(deadline) && ReadValue(stored, &scratch, &value)) {
+        (*values)[*i] = TakeValue(value, &scratch);
+      }
+    }
+  });
+}
+
+bool MemoryStorage::MultiPut(const KVPairList &kvs) {
+  std::vector<size_t> hashes(kvs.size());
+  std::vector<size_t> shard_of(kvs.size());
+  std::vector<std::string> encoded(encoder_.Enabled() ? kvs.size() : 0);
+  for (size_t i = 0; i < kvs.size(); ++i) {
+    hashes[i] = EntryTable::Hash(kvs[i].first);
+    shard_of[i] = ShardIndex(hashes[i]);
+    if (encoder_.Enabled()) {
+      encoder_.Encode(kvs[i].second, &encoded[i]);
+    }
+  }
+
+  bool success = true;
+  ApplyBatch(shards_, shard_of, &sequence_, [&](Shard &shard,
+                                                const auto &write,
+                                                const size_t *begin,
+                                                const size_t *end) {
+    for (const size_t *i = begin; i != end; ++i) {
+      const auto & [ key, value ] = kvs[*i];
+      std::string_view stored = encoded.empty() ? value : encoded[*i];
+      if (!MakeRoom(shard, write,
+                    EntryTable::EntryCharge(key.size(), stored.size(),
+                                            false))) {
+        success = false;
+        continue;
+      }
+      KeepVersion(shard, write, key, hashes[*i]);
+      if (shard.table.Put(key, stored, hashes[*i], 0, AccessClock())) {
+        shard.index.Insert(key);
+      }
+    }
+  });
+  return success;
+}
+
+bool MemoryStorage::MultiDelete(const KeyList &keys) {
+  std::vector<size_t> hashes(keys.size());
+  std::vector<size_t> shard_of(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    hashes[i] = EntryTable::Hash(keys[i]);
+    shard_of[i] = ShardIndex(hashes[i]);
+  }
+
+  bool all_found = true;
+  const uint64_t now = NowMs();
+  ApplyBatch(shards_, shard_of, &sequence_, [&](Shard &shard,
+                                                const auto &write,
+                                                const size_t *begin,
+                                                const size_t *end) {
+    for (const size_t *i = begin; i != end; ++i) {
+      if (EraseIfExpired(shard, keys[*i], hashes[*i], now)) {
+        all_found = false;
+        continue;
+      }
+      KeepVersion(shard, write, keys[*i], hashes[*i]);
+      if (shard.table.Erase(keys[*i], hashes[*i])) {
+        shard.index.Erase(keys[*i]);
+      } else {
+        all_found = false;
+      }
+    }
+  });
+  return all_found;
+}
+
+void MemoryStorage::Scan(ScanCursor *cursor, size_t batch_size,
+                         ScanBatch *batch) {
+  struct Position {
+    size_t shard = 0;
+    uint64_t table_position = 0;
+  };
+
+  batch->clear();
+  if (cursor->done) {
+    return;
+  }
+  if (!cursor->state) {
+    cursor->state = std::make_shared<Position>();
+  }
+  auto *position = static_cast<Position *>(cursor->state.get());
+
+  batch_size = std::max<size_t>(batch_size, 1);
+  const uint64_t now = NowMs();
+  std::string scratch;
+  while (batch->size() < batch_size) {
+    Shard &shard = shards_[position->shard];
+    bool shard_done = false;
+    {
+      std::shared_lock<std::shared_mutex> lock(shard.mutex);
+      shard_done = shard.table.Scan(
+          &position->table_position, batch_size - batch->size(),
+          [this, batch, &scratch](std::string_view key,
+                                  std::string_view stored) {
+            std::string_view value;
+            if (ReadValue(stored, &scratch, &value)) {
+              batch->emplace_back(key, TakeValue(value, &scratch));
+            }
+          },
+          now);
+    }
+    if (shard_done) {
+      position->table_position = 0;
+      if (++position->shard == shards_.size()) {
+        cursor->done = true;
+        break;
+      }
+    }
+  }
+}
+
+void MemoryStorage::Scan(std::string_view start, std::string_view end,
+                         size_t limit, ScanBatch *batch) {
+  batch->clear();
+  std::string from(start);
+  CommitSequence::Snapshot snapshot(&sequence_);
+  while (true) {
+    size_t chunk = kScanBatchSize;
+    if (limit != 0) {
+      chunk = std::min(chunk, limit - batch->size());
+    }
+    if (ScanChunk(snapshot.sequence(), &from, end, chunk, batch) ||
+        (limit != 0 && batch->size() == limit)) {
+      return;
+    }
+  }
+}
+
+bool MemoryStorage::ScanChunk(uint64_t snapshot, std::string *from,
+                              std::string_view end, size_t limit,
+                              ScanBatch *batch) {
+  // The keys of a shard at the snapshot are those of its index merged with
+  // those of its history, which also holds the keys deleted since.
+  struct Source {
+    BTreeIndex::Iterator index;
+    VersionHistory<OldEntry>::Map::const_iterator history;
+    VersionHistory<OldEntry>::Map::const_iterator history_end;
+    std::string_view key{};
+    bool valid = false;
+  };
+
+  // shard locks are taken in index order, as batch writers do
+  std::vector<std::shared_lock<std::shared_mutex>> locks;
+  std::vector<Source> sources;
+  locks.reserve(shards_.size());
+  sources.reserve(shards_.size());
+  for (auto &shard : shards_) {
+    locks.emplace_back(shard.mutex);
+    sources.push_back({shard.index.LowerBound(*from),
+                       shard.history.LowerBound(*from), shard.history.End()});
+  }
+
+  auto settle = [end](Source &source) {
+    bool in_index = source.index.Valid();
+    bool in_history = source.history != source.history_end;
+    if (in_index && in_history) {
+      source.key = std::min(source.index.key(),
+                            std::string_view(source.history->first));
+    } else if (in_index || in_history) {
+      source.key = in_index ? source.index.key() : source.history->first;
+    }
+    source.valid = (in_index || in_history) &&
+                   (end.empty() || source.key < end);
+  };
+  auto advance = [&settle](Source &source) {
+    if (source.index.Valid() && source.index.key() == source.key) {
+      source.index.Next();
+    }
+    if (source.history != source.history_end &&
+        source.history->first == source.key) {
+      ++source.history;
+    }
+    settle(source);
+  };
+
+  // one seek per shard, then one heap step per key
+  auto greater = [&sources](size_t a, size_t b) {
+    return sources[a].key > sources[b].key;
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(
+      greater);
+  for (size_t i = 0; i < sources.size(); ++i) {
+    settle(sources[i]);
+    if (sources[i].valid) {
+      heap.push(i);
+    }
+  }
+
+  const uint64_t now = NowMs();
+  std::string scratch;
+  std::string_view key;
+  for (size_t taken = 0; taken < limit && !heap.empty(); ++taken) {
+    size_t i = heap.top();
+    heap.pop();
+    key = sources[i].key;
+    std::string_view stored;
+    std::string_view value;
+    uint64_t deadline = 0;
+    if (FindAt(shards_[i], key, EntryTable::Hash(key), snapshot, &stored,
+               &deadline) &&
+        (deadline == 0 || deadline > now) &&
+        ReadValue(stored, &scratch, &value)) {
+      batch->emplace_back(key, TakeValue(value, &scratch));
+    }
+
+    advance(sources[i]);
+    if (sources[i].valid) {
+      heap.push(i);
+    }
+  }
+  if (heap.empty()) {
     return true;
   }
 
+  // the smallest key after the last one taken
+  from->assign(key.data(), key.size());
+  from->push_back('\0');
   return false;
 }
 
-KVMap MemoryStorage::GetAllEntries() {
-  return data_;
+void MemoryStorage::ExpiryLoop() {
+  std::vector<std::string> due;
+  std::unique_lock<std::mutex> lock(stop_mutex_);
+  while (!stop_cv_.wait_for(lock, std::chrono::milliseconds(kExpiryTickMs),
+                            [this]() { return stop_; })) {
+    lock.unlock();
+    clock_.store(static_cast<uint32_t>(NowMs() / kExpiryTickMs) + 1,
+                 std::memory_order_relaxed);
+    for (auto &shard : shards_) {
+      {
+        // most shards hold no TTL keys and no old versions; leave their
+        // readers and writers alone
+        std::shared_lock<std::shared_mutex> shard_lock(shard.mutex);
+        if (shard.wheel.Size() == 0 && shard.history.Empty()) {
+          continue;
+        }
+      }
+      // a shard that falls behind catches up over the next ticks, while
+      // reads already treat its expired keys as missing
+      std::unique_lock<std::shared_mutex> shard_lock(shard.mutex);
+      const uint64_t now = NowMs();
+      shard.wheel.Advance(now / kExpiryTickMs, kExpiryBudget, &due);
+      for (const auto &key : due) {
+        EraseIfExpired(shard, key, EntryTable::Hash(key), now);
+      }
+      due.clear();
+      // versions left behind by snapshots that closed since the last write
+      shard.history.Collect(sequence_.Oldest());
+    }
+    lock.lock();
+  }
+}
+
+size_t MemoryStorage::UsedBytes() const {
+  size_t bytes = 0;
+  for (const auto &shard : shards_) {
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    bytes += ShardBytes(shard);
+  }
+  return bytes;
+}
+
+size_t MemoryStorage::MemoryUsage() const {
+  size_t bytes = 0;
+  for (const auto &shard : shards_) {
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    bytes += shard.table.MemoryUsage() + shard.index.MemoryUsage();
+  }
+  return bytes;
 }
 
 /************************************************************************/
 /* FileStorage */
 /************************************************************************/
-FileStorage::FileStorage(const std::string &file_path) : file_path_(file_path) {
+FileStorage::FileStorage(const std::string &file_path,
+                         const StorageOptions &options)
+    : file_path_(file_path), io_(CreateAsyncIo(options.io)),
+      wal_(file_path + ".wal", options.wal, io_),
+      encoder_(options.compression),
+      checkpoint_interval_s_(options.checkpoint_interval_s),
+      on_checkpoint_(options.on_checkpoint) {
   Load();
+
+  if (checkpoint_interval_s_ > 0) {
+    checkpoint_thread_ = std::thread(&FileStorage::CheckpointLoop, this);
+  }
 }
 
-FileStorage::~FileStorage() { Persist(); }
+FileStorage::~FileStorage() {
+  {
+    std::lock_guard<std::mutex> lock(stop_mutex_);
+    stop_ = true;
+  }
+  stop_cv_.notify_all();
+  if (checkpoint_thread_.joinable()) {
+    checkpoint_thread_.join();
+  }
 
-bool FileStorage::Put(const std::string &key, const std::string &value) {
-  data_[key] = value;
-  return true;
+  Persist();
 }
 
-std::optional<std::string> FileStorage::Get(const std::string &key) {
-  auto it = data_.find(key);
-  if (it != data_.end()) {
-    return it->second;
+size_t FileStorage::ShardIndex(std::string_view key) {
+  return std::hash<std::string_view>{}(key) % kNumShards;
+}
+
+FileStorage::ValueMap &FileStorage::MutableMap(Shard &shard) {
+  // new references are only taken under the shard lock, so a count of one
+  // cannot go up while we write
+  if (shard.map.use_count() > 1) {
+    auto start = std::chrono::steady_clock::now();
+    shard.map = std::make_shared<ValueMap>(*shard.map);
+    copy_us_ += std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  }
+  return *shard.map;
+}
+
+bool FileStorage::Put(std::string_view key, std::string_view value) {
+  return wal_.Sync(ApplyPut(key, value, true));
+}
+
+void FileStorage::PutAsync(std::string_view key, std::string_view value,
+                           uint64_t ttl_ms, Durability durability,
+                           WriteCallback done) {
+  if (ttl_ms != 0) {
+    done(false);
+    return;
+  }
+  uint64_t lsn = ApplyPut(key, value, durability != Durability::kMemory);
+  wal_.SyncAsync(lsn, durability, std::move(done));
+}
+
+uint64_t FileStorage::ApplyPut(std::string_view key, std::string_view value,
+                               bool log) {
+  std::string encoded;
+  encoder_.Encode(value, &encoded);
+  auto owned = std::make_shared<const std::string>(std::move(encoded));
+
+  Shard &shard = ShardFor(key);
+  std::unique_lock<std::shared_mutex> lock(shard.mutex);
+  CommitSequence::Write write(&sequence_);
+  KeepVersion(shard, write, key);
+  InsertOrAssign(&MutableMap(shard), key, Value{owned});
+  return log ? wal_.Append(WalRecordType::kPutEncoded, key, *owned) : 0;
+}
+
+UpdateStatus FileStorage::Update(std::string_view key,
+                                 const Updater &updater) {
+  Shard &shard = ShardFor(key);
+  uint64_t lsn = 0;
+  {
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    CommitSequence::Write write(&sequence_);
+    auto it = shard.map->find(key);
+    const bool found = it != shard.map->end();
+    std::string scratch;
+    std::string_view current;
+    if (found && !ReadValue(it->second, &scratch, &current)) {
+      return UpdateStatus::kFailed;
+    }
+
+    std::string value;
+    UpdateStatus status =
+        updater(found ? std::optional<std::string_view>(current) : std::nullopt,
+                &value);
+    if (status != UpdateStatus::kOk) {
+      return status;
+    }
+    std::string encoded;
+    encoder_.Encode(value, &encoded);
+    auto owned = std::make_shared<const std::string>(std::move(encoded));
+    KeepVersion(shard, write, key);
+    InsertOrAssign(&MutableMap(shard), key, Value{owned});
+    lsn = wal_.Append(WalRecordType::kPutEncoded, key, *owned);
+  }
+
+  return wal_.Sync(lsn) ? UpdateStatus::kOk : UpdateStatus::kFailed;
+}
+
+std::optional<std::string> FileStorage::Get(std::string_view key) {
+  Shard &shard = ShardFor(key);
+  std::shared_lock<std::shared_mutex> lock(shard.mutex);
+  auto it = shard.map->find(key);
+  std::string scratch;
+  std::string_view value;
+  if (it != shard.map->end() && ReadValue(it->second, &scratch, &value)) {
+    return TakeValue(value, &scratch);
   }
 
   return std::nullopt;
 }
 
-bool FileStorage::Delete(const std::string &key) {
-  auto it = data_.find(key);
-  if (it != data_.end()) {
-    data_.erase(it);
+// Raw values still in the snapshot are handed out straight from the mapping.
+bool FileStorage::Visit(std::string_view key, const ValueVisitor &visitor) {
+  Shard &shard = ShardFor(key);
+  std::shared_lock<std::shared_mutex> lock(shard.mutex);
+  auto it = shard.map->find(key);
+  std::string scratch;
+  std::string_view value;
+  if (it == shard.map->end() || !ReadValue(it->second, &scratch, &value)) {
+    return false;
+  }
+
+  visitor(value);
+  return true;
+}
+
+void FileStorage::KeepVersion(Shard &shard,
+                              const CommitSequence::Write &write,
+                              std::string_view key) {
+  if (!shard.history.Empty()) {
+    shard.history.Collect(sequence_.Oldest());
+  }
+  if (!write.retain()) {
+    return;
+  }
+
+  // the value itself is shared, not copied
+  auto it = shard.map->find(key);
+  shard.history.Record(key,
+                       it == shard.map->end()
+                           ? std::nullopt
+                           : std::optional<Value>(it->second),
+                       write.sequence());
+}
+
+const FileStorage::Value *FileStorage::FindAt(const Shard &shard,
+                                              std::string_view key,
+                                              uint64_t snapshot) const {
+  if (!shard.history.Empty()) {
+    if (const auto *version = shard.history.Find(key, snapshot)) {
+      return *version ? &**version : nullptr;
+    }
+  }
+  auto it = shard.map->find(key);
+  return it == shard.map->end() ? nullptr : &it->second;
+}
+
+bool FileStorage::ReadStored(const Value &value, std::string_view *out,
+                             bool *encoded) const {
+  if (value.owned) {
+    *out = *value.owned;
+    *encoded = true;
     return true;
   }
 
-  return false;
+  const MappedSnapshot &snapshot = *snapshots_[value.partition];
+  if (!snapshot.Read(value.offset, value.size, out)) {
+    std::cerr << "Corrupt snapshot block in " << file_path_ << std::endl;
+    return false;
+  }
+  *encoded = snapshot.EncodedValues();
+  return true;
+}
+
+bool FileStorage::ReadValue(const Value &value, std::string *scratch,
+                            std::string_view *out) const {
+  std::string_view stored;
+  bool encoded = false;
+  if (!ReadStored(value, &stored, &encoded)) {
+    return false;
+  }
+  if (!encoded) {
+    *out = stored;
+    return true;
+  }
+
+  if (!ValueEncoder::View(stored, scratch, out)) {
+    std::cerr << "Corrupt value in " << file_path_ << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool FileStorage::Delete(std::string_view key) {
+  Shard &shard = ShardFor(key);
+  uint64_t lsn = 0;
+  {
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    if (!shard.map->contains(key)) {
+      return false;
+    }
+    CommitSequence::Write write(&sequence_);
+    KeepVersion(shard, write, key);
+    MutableMap(shard).erase(key);
+    lsn = wal_.Append(WalRecordType::kDelete, key, "");
+  }
+
+  return wal_.Sync(lsn);
+}
+
+void FileStorage::MultiGet(const KeyList &keys,
+                           std::vector<std::optional<std::string>> *values) {
+  values->assign(keys.size(), std::nullopt);
+
+  std::vector<size_t> shard_of(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    shard_of[i] = ShardIndex(keys[i]);
+  }
+
+  CommitSequence::Snapshot snapshot(&sequence_);
+  ForEachShardGroup(shard_of, kNumShards, [&](size_t shard_index,
+                                              const size_t *begin,
+                                              const size_t *end) {
+    Shard &shard = shards_[shard_index];
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    std::string scratch;
+    for (const size_t *i = begin; i != end; ++i) {
+      const Value *stored = FindAt(shard, keys[*i], snapshot.sequence());
+      std::string_view value;
+      if (stored && ReadValue(*stored, &scratch, &value)) {
+        (*values)[*i] = TakeValue(value, &scratch);
+      }
+    }
+  });
+}
+
+bool FileStorage::MultiPut(const KVPairList &kvs) {
+  uint64_t lsn = ApplyMultiPut(kvs, true);
+  return lsn == 0 || wal_.Sync(lsn);
+}
+
+void FileStorage::MultiPutAsync(const KVPairList &kvs, Durability durability,
+                                WriteCallback done) {
+  uint64_t lsn = ApplyMultiPut(kvs, durability != Durability::kMemory);
+  wal_.SyncAsync(lsn, durability, std::move(done));
+}
+
+uint64_t FileStorage::ApplyMultiPut(const KVPairList &kvs, bool log) {
+  std::vector<size_t> shard_of(kvs.size());
+  std::vector<std::shared_ptr<const std::string>> encoded(kvs.size());
+  std::string buffer;
+  for (size_t i = 0; i < kvs.size(); ++i) {
+    shard_of[i] = ShardIndex(kvs[i].first);
+    encoder_.Encode(kvs[i].second, &buffer);
+    encoded[i] = std::make_shared<const std::string>(std::move(buffer));
+  }
+
+  // records of every shard are made durable by one sync at the end
+  uint64_t lsn = 0;
+  ApplyBatch(shards_, shard_of, &sequence_, [&](Shard &shard,
+                                                const auto &write,
+                                                const size_t *begin,
+                                                const size_t *end) {
+    ValueMap &map = MutableMap(shard);
+    for (const size_t *i = begin; i != end; ++i) {
+      std::string_view key = kvs[*i].first;
+      KeepVersion(shard, write, key);
+      InsertOrAssign(&map, key, Value{encoded[*i]});
+      if (log) {
+        lsn = wal_.Append(WalRecordType::kPutEncoded, key, *encoded[*i]);
+      }
+    }
+  });
+  return lsn;
+}
+
+bool FileStorage::MultiDelete(const KeyList &keys) {
+  std::vector<size_t> shard_of(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    shard_of[i] = ShardIndex(keys[i]);
+  }
+
+  bool all_found = true;
+  uint64_t lsn = 0;
+  ApplyBatch(shards_, shard_of, &sequence_, [&](Shard &shard,
+                                                const auto &write,
+                                                const size_t *begin,
+                                                const size_t *end) {
+    for (const size_t *i = begin; i != end; ++i) {
+      if (!shard.map->contains(keys[*i])) {
+        all_found = false;
+        continue;
+      }
+      KeepVersion(shard, write, keys[*i]);
+      MutableMap(shard).erase(keys[*i]);
+      lsn = wal_.Append(WalRecordType::kDelete, keys[*i], "");
+    }
+  });
+
+  return (lsn == 0 || wal_.Sync(lsn)) && all_found;
+}
+
+void FileStorage::Apply(WalRecordType type, std::string_view key,
+                        std::string_view value) {
+  ValueMap *map = ShardFor(key).map.get();
+  if (type == WalRecordType::kDelete) {
+    map->erase(key);
+    return;
+  }
+
+  std::string encoded;
+  if (type == WalRecordType::kPut) {
+    // logged before values were encoded
+    encoder_.Encode(value, &encoded);
+    value = encoded;
+  }
+  InsertOrAssign(map, key, Value{std::make_shared<const std::string>(value)});
+}
+
+std::string FileStorage::ArchivePath(uint64_t number) const {
+  return file_path_ + ".wal." + std::to_string(number);
 }
 
 bool FileStorage::Load() {
-  data_.clear();
+  bool snapshot_ok = LoadSnapshot();
+
+  // Logs archived by a checkpoint that did not finish come first, oldest
+  // first, then the live log.
+  std::vector<uint64_t> numbers;
+  std::filesystem::path wal_path(wal_.path());
+  std::filesystem::path dir = wal_path.parent_path();
+  const std::string prefix = wal_path.filename().string() + ".";
+  std::error_code ec;
+  for (const auto &entry : std::filesystem::directory_iterator(
+           dir.empty() ? std::filesystem::path(".") : dir, ec)) {
+    std::string name = entry.path().filename().string();
+    if (name.size() > prefix.size() &&
+        name.compare(0, prefix.size(), prefix) == 0 &&
+        name.find_first_not_of("0123456789", prefix.size()) ==
+            std::string::npos) {
+      numbers.push_back(std::stoull(name.substr(prefix.size())));
+    }
+  }
+  std::sort(numbers.begin(), numbers.end());
+
+  bool wal_ok = true;
+  auto apply = [this](WalRecordType type, std::string_view key,
+                      std::string_view value) { Apply(type, key, value); };
+  for (uint64_t number : numbers) {
+    WriteAheadLog archive(ArchivePath(number), WalOptions());
+    wal_ok = archive.Open(apply) && wal_ok;
+    archives_.push_back(ArchivePath(number));
+    next_archive_ = number + 1;
+  }
+
+  // Redo everything acknowledged after the last checkpoint.
+  wal_ok = wal_.Open(apply) && wal_ok;
+
+  return snapshot_ok && wal_ok;
+}
+
+bool FileStorage::LoadSnapshot() {
+  snapshots_.clear();
 
   if (!std::filesystem::exists(file_path_)) {
     return true;
   }
 
+  if (SnapshotManifest::IsManifestFile(file_path_)) {
+    return LoadPartitions();
+  }
+  if (!MappedSnapshot::IsSnapshotFile(file_path_)) {
+    return LoadLegacySnapshot();
+  }
+
+  // a single-file snapshot from before partitioning
+  auto snapshot = MappedSnapshot::Open(file_path_);
+  if (!snapshot) {
+    return false;
+  }
+  snapshots_.push_back(snapshot);
+
+  for (auto &shard : shards_) {
+    shard.map->reserve(snapshot->NumEntries() / kNumShards);
+  }
+  return snapshot->ForEachIndexEntry(
+      [this](std::string_view key, uint64_t offset, uint32_t size) {
+        InsertOrAssign(ShardFor(key).map.get(), key,
+                       Value{nullptr, offset, size});
+      });
+}
+
+bool FileStorage::LoadPartitions() {
+  if (!manifest_.Read(file_path_)) {
+    return false;
+  }
+  const uint32_t num_partitions = manifest_.num_partitions;
+  snapshots_.resize(num_partitions);
+
+  // Partition i holds the keys of shard i, so the thread loading it owns
+  // that map and needs no lock. Keys that hash to another shard (a snapshot
+  // written with another shard count or hash) are set aside and moved in
+  // once every thread is done.
+  std::vector<std::vector<std::pair<std::string_view, Value>>> strays(
+      num_partitions);
+  std::atomic<bool> ok{true};
+  ParallelFor(num_partitions, [&](size_t i) {
+    auto snapshot = MappedSnapshot::Open(
+        manifest_.PartitionPath(file_path_, static_cast<uint32_t>(i)));
+    if (!snapshot) {
+      ok = false;
+      return;
+    }
+    snapshots_[i] = snapshot;
+
+    ValueMap *map = i < kNumShards ? shards_[i].map.get() : nullptr;
+    if (map) {
+      map->reserve(snapshot->NumEntries());
+    }
+    const auto partition = static_cast<uint32_t>(i);
+    if (!snapshot->ForEachIndexEntry([&](std::string_view key,
+                                         uint64_t offset, uint32_t size) {
+          Value value{nullptr, offset, size, partition};
+          if (ShardIndex(key) == i) {
+            InsertOrAssign(map, key, std::move(value));
+          } else {
+            strays[i].emplace_back(key, std::move(value));
+          }
+        })) {
+      ok = false;
+    }
+  });
+
+  // the keys point into the mappings, which stay
+  for (auto &stray : strays) {
+    for (auto & [ key, value ] : stray) {
+      InsertOrAssign(ShardFor(key).map.get(), key, std::move(value));
+    }
+  }
+
+  // Partitions of other generations were left by a checkpoint that did not
+  // finish writing or did not get to drop them.
+  std::filesystem::path path(file_path_);
+  std::filesystem::path dir = path.parent_path();
+  const std::string prefix = path.filename().string() + ".";
+  const std::string live = std::to_string(manifest_.generation);
+  std::error_code ec;
+  for (const auto &entry : std::filesystem::directory_iterator(
+           dir.empty() ? std::filesystem::path(".") : dir, ec)) {
+    std::string name = entry.path().filename().string();
+    if (name.compare(0, prefix.size(), prefix) != 0) {
+      continue;
+    }
+    // <generation>.part<i>
+    std::string_view rest(name);
+    rest.remove_prefix(prefix.size());
+    const size_t part = rest.find(".part");
+    if (part == std::string_view::npos || part == 0 ||
+        part + 5 == rest.size() ||
+        rest.find_first_not_of("0123456789") != part ||
+        rest.find_first_not_of("0123456789", part + 5) !=
+            std::string_view::npos) {
+      continue;
+    }
+    if (rest.substr(0, part) != live) {
+      std::filesystem::remove(entry.path(), ec);
+    }
+  }
+  return ok;
+}
+
+// Snapshots written before the block format: a count followed by
+// length-prefixed key/value pairs. They are rewritten on the next `Persist()`.
+bool FileStorage::LoadLegacySnapshot() {
   std::ifstream file(file_path_, std::ios::binary);
   if (!file) {
     return false;
@@ -98,36 +1430,224 @@ bool FileStorage::Load() {
     std::string value(value_length, '\0');
     file.read(&value[0], value_length);
 
-    data_[key] = value;
+    std::string encoded;
+    encoder_.Encode(value, &encoded);
+    (*ShardFor(key).map)[key] =
+        Value{std::make_shared<const std::string>(std::move(encoded))};
   }
 
   return file.good() || file.eof();
 }
 
-bool FileStorage::Persist() {
-  std::ofstream file(file_path_, std::ios::binary);
-  if (!file) {
+bool FileStorage::Persist(CheckpointStats *stats) {
+  std::lock_guard<std::mutex> checkpoint_lock(checkpoint_mutex_);
+  auto start = std::chrono::steady_clock::now();
+  uint64_t copy_us_before = copy_us_.load();
+
+  // Pin every shard map and mark the log cut while all writers are held
+  // off, so the snapshot contains exactly the records in the archived logs.
+  // Neither does I/O; the log is written out and moved once they are
+  // released.
+  ScanState state(this);
+  {
+    std::vector<std::unique_lock<std::shared_mutex>> locks;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+      locks.emplace_back(shards_[i].mutex);
+      state.maps[i] = shards_[i].map;
+    }
+    wal_.BeginRotate();
+  }
+  uint64_t pause_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+
+  std::string archive = ArchivePath(next_archive_);
+  bool rotated = wal_.FinishRotate(archive);
+  if (rotated) {
+    archives_.push_back(archive);
+    ++next_archive_;
+  }
+
+  // Write the next generation of partitions in parallel, one per shard, and
+  // swap the manifest in atomically; the archived logs and the partitions
+  // of the old generation may only be dropped once it is durable. Each
+  // shard map is unpinned as soon as it has been written.
+  SnapshotManifest next{manifest_.generation + 1, kNumShards};
+  std::atomic<size_t> entries{0};
+  std::atomic<bool> ok{rotated};
+  if (ok) {
+    ParallelFor(kNumShards, [&](size_t i) {
+      size_t written = 0;
+      if (!WritePartition(*state.maps[i],
+                          next.PartitionPath(file_path_,
+                                             static_cast<uint32_t>(i)),
+                          &written)) {
+        ok = false;
+      }
+      entries += written;
+      state.Unpin(i);
+    });
+  }
+
+  if (ok && next.Write(file_path_)) {
+    for (uint32_t i = 0; i < manifest_.num_partitions; ++i) {
+      std::filesystem::remove(manifest_.PartitionPath(file_path_, i));
+    }
+    manifest_ = next;
+    for (const auto &archive : archives_) {
+      std::filesystem::remove(archive);
+    }
+    archives_.clear();
+  } else {
+    ok = false;
+  }
+
+  if (stats) {
+    stats->entries = entries.load();
+    stats->pause_us = pause_us;
+    stats->copy_us = copy_us_.load() - copy_us_before;
+    stats->duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  }
+  return ok;
+}
+
+// Values are written as stored; raw ones from an old snapshot are encoded on
+// the way.
+bool FileStorage::WritePartition(const ValueMap &map, const std::string &path,
+                                 size_t *entries) const {
+  SnapshotWriter writer(path, kPartitionBlockSize, io_.get());
+  if (!writer.Open()) {
     return false;
   }
 
-  size_t count = data_.size();
-  file.write(reinterpret_cast<char *>(&count), sizeof(count));
+  std::string buffer;
+  for (const auto & [ key, value ] : map) {
+    std::string_view bytes;
+    bool encoded = false;
+    if (!ReadStored(value, &bytes, &encoded)) {
+      return false;
+    }
+    if (!encoded) {
+      encoder_.Encode(bytes, &buffer);
+      bytes = buffer;
+    }
+    if (!writer.Add(key, bytes)) {
+      return false;
+    }
+    ++*entries;
+  }
+  return writer.Finish();
+}
 
-  for (const auto & [ key, value ] : data_) {
-    size_t key_length = key.length();
-    file.write(reinterpret_cast<char *>(&key_length), sizeof(key_length));
-    file.write(key.data(), key_length);
+void FileStorage::CheckpointLoop() {
+  std::unique_lock<std::mutex> lock(stop_mutex_);
+  while (!stop_cv_.wait_for(lock, std::chrono::seconds(checkpoint_interval_s_),
+                            [this]() { return stop_; })) {
+    lock.unlock();
+    CheckpointStats stats;
+    bool ok = Persist(&stats);
+    if (on_checkpoint_) {
+      on_checkpoint_(ok, stats);
+    }
+    lock.lock();
+  }
+}
+
+FileStorage::ScanState::~ScanState() {
+  for (size_t i = 0; i < maps.size(); ++i) {
+    Unpin(i);
+  }
+}
+
+void FileStorage::ScanState::Unpin(size_t shard) {
+  if (maps[shard]) {
+    std::shared_lock<std::shared_mutex> lock(storage->shards_[shard].mutex);
+    maps[shard].reset();
+  }
+}
+
+bool FileStorage::ScanPinned(ScanState *state, size_t limit,
+                             const PinnedVisitor &visitor) {
+  for (size_t visited = 0; state->shard < kNumShards && visited < limit;) {
+    std::shared_ptr<const ValueMap> &map = state->maps[state->shard];
+    if (!state->in_shard) {
+      if (!map) {
+        std::shared_lock<std::shared_mutex> lock(shards_[state->shard].mutex);
+        map = shards_[state->shard].map;
+      }
+      state->it = map->begin();
+      state->in_shard = true;
+    }
+
+    if (state->it == map->end()) {
+      state->Unpin(state->shard);
+      ++state->shard;
+      state->in_shard = false;
+      continue;
+    }
+    if (!visitor(state->it->first, state->it->second)) {
+      return false;
+    }
+    ++state->it;
+    ++visited;
+  }
+  return true;
+}
 
-    size_t value_length = value.length();
-    file.write(reinterpret_cast<char *>(&value_length), sizeof(value_length));
-    file.write(value.data(), value_length);
+void FileStorage::Scan(ScanCursor *cursor, size_t batch_size,
+                       ScanBatch *batch) {
+  batch->clear();
+  if (cursor->done) {
+    return;
+  }
+  if (!cursor->state) {
+    cursor->state = std::make_shared<ScanState>(this);
   }
+  auto *state = static_cast<ScanState *>(cursor->state.get());
 
-  return file.good();
+  std::string scratch;
+  ScanPinned(state, std::max<size_t>(batch_size, 1),
+             [batch, &scratch, this](std::string_view key, const Value &value) {
+               std::string_view bytes;
+               if (ReadValue(value, &scratch, &bytes)) {
+                 batch->emplace_back(key, TakeValue(bytes, &scratch));
+               }
+               return true;
+             });
+  if (state->shard == kNumShards) {
+    cursor->done = true;
+    cursor->state.reset();
+  }
 }
 
-KVMap FileStorage::GetAllEntries() {
-  return data_;
+/************************************************************************/
+/* CreateStorageEngine */
+/************************************************************************/
+std::unique_ptr<StorageEngine>
+CreateStorageEngine(const std::string &engine_type,
+                    const std::string &file_path,
+                    const StorageOptions &options) {
+  if (engine_type == "memory") {
+    // already in memory, and a cache would hide its TTLs
+    return std::make_unique<MemoryStorage>(options.memory_shards,
+                                           options.memory_max_bytes,
+                                           options.compression);
+  }
+
+  std::unique_ptr<StorageEngine> engine;
+  if (engine_type == "lsm") {
+    engine = std::make_unique<LSMStorage>(file_path, options.lsm, options.wal,
+                                          options.io);
+  } else {
+    engine = std::make_unique<FileStorage>(file_path, options);
+  }
+  if (options.cache.entries == 0) {
+    return engine;
+  }
+  return std::make_unique<CachedStorageEngine>(std::move(engine),
+                                               options.cache);
 }
 
 } // namespace tiny_kv
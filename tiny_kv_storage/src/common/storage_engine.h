@@ -4,72 +4,536 @@
 
 #pragma once
 
+#include "src/common/btree_index.h"
+#include "src/common/entry_table.h"
+#include "src/common/mvcc.h"
+#include "src/common/snapshot.h"
+#include "src/common/timing_wheel.h"
+#include "src/common/value_codec.h"
+#include "src/common/wal.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <shared_mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 #include <parallel_hashmap/phmap.h>
 
 namespace tiny_kv {
 
-using KVMap = phmap::parallel_flat_hash_map<std::string, std::string>;
+// phmap's string hash and equality are transparent: lookups take a
+// `std::string_view` without materializing a key.
+using KVMap = phmap::parallel_flat_hash_map<std::string, std::string,
+                                            phmap::Hash<std::string>,
+                                            phmap::EqualTo<std::string>>;
+using KeyList = std::vector<std::string_view>;
+using KVPairList = std::vector<std::pair<std::string_view, std::string_view>>;
+using ValueVisitor = std::function<void(std::string_view value)>;
+using ScanBatch = std::vector<std::pair<std::string, std::string>>;
+
+// Outcome of an atomic read-modify-write.
+enum class UpdateStatus {
+  kOk,
+  kNotFound,   // compare-and-set on a missing key
+  kMismatch,   // compare-and-set found another value
+  kNotInteger, // increment of a non-integer value, or an overflow
+  kFailed,     // the write failed, or the engine has no atomic updates
+};
+
+// Short description of `status` for responses: "success", "key not found"...
+const char *UpdateStatusMessage(UpdateStatus status);
+
+// Computes the new value of a key from its current one (nullopt if missing)
+// into `*value`; anything but kOk leaves the key untouched. It runs under
+// the engine's write lock, so it must be quick and must not call back into
+// the engine.
+using Updater = std::function<UpdateStatus(
+    std::optional<std::string_view> current, std::string *value)>;
+
+// Outcome of a write made at a chosen `Durability` (see wal.h).
+using WriteCallback = std::function<void(bool success)>;
+
+// Resume point of `StorageEngine::Scan`, only meaningful to the engine that
+// filled it. Holding one may pin engine state, so drop it when done and
+// always before the engine.
+struct ScanCursor {
+  bool done = false;
+  std::shared_ptr<void> state; // engine-specific, null before the first batch
+};
+
+struct LSMOptions {
+  size_t memtable_bytes = 4 << 20;
+  size_t block_bytes = 4096;
+  int bloom_bits_per_key = 10;
+  int l0_compaction_trigger = 4;
+  int l0_stop_writes_trigger = 12;
+  uint64_t level1_bytes = 10 << 20;
+  int level_size_multiplier = 10;
+  uint64_t target_file_bytes = 2 << 20;
+  int max_levels = 7;
+};
+
+// Replacement policy of the read cache (see cached_storage.h).
+enum class CachePolicy {
+  kLRU,     // sharded LRU
+  kClock,   // CLOCK, hits take no exclusive lock
+  kTinyLFU, // W-TinyLFU, keeps the hot set through scans
+};
+
+bool ParseCachePolicy(const std::string &name, CachePolicy *policy);
+
+struct CacheOptions {
+  size_t entries = 0; // 0 disables the cache
+  CachePolicy policy = CachePolicy::kLRU;
+  bool write_through = false; // writes update cached values, else drop them
+};
+
+struct CheckpointStats {
+  size_t entries = 0;
+  uint64_t pause_us = 0; // every writer blocked while the cut was taken
+  uint64_t copy_us = 0;  // writers copying a shard still being written out
+  uint64_t duration_ms = 0;
+};
+
+struct StorageOptions {
+  size_t memory_shards = 16; // memory storage, rounded up to a power of two
+  size_t memory_max_bytes = 0;    // memory storage, 0 = unlimited
+  CompressionOptions compression; // memory and file storage
+  WalOptions wal;                 // file and lsm storage
+  AsyncIoOptions io;              // file and lsm storage
+  LSMOptions lsm;
+  int checkpoint_interval_s = 0; // file storage, 0 disables
+  // file storage: told the outcome of every background checkpoint, on the
+  // checkpoint thread
+  std::function<void(bool ok, const CheckpointStats &stats)> on_checkpoint;
+  CacheOptions cache;            // file and lsm storage
+};
 
 /************************************************************************/
 /* StorageEngine */
 /************************************************************************/
 class StorageEngine {
 public:
+  // Batch size of the helpers built on `Scan`.
+  static constexpr size_t kScanBatchSize = 1024;
+
   virtual ~StorageEngine() = default;
 
-  virtual bool Put(const std::string &key, const std::string &value) = 0;
-  virtual std::optional<std::string> Get(const std::string &key) = 0;
-  virtual bool Delete(const std::string &key) = 0;
-  virtual KVMap GetAllEntries() = 0;
+  virtual bool Put(std::string_view key, std::string_view value) = 0;
+  virtual std::optional<std::string> Get(std::string_view key) = 0;
+  virtual bool Delete(std::string_view key) = 0;
+
+  // Like `Put`, but the key expires `ttl_ms` milliseconds from now: reads
+  // stop seeing it at once and the engine removes it soon after. A later
+  // plain `Put` makes the key persistent again, and a `ttl_ms` of 0 is a
+  // plain `Put`. The default supports no expiry and returns false.
+  virtual bool PutWithTtl(std::string_view key, std::string_view value,
+                          uint64_t ttl_ms);
+
+  // Atomic read-modify-write of one key: no other write to `key` lands
+  // between reading the current value and storing the one `updater` makes.
+  // A key with a TTL keeps it. The default returns kFailed.
+  virtual UpdateStatus Update(std::string_view key, const Updater &updater);
+  // Stores `value` only if `key` currently holds `expected`.
+  UpdateStatus CompareAndSet(std::string_view key, std::string_view expected,
+                             std::string_view value);
+  // Adds `delta` to the decimal 64-bit integer stored at `key` (a missing
+  // key counts as 0) and sets `*result` to the sum.
+  UpdateStatus IncrementBy(std::string_view key, int64_t delta,
+                           int64_t *result);
+  // Appends `suffix` to the value of `key` (a missing key starts empty) and
+  // sets `*length` to the new value size.
+  UpdateStatus Append(std::string_view key, std::string_view suffix,
+                      size_t *length);
+
+  // Walks every entry a batch at a time: start from a default `ScanCursor`
+  // and call again until `cursor->done`. `batch` is cleared and refilled
+  // with about `batch_size` entries (possibly none before the end). Writes
+  // may interleave with a scan; an entry is returned at most once, and one
+  // that stays present throughout is always returned.
+  virtual void Scan(ScanCursor *cursor, size_t batch_size,
+                    ScanBatch *batch) = 0;
+  // Copies every entry through `Scan`; prefer `Scan` for large data sets.
+  KVMap GetAllEntries();
+
+  // Range read: fills `batch` with the entries whose keys lie in
+  // [start, end) in key order, at most `limit` of them (0 = no limit). An
+  // empty `end` means no upper bound. Like the cursor `Scan` it is not a
+  // snapshot: writes made during the call may or may not be seen. The
+  // default walks every entry through the cursor `Scan`; engines with an
+  // ordered index answer in O(log n + k).
+  virtual void Scan(std::string_view start, std::string_view end,
+                    size_t limit, ScanBatch *batch);
+
+  // Zero-copy read: calls `visitor` with a view of the stored value while the
+  // engine keeps it pinned, and returns false if `key` is missing. The view
+  // is only valid during the call, and the visitor must not call back into
+  // the engine. The default copies through `Get()`.
+  virtual bool Visit(std::string_view key, const ValueVisitor &visitor);
+
+  // Batch variants. The defaults loop over the single-key calls; engines
+  // override them to take each lock once and share one log sync per batch.
+  // `values` gets one slot per key, nullopt for a missing key.
+  virtual void MultiGet(const KeyList &keys,
+                        std::vector<std::optional<std::string>> *values);
+  // Returns false if any write failed.
+  virtual bool MultiPut(const KVPairList &kvs);
+  // Returns false if any key was missing.
+  virtual bool MultiDelete(const KeyList &keys);
+
+  // `PutWithTtl` and `MultiPut` at a chosen durability, for callers that
+  // must not block on the log. The write is applied before the call
+  // returns, so reads see it at once; `done` runs when it got as far as
+  // `durability` asks, inline or on an I/O thread, and must not block. The
+  // defaults have no log to wait for: they write and call `done` at once.
+  virtual void PutAsync(std::string_view key, std::string_view value,
+                        uint64_t ttl_ms, Durability durability,
+                        WriteCallback done);
+  virtual void MultiPutAsync(const KVPairList &kvs, Durability durability,
+                             WriteCallback done);
 };
 
 /************************************************************************/
 /* MemoryStorage */
 /************************************************************************/
+// Thread-safe: keys are striped over independently locked shards, so readers
+// never block each other and writers only contend within one shard. Each
+// shard keeps its entries in an `EntryTable`: short keys sit inline in the
+// hash slot and the rest of an entry shares one slab block. A `BTreeIndex`
+// per shard keeps the keys ordered for range reads, which merge the shards.
+//
+// A key with a TTL carries its deadline in the entry table, so every read
+// checks it and treats an expired key as missing. Removal is also active: a
+// `TimingWheel` per shard is advanced every `kExpiryTickMs` by a background
+// thread, which handles at most `kExpiryBudget` timers per shard and lock
+// hold, so a wave of expiring keys is spread over ticks instead of stalling
+// the shard. A shard with no timers and no old versions is only looked
+// at under its shared lock. Nothing ever walks a whole shard to find
+// expired keys.
+//
+// With a memory limit every shard gets an equal share of it, measured as
+// the `EntryTable::EntryBytes` of its entries plus its key index (which a
+// node split can push past the share by one node). A write that would not
+// fit first evicts keys by sampled approximate LRU: of
+// `kEvictionSamples` random entries the one read or written longest ago
+// goes. Reads stamp a coarse clock (advanced every `kExpiryTickMs`) into
+// the entry with a relaxed store under the shared lock, so there is no LRU
+// list and no extra lock on the read path.
+//
+// `MultiGet` and range scans read at a snapshot of the `CommitSequence`, so
+// they never see part of a batch or of a write racing with them, without
+// holding more than one shard lock at a time (a range scan holds all of
+// them for one chunk). Writes keep the entries they replace in their
+// shard's `VersionHistory` only while a snapshot is open; so do the
+// evictions that make room for them. Keys that expire are gone from every
+// snapshot too.
 class MemoryStorage : public StorageEngine {
 public:
-  bool Put(const std::string &key, const std::string &value) override;
-  std::optional<std::string> Get(const std::string &key) override;
-  bool Delete(const std::string &key) override;
-  KVMap GetAllEntries() override;
+  static constexpr uint64_t kExpiryTickMs = 100;
+  static constexpr size_t kExpiryBudget = 1024;
+  static constexpr size_t kEvictionSamples = 5;
+
+  // `max_memory_bytes` of 0 means no limit. With a codec in `compression`
+  // values are stored encoded: large ones that shrink stay compressed, are
+  // charged at their compressed size and are decompressed on every read.
+  explicit MemoryStorage(size_t num_shards = 16, size_t max_memory_bytes = 0,
+                         const CompressionOptions &compression = {});
+  ~MemoryStorage() override;
+
+  bool Put(std::string_view key, std::string_view value) override;
+  bool PutWithTtl(std::string_view key, std::string_view value,
+                  uint64_t ttl_ms) override;
+  // Runs `updater` under the shard's write lock.
+  UpdateStatus Update(std::string_view key, const Updater &updater) override;
+  std::optional<std::string> Get(std::string_view key) override;
+  bool Delete(std::string_view key) override;
+  void Scan(ScanCursor *cursor, size_t batch_size, ScanBatch *batch) override;
+  // Holds every shard's read lock for one chunk of `kScanBatchSize` keys at
+  // a time; all chunks read at one snapshot.
+  void Scan(std::string_view start, std::string_view end, size_t limit,
+            ScanBatch *batch) override;
+  bool Visit(std::string_view key, const ValueVisitor &visitor) override;
+  void MultiGet(const KeyList &keys,
+                std::vector<std::optional<std::string>> *values) override;
+  bool MultiPut(const KVPairList &kvs) override;
+  bool MultiDelete(const KeyList &keys) override;
+
+  size_t NumShards() const { return shards_.size(); }
+  // Bytes held by the entry tables and key indexes of every shard.
+  size_t MemoryUsage() const;
+  // Bytes counted against the memory limit.
+  size_t UsedBytes() const;
+  // Keys removed because their TTL ran out.
+  uint64_t ExpiredKeys() const {
+    return expired_keys_.load(std::memory_order_relaxed);
+  }
+  // Keys removed to stay under the memory limit.
+  uint64_t EvictedKeys() const {
+    return evicted_keys_.load(std::memory_order_relaxed);
+  }
+
+private:
+  // An entry replaced while a snapshot was open.
+  struct OldEntry {
+    std::string stored;
+    uint64_t deadline;
+  };
+
+  struct alignas(64) Shard {
+    mutable std::shared_mutex mutex;
+    EntryTable table;
+    BTreeIndex index;  // the keys of `table`
+    TimingWheel wheel; // keys given a TTL, in ticks of `kExpiryTickMs`
+    VersionHistory<OldEntry> history;
+    uint64_t eviction_seed = 0;
+  };
+
+  // The bytes to store for `value`: itself without a codec, otherwise its
+  // encoded form in `*buffer`.
+  std::string_view StoredValue(std::string_view value,
+                               std::string *buffer) const;
+  // Points `*value` at the value kept as `stored`, decompressing into
+  // `*scratch` if needed.
+  bool ReadValue(std::string_view stored, std::string *scratch,
+                 std::string_view *value) const;
+  // Requires `shard.mutex` held exclusively, before `write` changes `key`.
+  // Keeps the entry it replaces if a snapshot may read it, and drops the
+  // versions no snapshot needs any more.
+  void KeepVersion(Shard &shard, const CommitSequence::Write &write,
+                   std::string_view key, size_t hash);
+  // Requires `shard.mutex` held. Like `EntryTable::Find` as of `snapshot`.
+  bool FindAt(const Shard &shard, std::string_view key, size_t hash,
+              uint64_t snapshot, std::string_view *stored,
+              uint64_t *deadline) const;
+  // Appends the entries of [*from, end) as of `snapshot` under every shard
+  // lock, stopping after `limit` keys (expired ones count). Returns true once
+  // the range is exhausted, otherwise moves `*from` past the last key taken.
+  bool ScanChunk(uint64_t snapshot, std::string *from, std::string_view end,
+                 size_t limit, ScanBatch *batch);
+  size_t ShardIndex(size_t hash) const { return hash & shard_mask_; }
+  Shard &ShardFor(size_t hash) { return shards_[ShardIndex(hash)]; }
+  // Milliseconds since construction plus one: the clock of entry
+  // deadlines, never 0 (which means no deadline).
+  uint64_t NowMs() const;
+  bool Expired(uint64_t deadline) const {
+    return deadline != 0 && deadline <= NowMs();
+  }
+  // Requires `shard.mutex` held exclusively. Removes `key` if it has expired
+  // by `now`.
+  bool EraseIfExpired(Shard &shard, std::string_view key, size_t hash,
+                      uint64_t now);
+  // A read found `key` expired under the shared lock.
+  void DropExpired(Shard &shard, std::string_view key, size_t hash);
+  void ExpiryLoop();
+  // Access clock for reads and writes, or 0 when nothing is evicted.
+  uint32_t AccessClock() const {
+    return shard_budget_ != 0 ? clock_.load(std::memory_order_relaxed) : 0;
+  }
+  static size_t ShardBytes(const Shard &shard) {
+    return shard.table.EntryBytes() + shard.index.MemoryUsage();
+  }
+  // Requires `shard.mutex` held exclusively. Evicts until an entry charged
+  // `bytes` fits in the shard's budget, keeping each victim for the
+  // snapshots as a change by `write`; false if it cannot fit at all.
+  bool MakeRoom(Shard &shard, const CommitSequence::Write &write,
+                size_t bytes);
 
 private:
-  KVMap data_;
+  std::vector<Shard> shards_;
+  size_t shard_mask_;
+  const size_t shard_budget_; // 0 = unlimited
+  const ValueEncoder encoder_;
+  CommitSequence sequence_;
+  const std::chrono::steady_clock::time_point epoch_;
+  std::atomic<uint32_t> clock_{1};
+  std::atomic<uint64_t> expired_keys_{0};
+  std::atomic<uint64_t> evicted_keys_{0};
+
+  std::thread expiry_thread_;
+  std::mutex stop_mutex_;
+  std::condition_variable stop_cv_;
+  bool stop_ = false;
 };
 
 /************************************************************************/
 /* FileStorage */
 /************************************************************************/
+// Every `Put`/`Delete` is appended to a write-ahead log (`<file_path>.wal`)
+// before it is acknowledged, so a crash loses nothing that was acknowledged.
+// `Persist()` is a checkpoint: it rewrites the snapshot and truncates the log.
+// Values are encoded (see value_codec.h) before they are logged, so the log,
+// the snapshot and memory all hold the compressed form of large values;
+// logs and snapshots written before encoding existed hold raw values and are
+// still read.
+//
+// The snapshot is memory-mapped on load. Only its trailing key index is read
+// at startup; a value stays a reference into the mapping (checksummed on
+// first access) until it is overwritten.
+//
+// Keys are spread over shards whose maps are copy-on-write: a checkpoint
+// pins every shard map and marks the log cut in one short pause without
+// I/O, then archives the log up to the cut and writes the pinned maps to
+// disk while readers and writers carry on. The first write to a pinned
+// shard copies it.
+//
+// The snapshot is partitioned by shard: `<file_path>` is a manifest naming
+// one snapshot file per shard. Checkpoints write the partitions and loads
+// read them in parallel, each thread filling the maps of the shards it owns
+// without locks. Single-file snapshots are still loaded, on one thread.
+//
+// `MultiGet` reads at a snapshot like MemoryStorage's; a replaced value is
+// kept as the same shared buffer or snapshot location, not copied.
 class FileStorage : public StorageEngine {
 public:
-  explicit FileStorage(const std::string &file_path);
+  explicit FileStorage(const std::string &file_path,
+                       const StorageOptions &options = StorageOptions());
   ~FileStorage() override;
 
-  bool Put(const std::string &key, const std::string &value) override;
-  std::optional<std::string> Get(const std::string &key) override;
-  bool Delete(const std::string &key) override;
-  KVMap GetAllEntries() override;
-  bool Persist();
+  bool Put(std::string_view key, std::string_view value) override;
+  // Runs `updater` under the shard's write lock.
+  UpdateStatus Update(std::string_view key, const Updater &updater) override;
+  std::optional<std::string> Get(std::string_view key) override;
+  bool Delete(std::string_view key) override;
+  // Pins the shard map being walked; writes to it copy the map once.
+  void Scan(ScanCursor *cursor, size_t batch_size, ScanBatch *batch) override;
+  using StorageEngine::Scan; // unordered: ranges walk every entry
+  bool Visit(std::string_view key, const ValueVisitor &visitor) override;
+  void MultiGet(const KeyList &keys,
+                std::vector<std::optional<std::string>> *values) override;
+  bool MultiPut(const KVPairList &kvs) override;
+  bool MultiDelete(const KeyList &keys) override;
+  // No TTLs here either: a nonzero `ttl_ms` fails.
+  void PutAsync(std::string_view key, std::string_view value, uint64_t ttl_ms,
+                Durability durability, WriteCallback done) override;
+  void MultiPutAsync(const KVPairList &kvs, Durability durability,
+                     WriteCallback done) override;
+  bool Persist(CheckpointStats *stats = nullptr);
 
 private:
+  // Either an owned value or the location of one in `snapshots_`.
+  struct Value {
+    std::shared_ptr<const std::string> owned;
+    uint64_t offset = 0;
+    uint32_t size = 0;
+    uint32_t partition = 0; // index into `snapshots_`
+  };
+  using ValueMap = phmap::flat_hash_map<std::string, Value>;
+
+  static constexpr size_t kNumShards = 16;
+  // Each partition pads its last block, so they use smaller blocks than a
+  // single snapshot would.
+  static constexpr uint32_t kPartitionBlockSize = 4 << 10;
+  struct Shard {
+    mutable std::shared_mutex mutex;
+    // pinned while a checkpoint or scan holds another reference
+    std::shared_ptr<ValueMap> map = std::make_shared<ValueMap>();
+    VersionHistory<Value> history;
+  };
+
+  // Shard maps pinned by a scan or checkpoint, and the position in them.
+  struct ScanState {
+    explicit ScanState(FileStorage *storage) : storage(storage) {}
+    ~ScanState();
+    // Drops the pin under the shard lock, so a writer that then finds the
+    // map unshared is ordered after every read made through the pin.
+    void Unpin(size_t shard);
+
+    FileStorage *storage;
+    std::array<std::shared_ptr<const ValueMap>, kNumShards> maps;
+    size_t shard = 0;
+    bool in_shard = false;
+    ValueMap::const_iterator it;
+  };
+  // Returns false to stop the walk.
+  using PinnedVisitor =
+      std::function<bool(std::string_view key, const Value &value)>;
+
   bool Load();
+  bool LoadSnapshot();
+  // Loads the partitions named by the manifest at `file_path_`.
+  bool LoadPartitions();
+  bool LoadLegacySnapshot();
+  void Apply(WalRecordType type, std::string_view key, std::string_view value);
+  // Apply the writes, logging them if `log`. Return the lsn of the last
+  // record, or 0 if nothing was logged.
+  uint64_t ApplyPut(std::string_view key, std::string_view value, bool log);
+  uint64_t ApplyMultiPut(const KVPairList &kvs, bool log);
+  // Points `*out` at the bytes kept for `value`; `*encoded` tells whether
+  // they carry an encoding header (values of old snapshots do not).
+  bool ReadStored(const Value &value, std::string_view *out,
+                  bool *encoded) const;
+  // Points `*out` at the value itself, decompressing into `*scratch` if
+  // needed.
+  bool ReadValue(const Value &value, std::string *scratch,
+                 std::string_view *out) const;
+  // Visits up to `limit` entries, pinning each shard map on first use (if
+  // not pinned already) and releasing it once walked. Returns false if the
+  // visitor stopped the walk; the walk is over once `state->shard` reaches
+  // kNumShards.
+  bool ScanPinned(ScanState *state, size_t limit,
+                  const PinnedVisitor &visitor);
+  // Writes `map` as one snapshot partition at `path`.
+  bool WritePartition(const ValueMap &map, const std::string &path,
+                      size_t *entries) const;
+  // Requires `shard.mutex` held exclusively, before `write` changes `key`.
+  // Keeps the value it replaces if a snapshot may read it.
+  void KeepVersion(Shard &shard, const CommitSequence::Write &write,
+                   std::string_view key);
+  // Requires `shard.mutex` held. The value of `key` as of `snapshot`, or
+  // nullptr if it was missing.
+  const Value *FindAt(const Shard &shard, std::string_view key,
+                      uint64_t snapshot) const;
+  static size_t ShardIndex(std::string_view key);
+  Shard &ShardFor(std::string_view key) { return shards_[ShardIndex(key)]; }
+  // Requires `shard.mutex` held exclusively. Copies a pinned map first.
+  ValueMap &MutableMap(Shard &shard);
+  std::string ArchivePath(uint64_t number) const;
+  void CheckpointLoop();
 
 private:
-  KVMap data_;
+  std::array<Shard, kNumShards> shards_;
+  // mapped on load and never changed after; values keep pointing into
+  // them across checkpoints
+  std::vector<std::shared_ptr<MappedSnapshot>> snapshots_;
   std::string file_path_;
+  std::shared_ptr<AsyncIo> io_; // log and snapshot writes
+  WriteAheadLog wal_;
+  const ValueEncoder encoder_;
+  CommitSequence sequence_;
+
+  // logs cut by checkpoints whose snapshot is not durable yet
+  std::mutex checkpoint_mutex_;
+  SnapshotManifest manifest_; // the partitions on disk, if any
+  std::vector<std::string> archives_;
+  uint64_t next_archive_ = 1;
+  std::atomic<uint64_t> copy_us_{0};
+
+  int checkpoint_interval_s_;
+  std::function<void(bool, const CheckpointStats &)> on_checkpoint_;
+  std::thread checkpoint_thread_;
+  std::mutex stop_mutex_;
+  std::condition_variable stop_cv_;
+  bool stop_ = false;
 };
 
-inline std::unique_ptr<StorageEngine>
+// Smallest key above every key starting with `prefix`, or empty (no upper
+// bound) if there is none: [prefix, PrefixEnd(prefix)) is a prefix range.
+std::string PrefixEnd(std::string_view prefix);
+
+// `engine_type` is "memory", "file" or "lsm"; for "lsm" `file_path` is a
+// directory. File and lsm engines are wrapped in a `CachedStorageEngine`
+// when `options.cache.entries` is nonzero.
+std::unique_ptr<StorageEngine>
 CreateStorageEngine(const std::string &engine_type = "memory",
-                    const std::string &file_path = "") {
-  if (engine_type == "memory") {
-    return std::make_unique<MemoryStorage>();
-  } else {
-    return std::make_unique<FileStorage>(file_path);
-  }
-}
+                    const std::string &file_path = "",
+                    const StorageOptions &options = StorageOptions());
 
 } // namespace tiny_kv
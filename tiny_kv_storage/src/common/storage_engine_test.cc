@@ -3,11 +3,51 @@
 //
 
 #include "storage_engine.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
 #include <filesystem>
+#include <fstream>
+#include <future>
+#include <limits>
 #include <gtest/gtest.h>
+#include <map>
 #include <memory>
+#include <thread>
+#include <vector>
 
 namespace tiny_kv {
+
+namespace {
+
+// The snapshot (a manifest for FileStorage, a directory for LSMStorage),
+// its partitions and the log of a file-backed engine at `path`.
+void RemoveStorageFiles(const std::string &path) {
+  std::filesystem::remove_all(path);
+  std::filesystem::remove(path + ".wal");
+  const std::string prefix = path + ".";
+  for (const auto &entry : std::filesystem::directory_iterator(".")) {
+    std::string name = entry.path().filename().string();
+    if (name.compare(0, prefix.size(), prefix) == 0 &&
+        name.find(".part") != std::string::npos) {
+      std::filesystem::remove(entry.path());
+    }
+  }
+}
+
+// Runs a `PutAsync` and waits for its callback.
+bool PutAndWait(StorageEngine *storage, std::string_view key,
+                std::string_view value, Durability durability,
+                uint64_t ttl_ms = 0) {
+  auto result = std::make_shared<std::promise<bool>>();
+  auto done = result->get_future();
+  storage->PutAsync(key, value, ttl_ms, durability,
+                    [result](bool success) { result->set_value(success); });
+  return done.get();
+}
+
+} // namespace
+
 TEST(MemoryStorageTest, BasicOperations) {
   auto storage = std::make_unique<MemoryStorage>();
 
@@ -48,11 +88,257 @@ TEST(MemoryStorageTest, BatchOperations) {
   EXPECT_EQ(entries.count("key2"), 0);
 }
 
+TEST(MemoryStorageTest, ConcurrentAccess) {
+  auto storage = std::make_unique<MemoryStorage>(5);
+  EXPECT_EQ(storage->NumShards(), 8);
+
+  const int thread_count = 8;
+  const int keys_per_thread = 1000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_count; ++t) {
+    threads.emplace_back([&storage, t]() {
+      for (int i = 0; i < keys_per_thread; ++i) {
+        std::string key = std::to_string(t) + "_" + std::to_string(i);
+        EXPECT_TRUE(storage->Put(key, key));
+        EXPECT_EQ(storage->Get(key), key);
+        // readers of other threads' keys race with their writers
+        storage->Get(std::to_string((t + 1) % thread_count) + "_" +
+                     std::to_string(i));
+        if (i % 2 == 0) {
+          EXPECT_TRUE(storage->Delete(key));
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(storage->GetAllEntries().size(),
+            thread_count * keys_per_thread / 2);
+}
+
+TEST(MemoryStorageTest, ExpireKeys) {
+  auto storage = std::make_unique<MemoryStorage>();
+  const int expiring = 3000;
+  for (int i = 0; i < expiring; ++i) {
+    storage->PutWithTtl("bulk" + std::to_string(i), "v", 200);
+  }
+  EXPECT_TRUE(storage->PutWithTtl("soon", "v1", 200));
+  EXPECT_TRUE(storage->PutWithTtl("later", "v2", 60000));
+  EXPECT_TRUE(storage->PutWithTtl("revived", "v3", 200));
+  EXPECT_TRUE(storage->Put("revived", "v4"));
+  EXPECT_TRUE(storage->PutWithTtl("plain", "v5", 0));
+  // a TTL too long to add to the clock must not wrap to an early deadline
+  EXPECT_TRUE(storage->PutWithTtl("forever", "v6",
+                                  std::numeric_limits<uint64_t>::max()));
+  EXPECT_EQ(storage->Get("soon"), "v1");
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+  // every read hides expired keys, whether or not they were removed yet
+  EXPECT_EQ(storage->Get("soon"), std::nullopt);
+  EXPECT_FALSE(storage->Visit("bulk1", [](std::string_view) {}));
+  std::vector<std::optional<std::string>> values;
+  storage->MultiGet({"bulk2", "later", "revived", "forever"}, &values);
+  EXPECT_EQ(values, (std::vector<std::optional<std::string>>{
+                        std::nullopt, "v2", "v4", "v6"}));
+  EXPECT_FALSE(storage->Delete("bulk3"));
+  ScanBatch batch;
+  storage->Scan("", "", 0, &batch);
+  EXPECT_EQ(batch, (ScanBatch{{"forever", "v6"},
+                              {"later", "v2"},
+                              {"plain", "v5"},
+                              {"revived", "v4"}}));
+  EXPECT_EQ(storage->GetAllEntries().size(), 4u);
+
+  // the rest are removed in the background without being touched
+  for (int i = 0; i < 100 && storage->ExpiredKeys() < expiring + 1; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  EXPECT_EQ(storage->ExpiredKeys(), expiring + 1u);
+  EXPECT_EQ(storage->Get("later"), "v2");
+  EXPECT_EQ(storage->Get("forever"), "v6");
+}
+
+TEST(MemoryStorageTest, EvictsToMemoryLimit) {
+  const std::string value(100, 'v');
+  auto fill = [&value](MemoryStorage *storage, const std::string &prefix,
+                       int count) {
+    for (int i = 0; i < count; ++i) {
+      EXPECT_TRUE(storage->Put(prefix + std::to_string(i), value));
+    }
+  };
+
+  // room for about 1250 of these entries
+  MemoryStorage unlimited(4);
+  fill(&unlimited, "k", 1000);
+  const size_t limit = unlimited.UsedBytes() * 5 / 4;
+
+  auto storage = std::make_unique<MemoryStorage>(4, limit);
+  fill(storage.get(), "k", 1000);
+  EXPECT_EQ(storage->EvictedKeys(), 0u);
+
+  // reads on a later clock tick protect the first hundred keys
+  std::this_thread::sleep_for(
+      std::chrono::milliseconds(3 * MemoryStorage::kExpiryTickMs));
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(storage->Get("k" + std::to_string(i)).has_value());
+  }
+  fill(storage.get(), "n", 400);
+
+  EXPECT_GT(storage->EvictedKeys(), 0u);
+  EXPECT_LE(storage->UsedBytes(), limit + limit / 16);
+  EXPECT_EQ(storage->GetAllEntries().size() + storage->EvictedKeys(), 1400u);
+  int hot = 0;
+  for (int i = 0; i < 100; ++i) {
+    hot += storage->Get("k" + std::to_string(i)).has_value();
+  }
+  EXPECT_GE(hot, 97);
+
+  // an entry larger than a shard's share is refused without evicting
+  uint64_t evicted = storage->EvictedKeys();
+  EXPECT_FALSE(storage->Put("huge", std::string(limit, 'x')));
+  EXPECT_EQ(storage->EvictedKeys(), evicted);
+}
+
+// Eviction is a write like any other: a snapshot read sees exactly the
+// keys that were present at its snapshot, even if they are evicted while
+// it reads.
+TEST(MemoryStorageTest, SnapshotReadsSeeEvictedKeys) {
+  const std::string value(100, 'v');
+  MemoryStorage unlimited(4);
+  for (int i = 0; i < 200; ++i) {
+    unlimited.Put("f" + std::to_string(i), value);
+  }
+  MemoryStorage storage(4, unlimited.UsedBytes());
+
+  // the marker names the last batch applied
+  std::vector<std::string> keys = {"marker"};
+  KVPairList kvs = {{"marker", "0"}};
+  for (int i = 0; i < 32; ++i) {
+    keys.push_back("p" + std::to_string(i));
+  }
+  for (size_t i = 1; i < keys.size(); ++i) {
+    kvs.emplace_back(keys[i], value);
+  }
+  const KeyList key_list(keys.begin(), keys.end());
+
+  // which keys were left after each batch, recorded by the writer
+  const int batches = 20000;
+  std::vector<uint64_t> present(batches + 1);
+  std::atomic<int> recorded{-1};
+  auto record = [&](int batch) {
+    uint64_t mask = 0;
+    for (size_t i = 1; i < keys.size(); ++i) {
+      mask |= uint64_t{storage.Get(keys[i]).has_value()} << i;
+    }
+    present[batch] = mask;
+    recorded = batch;
+  };
+  ASSERT_TRUE(storage.MultiPut(kvs));
+  record(0);
+
+  std::atomic<bool> stop{false};
+  std::thread reader([&]() {
+    std::vector<std::optional<std::string>> values;
+    while (!stop) {
+      storage.MultiGet(key_list, &values);
+      ASSERT_TRUE(values[0].has_value());
+      int batch = std::stoi(*values[0]);
+      while (recorded < batch) {
+        std::this_thread::yield();
+      }
+      uint64_t mask = 0;
+      for (size_t i = 1; i < values.size(); ++i) {
+        mask |= uint64_t{values[i].has_value()} << i;
+      }
+      ASSERT_EQ(mask, present[batch]) << "read a torn eviction at " << batch;
+    }
+  });
+
+  // each batch adds a key and rewrites another, evicting others, and moves
+  // the marker
+  for (int batch = 1; batch <= batches; ++batch) {
+    EXPECT_TRUE(storage.MultiPut({{"f" + std::to_string(batch), value},
+                                  {keys[1 + batch % 32], value},
+                                  {"marker", std::to_string(batch)}}));
+    record(batch);
+  }
+  stop = true;
+  reader.join();
+  EXPECT_GT(storage.EvictedKeys(), 0u);
+}
+
+TEST(MemoryStorageTest, CompressesLargeValues) {
+  CompressionOptions compression;
+  ASSERT_TRUE(ParseValueCodec("lz4", &compression.codec));
+  compression.min_bytes = 64;
+  MemoryStorage plain(4);
+  MemoryStorage compressed(4, 0, compression);
+
+  auto json = [](int i) {
+    std::string value;
+    while (value.size() < 2000) {
+      value += "{\"id\":" + std::to_string(i++) +
+               ",\"name\":\"user\",\"active\":true},";
+    }
+    return value;
+  };
+  std::vector<std::string> keys;
+  std::vector<std::string> values;
+  for (int i = 0; i < 400; ++i) {
+    keys.push_back("k" + std::to_string(1000 + i));
+    values.push_back(i % 4 == 0 ? "small" + std::to_string(i) : json(i));
+  }
+  KVPairList pairs;
+  for (int i = 0; i < 400; ++i) {
+    if (i < 200) {
+      EXPECT_TRUE(plain.Put(keys[i], values[i]));
+      EXPECT_TRUE(compressed.Put(keys[i], values[i]));
+    } else {
+      pairs.emplace_back(keys[i], values[i]);
+    }
+  }
+  EXPECT_TRUE(plain.MultiPut(pairs));
+  EXPECT_TRUE(compressed.MultiPut(pairs));
+  EXPECT_TRUE(compressed.PutWithTtl("ttl", values[1], 60000));
+  EXPECT_LT(compressed.UsedBytes(), plain.UsedBytes() / 2);
+
+  // every read path hands out the original values
+  for (int i = 0; i < 400; ++i) {
+    EXPECT_EQ(compressed.Get(keys[i]), values[i]);
+    std::string visited;
+    EXPECT_TRUE(compressed.Visit(
+        keys[i], [&visited](std::string_view value) { visited = value; }));
+    EXPECT_EQ(visited, values[i]);
+  }
+  EXPECT_EQ(compressed.Get("ttl"), values[1]);
+
+  std::vector<std::optional<std::string>> got;
+  compressed.MultiGet(KeyList(keys.begin(), keys.end()), &got);
+  ASSERT_EQ(got.size(), keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(got[i], values[i]);
+  }
+
+  ASSERT_TRUE(compressed.Delete("ttl"));
+  auto sorted = [](StorageEngine *storage) {
+    KVMap all = storage->GetAllEntries();
+    return std::map<std::string, std::string>(all.begin(), all.end());
+  };
+  EXPECT_EQ(sorted(&compressed), sorted(&plain));
+  ScanBatch range;
+  compressed.Scan("k1100", "k1300", 0, &range);
+  ASSERT_EQ(range.size(), 200u);
+  for (size_t i = 0; i < range.size(); ++i) {
+    EXPECT_EQ(range[i].second, values[100 + i]);
+  }
+}
+
 TEST(FileStorageTest, PersistAndLoad) {
   const std::string test_file = "test.db";
-  if (std::filesystem::exists(test_file)) {
-    std::filesystem::remove(test_file);
-  }
+  RemoveStorageFiles(test_file);
 
   {
     auto storage = std::make_unique<FileStorage>(test_file);
@@ -97,7 +383,731 @@ TEST(FileStorageTest, PersistAndLoad) {
     EXPECT_FALSE(storage->Get("key1").has_value());
   }
 
-  std::filesystem::remove(test_file);
+  RemoveStorageFiles(test_file);
+}
+
+TEST(FileStorageTest, RecoverFromLogWithoutPersist) {
+  const std::string test_file = "test_wal.db";
+  const std::string crash_file = "test_wal_crash.db";
+  for (const auto &path : {test_file, crash_file}) {
+    RemoveStorageFiles(path);
+  }
+
+  {
+    auto storage = std::make_unique<FileStorage>(test_file);
+    EXPECT_TRUE(storage->Put("key1", "value1"));
+    EXPECT_TRUE(storage->Put("key2", "value2"));
+    EXPECT_TRUE(storage->Put("key2", "value2_new"));
+    EXPECT_TRUE(storage->Delete("key1"));
+
+    // copy the on-disk state while `storage` is still alive, as if the
+    // process had been killed before `Persist()` ran
+    EXPECT_FALSE(std::filesystem::exists(test_file));
+    std::filesystem::copy_file(test_file + ".wal", crash_file + ".wal");
+  }
+
+  {
+    auto storage = std::make_unique<FileStorage>(crash_file);
+    EXPECT_FALSE(storage->Get("key1").has_value());
+    auto value2 = storage->Get("key2");
+    EXPECT_TRUE(value2.has_value());
+    EXPECT_EQ(*value2, "value2_new");
+  }
+
+  // the checkpoint in `~FileStorage()` folds the log into the snapshot
+  EXPECT_EQ(std::filesystem::file_size(crash_file + ".wal"), 0);
+  {
+    auto storage = std::make_unique<FileStorage>(crash_file);
+    EXPECT_EQ(storage->GetAllEntries().size(), 1);
+  }
+
+  for (const auto &path : {test_file, crash_file}) {
+    RemoveStorageFiles(path);
+  }
+}
+
+TEST(FileStorageTest, DurabilityLevels) {
+  const std::string test_file = "test_durability.db";
+  const std::string crash_file = "test_durability_crash.db";
+  for (const auto &path : {test_file, crash_file}) {
+    RemoveStorageFiles(path);
+  }
+
+  {
+    // kSync syncs even when the policy never does
+    StorageOptions options;
+    options.wal.fsync_policy = FsyncPolicy::kNever;
+    auto storage = std::make_unique<FileStorage>(test_file, options);
+    EXPECT_TRUE(PutAndWait(storage.get(), "memory", "1", Durability::kMemory));
+    EXPECT_TRUE(PutAndWait(storage.get(), "async", "2", Durability::kAsyncLog));
+    EXPECT_TRUE(
+        PutAndWait(storage.get(), "default", "3", Durability::kDefault));
+    EXPECT_FALSE(
+        PutAndWait(storage.get(), "ttl", "x", Durability::kMemory, 1000));
+
+    std::promise<bool> batch_done;
+    storage->MultiPutAsync({{"batch1", "4"}, {"batch2", "5"}},
+                           Durability::kSync, [&batch_done](bool success) {
+                             batch_done.set_value(success);
+                           });
+    EXPECT_TRUE(batch_done.get_future().get());
+
+    // every level is applied before the call returns
+    EXPECT_EQ(storage->Get("memory"), "1");
+    EXPECT_EQ(storage->Get("async"), "2");
+    EXPECT_EQ(storage->Get("batch2"), "5");
+    EXPECT_FALSE(storage->Get("ttl").has_value());
+
+    // the synced batch came after the async put, so the log holds both
+    std::filesystem::copy_file(test_file + ".wal", crash_file + ".wal");
+  }
+
+  {
+    auto storage = std::make_unique<FileStorage>(crash_file);
+    EXPECT_FALSE(storage->Get("memory").has_value());
+    EXPECT_EQ(storage->Get("async"), "2");
+    EXPECT_EQ(storage->Get("default"), "3");
+    EXPECT_EQ(storage->Get("batch1"), "4");
+    EXPECT_EQ(storage->Get("batch2"), "5");
+  }
+
+  // a checkpoint keeps memory-only writes like any other
+  {
+    auto storage = std::make_unique<FileStorage>(test_file);
+    EXPECT_EQ(storage->Get("memory"), "1");
+  }
+
+  for (const auto &path : {test_file, crash_file}) {
+    RemoveStorageFiles(path);
+  }
+}
+
+TEST(FileStorageTest, UpgradeLegacySnapshot) {
+  const std::string test_file = "test_legacy.db";
+  RemoveStorageFiles(test_file);
+
+  // count followed by length-prefixed pairs
+  {
+    std::ofstream file(test_file, std::ios::binary);
+    size_t count = 1;
+    size_t length = 4;
+    file.write(reinterpret_cast<char *>(&count), sizeof(count));
+    file.write(reinterpret_cast<char *>(&length), sizeof(length));
+    file.write("key1", length);
+    length = 6;
+    file.write(reinterpret_cast<char *>(&length), sizeof(length));
+    file.write("value1", length);
+  }
+
+  EXPECT_FALSE(MappedSnapshot::IsSnapshotFile(test_file));
+  {
+    auto storage = std::make_unique<FileStorage>(test_file);
+    EXPECT_EQ(storage->Get("key1"), "value1");
+  }
+
+  EXPECT_TRUE(SnapshotManifest::IsManifestFile(test_file));
+  {
+    auto storage = std::make_unique<FileStorage>(test_file);
+    // served from the mapped snapshot
+    std::string visited;
+    EXPECT_TRUE(storage->Visit("key1", [&visited](std::string_view value) {
+      visited = value;
+    }));
+    EXPECT_EQ(visited, "value1");
+    EXPECT_EQ(storage->Get("key1"), "value1");
+    EXPECT_EQ(storage->GetAllEntries().size(), 1);
+  }
+
+  RemoveStorageFiles(test_file);
+}
+
+TEST(FileStorageTest, CompressedValuesAndOldFormats) {
+  const std::string test_file = "test_compressed.db";
+  RemoveStorageFiles(test_file);
+
+  StorageOptions options;
+  ASSERT_TRUE(ParseValueCodec("lz4", &options.compression.codec));
+  std::string json;
+  for (int i = 0; json.size() < 4000; ++i) {
+    json += "{\"id\":" + std::to_string(i) + ",\"tags\":[\"a\",\"b\"]},";
+  }
+
+  {
+    auto storage = std::make_unique<FileStorage>(test_file, options);
+    EXPECT_TRUE(storage->Put("json", json));
+    EXPECT_TRUE(storage->Put("small", "v"));
+    EXPECT_TRUE(storage->MultiPut({{"json2", json}}));
+    EXPECT_EQ(storage->Get("json"), json);
+    // the log already holds the compressed form
+    EXPECT_LT(std::filesystem::file_size(test_file + ".wal"), json.size());
+    for (int i = 0; i < 100; ++i) {
+      EXPECT_TRUE(storage->Put("bulk" + std::to_string(i), json));
+    }
+  }
+  // far below the 400 KB the values take raw
+  SnapshotManifest manifest;
+  ASSERT_TRUE(manifest.Read(test_file));
+  uintmax_t snapshot_size = 0;
+  for (uint32_t i = 0; i < manifest.num_partitions; ++i) {
+    snapshot_size +=
+        std::filesystem::file_size(manifest.PartitionPath(test_file, i));
+  }
+  EXPECT_LT(snapshot_size, 100 * json.size() / 2);
+
+  {
+    // the codec only picks how values are written; every encoding reads
+    auto storage = std::make_unique<FileStorage>(test_file);
+    std::string visited;
+    EXPECT_TRUE(storage->Visit("json2", [&visited](std::string_view value) {
+      visited = value;
+    }));
+    EXPECT_EQ(visited, json);
+    EXPECT_EQ(storage->Get("small"), "v");
+    EXPECT_EQ(storage->GetAllEntries()["json"], json);
+  }
+  RemoveStorageFiles(test_file);
+
+  // a version 1 snapshot and a log written before values were encoded
+  {
+    SnapshotWriter writer(test_file);
+    ASSERT_TRUE(writer.Open());
+    ASSERT_TRUE(writer.Add("old", json));
+    ASSERT_TRUE(writer.Finish());
+    std::fstream file(test_file, std::ios::in | std::ios::out |
+                                     std::ios::binary);
+    const uint32_t version = 1;
+    file.seekp(sizeof(uint64_t));
+    file.write(reinterpret_cast<const char *>(&version), sizeof(version));
+
+    WriteAheadLog wal(test_file + ".wal", WalOptions());
+    ASSERT_TRUE(wal.Open([](WalRecordType, std::string_view,
+                            std::string_view) {}));
+    EXPECT_TRUE(wal.Sync(wal.Append(WalRecordType::kPut, "logged", json)));
+  }
+  {
+    auto storage = std::make_unique<FileStorage>(test_file, options);
+    EXPECT_EQ(storage->Get("old"), json);
+    EXPECT_EQ(storage->Get("logged"), json);
+  }
+  // rewritten with encoded values by the checkpoint on close
+  ASSERT_TRUE(manifest.Read(test_file));
+  for (uint32_t i = 0; i < manifest.num_partitions; ++i) {
+    auto snapshot = MappedSnapshot::Open(manifest.PartitionPath(test_file, i));
+    ASSERT_NE(snapshot, nullptr);
+    EXPECT_TRUE(snapshot->EncodedValues());
+  }
+  {
+    auto storage = std::make_unique<FileStorage>(test_file);
+    EXPECT_EQ(storage->Get("old"), json);
+    EXPECT_EQ(storage->Get("logged"), json);
+  }
+  RemoveStorageFiles(test_file);
+}
+
+TEST(FileStorageTest, PartitionedSnapshot) {
+  const std::string test_file = "test_partitioned.db";
+  RemoveStorageFiles(test_file);
+
+  const int num_keys = 10000;
+  {
+    auto storage = std::make_unique<FileStorage>(test_file);
+    for (int i = 0; i < num_keys; ++i) {
+      std::string key = "key" + std::to_string(i);
+      EXPECT_TRUE(storage->Put(key, "value" + key));
+    }
+  }
+
+  SnapshotManifest manifest;
+  ASSERT_TRUE(manifest.Read(test_file));
+  EXPECT_GT(manifest.num_partitions, 1u);
+  uint64_t entries = 0;
+  for (uint32_t i = 0; i < manifest.num_partitions; ++i) {
+    auto partition =
+        MappedSnapshot::Open(manifest.PartitionPath(test_file, i));
+    ASSERT_NE(partition, nullptr);
+    // every partition gets a share of the keys
+    EXPECT_GT(partition->NumEntries(), 0u);
+    entries += partition->NumEntries();
+  }
+  EXPECT_EQ(entries, num_keys);
+
+  // left behind by a checkpoint that never swapped its manifest in
+  const std::string stale =
+      test_file + "." + std::to_string(manifest.generation + 7) + ".part0";
+  std::ofstream(stale) << "partial";
+  {
+    auto storage = std::make_unique<FileStorage>(test_file);
+    EXPECT_FALSE(std::filesystem::exists(stale));
+    EXPECT_EQ(storage->GetAllEntries().size(), num_keys);
+    EXPECT_EQ(storage->Get("key42"), "valuekey42");
+    EXPECT_TRUE(storage->Delete("key42"));
+    EXPECT_TRUE(storage->Put("key43", "new"));
+  }
+
+  // the next generation replaced the old one
+  SnapshotManifest next;
+  ASSERT_TRUE(next.Read(test_file));
+  EXPECT_EQ(next.generation, manifest.generation + 1);
+  for (uint32_t i = 0; i < manifest.num_partitions; ++i) {
+    EXPECT_FALSE(
+        std::filesystem::exists(manifest.PartitionPath(test_file, i)));
+  }
+  {
+    auto storage = std::make_unique<FileStorage>(test_file);
+    EXPECT_EQ(storage->GetAllEntries().size(), num_keys - 1);
+    EXPECT_FALSE(storage->Get("key42").has_value());
+    EXPECT_EQ(storage->Get("key43"), "new");
+  }
+  RemoveStorageFiles(test_file);
+
+  // partitions that do not match the shards (another shard count) still
+  // load, each key wherever it landed
+  SnapshotManifest foreign{3, 2};
+  for (uint32_t i = 0; i < foreign.num_partitions; ++i) {
+    SnapshotWriter writer(foreign.PartitionPath(test_file, i));
+    ASSERT_TRUE(writer.Open());
+    for (int j = 0; j < 100; ++j) {
+      std::string key = "p" + std::to_string(i) + "_" + std::to_string(j);
+      std::string encoded;
+      ValueEncoder().Encode(key, &encoded);
+      ASSERT_TRUE(writer.Add(key, encoded));
+    }
+    ASSERT_TRUE(writer.Finish());
+  }
+  ASSERT_TRUE(foreign.Write(test_file));
+  {
+    auto storage = std::make_unique<FileStorage>(test_file);
+    EXPECT_EQ(storage->GetAllEntries().size(), 200);
+    EXPECT_EQ(storage->Get("p1_99"), "p1_99");
+    std::vector<std::optional<std::string>> values;
+    storage->MultiGet({"p0_0", "p1_0"}, &values);
+    EXPECT_EQ(values[0], "p0_0");
+    EXPECT_EQ(values[1], "p1_0");
+  }
+  RemoveStorageFiles(test_file);
+}
+
+TEST(FileStorageTest, CheckpointWhileWriting) {
+  const std::string test_file = "test_checkpoint.db";
+  RemoveStorageFiles(test_file);
+
+  const int thread_count = 4;
+  const int writes_per_thread = 2000;
+  {
+    StorageOptions options;
+    options.wal.fsync_policy = FsyncPolicy::kNever;
+    auto storage = std::make_unique<FileStorage>(test_file, options);
+
+    std::atomic<bool> done{false};
+    std::thread checkpointer([&]() {
+      while (!done) {
+        CheckpointStats stats;
+        EXPECT_TRUE(storage->Persist(&stats));
+        EXPECT_LE(stats.pause_us, stats.duration_ms * 1000 + 1000);
+      }
+    });
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < thread_count; ++t) {
+      writers.emplace_back([&storage, t]() {
+        for (int i = 0; i < writes_per_thread; ++i) {
+          std::string key = std::to_string(t) + "_" + std::to_string(i);
+          EXPECT_TRUE(storage->Put(key, key));
+          if (i % 4 == 0) {
+            EXPECT_TRUE(storage->Delete(key));
+          }
+        }
+      });
+    }
+    for (auto &writer : writers) {
+      writer.join();
+    }
+    done = true;
+    checkpointer.join();
+  }
+
+  // a crash right after a checkpoint cut the log: the archived log is replayed
+  // on top of the older snapshot, its manifest and partitions
+  SnapshotManifest old;
+  ASSERT_TRUE(old.Read(test_file));
+  std::vector<std::string> snapshot_files = {test_file};
+  for (uint32_t i = 0; i < old.num_partitions; ++i) {
+    snapshot_files.push_back(old.PartitionPath(test_file, i));
+  }
+  for (const auto &path : snapshot_files) {
+    std::filesystem::copy_file(path, path + ".old");
+  }
+  {
+    auto storage = std::make_unique<FileStorage>(test_file);
+    EXPECT_TRUE(storage->Put("archived", "value"));
+    std::filesystem::copy_file(test_file + ".wal", "archived.wal");
+  }
+  for (const auto &path : snapshot_files) {
+    std::filesystem::rename(path + ".old", path);
+  }
+  std::filesystem::rename("archived.wal", test_file + ".wal.7");
+
+  auto storage = std::make_unique<FileStorage>(test_file);
+  EXPECT_EQ(storage->Get("archived"), "value");
+  auto entries = storage->GetAllEntries();
+  EXPECT_EQ(entries.size(), thread_count * writes_per_thread * 3 / 4 + 1);
+  for (int t = 0; t < thread_count; ++t) {
+    for (int i = 0; i < writes_per_thread; ++i) {
+      std::string key = std::to_string(t) + "_" + std::to_string(i);
+      EXPECT_EQ(entries.count(key), i % 4 == 0 ? 0 : 1) << key;
+    }
+  }
+  storage.reset();
+  EXPECT_FALSE(std::filesystem::exists(test_file + ".wal.7"));
+
+  RemoveStorageFiles(test_file);
+}
+
+TEST(FileStorageTest, BackgroundCheckpointReports) {
+  const std::string test_file = "test_checkpoint_report.db";
+  RemoveStorageFiles(test_file);
+
+  std::atomic<int> checkpoints{0};
+  {
+    StorageOptions options;
+    options.checkpoint_interval_s = 1;
+    options.on_checkpoint = [&checkpoints](bool ok, const CheckpointStats &) {
+      EXPECT_TRUE(ok);
+      checkpoints++;
+    };
+    auto storage = std::make_unique<FileStorage>(test_file, options);
+    EXPECT_TRUE(storage->Put("key", "value"));
+    while (checkpoints == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+  EXPECT_EQ(FileStorage(test_file).Get("key"), "value");
+
+  RemoveStorageFiles(test_file);
+}
+
+TEST(StorageEngineTest, BatchAndVisitOnEveryEngine) {
+  const std::string path = "test_batch.db";
+  for (const std::string type : {"memory", "file", "lsm"}) {
+    RemoveStorageFiles(path);
+
+    auto storage = CreateStorageEngine(type, path);
+    std::vector<std::string> keys;
+    std::vector<std::string> values_in;
+    for (int i = 0; i < 100; ++i) {
+      keys.push_back("key" + std::to_string(i));
+      values_in.push_back(keys.back() + "_value");
+    }
+
+    KVPairList kvs;
+    for (size_t i = 0; i < keys.size(); ++i) {
+      kvs.emplace_back(keys[i], values_in[i]);
+    }
+    EXPECT_TRUE(storage->MultiPut(kvs)) << type;
+    EXPECT_EQ(storage->Get("key42"), "key42_value") << type;
+
+    KeyList lookup = {"key1", "missing", "key99", "key1"};
+    std::vector<std::optional<std::string>> values;
+    storage->MultiGet(lookup, &values);
+    ASSERT_EQ(values.size(), lookup.size()) << type;
+    EXPECT_EQ(values[0], "key1_value") << type;
+    EXPECT_FALSE(values[1].has_value()) << type;
+    EXPECT_EQ(values[2], "key99_value") << type;
+    EXPECT_EQ(values[3], "key1_value") << type;
+
+    std::string visited;
+    EXPECT_TRUE(storage->Visit("key7", [&visited](std::string_view value) {
+      visited = value;
+    })) << type;
+    EXPECT_EQ(visited, "key7_value") << type;
+    EXPECT_FALSE(storage->Visit("missing", [](std::string_view) {
+      ADD_FAILURE();
+    })) << type;
+
+    EXPECT_TRUE(storage->MultiDelete({"key1", "key2"})) << type;
+    EXPECT_FALSE(storage->MultiDelete({"key3", "key2"})) << type;
+    EXPECT_FALSE(storage->Get("key3").has_value()) << type;
+    EXPECT_EQ(storage->GetAllEntries().size(), keys.size() - 3) << type;
+
+    storage.reset();
+    RemoveStorageFiles(path);
+  }
+}
+
+TEST(StorageEngineTest, ScanWhileWritingOnEveryEngine) {
+  const std::string path = "test_scan.db";
+  StorageOptions options;
+  options.lsm.memtable_bytes = 4 << 10; // spread lsm data over many tables
+  for (const std::string type : {"memory", "file", "lsm"}) {
+    RemoveStorageFiles(path);
+
+    auto storage = CreateStorageEngine(type, path, options);
+    for (int i = 0; i < 1000; ++i) {
+      storage->Put("stable" + std::to_string(i), "v" + std::to_string(i));
+    }
+    for (int i = 0; i < 100; ++i) {
+      storage->Put("doomed" + std::to_string(i), "x");
+    }
+
+    std::map<std::string, std::string> seen;
+    ScanCursor cursor;
+    ScanBatch batch;
+    for (int round = 0; !cursor.done; ++round) {
+      storage->Scan(&cursor, 16, &batch);
+      for (const auto &[key, value] : batch) {
+        EXPECT_TRUE(seen.emplace(key, value).second)
+            << type << " returned " << key << " twice";
+      }
+      // grow the data set and delete some of it between batches
+      for (int i = 0; i < 20; ++i) {
+        storage->Put("added" + std::to_string(round * 20 + i), "a");
+      }
+      storage->Delete("doomed" + std::to_string(round % 100));
+    }
+
+    for (int i = 0; i < 1000; ++i) {
+      auto it = seen.find("stable" + std::to_string(i));
+      ASSERT_NE(it, seen.end()) << type << " missed stable" << i;
+      EXPECT_EQ(it->second, "v" + std::to_string(i)) << type;
+    }
+
+    storage.reset();
+    RemoveStorageFiles(path);
+  }
+}
+
+TEST(StorageEngineTest, RangeScanOnEveryEngine) {
+  const std::string path = "test_range.db";
+  StorageOptions options;
+  options.lsm.memtable_bytes = 4 << 10;
+  for (const std::string type : {"memory", "file", "lsm"}) {
+    RemoveStorageFiles(path);
+
+    auto storage = CreateStorageEngine(type, path, options);
+    std::map<std::string, std::string> reference;
+    for (int i = 0; i < 3000; ++i) {
+      char key[16];
+      snprintf(key, sizeof(key), "%c%05d", 'a' + i % 3, i);
+      storage->Put(key, std::to_string(i));
+      reference[key] = std::to_string(i);
+    }
+    // overwrite and delete some, so lsm tables hold stale versions
+    for (int i = 0; i < 3000; i += 7) {
+      char key[16];
+      snprintf(key, sizeof(key), "%c%05d", 'a' + i % 3, i);
+      if (i % 2 == 0) {
+        storage->Delete(key);
+        reference.erase(key);
+      } else {
+        storage->Put(key, "new");
+        reference[key] = "new";
+      }
+    }
+
+    auto expect_range = [&](const std::string &start, const std::string &end,
+                            size_t limit) {
+      ScanBatch batch;
+      storage->Scan(start, end, limit, &batch);
+      auto it = reference.lower_bound(start);
+      size_t count = 0;
+      for (; it != reference.end() && (end.empty() || it->first < end) &&
+             (limit == 0 || count < limit);
+           ++it, ++count) {
+        ASSERT_LT(count, batch.size()) << type << " [" << start << ", " << end
+                                       << ") stopped early";
+        EXPECT_EQ(batch[count].first, it->first) << type;
+        EXPECT_EQ(batch[count].second, it->second) << type;
+      }
+      EXPECT_EQ(batch.size(), count) << type << " [" << start << ", " << end
+                                     << ")";
+    };
+
+    expect_range("", "", 0);
+    expect_range("b00100", "b00200", 0);
+    expect_range("b00100", "b00200", 5);
+    expect_range("a", "", 10);
+    expect_range("b", PrefixEnd("b"), 0); // crosses the 1024-key chunks
+    expect_range("c02990", "", 0);
+    expect_range("z", "", 0);
+    expect_range("b00200", "b00100", 0);
+
+    storage.reset();
+    RemoveStorageFiles(path);
+  }
+}
+
+TEST(StorageEngineTest, AtomicUpdatesOnEveryEngine) {
+  const std::string path = "test_update.db";
+  for (const std::string type : {"memory", "file", "lsm"}) {
+    RemoveStorageFiles(path);
+
+    auto storage = CreateStorageEngine(type, path);
+    EXPECT_EQ(storage->CompareAndSet("cas", "a", "b"), UpdateStatus::kNotFound)
+        << type;
+    storage->Put("cas", "a");
+    EXPECT_EQ(storage->CompareAndSet("cas", "x", "b"), UpdateStatus::kMismatch)
+        << type;
+    EXPECT_EQ(storage->CompareAndSet("cas", "a", "b"), UpdateStatus::kOk)
+        << type;
+    EXPECT_EQ(storage->Get("cas"), "b") << type;
+
+    int64_t number = 0;
+    EXPECT_EQ(storage->IncrementBy("counter", 5, &number), UpdateStatus::kOk)
+        << type;
+    EXPECT_EQ(number, 5) << type;
+    EXPECT_EQ(storage->IncrementBy("counter", -7, &number), UpdateStatus::kOk)
+        << type;
+    EXPECT_EQ(storage->Get("counter"), "-2") << type;
+    EXPECT_EQ(storage->IncrementBy("cas", 1, &number),
+              UpdateStatus::kNotInteger)
+        << type;
+    storage->Put("big", std::to_string(INT64_MAX));
+    EXPECT_EQ(storage->IncrementBy("big", 1, &number),
+              UpdateStatus::kNotInteger)
+        << type;
+    storage->Put("padded", "12 ");
+    EXPECT_EQ(storage->IncrementBy("padded", 1, &number),
+              UpdateStatus::kNotInteger)
+        << type;
+
+    size_t length = 0;
+    EXPECT_EQ(storage->Append("log", "ab", &length), UpdateStatus::kOk)
+        << type;
+    EXPECT_EQ(storage->Append("log", "cde", &length), UpdateStatus::kOk)
+        << type;
+    EXPECT_EQ(length, 5u) << type;
+    EXPECT_EQ(storage->Get("log"), "abcde") << type;
+
+    // concurrent increments are never lost
+    const int thread_count = 8;
+    const int increments = 500;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; ++t) {
+      threads.emplace_back([&storage, increments] {
+        int64_t result = 0;
+        for (int i = 0; i < increments; ++i) {
+          storage->IncrementBy("shared", 1, &result);
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    EXPECT_EQ(storage->Get("shared"),
+              std::to_string(thread_count * increments))
+        << type;
+
+    // updates go through the log like any write
+    storage.reset();
+    storage = CreateStorageEngine(type, path);
+    if (type != "memory") {
+      EXPECT_EQ(storage->Get("cas"), "b") << type;
+      EXPECT_EQ(storage->Get("log"), "abcde") << type;
+    }
+
+    storage.reset();
+    RemoveStorageFiles(path);
+  }
+}
+
+TEST(StorageEngineTest, DurabilityLevelsOnEveryEngine) {
+  const std::string path = "test_durability_levels.db";
+  for (const std::string type : {"memory", "file", "lsm"}) {
+    RemoveStorageFiles(path);
+
+    auto storage = CreateStorageEngine(type, path);
+    for (auto durability : {Durability::kDefault, Durability::kMemory,
+                            Durability::kAsyncLog, Durability::kSync}) {
+      std::string key = "key" + std::to_string(static_cast<int>(durability));
+      EXPECT_TRUE(PutAndWait(storage.get(), key, key, durability)) << type;
+      EXPECT_EQ(storage->Get(key), key) << type;
+    }
+
+    // a clean shutdown keeps every level
+    storage.reset();
+    storage = CreateStorageEngine(type, path);
+    if (type != "memory") {
+      EXPECT_EQ(storage->GetAllEntries().size(), 4u) << type;
+    }
+
+    storage.reset();
+    RemoveStorageFiles(path);
+  }
+}
+
+TEST(StorageEngineTest, SnapshotReadsOnEveryEngine) {
+  const std::string path = "test_snapshot.db";
+  for (const std::string type : {"memory", "file", "lsm"}) {
+    RemoveStorageFiles(path);
+
+    auto storage = CreateStorageEngine(type, path);
+    // spread over every shard; a batch writes one round to all of them
+    std::vector<std::string> keys;
+    for (int i = 0; i < 32; ++i) {
+      keys.push_back("k" + std::to_string(100 + i));
+    }
+    const KeyList key_list(keys.begin(), keys.end());
+
+    std::atomic<bool> stop{false};
+    std::thread writer([&]() {
+      for (int round = 0; !stop; ++round) {
+        if (round % 5 == 4) {
+          storage->MultiDelete(key_list);
+          continue;
+        }
+        const std::string value = std::to_string(round);
+        KVPairList kvs;
+        for (const auto &key : keys) {
+          kvs.emplace_back(key, value);
+        }
+        storage->MultiPut(kvs);
+      }
+    });
+
+    // a read sees every key of one batch, or none of them
+    std::vector<std::optional<std::string>> values;
+    for (int i = 0; i < 2000; ++i) {
+      storage->MultiGet(key_list, &values);
+      for (const auto &value : values) {
+        ASSERT_EQ(value, values[0]) << type << " read a torn batch";
+      }
+      if (type == "file") {
+        continue; // ranges walk every entry without a snapshot
+      }
+      ScanBatch batch;
+      storage->Scan("k", "l", 0, &batch);
+      ASSERT_TRUE(batch.empty() || batch.size() == keys.size()) << type;
+      for (const auto & [ key, value ] : batch) {
+        ASSERT_EQ(value, batch[0].second) << type << " scanned a torn batch";
+      }
+    }
+    stop = true;
+    writer.join();
+
+    storage.reset();
+    RemoveStorageFiles(path);
+  }
+}
+
+TEST(MemoryStorageTest, UpdateKeepsTtl) {
+  MemoryStorage storage;
+  ASSERT_TRUE(storage.PutWithTtl("counter", "1", 50));
+  int64_t number = 0;
+  EXPECT_EQ(storage.IncrementBy("counter", 1, &number), UpdateStatus::kOk);
+  EXPECT_EQ(storage.Get("counter"), "2");
+  std::this_thread::sleep_for(std::chrono::milliseconds(80));
+  EXPECT_FALSE(storage.Get("counter").has_value());
+
+  // an expired key counts as missing
+  EXPECT_EQ(storage.IncrementBy("counter", 1, &number), UpdateStatus::kOk);
+  EXPECT_EQ(number, 1);
+}
+
+TEST(StorageEngineTest, PrefixEnd) {
+  EXPECT_EQ(PrefixEnd("abc"), "abd");
+  EXPECT_EQ(PrefixEnd(std::string("a\xff\xff", 3)), "b");
+  EXPECT_EQ(PrefixEnd(std::string("\xff", 1)), "");
+  EXPECT_EQ(PrefixEnd(""), "");
 }
 
 TEST(StorageEngineFactory, CreateEngines) {
@@ -108,7 +1118,10 @@ TEST(StorageEngineFactory, CreateEngines) {
   auto file_storage = CreateStorageEngine("file", "test.db");
   EXPECT_TRUE(file_storage->Put("key", "value"));
   EXPECT_TRUE(file_storage->Get("key").has_value());
-  std::filesystem::remove("test.db");
+  EXPECT_FALSE(file_storage->PutWithTtl("key", "value", 1000));
+  EXPECT_TRUE(file_storage->PutWithTtl("key", "value", 0));
+  file_storage.reset();
+  RemoveStorageFiles("test.db");
 }
 
 } // namespace tiny_kv
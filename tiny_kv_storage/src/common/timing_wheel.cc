@@ -0,0 +1,93 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "timing_wheel.h"
+#include <algorithm>
+#include <iterator>
+
+namespace tiny_kv {
+
+/************************************************************************/
+/* TimingWheel */
+/************************************************************************/
+void TimingWheel::Schedule(std::string_view key, uint64_t tick) {
+  if (tick <= current_) {
+    tick = current_ + 1;
+  }
+  Place({tick, std::string(key)});
+  ++size_;
+}
+
+void TimingWheel::Place(Timer timer) {
+  const uint64_t delta = timer.tick - current_;
+  size_t level = 0;
+  while (level + 1 < kLevels && delta >> (kSlotBits * (level + 1)) != 0) {
+    ++level;
+  }
+
+  // Level `level` covers deltas below 64^(level + 1); a slot there is
+  // cascaded when the wheel reaches the start of its span, which is never
+  // before `current_` and never past `timer.tick`. Deadlines beyond the top
+  // level are parked as far out as it reaches.
+  uint64_t tick = timer.tick;
+  if (delta >> (kSlotBits * kLevels) != 0) {
+    tick = current_ + (uint64_t(1) << (kSlotBits * kLevels)) - 1;
+  }
+  size_t slot = (tick >> (kSlotBits * level)) & (kSlots - 1);
+  slots_[level][slot].push_back(std::move(timer));
+}
+
+bool TimingWheel::Advance(uint64_t now_tick, size_t budget,
+                          std::vector<std::string> *due) {
+  if (size_ == 0) {
+    current_ = std::max(current_, now_tick);
+    return true;
+  }
+
+  while (true) {
+    while (!pending_.empty()) {
+      if (budget == 0) {
+        return false;
+      }
+      --budget;
+      Timer timer = std::move(pending_.back());
+      pending_.pop_back();
+      if (timer.tick <= current_) {
+        due->push_back(std::move(timer.key));
+        --size_;
+      } else {
+        Place(std::move(timer));
+      }
+    }
+
+    if (current_ >= now_tick) {
+      return true;
+    }
+    if (budget == 0) {
+      return false;
+    }
+    --budget;
+
+    // take out every slot that starts at the new tick; cascaded timers
+    // either fall due now or land in a lower level
+    ++current_;
+    for (size_t level = 0; level < kLevels; ++level) {
+      const size_t shift = kSlotBits * level;
+      if (level > 0 && (current_ & ((uint64_t(1) << shift) - 1)) != 0) {
+        break;
+      }
+      auto &slot = slots_[level][(current_ >> shift) & (kSlots - 1)];
+      if (pending_.empty()) {
+        pending_.swap(slot);
+      } else {
+        pending_.insert(pending_.end(), std::make_move_iterator(slot.begin()),
+                        std::make_move_iterator(slot.end()));
+      }
+      // a burst that went through this slot should not pin its memory
+      std::vector<Timer>().swap(slot);
+    }
+  }
+}
+
+} // namespace tiny_kv
@@ -0,0 +1,67 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tiny_kv {
+
+/************************************************************************/
+/* TimingWheel */
+/************************************************************************/
+// Hierarchical timing wheel of keys. Level 0 has one slot per tick and
+// every level above spans 64 times the level below, so four levels cover
+// 64^4 ticks; later deadlines are parked in the top level and placed again
+// when it comes round. Scheduling is O(1). When the wheel reaches a slot of
+// a higher level it redistributes ("cascades") the slot downwards, so a key
+// is moved at most once per level before it falls due.
+//
+// `Advance` is budgeted: it handles a bounded number of timers per call and
+// resumes where it stopped, so a burst of deadlines is spread over several
+// calls instead of stalling one. Keys are not deduplicated; the owner
+// decides whether a key that falls due is still meant to expire.
+// Not thread-safe.
+class TimingWheel {
+public:
+  static constexpr size_t kLevels = 4;
+  static constexpr size_t kSlotBits = 6;
+  static constexpr size_t kSlots = size_t(1) << kSlotBits;
+
+  TimingWheel() = default;
+
+  // `key` falls due at `tick`, or at the next tick if that has passed.
+  // Ticks are whatever unit the owner advances the wheel in.
+  void Schedule(std::string_view key, uint64_t tick);
+  // Moves the keys due by `now_tick` to `due`, handling at most `budget`
+  // timers and ticks. Returns false if the budget ran out first. An empty
+  // wheel jumps straight to `now_tick`.
+  bool Advance(uint64_t now_tick, size_t budget,
+               std::vector<std::string> *due);
+
+  // Scheduled keys that have not been handed out yet.
+  size_t Size() const { return size_; }
+  uint64_t CurrentTick() const { return current_; }
+
+private:
+  struct Timer {
+    uint64_t tick;
+    std::string key;
+  };
+
+  // Requires `timer.tick > current_`.
+  void Place(Timer timer);
+
+private:
+  std::vector<Timer> slots_[kLevels][kSlots];
+  std::vector<Timer> pending_; // taken out of a slot, not handled yet
+  uint64_t current_ = 0;       // every slot up to this tick was taken out
+  size_t size_ = 0;
+};
+
+} // namespace tiny_kv
@@ -0,0 +1,109 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "timing_wheel.h"
+#include <gtest/gtest.h>
+#include <iterator>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace tiny_kv {
+
+TEST(TimingWheelTest, KeysFallDueAtTheirTick) {
+  TimingWheel wheel;
+  const uint64_t ticks[] = {1, 5, 63, 64, 65, 4095, 5000, 300000,
+                            (uint64_t(1) << 24) + 10};
+  for (uint64_t tick : ticks) {
+    wheel.Schedule(std::to_string(tick), tick);
+  }
+  EXPECT_EQ(wheel.Size(), std::size(ticks));
+
+  // cascades never hand a key out early or late
+  std::vector<std::string> due;
+  uint64_t now = 0;
+  for (uint64_t tick : ticks) {
+    ASSERT_TRUE(wheel.Advance(tick - 1, 1 << 30, &due));
+    EXPECT_TRUE(due.empty()) << "before " << tick << ": " << due[0];
+    now = tick;
+    ASSERT_TRUE(wheel.Advance(now, 1 << 30, &due));
+    ASSERT_EQ(due.size(), 1u);
+    EXPECT_EQ(due[0], std::to_string(tick));
+    due.clear();
+  }
+  EXPECT_EQ(wheel.Size(), 0u);
+
+  // a deadline that has passed falls due at the next tick
+  wheel.Schedule("late", 3);
+  ASSERT_TRUE(wheel.Advance(now, 100, &due));
+  EXPECT_TRUE(due.empty());
+  ASSERT_TRUE(wheel.Advance(now + 1, 100, &due));
+  EXPECT_EQ(due, std::vector<std::string>{"late"});
+}
+
+TEST(TimingWheelTest, EmptyWheelJumpsAhead) {
+  TimingWheel wheel;
+  std::vector<std::string> due;
+  EXPECT_TRUE(wheel.Advance(uint64_t(1) << 40, 0, &due));
+  EXPECT_EQ(wheel.CurrentTick(), uint64_t(1) << 40);
+
+  wheel.Schedule("a", (uint64_t(1) << 40) + 2);
+  EXPECT_TRUE(wheel.Advance((uint64_t(1) << 40) + 2, 100, &due));
+  EXPECT_EQ(due, std::vector<std::string>{"a"});
+}
+
+TEST(TimingWheelTest, BudgetBoundsEachCall) {
+  TimingWheel wheel;
+  for (int i = 0; i < 1000; ++i) {
+    wheel.Schedule("k" + std::to_string(i), 200);
+  }
+
+  // each call hands out at most its budget and resumes where it stopped
+  std::vector<std::string> due;
+  int calls = 0;
+  while (!wheel.Advance(200, 64, &due)) {
+    ++calls;
+    ASSERT_LE(due.size(), size_t(64) * calls);
+  }
+  EXPECT_GE(calls, 1000 / 64);
+  EXPECT_EQ(due.size(), 1000u);
+  EXPECT_EQ(wheel.Size(), 0u);
+}
+
+TEST(TimingWheelTest, MatchesReference) {
+  TimingWheel wheel;
+  std::map<std::string, uint64_t> reference;
+  std::mt19937_64 rng(11);
+  uint64_t now = 0;
+
+  for (int round = 0; round < 2000; ++round) {
+    for (int i = rng() % 8; i > 0; --i) {
+      uint64_t tick = now + 1 + rng() % (rng() % 4 == 0 ? 100000 : 200);
+      std::string key = std::to_string(round) + "/" + std::to_string(i);
+      wheel.Schedule(key, tick);
+      reference.emplace(key, tick);
+    }
+
+    now += rng() % 300;
+    std::vector<std::string> due;
+    while (!wheel.Advance(now, 1 + rng() % 50, &due)) {
+    }
+    std::set<std::string> expected;
+    for (auto it = reference.begin(); it != reference.end();) {
+      if (it->second <= now) {
+        expected.insert(it->first);
+        it = reference.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    ASSERT_EQ(std::set<std::string>(due.begin(), due.end()), expected)
+        << "round " << round;
+    ASSERT_EQ(wheel.Size(), reference.size());
+  }
+}
+
+} // namespace tiny_kv
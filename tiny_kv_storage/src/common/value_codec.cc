@@ -0,0 +1,155 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "value_codec.h"
+#include "third_party/lz4_block/lz4_block.h"
+#include <algorithm>
+
+namespace tiny_kv {
+
+namespace {
+
+void AppendVarint(std::string *dst, uint64_t value) {
+  while (value >= 0x80) {
+    dst->push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  dst->push_back(static_cast<char>(value));
+}
+
+bool ReadVarint(std::string_view *src, uint64_t *value) {
+  *value = 0;
+  for (unsigned shift = 0; shift < 64 && !src->empty(); shift += 7) {
+    uint8_t byte = static_cast<uint8_t>(src->front());
+    src->remove_prefix(1);
+    *value |= uint64_t(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+class Lz4Codec : public ValueCodec {
+public:
+  ValueEncoding Encoding() const override { return ValueEncoding::kLz4; }
+  std::string_view Name() const override { return "lz4"; }
+
+  bool Compress(std::string_view value, size_t max_size,
+                std::string *out) const override {
+    const size_t start = out->size();
+    AppendVarint(out, value.size());
+    const size_t header = out->size() - start;
+    if (header >= max_size) {
+      out->resize(start);
+      return false;
+    }
+
+    // the block is written in place and gives up once it passes the limit
+    const size_t capacity =
+        std::min(max_size - header, lz4_block::CompressBound(value.size()));
+    out->resize(start + header + capacity);
+    size_t size = lz4_block::Compress(value.data(), value.size(),
+                                      &(*out)[start + header], capacity);
+    out->resize(size == 0 ? start : start + header + size);
+    return size != 0;
+  }
+
+  bool Decompress(std::string_view payload, std::string *out) const override {
+    uint64_t size = 0;
+    // a block byte expands to at most 255 bytes, which bounds a corrupt size
+    if (!ReadVarint(&payload, &size) || size > payload.size() * 255 + 16) {
+      return false;
+    }
+
+    const size_t start = out->size();
+    out->resize(start + size);
+    if (!lz4_block::Decompress(payload.data(), payload.size(),
+                               &(*out)[start], size)) {
+      out->resize(start);
+      return false;
+    }
+    return true;
+  }
+};
+
+const Lz4Codec kLz4Codec;
+const ValueCodec *const kCodecs[] = {&kLz4Codec};
+
+} // namespace
+
+const ValueCodec *FindCodec(ValueEncoding encoding) {
+  for (const ValueCodec *codec : kCodecs) {
+    if (codec->Encoding() == encoding) {
+      return codec;
+    }
+  }
+  return nullptr;
+}
+
+bool ParseValueCodec(const std::string &name, const ValueCodec **codec) {
+  if (name == "none") {
+    *codec = nullptr;
+    return true;
+  }
+  for (const ValueCodec *candidate : kCodecs) {
+    if (candidate->Name() == name) {
+      *codec = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+/************************************************************************/
+/* ValueEncoder */
+/************************************************************************/
+void ValueEncoder::Encode(std::string_view value, std::string *out) const {
+  out->clear();
+  if (options_.codec && !value.empty() &&
+      value.size() >= options_.min_bytes) {
+    out->push_back(static_cast<char>(options_.codec->Encoding()));
+    // only worth it if the encoded value ends up smaller than a raw one
+    if (options_.codec->Compress(value, value.size() - 1, out)) {
+      return;
+    }
+    out->clear();
+  }
+
+  out->reserve(1 + value.size());
+  out->push_back(static_cast<char>(ValueEncoding::kRaw));
+  out->append(value);
+}
+
+bool ValueEncoder::Decode(std::string_view encoded, std::string *value) {
+  value->clear();
+  if (encoded.empty()) {
+    return false;
+  }
+
+  auto encoding = static_cast<ValueEncoding>(encoded.front());
+  encoded.remove_prefix(1);
+  if (encoding == ValueEncoding::kRaw) {
+    value->assign(encoded);
+    return true;
+  }
+  const ValueCodec *codec = FindCodec(encoding);
+  return codec != nullptr && codec->Decompress(encoded, value);
+}
+
+bool ValueEncoder::View(std::string_view encoded, std::string *scratch,
+                        std::string_view *value) {
+  if (!encoded.empty() &&
+      static_cast<ValueEncoding>(encoded.front()) == ValueEncoding::kRaw) {
+    *value = encoded.substr(1);
+    return true;
+  }
+  if (!Decode(encoded, scratch)) {
+    return false;
+  }
+  *value = *scratch;
+  return true;
+}
+
+} // namespace tiny_kv
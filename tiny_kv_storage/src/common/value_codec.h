@@ -0,0 +1,80 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace tiny_kv {
+
+// An encoded value is one byte naming its encoding followed by the payload.
+// The numbers are persisted by FileStorage; never reuse one.
+enum class ValueEncoding : uint8_t {
+  kRaw = 0, // the payload is the value
+  kLz4 = 1, // [varint value size][LZ4 block]
+};
+
+/************************************************************************/
+/* ValueCodec */
+/************************************************************************/
+// A compression algorithm for one encoding. Codecs are stateless and
+// thread-safe; to add one, implement it and list it in `FindCodec`.
+class ValueCodec {
+public:
+  virtual ~ValueCodec() = default;
+
+  virtual ValueEncoding Encoding() const = 0;
+  virtual std::string_view Name() const = 0;
+  // Appends the payload for `value` to `out` and returns true, unless it
+  // would take more than `max_size` bytes; then `out` is left unchanged.
+  virtual bool Compress(std::string_view value, size_t max_size,
+                        std::string *out) const = 0;
+  // Appends the value `payload` encodes to `out`. False if it is corrupt.
+  virtual bool Decompress(std::string_view payload,
+                          std::string *out) const = 0;
+};
+
+// The codec of `encoding`, or nullptr for `kRaw` and unknown encodings.
+const ValueCodec *FindCodec(ValueEncoding encoding);
+// Parses a codec name: "none" yields nullptr, an unknown name false.
+bool ParseValueCodec(const std::string &name, const ValueCodec **codec);
+
+struct CompressionOptions {
+  const ValueCodec *codec = nullptr; // nullptr stores values as given
+  size_t min_bytes = 256;            // smaller values are never compressed
+};
+
+/************************************************************************/
+/* ValueEncoder */
+/************************************************************************/
+// Turns values into encoded values with the configured codec. A value is
+// compressed only if it is at least `min_bytes` long and comes out smaller;
+// otherwise it is stored raw behind the header. Decoding handles every
+// encoding, whatever the codec an engine runs with now.
+class ValueEncoder {
+public:
+  explicit ValueEncoder(const CompressionOptions &options = {})
+      : options_(options) {}
+
+  // Whether the engine stores encoded values at all. Engines that keep
+  // nothing on disk may skip the header when there is no codec.
+  bool Enabled() const { return options_.codec != nullptr; }
+  // Replaces `*out` with the encoded form of `value`.
+  void Encode(std::string_view value, std::string *out) const;
+
+  // Replaces `*value` with the value `encoded` holds. False if corrupt.
+  static bool Decode(std::string_view encoded, std::string *value);
+  // Points `*value` at the value `encoded` holds: raw payloads in place,
+  // others decompressed into `*scratch`. False if corrupt.
+  static bool View(std::string_view encoded, std::string *scratch,
+                   std::string_view *value);
+
+private:
+  CompressionOptions options_;
+};
+
+} // namespace tiny_kv
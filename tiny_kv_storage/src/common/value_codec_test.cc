@@ -0,0 +1,178 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "value_codec.h"
+#include "third_party/lz4_block/lz4_block.h"
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+
+namespace tiny_kv {
+
+namespace {
+
+std::string JsonLike(size_t size, std::mt19937_64 *rng) {
+  std::string value;
+  while (value.size() < size) {
+    value += "{\"id\":" + std::to_string((*rng)() % 100000) +
+             ",\"name\":\"user\",\"active\":true},";
+  }
+  value.resize(size);
+  return value;
+}
+
+std::string Random(size_t size, std::mt19937_64 *rng) {
+  std::string value(size, '\0');
+  for (char &c : value) {
+    c = static_cast<char>((*rng)());
+  }
+  return value;
+}
+
+} // namespace
+
+TEST(Lz4BlockTest, RoundTrip) {
+  std::mt19937_64 rng(5);
+  for (size_t size : {0, 1, 12, 13, 17, 100, 255, 4096, 70000, 300000}) {
+    for (int kind = 0; kind < 3; ++kind) {
+      std::string input = kind == 0   ? JsonLike(size, &rng)
+                          : kind == 1 ? Random(size, &rng)
+                                      : std::string(size, 'a');
+      std::string block(lz4_block::CompressBound(size), '\0');
+      size_t block_size =
+          lz4_block::Compress(input.data(), size, &block[0], block.size());
+      ASSERT_GT(block_size, 0u) << size;
+
+      std::string output(size, '\0');
+      ASSERT_TRUE(lz4_block::Decompress(block.data(), block_size, &output[0],
+                                        size));
+      EXPECT_EQ(output, input);
+      if (size > 0) {
+        // a wrong size, a cut block or too little room are all rejected
+        EXPECT_FALSE(lz4_block::Decompress(block.data(), block_size,
+                                           &output[0], size - 1));
+        EXPECT_FALSE(lz4_block::Decompress(block.data(), block_size - 1,
+                                           &output[0], size));
+        EXPECT_EQ(lz4_block::Compress(input.data(), size, &block[0],
+                                      block_size - 1),
+                  0u);
+      }
+    }
+  }
+
+  // overlapping matches and long length continuations
+  std::string runs = std::string(1000, 'x') + "abcabcabcabcabc" +
+                     std::string(300, 'y') + JsonLike(64, &rng);
+  std::string block(lz4_block::CompressBound(runs.size()), '\0');
+  size_t block_size =
+      lz4_block::Compress(runs.data(), runs.size(), &block[0], block.size());
+  EXPECT_LT(block_size, runs.size() / 4);
+  std::string output(runs.size(), '\0');
+  ASSERT_TRUE(lz4_block::Decompress(block.data(), block_size, &output[0],
+                                    output.size()));
+  EXPECT_EQ(output, runs);
+}
+
+TEST(Lz4BlockTest, CorruptBlocksStayInBounds) {
+  std::mt19937_64 rng(6);
+  std::string input = JsonLike(2000, &rng);
+  std::string block(lz4_block::CompressBound(input.size()), '\0');
+  block.resize(lz4_block::Compress(input.data(), input.size(), &block[0],
+                                   block.size()));
+
+  // any outcome is fine as long as nothing is read or written out of
+  // bounds (checked under the sanitizers)
+  std::string output(input.size(), '\0');
+  for (int i = 0; i < 2000; ++i) {
+    std::string corrupt = block;
+    corrupt[rng() % corrupt.size()] ^= static_cast<char>(1 + rng() % 255);
+    lz4_block::Decompress(corrupt.data(), corrupt.size(), &output[0],
+                          output.size());
+  }
+}
+
+TEST(ValueCodecTest, ParseCodec) {
+  const ValueCodec *codec = nullptr;
+  ASSERT_TRUE(ParseValueCodec("lz4", &codec));
+  ASSERT_NE(codec, nullptr);
+  EXPECT_EQ(codec->Name(), "lz4");
+  EXPECT_EQ(FindCodec(codec->Encoding()), codec);
+
+  EXPECT_TRUE(ParseValueCodec("none", &codec));
+  EXPECT_EQ(codec, nullptr);
+  EXPECT_FALSE(ParseValueCodec("zip", &codec));
+  EXPECT_EQ(FindCodec(ValueEncoding::kRaw), nullptr);
+}
+
+TEST(ValueCodecTest, CompressesAboveThresholdWhenSmaller) {
+  CompressionOptions options;
+  ASSERT_TRUE(ParseValueCodec("lz4", &options.codec));
+  options.min_bytes = 64;
+  ValueEncoder encoder(options);
+  EXPECT_TRUE(encoder.Enabled());
+  EXPECT_FALSE(ValueEncoder().Enabled());
+
+  std::mt19937_64 rng(7);
+  const std::string small = JsonLike(63, &rng);
+  const std::string json = JsonLike(4000, &rng);
+  const std::string noise = Random(4000, &rng);
+
+  std::string encoded;
+  std::string decoded;
+  encoder.Encode(small, &encoded);
+  EXPECT_EQ(encoded[0], static_cast<char>(ValueEncoding::kRaw));
+  EXPECT_EQ(encoded.substr(1), small);
+
+  encoder.Encode(json, &encoded);
+  EXPECT_EQ(encoded[0], static_cast<char>(ValueEncoding::kLz4));
+  EXPECT_LT(encoded.size(), json.size() / 2);
+  ASSERT_TRUE(ValueEncoder::Decode(encoded, &decoded));
+  EXPECT_EQ(decoded, json);
+
+  // incompressible values are kept raw rather than grown
+  encoder.Encode(noise, &encoded);
+  EXPECT_EQ(encoded[0], static_cast<char>(ValueEncoding::kRaw));
+  EXPECT_EQ(encoded.size(), noise.size() + 1);
+
+  // without a codec every value is raw, and any encoding still decodes
+  ValueEncoder().Encode(json, &encoded);
+  EXPECT_EQ(encoded.size(), json.size() + 1);
+  ASSERT_TRUE(ValueEncoder::Decode(encoded, &decoded));
+  EXPECT_EQ(decoded, json);
+}
+
+TEST(ValueCodecTest, ViewAndCorruption) {
+  CompressionOptions options;
+  ASSERT_TRUE(ParseValueCodec("lz4", &options.codec));
+  ValueEncoder encoder(options);
+  std::mt19937_64 rng(8);
+  const std::string json = JsonLike(1000, &rng);
+
+  // raw payloads are viewed in place, compressed ones land in the scratch
+  std::string encoded;
+  std::string scratch;
+  std::string_view value;
+  ValueEncoder().Encode("plain", &encoded);
+  ASSERT_TRUE(ValueEncoder::View(encoded, &scratch, &value));
+  EXPECT_EQ(value, "plain");
+  EXPECT_EQ(value.data(), encoded.data() + 1);
+  EXPECT_TRUE(scratch.empty());
+
+  encoder.Encode(json, &encoded);
+  ASSERT_TRUE(ValueEncoder::View(encoded, &scratch, &value));
+  EXPECT_EQ(value, json);
+  EXPECT_EQ(value.data(), scratch.data());
+
+  std::string decoded;
+  EXPECT_FALSE(ValueEncoder::Decode("", &decoded));
+  EXPECT_FALSE(ValueEncoder::Decode(std::string(1, '\x7f') + "x", &decoded));
+  EXPECT_FALSE(ValueEncoder::Decode(encoded.substr(0, encoded.size() / 2),
+                                    &decoded));
+  // a size no block could expand to is rejected before allocating
+  std::string huge(1, static_cast<char>(ValueEncoding::kLz4));
+  huge += std::string(9, '\xff') + '\x01' + "abc";
+  EXPECT_FALSE(ValueEncoder::Decode(huge, &decoded));
+}
+
+} // namespace tiny_kv
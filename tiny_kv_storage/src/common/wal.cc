@@ -0,0 +1,464 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "wal.h"
+#include "crc32.h"
+#include "file_util.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace tiny_kv {
+
+namespace {
+
+constexpr size_t kHeaderSize = sizeof(uint32_t) * 2;
+// initial capacity of each staging buffer; it is registered with the I/O
+// backend, so it should rarely have to grow
+constexpr size_t kBufferBytes = 128 << 10;
+
+void AppendUint32(std::string *dst, uint32_t value) {
+  dst->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+uint32_t DecodeUint32(const char *src) {
+  uint32_t value;
+  memcpy(&value, src, sizeof(value));
+  return value;
+}
+
+// Decodes one payload. Returns false if the payload is malformed.
+bool DecodePayload(std::string_view payload, WalRecordType *type,
+                   std::string_view *key, std::string_view *value) {
+  if (payload.size() < 1 + sizeof(uint32_t)) {
+    return false;
+  }
+  *type = static_cast<WalRecordType>(payload[0]);
+  payload.remove_prefix(1);
+
+  uint32_t key_length = DecodeUint32(payload.data());
+  payload.remove_prefix(sizeof(uint32_t));
+  if (payload.size() < key_length + sizeof(uint32_t)) {
+    return false;
+  }
+  *key = payload.substr(0, key_length);
+  payload.remove_prefix(key_length);
+
+  uint32_t value_length = DecodeUint32(payload.data());
+  payload.remove_prefix(sizeof(uint32_t));
+  if (payload.size() != value_length) {
+    return false;
+  }
+  *value = payload;
+  return *type == WalRecordType::kPut || *type == WalRecordType::kDelete ||
+         *type == WalRecordType::kPutEncoded;
+}
+
+} // namespace
+
+bool ParseFsyncPolicy(const std::string &name, FsyncPolicy *policy) {
+  if (name == "always") {
+    *policy = FsyncPolicy::kAlways;
+  } else if (name == "interval") {
+    *policy = FsyncPolicy::kInterval;
+  } else if (name == "never") {
+    *policy = FsyncPolicy::kNever;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ParseDurability(const std::string &name, Durability *durability) {
+  if (name == "default") {
+    *durability = Durability::kDefault;
+  } else if (name == "memory") {
+    *durability = Durability::kMemory;
+  } else if (name == "async") {
+    *durability = Durability::kAsyncLog;
+  } else if (name == "sync") {
+    *durability = Durability::kSync;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/************************************************************************/
+/* WriteAheadLog */
+/************************************************************************/
+WriteAheadLog::WriteAheadLog(const std::string &path,
+                             const WalOptions &options,
+                             std::shared_ptr<AsyncIo> io)
+    : path_(path), options_(options), io_(std::move(io)) {}
+
+WriteAheadLog::~WriteAheadLog() { Close(); }
+
+bool WriteAheadLog::Open(const RecordHandler &handler) {
+  uint64_t valid_size = 0;
+  {
+    std::ifstream file(path_, std::ios::binary | std::ios::ate);
+    uint64_t file_size = file ? static_cast<uint64_t>(file.tellg()) : 0;
+    file.seekg(0);
+    std::string payload;
+    char header[kHeaderSize];
+
+    while (file && file.read(header, kHeaderSize)) {
+      uint32_t crc = DecodeUint32(header);
+      uint32_t payload_length = DecodeUint32(header + sizeof(uint32_t));
+
+      // a torn header can claim any length; one running past the end of
+      // the file is the torn tail, not an allocation to attempt
+      if (payload_length > file_size - valid_size - kHeaderSize) {
+        break;
+      }
+      payload.resize(payload_length);
+      if (!file.read(&payload[0], payload_length) ||
+          Crc32(payload.data(), payload.size()) != crc) {
+        break;
+      }
+
+      WalRecordType type;
+      std::string_view key;
+      std::string_view value;
+      if (!DecodePayload(payload, &type, &key, &value)) {
+        break;
+      }
+
+      handler(type, key, value);
+      valid_size += kHeaderSize + payload_length;
+    }
+  }
+
+  fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (fd_ < 0 || ftruncate(fd_, valid_size) != 0) {
+    healthy_ = false;
+    return false;
+  }
+  size_bytes_ = valid_size;
+  pending_.bytes.reserve(kBufferBytes);
+  flush_buffer_.bytes.reserve(kBufferBytes);
+  cut_.bytes.reserve(kBufferBytes);
+
+  if (options_.fsync_policy == FsyncPolicy::kInterval) {
+    sync_thread_ = std::thread(&WriteAheadLog::SyncLoop, this);
+  }
+  return true;
+}
+
+void WriteAheadLog::Close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  stop_cv_.notify_all();
+  if (sync_thread_.joinable()) {
+    sync_thread_.join();
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (fd_ < 0) {
+    return;
+  }
+  flushed_cv_.wait(lock, [this]() { return !flushing_; });
+  if (healthy_ && (last_lsn_ > synced_lsn_ || !pending_.bytes.empty())) {
+    FlushLocked(lock, options_.fsync_policy != FsyncPolicy::kNever);
+  }
+  close(fd_);
+  fd_ = -1;
+  for (Buffer *buffer : {&pending_, &flush_buffer_, &cut_}) {
+    if (buffer->registered >= 0) {
+      io_->UnregisterBuffer(buffer->registered);
+      buffer->registered = -1;
+    }
+  }
+}
+
+uint64_t WriteAheadLog::Append(WalRecordType type, std::string_view key,
+                               std::string_view value) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::string &pending = pending_.bytes;
+
+  size_t offset = pending.size();
+  pending.append(kHeaderSize, '\0');
+  pending.push_back(static_cast<char>(type));
+  AppendUint32(&pending, static_cast<uint32_t>(key.size()));
+  pending.append(key.data(), key.size());
+  AppendUint32(&pending, static_cast<uint32_t>(value.size()));
+  pending.append(value.data(), value.size());
+
+  const char *payload = pending.data() + offset + kHeaderSize;
+  uint32_t payload_length =
+      static_cast<uint32_t>(pending.size() - offset - kHeaderSize);
+  uint32_t crc = Crc32(payload, payload_length);
+  memcpy(&pending[offset], &crc, sizeof(crc));
+  memcpy(&pending[offset + sizeof(crc)], &payload_length,
+         sizeof(payload_length));
+
+  return ++last_lsn_;
+}
+
+bool WriteAheadLog::Sync(uint64_t lsn) {
+  const bool fsync = options_.fsync_policy == FsyncPolicy::kAlways;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!IsDurable(lsn, fsync)) {
+    if (!healthy_) {
+      return false;
+    }
+    if (!flushing_ && !rotating_) {
+      StartFlushLocked(fsync);
+    }
+    flushed_cv_.wait(lock);
+  }
+  return healthy_;
+}
+
+void WriteAheadLog::SyncAsync(uint64_t lsn, Durability durability,
+                              SyncCallback done) {
+  if (durability == Durability::kMemory) {
+    if (done) {
+      done(true);
+    }
+    return;
+  }
+
+  const bool fsync = durability == Durability::kSync ||
+                     (durability == Durability::kDefault &&
+                      options_.fsync_policy == FsyncPolicy::kAlways);
+  const bool wait = durability != Durability::kAsyncLog;
+  bool ok = true;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ok = healthy_;
+    if (ok && !IsDurable(lsn, fsync)) {
+      waiters_.push_back({lsn, fsync, wait ? std::move(done) : nullptr});
+      if (!flushing_ && !rotating_) {
+        StartFlushLocked(fsync ||
+                         options_.fsync_policy == FsyncPolicy::kAlways);
+      }
+      if (wait) {
+        return;
+      }
+    }
+  }
+  if (done) {
+    done(ok);
+  }
+}
+
+bool WriteAheadLog::Reset() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  flushed_cv_.wait(lock, [this]() { return !flushing_; });
+
+  pending_.bytes.clear();
+  written_lsn_ = last_lsn_;
+  synced_lsn_ = last_lsn_;
+  flushed_cv_.notify_all();
+
+  if (fd_ < 0 || ftruncate(fd_, 0) != 0) {
+    healthy_ = false;
+    return false;
+  }
+  size_bytes_ = 0;
+  return true;
+}
+
+void WriteAheadLog::BeginRotate() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  rotating_ = true;
+  cut_lsn_ = last_lsn_;
+  // the staged records leave with the old log; later ones stage afresh
+  std::swap(pending_, cut_);
+}
+
+bool WriteAheadLog::FinishRotate(const std::string &archive_path) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  // a flush in flight only holds records from before the cut
+  flushed_cv_.wait(lock, [this]() { return !flushing_; });
+  bool ok = healthy_ && fd_ >= 0;
+  const int old_fd = fd_;
+  // keeps flushes off both files while they change places; appends go on
+  flushing_ = true;
+  lock.unlock();
+
+  // Only a failed write fails the log, as in a flush. If the old log
+  // cannot be archived or the new one opened, the old one stays in place,
+  // cut included, and this rotation alone fails.
+  int fd = -1;
+  int error = 0;
+  bool kept = false; // the old log is still at `path_` and in use
+  if (ok) {
+    if (!WriteFully(old_fd, cut_.bytes.data(), cut_.bytes.size()) ||
+        fdatasync(old_fd) != 0) {
+      error = errno;
+    } else if (std::rename(path_.c_str(), archive_path.c_str()) != 0) {
+      error = errno;
+      kept = true;
+    } else {
+      fd = open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_TRUNC, 0644);
+      if (fd < 0) {
+        error = errno;
+        kept = std::rename(archive_path.c_str(), path_.c_str()) == 0;
+      }
+    }
+  }
+  ok = fd >= 0;
+  if (error != 0) {
+    std::cerr << "Rotating " << path_ << " failed: " << strerror(error)
+              << std::endl;
+  }
+
+  std::vector<SyncCallback> ready;
+  bool healthy = true;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (ok) {
+      close(old_fd);
+      fd_ = fd;
+      size_bytes_ = 0;
+    } else if (kept) {
+      size_bytes_ += cut_.bytes.size();
+    } else {
+      healthy_ = false;
+    }
+    if (healthy_) {
+      written_lsn_ = cut_lsn_;
+      synced_lsn_ = cut_lsn_;
+    }
+    healthy = healthy_;
+    cut_.bytes.clear();
+    flushing_ = false;
+    rotating_ = false;
+    ready = ReleaseWaitersLocked();
+    flushed_cv_.notify_all();
+  }
+
+  for (auto &done : ready) {
+    done(healthy);
+  }
+  return ok && SyncParentDir(path_);
+}
+
+bool WriteAheadLog::IsDurable(uint64_t lsn, bool fsync) const {
+  return (fsync ? synced_lsn_ : written_lsn_) >= lsn;
+}
+
+void WriteAheadLog::StartFlushLocked(bool sync) {
+  if (!io_) {
+    io_ = CreateAsyncIo();
+  }
+  flushing_ = true;
+  std::swap(pending_, flush_buffer_);
+  RegisterBuffer(&flush_buffer_);
+  const uint64_t upto = last_lsn_;
+
+  AsyncIo::WriteOp op;
+  op.fd = fd_;
+  op.data = flush_buffer_.bytes.data();
+  op.size = flush_buffer_.bytes.size();
+  op.offset = size_bytes_.load(); // the log is only written here
+  op.sync = sync;
+  op.buffer = flush_buffer_.registered;
+  io_->Submit(op, [this, upto, sync](int error) {
+    FinishFlush(upto, sync, error);
+  });
+}
+
+void WriteAheadLog::FinishFlush(uint64_t upto, bool sync, int error) {
+  std::vector<SyncCallback> ready;
+  bool ok = true;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_bytes_ += flush_buffer_.bytes.size();
+    flush_buffer_.bytes.clear();
+    flushing_ = false;
+    if (error == 0) {
+      written_lsn_ = upto;
+      if (sync) {
+        synced_lsn_ = upto;
+      }
+    } else {
+      std::cerr << "Write to " << path_ << " failed: " << strerror(error)
+                << std::endl;
+      healthy_ = false;
+    }
+    ok = healthy_;
+    ready = ReleaseWaitersLocked();
+    // under the lock: a waiter may destroy the log as soon as it wakes
+    flushed_cv_.notify_all();
+  }
+
+  for (auto &done : ready) {
+    done(ok);
+  }
+}
+
+std::vector<WriteAheadLog::SyncCallback>
+WriteAheadLog::ReleaseWaitersLocked() {
+  std::vector<SyncCallback> ready;
+  bool next_sync = options_.fsync_policy == FsyncPolicy::kAlways;
+  auto kept = waiters_.begin();
+  for (Waiter &waiter : waiters_) {
+    if (!healthy_ || IsDurable(waiter.lsn, waiter.fsync)) {
+      if (waiter.done) {
+        ready.push_back(std::move(waiter.done));
+      }
+    } else {
+      next_sync = next_sync || waiter.fsync;
+      *kept++ = std::move(waiter);
+    }
+  }
+  waiters_.erase(kept, waiters_.end());
+  // a rotation flushes the rest once the new log is in place
+  if (!waiters_.empty() && !rotating_) {
+    StartFlushLocked(next_sync);
+  }
+  return ready;
+}
+
+bool WriteAheadLog::FlushLocked(std::unique_lock<std::mutex> &lock,
+                                bool sync) {
+  StartFlushLocked(sync);
+  flushed_cv_.wait(lock, [this]() { return !flushing_; });
+  return healthy_;
+}
+
+void WriteAheadLog::RegisterBuffer(Buffer *buffer) {
+  const std::string &bytes = buffer->bytes;
+  if (bytes.data() == buffer->registered_data &&
+      bytes.capacity() == buffer->registered_size) {
+    return;
+  }
+
+  // grown since, so the old registration points at freed memory
+  if (buffer->registered >= 0) {
+    io_->UnregisterBuffer(buffer->registered);
+  }
+  buffer->registered = io_->RegisterBuffer(bytes.data(), bytes.capacity());
+  buffer->registered_data = bytes.data();
+  buffer->registered_size = bytes.capacity();
+}
+
+void WriteAheadLog::SyncLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_) {
+    stop_cv_.wait_for(lock,
+                      std::chrono::milliseconds(options_.fsync_interval_ms),
+                      [this]() { return stop_; });
+    if (stop_ || !healthy_) {
+      continue;
+    }
+    if (flushing_ || rotating_ || last_lsn_ == synced_lsn_) {
+      continue;
+    }
+    StartFlushLocked(true);
+  }
+}
+
+} // namespace tiny_kv
@@ -0,0 +1,180 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#pragma once
+
+#include "src/common/async_io.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace tiny_kv {
+
+enum class FsyncPolicy {
+  kAlways,   // fdatasync before a writer is acknowledged
+  kInterval, // write before ack, fdatasync every `fsync_interval_ms`
+  kNever,    // write before ack, leave syncing to the OS
+};
+
+bool ParseFsyncPolicy(const std::string &name, FsyncPolicy *policy);
+
+// How far one write must get before it is acknowledged.
+enum class Durability {
+  kDefault,  // as far as the fsync policy says
+  kMemory,   // applied but never logged: a crash loses it unless a
+             // checkpoint or memtable flush saved it first
+  kAsyncLog, // logged, acknowledged before the log write completes
+  kSync,     // logged and fdatasynced, whatever the fsync policy
+};
+
+// "default", "memory", "async" or "sync".
+bool ParseDurability(const std::string &name, Durability *durability);
+
+struct WalOptions {
+  FsyncPolicy fsync_policy = FsyncPolicy::kAlways;
+  int fsync_interval_ms = 100;
+};
+
+enum class WalRecordType : uint8_t {
+  kPut = 1,
+  kDelete = 2,
+  kPutEncoded = 3, // the value is encoded, see value_codec.h
+};
+
+/************************************************************************/
+/* WriteAheadLog */
+/************************************************************************/
+// Append-only redo log. Records are staged in memory by `Append()` and made
+// durable by `Sync()`: the first waiting writer hands everything staged so
+// far to the I/O backend (see async_io.h) as a single write (+ fdatasync),
+// and every writer waits for its completion. Concurrent writers share one
+// system call, and none of them makes it: the write and the fdatasync run
+// on io_uring or on the backend's threads.
+//
+// Record layout: [crc32 u32][payload_len u32][payload]
+//                payload = [type u8][key_len u32][key][value_len u32][value]
+class WriteAheadLog {
+public:
+  using RecordHandler = std::function<void(
+      WalRecordType type, std::string_view key, std::string_view value)>;
+  using SyncCallback = std::function<void(bool ok)>;
+
+  // Flushes go through `io`, or through a backend of the log's own (created
+  // on the first flush) if it is null.
+  WriteAheadLog(const std::string &path, const WalOptions &options,
+                std::shared_ptr<AsyncIo> io = nullptr);
+  ~WriteAheadLog();
+
+  WriteAheadLog(const WriteAheadLog &) = delete;
+  WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+  // Replays every intact record through `handler`, cuts off a torn tail left
+  // by a crash and opens the log for appending.
+  bool Open(const RecordHandler &handler);
+  void Close();
+
+  // Stages a record and returns its log sequence number. Callers that need
+  // the log order to match their apply order must call this under the same
+  // lock that protects the applied state.
+  uint64_t Append(WalRecordType type, std::string_view key,
+                  std::string_view value);
+
+  // Blocks until record `lsn` has reached the durability level of the fsync
+  // policy. Returns false once the log has seen an I/O error.
+  bool Sync(uint64_t lsn);
+  // `Sync()` at a chosen durability, for callers that must not block. Calls
+  // `done` (if set) with the result once record `lsn` got that far: inline
+  // if it already has, else on an I/O thread, so `done` must not block
+  // either. kAsyncLog starts writing the record and reports at once;
+  // kMemory only reports success.
+  void SyncAsync(uint64_t lsn, Durability durability, SyncCallback done);
+
+  // Discards the whole log. Only valid after its contents were made durable
+  // elsewhere (a checkpoint) and while no `Append()` can run concurrently.
+  bool Reset();
+
+  // Rotation in two steps, for callers that snapshot their own state at
+  // the cut. `BeginRotate()` only marks the cut after the last record
+  // appended, without I/O, so it can run under the locks that keep
+  // `Append()` out. `FinishRotate()`, called once those are released, moves
+  // every record before the cut into `archive_path`, synced, and continues
+  // in an empty log. Records appended in between stay staged for the new
+  // log, and syncs of them wait for the rotation. If the old log cannot be
+  // archived or the new one opened, `FinishRotate()` returns false and the
+  // old log, cut included, stays in use; only a failed write fails the log.
+  void BeginRotate();
+  bool FinishRotate(const std::string &archive_path);
+
+  uint64_t SizeBytes() const { return size_bytes_.load(); }
+  const std::string &path() const { return path_; }
+
+private:
+  // Staged records, and the registration of their memory with `io_`. The
+  // two buffers trade places whole, so a registration follows its memory.
+  struct Buffer {
+    std::string bytes;
+    int registered = -1;
+    const char *registered_data = nullptr;
+    size_t registered_size = 0;
+  };
+
+  // A `SyncAsync()` caller waiting for its record.
+  struct Waiter {
+    uint64_t lsn;
+    bool fsync;
+    SyncCallback done; // empty for kAsyncLog
+  };
+
+  // Whether record `lsn` has been written, and synced too if `fsync`.
+  bool IsDurable(uint64_t lsn, bool fsync) const;
+  // Requires `mutex_` held and no flush in flight. Submits everything
+  // staged; `FinishFlush()` runs on the I/O thread once it is done, and
+  // starts the next flush while waiters are left.
+  void StartFlushLocked(bool sync);
+  void FinishFlush(uint64_t upto, bool sync, int error);
+  // Requires `mutex_` held and no flush in flight. Takes the callbacks of
+  // the waiters that got far enough (all of them once the log failed) and,
+  // outside a rotation, flushes again for the rest.
+  std::vector<SyncCallback> ReleaseWaitersLocked();
+  // Flushes everything staged and waits for it.
+  bool FlushLocked(std::unique_lock<std::mutex> &lock, bool sync);
+  // Registers the memory of `buffer` again if it moved since.
+  void RegisterBuffer(Buffer *buffer);
+  void SyncLoop();
+
+private:
+  std::string path_;
+  WalOptions options_;
+  std::shared_ptr<AsyncIo> io_;
+  int fd_ = -1;
+
+  mutable std::mutex mutex_;
+  std::condition_variable flushed_cv_;
+  Buffer pending_;      // staged, not yet written
+  Buffer flush_buffer_; // being written by the flush in flight
+  Buffer cut_;          // staged before the cut of a rotation
+  // always true while `waiters_` is not empty, outside a rotation
+  bool flushing_ = false;
+  bool rotating_ = false; // between `BeginRotate()` and `FinishRotate()`
+  uint64_t cut_lsn_ = 0;
+  std::vector<Waiter> waiters_;
+  bool healthy_ = true;
+  uint64_t last_lsn_ = 0;
+  uint64_t written_lsn_ = 0;
+  uint64_t synced_lsn_ = 0;
+  std::atomic<uint64_t> size_bytes_{0};
+
+  std::thread sync_thread_;
+  std::condition_variable stop_cv_;
+  bool stop_ = false;
+};
+
+} // namespace tiny_kv
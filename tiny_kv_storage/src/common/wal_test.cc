@@ -0,0 +1,363 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "wal.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <gtest/gtest.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace tiny_kv {
+
+namespace {
+
+std::map<std::string, std::string> Replay(const std::string &path) {
+  std::map<std::string, std::string> data;
+  WriteAheadLog wal(path, WalOptions());
+  wal.Open([&data](WalRecordType type, std::string_view key,
+                   std::string_view value) {
+    if (type == WalRecordType::kPut) {
+      data[std::string(key)] = std::string(value);
+    } else {
+      data.erase(std::string(key));
+    }
+  });
+  return data;
+}
+
+} // namespace
+
+TEST(WriteAheadLogTest, AppendAndReplay) {
+  const std::string path = "wal_test.wal";
+  std::filesystem::remove(path);
+
+  {
+    WriteAheadLog wal(path, WalOptions());
+    ASSERT_TRUE(wal.Open([](WalRecordType, std::string_view,
+                            std::string_view) { FAIL(); }));
+
+    EXPECT_TRUE(wal.Sync(wal.Append(WalRecordType::kPut, "key1", "value1")));
+    EXPECT_TRUE(wal.Sync(wal.Append(WalRecordType::kPut, "key2", "value2")));
+    EXPECT_TRUE(wal.Sync(wal.Append(WalRecordType::kDelete, "key1", "")));
+    EXPECT_TRUE(wal.Sync(wal.Append(WalRecordType::kPut, "empty", "")));
+  }
+
+  auto data = Replay(path);
+  EXPECT_EQ(data.size(), 2);
+  EXPECT_EQ(data["key2"], "value2");
+  EXPECT_EQ(data.count("empty"), 1);
+
+  std::filesystem::remove(path);
+}
+
+TEST(WriteAheadLogTest, TornTailIsDiscarded) {
+  const std::string path = "wal_test_torn.wal";
+  std::filesystem::remove(path);
+
+  {
+    WriteAheadLog wal(path, WalOptions());
+    wal.Open([](WalRecordType, std::string_view, std::string_view) {});
+    wal.Sync(wal.Append(WalRecordType::kPut, "key1", "value1"));
+    wal.Sync(wal.Append(WalRecordType::kPut, "key2", "value2"));
+  }
+
+  // simulate a crash in the middle of the last record
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 3);
+
+  {
+    auto data = Replay(path);
+    EXPECT_EQ(data.size(), 1);
+    EXPECT_EQ(data["key1"], "value1");
+  }
+
+  // records appended after recovery must not hide behind the torn bytes
+  {
+    WriteAheadLog wal(path, WalOptions());
+    wal.Open([](WalRecordType, std::string_view, std::string_view) {});
+    wal.Sync(wal.Append(WalRecordType::kPut, "key3", "value3"));
+  }
+
+  auto data = Replay(path);
+  EXPECT_EQ(data.size(), 2);
+  EXPECT_EQ(data["key3"], "value3");
+
+  std::filesystem::remove(path);
+}
+
+TEST(WriteAheadLogTest, TornHeaderLengthIsDiscarded) {
+  const std::string path = "wal_test_torn_header.wal";
+  std::filesystem::remove(path);
+
+  {
+    WriteAheadLog wal(path, WalOptions());
+    wal.Open([](WalRecordType, std::string_view, std::string_view) {});
+    wal.Sync(wal.Append(WalRecordType::kPut, "key1", "value1"));
+  }
+
+  // garbage after a crash: a header claiming a 4 GiB payload
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::app);
+    const char garbage[] = {'\x12', '\x34', '\x56', '\x78',
+                            '\xff', '\xff', '\xff', '\xff'};
+    file.write(garbage, sizeof(garbage));
+  }
+  uint64_t garbage_size = std::filesystem::file_size(path);
+
+  auto data = Replay(path);
+  EXPECT_EQ(data.size(), 1);
+  EXPECT_EQ(data["key1"], "value1");
+  // truncated back to the last whole record
+  EXPECT_EQ(std::filesystem::file_size(path), garbage_size - 8);
+
+  std::filesystem::remove(path);
+}
+
+TEST(WriteAheadLogTest, GroupCommitConcurrentWriters) {
+  const std::string path = "wal_test_group.wal";
+  std::filesystem::remove(path);
+
+  const int thread_count = 8;
+  const int writes_per_thread = 200;
+
+  for (auto backend : {AsyncIoBackend::kAuto, AsyncIoBackend::kThreads}) {
+    AsyncIoOptions io_options;
+    io_options.backend = backend;
+    auto io = CreateAsyncIo(io_options);
+    for (auto policy :
+         {FsyncPolicy::kAlways, FsyncPolicy::kInterval, FsyncPolicy::kNever}) {
+      std::filesystem::remove(path);
+      {
+        WalOptions options;
+        options.fsync_policy = policy;
+        options.fsync_interval_ms = 5;
+        WriteAheadLog wal(path, options, io);
+        wal.Open([](WalRecordType, std::string_view, std::string_view) {});
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < thread_count; ++t) {
+          threads.emplace_back([&wal, t]() {
+            for (int i = 0; i < writes_per_thread; ++i) {
+              std::string key = std::to_string(t) + "_" + std::to_string(i);
+              EXPECT_TRUE(
+                  wal.Sync(wal.Append(WalRecordType::kPut, key, key)));
+            }
+          });
+        }
+        for (auto &thread : threads) {
+          thread.join();
+        }
+      }
+
+      auto data = Replay(path);
+      EXPECT_EQ(data.size(), thread_count * writes_per_thread);
+    }
+  }
+
+  std::filesystem::remove(path);
+}
+
+TEST(WriteAheadLogTest, SyncAsync) {
+  const std::string path = "wal_test_async.wal";
+  std::filesystem::remove(path);
+
+  const int thread_count = 4;
+  const int writes_per_thread = 100;
+  {
+    WalOptions options;
+    options.fsync_policy = FsyncPolicy::kNever;
+    WriteAheadLog wal(path, options);
+    wal.Open([](WalRecordType, std::string_view, std::string_view) {});
+
+    // memory and async-log levels answer at once
+    int answered = 0;
+    wal.SyncAsync(0, Durability::kMemory, [&answered](bool ok) {
+      EXPECT_TRUE(ok);
+      answered++;
+    });
+    wal.SyncAsync(wal.Append(WalRecordType::kPut, "async", "1"),
+                  Durability::kAsyncLog, [&answered](bool ok) {
+                    EXPECT_TRUE(ok);
+                    answered++;
+                  });
+    EXPECT_EQ(answered, 2);
+
+    // callers never block; the log keeps flushing while waiters are left
+    std::mutex mutex;
+    std::condition_variable done_cv;
+    int done = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; ++t) {
+      threads.emplace_back([&, t]() {
+        for (int i = 0; i < writes_per_thread; ++i) {
+          std::string key = std::to_string(t) + "_" + std::to_string(i);
+          wal.SyncAsync(wal.Append(WalRecordType::kPut, key, key),
+                        i % 2 ? Durability::kSync : Durability::kDefault,
+                        [&](bool ok) {
+                          EXPECT_TRUE(ok);
+                          std::lock_guard<std::mutex> lock(mutex);
+                          done++;
+                          done_cv.notify_all();
+                        });
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock,
+                 [&]() { return done == thread_count * writes_per_thread; });
+  }
+
+  auto data = Replay(path);
+  EXPECT_EQ(data.size(), thread_count * writes_per_thread + 1);
+  EXPECT_EQ(data["async"], "1");
+
+  std::filesystem::remove(path);
+}
+
+TEST(WriteAheadLogTest, Reset) {
+  const std::string path = "wal_test_reset.wal";
+  std::filesystem::remove(path);
+
+  {
+    WriteAheadLog wal(path, WalOptions());
+    wal.Open([](WalRecordType, std::string_view, std::string_view) {});
+    wal.Sync(wal.Append(WalRecordType::kPut, "key1", "value1"));
+    EXPECT_GT(wal.SizeBytes(), 0);
+
+    EXPECT_TRUE(wal.Reset());
+    EXPECT_EQ(wal.SizeBytes(), 0);
+    wal.Sync(wal.Append(WalRecordType::kPut, "key2", "value2"));
+  }
+
+  auto data = Replay(path);
+  EXPECT_EQ(data.size(), 1);
+  EXPECT_EQ(data["key2"], "value2");
+
+  std::filesystem::remove(path);
+}
+
+TEST(WriteAheadLogTest, RotateAtCut) {
+  const std::string path = "wal_test_rotate.wal";
+  const std::string archive = path + ".1";
+  std::filesystem::remove(path);
+  std::filesystem::remove(archive);
+
+  {
+    WriteAheadLog wal(path, WalOptions());
+    wal.Open([](WalRecordType, std::string_view, std::string_view) {});
+    wal.Sync(wal.Append(WalRecordType::kPut, "flushed", "1"));
+    wal.Append(WalRecordType::kPut, "staged", "2");
+
+    wal.BeginRotate();
+    // after the cut: waits for the rotation, then goes to the new log
+    std::promise<bool> synced;
+    std::future<bool> done = synced.get_future();
+    wal.SyncAsync(wal.Append(WalRecordType::kPut, "later", "3"),
+                  Durability::kSync,
+                  [&synced](bool ok) { synced.set_value(ok); });
+    EXPECT_EQ(done.wait_for(std::chrono::milliseconds(50)),
+              std::future_status::timeout);
+
+    EXPECT_TRUE(wal.FinishRotate(archive));
+    EXPECT_TRUE(done.get());
+    wal.Sync(wal.Append(WalRecordType::kPut, "last", "4"));
+  }
+
+  auto archived = Replay(archive);
+  EXPECT_EQ(archived.size(), 2);
+  EXPECT_EQ(archived["flushed"], "1");
+  EXPECT_EQ(archived["staged"], "2");
+  auto data = Replay(path);
+  EXPECT_EQ(data.size(), 2);
+  EXPECT_EQ(data["later"], "3");
+  EXPECT_EQ(data["last"], "4");
+
+  std::filesystem::remove(path);
+  std::filesystem::remove(archive);
+}
+
+// A rotation that cannot archive the log or open the next one fails alone:
+// the old log stays in use and keeps every record.
+TEST(WriteAheadLogTest, FailedRotateKeepsLog) {
+  const std::string path = "wal_test_failed_rotate.wal";
+  const std::string archive = path + ".1";
+  std::filesystem::remove(path);
+  std::filesystem::remove(archive);
+
+  {
+    WriteAheadLog wal(path, WalOptions());
+    wal.Open([](WalRecordType, std::string_view, std::string_view) {});
+    wal.Append(WalRecordType::kPut, "before", "1");
+
+    // the archive's directory does not exist
+    wal.BeginRotate();
+    uint64_t lsn = wal.Append(WalRecordType::kPut, "unarchived", "2");
+    EXPECT_FALSE(wal.FinishRotate("wal_test_missing_dir/" + archive));
+    EXPECT_TRUE(wal.Sync(lsn));
+
+    // archived, but no descriptor is left for the new log, so the old one
+    // moves back
+    wal.BeginRotate();
+    lsn = wal.Append(WalRecordType::kPut, "unopened", "3");
+    struct rlimit limit;
+    ASSERT_EQ(getrlimit(RLIMIT_NOFILE, &limit), 0);
+    struct rlimit lowered = limit;
+    lowered.rlim_cur = std::min<rlim_t>(limit.rlim_cur, 1024);
+    ASSERT_EQ(setrlimit(RLIMIT_NOFILE, &lowered), 0);
+    std::vector<int> fds;
+    for (int fd = open(path.c_str(), O_RDONLY); fd >= 0; fd = dup(fd)) {
+      fds.push_back(fd);
+    }
+    bool rotated = wal.FinishRotate(archive);
+    for (int fd : fds) {
+      close(fd);
+    }
+    setrlimit(RLIMIT_NOFILE, &limit);
+    EXPECT_FALSE(rotated);
+    EXPECT_FALSE(std::filesystem::exists(archive));
+    EXPECT_TRUE(wal.Sync(lsn));
+
+    wal.BeginRotate();
+    EXPECT_TRUE(wal.FinishRotate(archive));
+    EXPECT_TRUE(wal.Sync(wal.Append(WalRecordType::kPut, "after", "4")));
+  }
+
+  auto archived = Replay(archive);
+  EXPECT_EQ(archived.size(), 3);
+  EXPECT_EQ(archived["before"], "1");
+  EXPECT_EQ(archived["unarchived"], "2");
+  EXPECT_EQ(archived["unopened"], "3");
+  auto data = Replay(path);
+  EXPECT_EQ(data.size(), 1);
+  EXPECT_EQ(data["after"], "4");
+
+  std::filesystem::remove(path);
+  std::filesystem::remove(archive);
+}
+
+TEST(WriteAheadLogTest, ParseFsyncPolicy) {
+  FsyncPolicy policy;
+  EXPECT_TRUE(ParseFsyncPolicy("always", &policy));
+  EXPECT_EQ(policy, FsyncPolicy::kAlways);
+  EXPECT_TRUE(ParseFsyncPolicy("interval", &policy));
+  EXPECT_EQ(policy, FsyncPolicy::kInterval);
+  EXPECT_TRUE(ParseFsyncPolicy("never", &policy));
+  EXPECT_EQ(policy, FsyncPolicy::kNever);
+  EXPECT_FALSE(ParseFsyncPolicy("sometimes", &policy));
+}
+
+} // namespace tiny_kv
@@ -0,0 +1,69 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+namespace tiny_kv {
+
+/************************************************************************/
+/* ZipfianGenerator */
+/************************************************************************/
+// Draws integers in [min, max] with a Zipfian skew, the YCSB way: `min` is
+// the most popular and popularity falls off with rank. Construction sums
+// over every item, so build one per workload, not per draw. Not
+// thread-safe; give each thread its own.
+class ZipfianGenerator {
+public:
+  ZipfianGenerator(uint64_t min, uint64_t max, double zipfian_const = 0.99,
+                   uint64_t seed = std::random_device{}())
+      : items_(max - min + 1), base_(min), zipfian_const_(zipfian_const),
+        gen_(seed) {
+
+    theta_ = zipfian_const_;
+    zeta_n_ = CalculateZetaN(items_, theta_);
+    alpha_ = 1.0 / (1.0 - theta_);
+    eta_ = (1 - std::pow(2.0 / items_, 1 - theta_)) / (1 - zeta_2_ / zeta_n_);
+  }
+
+  uint64_t Next() {
+    double u = std::uniform_real_distribution<>(0, 1)(gen_);
+    double uz = u * zeta_n_;
+
+    if (uz < 1.0) {
+      return base_;
+    }
+
+    if (uz < 1.0 + std::pow(0.5, theta_)) {
+      return base_ + 1;
+    }
+
+    return base_ + static_cast<uint64_t>(items_ *
+                                         std::pow(eta_ * u - eta_ + 1, alpha_));
+  }
+
+private:
+  double CalculateZetaN(uint64_t n, double theta) {
+    double sum = 0;
+    for (uint64_t i = 1; i <= n; i++) {
+      sum += 1.0 / std::pow(i, theta);
+    }
+    return sum;
+  }
+
+  const uint64_t items_;
+  const uint64_t base_;
+  const double zipfian_const_;
+  double theta_;
+  double alpha_;
+  double zeta_n_;
+  double eta_;
+  static constexpr double zeta_2_ = 1.6449340668482264; // Zeta(2)
+  std::mt19937_64 gen_;
+};
+
+} // namespace tiny_kv
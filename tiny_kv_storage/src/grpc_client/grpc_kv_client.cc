@@ -93,7 +93,8 @@ std::pair<bool, std::string> GrpcKVClient::Get(const std::string &key) {
   return {true, response.value()};
 }
 
-bool GrpcKVClient::Put(const std::string &key, const std::string &value) {
+bool GrpcKVClient::Put(const std::string &key, const std::string &value,
+                       uint64_t ttl_seconds, WriteDurability durability) {
   if (!connected_) {
     last_error_ = "Failed to connect to server";
     return false;
@@ -102,6 +103,8 @@ bool GrpcKVClient::Put(const std::string &key, const std::string &value) {
   PutRequest request;
   request.set_key(key);
   request.set_value(value);
+  request.set_ttl_seconds(ttl_seconds);
+  request.set_durability(durability);
 
   PutResponse response;
 
@@ -150,6 +153,131 @@ bool GrpcKVClient::Delete(const std::string &key) {
   return true;
 }
 
+bool GrpcKVClient::CompareAndSet(const std::string &key,
+                                 const std::string &expected,
+                                 const std::string &value) {
+  if (!connected_) {
+    last_error_ = "Failed to connect to server";
+    return false;
+  }
+
+  CompareAndSetRequest request;
+  request.set_key(key);
+  request.set_expected(expected);
+  request.set_value(value);
+
+  CompareAndSetResponse response;
+
+  grpc::ClientContext context;
+
+  grpc::Status status = stub_->CompareAndSet(&context, request, &response);
+
+  if (!status.ok()) {
+    last_error_ = "RPC failed: " + status.error_message();
+    return false;
+  }
+
+  if (!response.success()) {
+    last_error_ = response.message();
+    return false;
+  }
+
+  return true;
+}
+
+bool GrpcKVClient::IncrementBy(const std::string &key, int64_t delta,
+                               int64_t *value) {
+  if (!connected_) {
+    last_error_ = "Failed to connect to server";
+    return false;
+  }
+
+  IncrementByRequest request;
+  request.set_key(key);
+  request.set_delta(delta);
+
+  IncrementByResponse response;
+
+  grpc::ClientContext context;
+
+  grpc::Status status = stub_->IncrementBy(&context, request, &response);
+
+  if (!status.ok()) {
+    last_error_ = "RPC failed: " + status.error_message();
+    return false;
+  }
+
+  if (!response.success()) {
+    last_error_ = response.message();
+    return false;
+  }
+
+  *value = response.value();
+
+  return true;
+}
+
+bool GrpcKVClient::Append(const std::string &key, const std::string &suffix,
+                          uint64_t *length) {
+  if (!connected_) {
+    last_error_ = "Failed to connect to server";
+    return false;
+  }
+
+  AppendRequest request;
+  request.set_key(key);
+  request.set_suffix(suffix);
+
+  AppendResponse response;
+
+  grpc::ClientContext context;
+
+  grpc::Status status = stub_->Append(&context, request, &response);
+
+  if (!status.ok()) {
+    last_error_ = "RPC failed: " + status.error_message();
+    return false;
+  }
+
+  if (!response.success()) {
+    last_error_ = response.message();
+    return false;
+  }
+
+  *length = response.length();
+
+  return true;
+}
+
+bool GrpcKVClient::CacheStats(uint64_t *hits, uint64_t *misses) {
+  if (!connected_) {
+    last_error_ = "Failed to connect to server";
+    return false;
+  }
+
+  CacheStatsRequest request;
+  CacheStatsResponse response;
+
+  grpc::ClientContext context;
+
+  grpc::Status status = stub_->CacheStats(&context, request, &response);
+
+  if (!status.ok()) {
+    last_error_ = "RPC failed: " + status.error_message();
+    return false;
+  }
+
+  if (!response.success()) {
+    last_error_ = response.message();
+    return false;
+  }
+
+  *hits = response.hits();
+  *misses = response.misses();
+
+  return true;
+}
+
 std::unordered_map<std::string, std::string>
 GrpcKVClient::MultiGet(const std::vector<std::string> &keys) {
   std::unordered_map<std::string, std::string> result;
@@ -187,7 +315,8 @@ GrpcKVClient::MultiGet(const std::vector<std::string> &keys) {
 }
 
 bool GrpcKVClient::MultiPut(
-    const std::unordered_map<std::string, std::string> &kv_pairs) {
+    const std::unordered_map<std::string, std::string> &kv_pairs,
+    WriteDurability durability) {
   if (!connected_) {
     last_error_ = "Failed to connect to server";
     return false;
@@ -199,6 +328,7 @@ bool GrpcKVClient::MultiPut(
     kv->set_key(key);
     kv->set_value(value);
   }
+  request.set_durability(durability);
 
   MultiPutResponse response;
   grpc::ClientContext context;
@@ -247,6 +377,45 @@ bool GrpcKVClient::MultiDelete(const std::vector<std::string> &keys) {
   return true;
 }
 
+std::vector<std::pair<std::string, std::string>>
+GrpcKVClient::Scan(const std::string &start, const std::string &end,
+                   uint64_t limit, const std::string &prefix) {
+  std::vector<std::pair<std::string, std::string>> result;
+
+  if (!connected_) {
+    last_error_ = "Failed to connect to server";
+    return result;
+  }
+
+  ScanRequest request;
+  request.set_start(start);
+  request.set_end(end);
+  request.set_limit(limit);
+  request.set_prefix(prefix);
+
+  grpc::ClientContext context;
+  std::unique_ptr<grpc::ClientReader<ScanResponse>> reader =
+      stub_->Scan(&context, request);
+
+  ScanResponse response;
+  while (reader->Read(&response)) {
+    if (!response.success()) {
+      last_error_ = response.message();
+    }
+    for (auto &kv : *response.mutable_kvs()) {
+      result.emplace_back(std::move(*kv.mutable_key()),
+                          std::move(*kv.mutable_value()));
+    }
+  }
+
+  grpc::Status status = reader->Finish();
+  if (!status.ok()) {
+    last_error_ = "RPC failed: " + status.error_message();
+  }
+
+  return result;
+}
+
 std::string GrpcKVClient::GetLastError() const { return last_error_; }
 
 void GrpcKVClient::AsyncGet(
@@ -282,7 +451,8 @@ void GrpcKVClient::AsyncGet(
 }
 
 void GrpcKVClient::AsyncPut(const std::string &key, const std::string &value,
-                            std::function<void(bool)> callback) {
+                            std::function<void(bool)> callback,
+                            uint64_t ttl_seconds) {
   if (!connected_) {
     callback(false);
     return;
@@ -293,6 +463,7 @@ void GrpcKVClient::AsyncPut(const std::string &key, const std::string &value,
   auto *response = new PutResponse;
   request->set_key(key);
   request->set_value(value);
+  request->set_ttl_seconds(ttl_seconds);
 
   auto *call = new std::function<void()>([=]() {
     bool success = response->success();
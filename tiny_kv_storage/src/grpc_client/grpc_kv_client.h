@@ -30,19 +30,41 @@ public:
   void Shutdown();
 
   std::pair<bool, std::string> Get(const std::string &key);
-  bool Put(const std::string &key, const std::string &value);
+  // A nonzero `ttl_seconds` makes the key expire that long after the put.
+  // The server answers once the write got as far as `durability` asks.
+  bool Put(const std::string &key, const std::string &value,
+           uint64_t ttl_seconds = 0,
+           WriteDurability durability = DURABILITY_DEFAULT);
   bool Delete(const std::string &key);
+  // Atomic updates run by the server; on failure `GetLastError()` says why
+  // (e.g. "value mismatch").
+  bool CompareAndSet(const std::string &key, const std::string &expected,
+                     const std::string &value);
+  bool IncrementBy(const std::string &key, int64_t delta, int64_t *value);
+  bool Append(const std::string &key, const std::string &suffix,
+              uint64_t *length);
+  // Hit and miss counters of the server's read cache; fails if the server
+  // runs without one.
+  bool CacheStats(uint64_t *hits, uint64_t *misses);
   std::unordered_map<std::string, std::string>
   MultiGet(const std::vector<std::string> &keys);
-  bool MultiPut(const std::unordered_map<std::string, std::string> &kv_pairs);
+  bool MultiPut(const std::unordered_map<std::string, std::string> &kv_pairs,
+                WriteDurability durability = DURABILITY_DEFAULT);
   bool MultiDelete(const std::vector<std::string> &keys);
+  // Pairs with keys in [start, end) that start with `prefix`, in key order
+  // and at most `limit` of them (0 = no limit); an empty `end` is unbounded.
+  // The server streams the range in chunks.
+  std::vector<std::pair<std::string, std::string>>
+  Scan(const std::string &start, const std::string &end, uint64_t limit = 0,
+       const std::string &prefix = "");
 
   std::string GetLastError() const;
 
   void AsyncGet(const std::string &key,
                 std::function<void(bool, const std::string &)> callback);
   void AsyncPut(const std::string &key, const std::string &value,
-                std::function<void(bool)> callback);
+                std::function<void(bool)> callback,
+                uint64_t ttl_seconds = 0);
   void AsyncDelete(const std::string &key, std::function<void(bool)> callback);
   void AsyncMultiGet(
       const std::vector<std::string> &keys,
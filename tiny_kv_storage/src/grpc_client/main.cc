@@ -27,6 +27,11 @@ Supported Client Commands:
   mget <key1> <key2> ...      Get multiple keys
   mput <key1> <value1> <key2> <value2> ...  Set multiple key-value pairs
   mdel <key1> <key2> ...      Delete multiple keys
+  scan <start> <end> [limit]  List keys in [start, end), "-" is an open bound
+  pscan <prefix> [limit]      List keys starting with a prefix
+  cas <key> <expected> <new>  Set a key only if it holds <expected>
+  incrby <key> <delta>        Add <delta> to an integer value
+  append <key> <suffix>       Append <suffix> to a value
   exit                        Exit the client
 )";
 
@@ -84,6 +89,11 @@ private:
     command_handlers_["mget"] = &CommandProcessor::HandleMultiGetCommand;
     command_handlers_["mput"] = &CommandProcessor::HandleMultiPutCommand;
     command_handlers_["mdel"] = &CommandProcessor::HandleMultiDeleteCommand;
+    command_handlers_["scan"] = &CommandProcessor::HandleScanCommand;
+    command_handlers_["pscan"] = &CommandProcessor::HandlePrefixScanCommand;
+    command_handlers_["cas"] = &CommandProcessor::HandleCasCommand;
+    command_handlers_["incrby"] = &CommandProcessor::HandleIncrByCommand;
+    command_handlers_["append"] = &CommandProcessor::HandleAppendCommand;
   }
 
   void HandleCallback(bool success, const std::string &value) {
@@ -137,12 +147,19 @@ private:
       PrintUsage("put");
       return;
     }
+    std::string option;
+    uint64_t ttl_seconds = 0;
+    if (iss >> option && (option != "EX" || !(iss >> ttl_seconds))) {
+      PrintUsage("put");
+      return;
+    }
 
     if (FLAGS_async) {
       client_->AsyncPut(key, value,
-                        [this](bool success) { HandleCallback(success); });
+                        [this](bool success) { HandleCallback(success); },
+                        ttl_seconds);
     } else {
-      HandleCallback(client_->Put(key, value));
+      HandleCallback(client_->Put(key, value, ttl_seconds));
     }
   }
 
@@ -229,14 +246,92 @@ private:
     }
   }
 
+  // Scans are always synchronous: the range streams back in chunks.
+  void HandleScanCommand(std::istringstream &iss) {
+    std::string start, end;
+    uint64_t limit = 0;
+    if (!(iss >> start >> end)) {
+      PrintUsage("scan");
+      return;
+    }
+    iss >> limit;
+
+    PrintScanResult(client_->Scan(start == "-" ? "" : start,
+                                  end == "-" ? "" : end, limit));
+  }
+
+  void HandlePrefixScanCommand(std::istringstream &iss) {
+    std::string prefix;
+    uint64_t limit = 0;
+    if (!(iss >> prefix)) {
+      PrintUsage("pscan");
+      return;
+    }
+    iss >> limit;
+
+    PrintScanResult(client_->Scan("", "", limit, prefix));
+  }
+
+  // The atomic updates are always synchronous.
+  void HandleCasCommand(std::istringstream &iss) {
+    std::string key, expected, value;
+    if (!(iss >> key >> expected >> value)) {
+      PrintUsage("cas");
+      return;
+    }
+
+    HandleCallback(client_->CompareAndSet(key, expected, value));
+  }
+
+  void HandleIncrByCommand(std::istringstream &iss) {
+    std::string key;
+    int64_t delta = 0;
+    if (!(iss >> key >> delta)) {
+      PrintUsage("incrby");
+      return;
+    }
+
+    int64_t value = 0;
+    bool success = client_->IncrementBy(key, delta, &value);
+    HandleCallback(success, std::to_string(value));
+  }
+
+  void HandleAppendCommand(std::istringstream &iss) {
+    std::string key, suffix;
+    if (!(iss >> key >> suffix)) {
+      PrintUsage("append");
+      return;
+    }
+
+    uint64_t length = 0;
+    bool success = client_->Append(key, suffix, &length);
+    HandleCallback(success, std::to_string(length));
+  }
+
+  void PrintScanResult(
+      const std::vector<std::pair<std::string, std::string>> &result) {
+    if (result.empty()) {
+      printf("error or empty result) %s\n", client_->GetLastError().c_str());
+      return;
+    }
+    for (const auto & [ key, value ] : result) {
+      printf("%s: %s\n", key.c_str(), value.c_str());
+    }
+  }
+
   void PrintUsage(const std::string &cmd) {
     static const std::unordered_map<std::string, std::string> usage_map = {
         {"get", "Usage: get <key>"},
-        {"put", "Usage: put <key> <value>"},
+        {"put", "Usage: put <key> <value> [EX <seconds>]"},
         {"delete", "Usage: delete <key>"},
         {"mget", "Usage: mget <key1> <key2> ..."},
         {"mput", "Usage: mput <key1> <value1> <key2> <value2> ..."},
-        {"mdel", "Usage: mdel <key1> <key2> ..."}};
+        {"mdel", "Usage: mdel <key1> <key2> ..."},
+        {"scan", "Usage: scan <start|-> <end|-> [limit]"},
+        {"pscan", "Usage: pscan <prefix> [limit]"},
+        {"cas", "Usage: cas <key> <expected> <new value>"},
+        {"incrby", "Usage: incrby <key> <delta>"},
+        {"append", "Usage: append <key> <suffix>"}};
 
     auto it = usage_map.find(cmd);
     if (it != usage_map.end()) {
@@ -3,10 +3,30 @@
 //
 
 #include "async_grpc_kv_server.h"
+#include "src/common/cached_storage.h"
+#include <algorithm>
 #include <iostream>
+#include <limits>
 
 namespace tiny_kv {
 
+namespace {
+
+Durability ToDurability(WriteDurability durability) {
+  switch (durability) {
+  case DURABILITY_MEMORY:
+    return Durability::kMemory;
+  case DURABILITY_ASYNC_LOG:
+    return Durability::kAsyncLog;
+  case DURABILITY_FSYNC:
+    return Durability::kSync;
+  default:
+    return Durability::kDefault;
+  }
+}
+
+} // namespace
+
 /************************************************************************/
 /* GetServiceContext */
 /************************************************************************/
@@ -26,11 +46,14 @@ void GetServiceContext::Process() {
 
     status_ = Status::PROCESS;
 
-    auto value = storage_->Get(request_.key());
-    if (value.has_value()) {
+    // copy the stored bytes straight into the response message
+    bool found =
+        storage_->Visit(request_.key(), [this](std::string_view value) {
+          response_.set_value(value.data(), value.size());
+        });
+    if (found) {
       response_.set_success(true);
       response_.set_message("success");
-      response_.set_value(*value);
     } else {
       response_.set_success(false);
       response_.set_message("key not found");
@@ -70,11 +93,24 @@ void PutServiceContext::Process() {
 
     status_ = Status::PROCESS;
 
-    bool success = storage_->Put(request_.key(), request_.value());
-    response_.set_success(success);
-    response_.set_message(success ? "success" : "fail");
+    // the engine takes the TTL in milliseconds
+    if (request_.ttl_seconds() > std::numeric_limits<uint64_t>::max() / 1000) {
+      response_.set_success(false);
+      response_.set_message("ttl out of range");
+      responder_.Finish(response_, grpc::Status::OK, this);
+      return;
+    }
 
-    responder_.Finish(response_, grpc::Status::OK, this);
+    // answered from the completion, which may come on an I/O thread after
+    // this returns; nothing here touches the call once it is finished
+    storage_->PutAsync(request_.key(), request_.value(),
+                       request_.ttl_seconds() * 1000,
+                       ToDurability(request_.durability()),
+                       [this](bool success) {
+                         response_.set_success(success);
+                         response_.set_message(success ? "success" : "fail");
+                         responder_.Finish(response_, grpc::Status::OK, this);
+                       });
 
   } else if (status_ == Status::PROCESS) {
     status_ = Status::FINISH;
@@ -148,11 +184,14 @@ void MultiGetServiceContext::Process() {
     response_.set_success(true);
     response_.set_message("success");
 
-    for (const auto& key : request_.keys()) {
-      auto value = storage_->Get(key);
+    KeyList keys(request_.keys().begin(), request_.keys().end());
+    std::vector<std::optional<std::string>> values;
+    storage_->MultiGet(keys, &values);
+
+    for (int i = 0; i < request_.keys_size(); ++i) {
       auto* kv = response_.add_kvs();
-      kv->set_key(key);
-      kv->set_value(value.has_value() ? *value : "");
+      kv->set_key(request_.keys(i));
+      kv->set_value(values[i].has_value() ? *values[i] : "");
     }
 
     responder_.Finish(response_, grpc::Status::OK, this);
@@ -188,17 +227,18 @@ void MultiPutServiceContext::Process() {
 
     status_ = Status::PROCESS;
 
-    bool success = true;
+    KVPairList kvs;
+    kvs.reserve(request_.kvs_size());
     for (const auto& kv : request_.kvs()) {
-      if (!storage_->Put(kv.key(), kv.value())) {
-        success = false;
-      }
+      kvs.emplace_back(kv.key(), kv.value());
     }
-
-    response_.set_success(success);
-    response_.set_message(success ? "success" : "partial failure");
-
-    responder_.Finish(response_, grpc::Status::OK, this);
+    // finished from the completion, as in PutServiceContext
+    storage_->MultiPutAsync(
+        kvs, ToDurability(request_.durability()), [this](bool success) {
+          response_.set_success(success);
+          response_.set_message(success ? "success" : "partial failure");
+          responder_.Finish(response_, grpc::Status::OK, this);
+        });
 
   } else if (status_ == Status::PROCESS) {
     status_ = Status::FINISH;
@@ -231,12 +271,8 @@ void MultiDeleteServiceContext::Process() {
 
     status_ = Status::PROCESS;
 
-    bool success = true;
-    for (const auto& key : request_.keys()) {
-      if (!storage_->Delete(key)) {
-        success = false;
-      }
-    }
+    KeyList keys(request_.keys().begin(), request_.keys().end());
+    bool success = storage_->MultiDelete(keys);
 
     response_.set_success(success);
     response_.set_message(success ? "success" : "partial failure");
@@ -255,19 +291,279 @@ void MultiDeleteServiceContext::Recycle() {
   }
 }
 
+/************************************************************************/
+/* CompareAndSetServiceContext */
+/************************************************************************/
+CompareAndSetServiceContext::CompareAndSetServiceContext(
+    std::unique_ptr<StorageEngine> &storage)
+    : BaseServiceContext<CompareAndSetRequest, CompareAndSetResponse>(storage) {}
+
+void CompareAndSetServiceContext::DoRequest(grpc::ServerCompletionQueue *cq) {
+  cq_ = cq;
+  service_->RequestCompareAndSet(&ctx_, &request_, &responder_, cq, cq, this);
+}
+
+void CompareAndSetServiceContext::Process() {
+  if (status_ == Status::CREATE) {
+    auto *new_context = new CompareAndSetServiceContext(storage_);
+    new_context->set_service(service_);
+    new_context->DoRequest(cq_);
+
+    status_ = Status::PROCESS;
+
+    UpdateStatus status = storage_->CompareAndSet(
+        request_.key(), request_.expected(), request_.value());
+    response_.set_success(status == UpdateStatus::kOk);
+    response_.set_message(UpdateStatusMessage(status));
+
+    responder_.Finish(response_, grpc::Status::OK, this);
+
+  } else if (status_ == Status::PROCESS) {
+    status_ = Status::FINISH;
+    Recycle();
+  }
+}
+
+void CompareAndSetServiceContext::Recycle() {
+  if (status_ == Status::FINISH) {
+    delete this;
+  }
+}
+
+/************************************************************************/
+/* IncrementByServiceContext */
+/************************************************************************/
+IncrementByServiceContext::IncrementByServiceContext(
+    std::unique_ptr<StorageEngine> &storage)
+    : BaseServiceContext<IncrementByRequest, IncrementByResponse>(storage) {}
+
+void IncrementByServiceContext::DoRequest(grpc::ServerCompletionQueue *cq) {
+  cq_ = cq;
+  service_->RequestIncrementBy(&ctx_, &request_, &responder_, cq, cq, this);
+}
+
+void IncrementByServiceContext::Process() {
+  if (status_ == Status::CREATE) {
+    auto *new_context = new IncrementByServiceContext(storage_);
+    new_context->set_service(service_);
+    new_context->DoRequest(cq_);
+
+    status_ = Status::PROCESS;
+
+    int64_t value = 0;
+    UpdateStatus status =
+        storage_->IncrementBy(request_.key(), request_.delta(), &value);
+    response_.set_success(status == UpdateStatus::kOk);
+    response_.set_message(UpdateStatusMessage(status));
+    if (status == UpdateStatus::kOk) {
+      response_.set_value(value);
+    }
+
+    responder_.Finish(response_, grpc::Status::OK, this);
+
+  } else if (status_ == Status::PROCESS) {
+    status_ = Status::FINISH;
+    Recycle();
+  }
+}
+
+void IncrementByServiceContext::Recycle() {
+  if (status_ == Status::FINISH) {
+    delete this;
+  }
+}
+
+/************************************************************************/
+/* AppendServiceContext */
+/************************************************************************/
+AppendServiceContext::AppendServiceContext(
+    std::unique_ptr<StorageEngine> &storage)
+    : BaseServiceContext<AppendRequest, AppendResponse>(storage) {}
+
+void AppendServiceContext::DoRequest(grpc::ServerCompletionQueue *cq) {
+  cq_ = cq;
+  service_->RequestAppend(&ctx_, &request_, &responder_, cq, cq, this);
+}
+
+void AppendServiceContext::Process() {
+  if (status_ == Status::CREATE) {
+    auto *new_context = new AppendServiceContext(storage_);
+    new_context->set_service(service_);
+    new_context->DoRequest(cq_);
+
+    status_ = Status::PROCESS;
+
+    size_t length = 0;
+    UpdateStatus status =
+        storage_->Append(request_.key(), request_.suffix(), &length);
+    response_.set_success(status == UpdateStatus::kOk);
+    response_.set_message(UpdateStatusMessage(status));
+    if (status == UpdateStatus::kOk) {
+      response_.set_length(length);
+    }
+
+    responder_.Finish(response_, grpc::Status::OK, this);
+
+  } else if (status_ == Status::PROCESS) {
+    status_ = Status::FINISH;
+    Recycle();
+  }
+}
+
+void AppendServiceContext::Recycle() {
+  if (status_ == Status::FINISH) {
+    delete this;
+  }
+}
+
+/************************************************************************/
+/* CacheStatsServiceContext */
+/************************************************************************/
+CacheStatsServiceContext::CacheStatsServiceContext(
+    std::unique_ptr<StorageEngine> &storage)
+    : BaseServiceContext<CacheStatsRequest, CacheStatsResponse>(storage) {}
+
+void CacheStatsServiceContext::DoRequest(grpc::ServerCompletionQueue *cq) {
+  cq_ = cq;
+  service_->RequestCacheStats(&ctx_, &request_, &responder_, cq, cq, this);
+}
+
+void CacheStatsServiceContext::Process() {
+  if (status_ == Status::CREATE) {
+    auto *new_context = new CacheStatsServiceContext(storage_);
+    new_context->set_service(service_);
+    new_context->DoRequest(cq_);
+
+    status_ = Status::PROCESS;
+
+    auto *cached = dynamic_cast<CachedStorageEngine *>(storage_.get());
+    response_.set_success(cached != nullptr);
+    if (cached) {
+      CacheStats stats = cached->Stats();
+      response_.set_message("success");
+      response_.set_hits(stats.hits);
+      response_.set_misses(stats.misses);
+    } else {
+      response_.set_message("no cache");
+    }
+
+    responder_.Finish(response_, grpc::Status::OK, this);
+
+  } else if (status_ == Status::PROCESS) {
+    status_ = Status::FINISH;
+    Recycle();
+  }
+}
+
+void CacheStatsServiceContext::Recycle() {
+  if (status_ == Status::FINISH) {
+    delete this;
+  }
+}
+
+/************************************************************************/
+/* ScanServiceContext */
+/************************************************************************/
+ScanServiceContext::ScanServiceContext(std::unique_ptr<StorageEngine> &storage)
+    : service_(nullptr), storage_(storage), writer_(&ctx_) {}
+
+void ScanServiceContext::DoRequest(grpc::ServerCompletionQueue *cq) {
+  cq_ = cq;
+  service_->RequestScan(&ctx_, &request_, &writer_, cq, cq, this);
+}
+
+void ScanServiceContext::Process() {
+  if (status_ == Status::CREATE) {
+    auto *new_context = new ScanServiceContext(storage_);
+    new_context->set_service(service_);
+    new_context->DoRequest(cq_);
+
+    status_ = Status::WRITE;
+
+    // a prefix narrows whatever range was given
+    next_start_ = request_.start();
+    end_ = request_.end();
+    if (!request_.prefix().empty()) {
+      next_start_ = std::max(next_start_, request_.prefix());
+      std::string prefix_end = PrefixEnd(request_.prefix());
+      if (end_.empty() || (!prefix_end.empty() && prefix_end < end_)) {
+        end_ = std::move(prefix_end);
+      }
+    }
+    remaining_ = request_.limit();
+
+    WriteNextChunk();
+
+  } else if (status_ == Status::WRITE) {
+    WriteNextChunk();
+
+  } else if (status_ == Status::FINISH) {
+    Recycle();
+  }
+}
+
+void ScanServiceContext::WriteNextChunk() {
+  size_t chunk = kChunkSize;
+  if (request_.limit() != 0) {
+    chunk = std::min<uint64_t>(chunk, remaining_);
+  }
+  ScanBatch batch;
+  storage_->Scan(next_start_, end_, chunk, &batch);
+
+  bool last = batch.size() < chunk;
+  if (request_.limit() != 0) {
+    remaining_ -= batch.size();
+    last = last || remaining_ == 0;
+  }
+  if (!last) {
+    // resume just past the last key sent
+    next_start_ = batch.back().first;
+    next_start_.push_back('\0');
+  }
+
+  response_.Clear();
+  response_.set_success(true);
+  response_.set_message("success");
+  for (auto & [ key, value ] : batch) {
+    auto *kv = response_.add_kvs();
+    kv->set_key(std::move(key));
+    kv->set_value(std::move(value));
+  }
+
+  if (last) {
+    status_ = Status::FINISH;
+    writer_.WriteAndFinish(response_, grpc::WriteOptions(), grpc::Status::OK,
+                           this);
+  } else {
+    writer_.Write(response_, this);
+  }
+}
+
+void ScanServiceContext::Recycle() {
+  if (status_ == Status::FINISH) {
+    delete this;
+  }
+}
+
 /************************************************************************/
 /* AsyncKVServiceImpl */
 /************************************************************************/
 AsyncKVServiceImpl::AsyncKVServiceImpl(const std::string &storage_type,
-                                       const std::string &storage_path)
+                                       const std::string &storage_path,
+                                       const StorageOptions &storage_options)
     : service_(std::make_unique<KVService::AsyncService>()),
-      storage_(CreateStorageEngine(storage_type, storage_path)),
+      storage_(
+          CreateStorageEngine(storage_type, storage_path, storage_options)),
       shutdown_(false) {}
 
 AsyncKVServiceImpl::~AsyncKVServiceImpl() {
   Stop();
 
-  auto *file_storage = dynamic_cast<FileStorage *>(storage_.get());
+  StorageEngine *engine = storage_.get();
+  if (auto *cached = dynamic_cast<CachedStorageEngine *>(engine)) {
+    engine = cached->wrapped();
+  }
+  auto *file_storage = dynamic_cast<FileStorage *>(engine);
   if (file_storage) {
     file_storage->Persist();
   }
@@ -316,6 +612,26 @@ void AsyncKVServiceImpl::CreateContexts() {
   auto *multi_delete_context = new MultiDeleteServiceContext(storage_);
   multi_delete_context->set_service(service_.get());
   multi_delete_context->DoRequest(cq_.get());
+
+  auto *scan_context = new ScanServiceContext(storage_);
+  scan_context->set_service(service_.get());
+  scan_context->DoRequest(cq_.get());
+
+  auto *cas_context = new CompareAndSetServiceContext(storage_);
+  cas_context->set_service(service_.get());
+  cas_context->DoRequest(cq_.get());
+
+  auto *incr_context = new IncrementByServiceContext(storage_);
+  incr_context->set_service(service_.get());
+  incr_context->DoRequest(cq_.get());
+
+  auto *append_context = new AppendServiceContext(storage_);
+  append_context->set_service(service_.get());
+  append_context->DoRequest(cq_.get());
+
+  auto *cache_stats_context = new CacheStatsServiceContext(storage_);
+  cache_stats_context->set_service(service_.get());
+  cache_stats_context->DoRequest(cq_.get());
 }
 
 void AsyncKVServiceImpl::HandleRequests() {
@@ -329,10 +645,11 @@ void AsyncKVServiceImpl::HandleRequests() {
       break;
     }
 
+    // a cancelled call must still free its context
     if (ok) {
-      auto *context =
-          static_cast<BaseServiceContext<GetRequest, GetResponse> *>(tag);
-      context->Process();
+      static_cast<ServiceContext *>(tag)->Process();
+    } else {
+      static_cast<ServiceContext *>(tag)->Abandon();
     }
   }
 }
@@ -363,10 +680,11 @@ void AsyncKVServiceImpl::Wait() {
 AsyncGrpcKVServer::AsyncGrpcKVServer(const std::string &server_address,
                                      const std::string &storage_type,
                                      const std::string &storage_path,
-                                     int num_threads)
+                                     int num_threads,
+                                     const StorageOptions &storage_options)
     : server_address_(server_address),
-      service_(
-          std::make_unique<AsyncKVServiceImpl>(storage_type, storage_path)),
+      service_(std::make_unique<AsyncKVServiceImpl>(
+          storage_type, storage_path, storage_options)),
       num_threads_(num_threads) {}
 
 AsyncGrpcKVServer::~AsyncGrpcKVServer() { Stop(); }
@@ -6,6 +6,8 @@
 
 #include "src/common/storage_engine.h"
 #include "src/proto/kv_service.grpc.pb.h"
+#include <atomic>
+#include <cstdint>
 #include <grpcpp/grpcpp.h>
 #include <memory>
 #include <string>
@@ -16,11 +18,37 @@ namespace tiny_kv {
 
 class AsyncGrpcKVServer;
 
+/************************************************************************/
+/* ServiceContext */
+/************************************************************************/
+// What the completion queue hands back as a tag: one call in flight.
+class ServiceContext {
+public:
+  ServiceContext() { live_.fetch_add(1, std::memory_order_relaxed); }
+  virtual ~ServiceContext() {
+    live_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  virtual void Process() = 0;
+  virtual void Recycle() = 0;
+  // The tag came back with `ok == false`: the call was cancelled, its
+  // client went away, or the server is shutting down. Nothing of the call
+  // is pending any more, so the context goes.
+  virtual void Abandon() { delete this; }
+
+  // Contexts alive in the process: one waiting per method of every server,
+  // plus the calls in flight.
+  static int64_t Live() { return live_.load(std::memory_order_relaxed); }
+
+private:
+  static inline std::atomic<int64_t> live_{0};
+};
+
 /************************************************************************/
 /* BaseServiceContext */
 /************************************************************************/
 template <typename Request, typename Response>
-class BaseServiceContext {
+class BaseServiceContext : public ServiceContext {
 protected:
   Request request_;
   Response response_;
@@ -41,8 +69,6 @@ public:
   }
 
   virtual void DoRequest(grpc::ServerCompletionQueue* cq) = 0;
-  virtual void Process() = 0;
-  virtual void Recycle() = 0;
 };
 
 /************************************************************************/
@@ -66,6 +92,9 @@ private:
 /************************************************************************/
 /* PutServiceContext */
 /************************************************************************/
+// Answers once the write reached the durability the request asks for. The
+// call is finished from the engine's completion callback, so a CQ thread
+// never waits on the log.
 class PutServiceContext : public BaseServiceContext<PutRequest, PutResponse> {
 public:
   PutServiceContext(std::unique_ptr<StorageEngine>& storage);
@@ -153,13 +182,132 @@ private:
   grpc::ServerCompletionQueue* cq_ = nullptr;
 };
 
+/************************************************************************/
+/* CompareAndSetServiceContext */
+/************************************************************************/
+class CompareAndSetServiceContext
+    : public BaseServiceContext<CompareAndSetRequest, CompareAndSetResponse> {
+public:
+  CompareAndSetServiceContext(std::unique_ptr<StorageEngine>& storage);
+  ~CompareAndSetServiceContext() override = default;
+
+  void DoRequest(grpc::ServerCompletionQueue* cq) override;
+  void Process() override;
+  void Recycle() override;
+
+private:
+  enum class Status { CREATE, PROCESS, FINISH };
+  Status status_ = Status::CREATE;
+  grpc::ServerCompletionQueue* cq_ = nullptr;
+};
+
+/************************************************************************/
+/* IncrementByServiceContext */
+/************************************************************************/
+class IncrementByServiceContext
+    : public BaseServiceContext<IncrementByRequest, IncrementByResponse> {
+public:
+  IncrementByServiceContext(std::unique_ptr<StorageEngine>& storage);
+  ~IncrementByServiceContext() override = default;
+
+  void DoRequest(grpc::ServerCompletionQueue* cq) override;
+  void Process() override;
+  void Recycle() override;
+
+private:
+  enum class Status { CREATE, PROCESS, FINISH };
+  Status status_ = Status::CREATE;
+  grpc::ServerCompletionQueue* cq_ = nullptr;
+};
+
+/************************************************************************/
+/* AppendServiceContext */
+/************************************************************************/
+class AppendServiceContext
+    : public BaseServiceContext<AppendRequest, AppendResponse> {
+public:
+  AppendServiceContext(std::unique_ptr<StorageEngine>& storage);
+  ~AppendServiceContext() override = default;
+
+  void DoRequest(grpc::ServerCompletionQueue* cq) override;
+  void Process() override;
+  void Recycle() override;
+
+private:
+  enum class Status { CREATE, PROCESS, FINISH };
+  Status status_ = Status::CREATE;
+  grpc::ServerCompletionQueue* cq_ = nullptr;
+};
+
+/************************************************************************/
+/* CacheStatsServiceContext */
+/************************************************************************/
+class CacheStatsServiceContext
+    : public BaseServiceContext<CacheStatsRequest, CacheStatsResponse> {
+public:
+  CacheStatsServiceContext(std::unique_ptr<StorageEngine>& storage);
+  ~CacheStatsServiceContext() override = default;
+
+  void DoRequest(grpc::ServerCompletionQueue* cq) override;
+  void Process() override;
+  void Recycle() override;
+
+private:
+  enum class Status { CREATE, PROCESS, FINISH };
+  Status status_ = Status::CREATE;
+  grpc::ServerCompletionQueue* cq_ = nullptr;
+};
+
+/************************************************************************/
+/* ScanServiceContext */
+/************************************************************************/
+// Server-streaming: the range goes out in chunks of `kChunkSize` entries,
+// each read from the engine just before it is written, so neither side
+// holds a long range in memory at once.
+class ScanServiceContext : public ServiceContext {
+public:
+  ScanServiceContext(std::unique_ptr<StorageEngine>& storage);
+  ~ScanServiceContext() override = default;
+
+  void set_service(KVService::AsyncService* service) {
+    service_ = service;
+  }
+
+  void DoRequest(grpc::ServerCompletionQueue* cq);
+  void Process() override;
+  void Recycle() override;
+
+private:
+  static constexpr size_t kChunkSize = 128;
+
+  // Reads the next chunk and writes it; the last chunk finishes the call.
+  void WriteNextChunk();
+
+  enum class Status { CREATE, WRITE, FINISH };
+  Status status_ = Status::CREATE;
+  grpc::ServerCompletionQueue* cq_ = nullptr;
+
+  ScanRequest request_;
+  ScanResponse response_;
+  grpc::ServerContext ctx_;
+  KVService::AsyncService* service_;
+  std::unique_ptr<StorageEngine>& storage_;
+  grpc::ServerAsyncWriter<ScanResponse> writer_;
+
+  std::string next_start_; // first key of the next chunk
+  std::string end_;
+  uint64_t remaining_ = 0; // entries left when the request has a limit
+};
+
 /************************************************************************/
 /* AsyncKVServiceImpl */
 /************************************************************************/
 class AsyncKVServiceImpl {
 public:
-  explicit AsyncKVServiceImpl(const std::string& storage_type = "memory",
-                             const std::string& storage_path = "");
+  explicit AsyncKVServiceImpl(
+      const std::string& storage_type = "memory",
+      const std::string& storage_path = "",
+      const StorageOptions& storage_options = StorageOptions());
   ~AsyncKVServiceImpl();
 
   void Start(const std::string& server_address, int num_threads);
@@ -186,7 +334,8 @@ public:
   AsyncGrpcKVServer(const std::string& server_address,
                    const std::string& storage_type = "memory",
                    const std::string& storage_path = "",
-                   int num_threads = 4);
+                   int num_threads = 4,
+                   const StorageOptions& storage_options = StorageOptions());
   ~AsyncGrpcKVServer();
 
   void Start();
@@ -0,0 +1,57 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "async_grpc_kv_server.h"
+#include <chrono>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+
+namespace tiny_kv {
+
+// A client that cancels a streaming Scan halfway leaves the server with a
+// failed write; its context must be freed rather than leaked.
+TEST(AsyncGrpcKVServerTest, CancelledScanIsReleased) {
+  const std::string address = "127.0.0.1:50071";
+  AsyncGrpcKVServer server(address, "memory", "", 2);
+  server.Start();
+  const int64_t idle = ServiceContext::Live();
+
+  auto stub = KVService::NewStub(
+      grpc::CreateChannel(address, grpc::InsecureChannelCredentials()));
+  // far more than the flow-control window, so the stream stalls on writes
+  const std::string value(1024, 'v');
+  for (int batch = 0; batch < 16; ++batch) {
+    MultiPutRequest request;
+    for (int i = 0; i < 256; ++i) {
+      auto *kv = request.add_kvs();
+      kv->set_key("key" + std::to_string(batch * 256 + i));
+      kv->set_value(value);
+    }
+    MultiPutResponse response;
+    grpc::ClientContext context;
+    ASSERT_TRUE(stub->MultiPut(&context, request, &response).ok());
+    ASSERT_TRUE(response.success());
+  }
+
+  for (int i = 0; i < 8; ++i) {
+    grpc::ClientContext context;
+    auto reader = stub->Scan(&context, ScanRequest());
+    ScanResponse response;
+    ASSERT_TRUE(reader->Read(&response));
+    context.TryCancel();
+    while (reader->Read(&response)) {
+    }
+    EXPECT_FALSE(reader->Finish().ok());
+  }
+
+  // the server frees the contexts once it sees the cancellations
+  for (int i = 0; i < 100 && ServiceContext::Live() > idle; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  EXPECT_EQ(ServiceContext::Live(), idle);
+  server.Stop();
+}
+
+} // namespace tiny_kv
@@ -3,6 +3,7 @@
 //
 
 #include "async_grpc_kv_server.h"
+#include <cinttypes>
 #include <csignal>
 #include <gflags/gflags.h>
 #include <stdio.h>
@@ -10,9 +11,40 @@
 
 DEFINE_string(ip, "127.0.0.1", "The server ip");
 DEFINE_int32(port, 8080, "The server port");
-DEFINE_string(storage_type, "memory", "Storage type: 'memory' or 'file'");
+DEFINE_string(storage_type, "memory",
+              "Storage type: 'memory', 'file' or 'lsm'");
 DEFINE_string(storage_path, "test.db",
-              "Path to database file when using file storage");
+              "Path to database file (file storage) or directory (lsm "
+              "storage)");
+DEFINE_int32(memory_shards, 16,
+             "Number of independently locked shards of memory storage");
+DEFINE_uint64(max_memory_bytes, 0,
+              "Memory storage limit; writes evict approximately least "
+              "recently used keys to stay under it. 0 disables");
+DEFINE_string(value_codec, "none",
+              "Compression of large values in memory and file storage: "
+              "'none' or 'lz4'");
+DEFINE_uint64(compress_min_bytes, 256,
+              "Values shorter than this are never compressed");
+DEFINE_string(wal_fsync, "always",
+              "WAL fsync policy for file storage: 'always', 'interval' or "
+              "'never'");
+DEFINE_int32(wal_fsync_interval_ms, 100,
+             "fdatasync period of the WAL when --wal_fsync=interval");
+DEFINE_string(async_io, "auto",
+              "Backend of the WAL and snapshot writes of file and lsm "
+              "storage: 'auto' (io_uring where available) or 'threads'");
+DEFINE_int32(checkpoint_interval_s, 0,
+             "Seconds between background checkpoints of file storage, 0 "
+             "disables");
+DEFINE_uint64(cache_entries, 0,
+              "Entries of the read cache in front of file and lsm storage, "
+              "0 disables");
+DEFINE_string(cache_policy, "lru",
+              "Replacement policy of the read cache: 'lru', 'clock' or "
+              "'tinylfu'");
+DEFINE_bool(cache_write_through, false,
+            "Writes update cached values instead of dropping them");
 
 static tiny_kv::AsyncGrpcKVServer *g_server = nullptr;
 
@@ -28,8 +60,52 @@ int main(int argc, char *argv[]) {
 
   std::string server_address = FLAGS_ip + ":" + std::to_string(FLAGS_port);
 
+  tiny_kv::StorageOptions storage_options;
+  if (!tiny_kv::ParseFsyncPolicy(FLAGS_wal_fsync,
+                                 &storage_options.wal.fsync_policy)) {
+    printf("Invalid --wal_fsync: %s\n", FLAGS_wal_fsync.c_str());
+    return 1;
+  }
+  if (!tiny_kv::ParseAsyncIoBackend(FLAGS_async_io,
+                                    &storage_options.io.backend)) {
+    printf("Invalid --async_io: %s\n", FLAGS_async_io.c_str());
+    return 1;
+  }
+  if (FLAGS_memory_shards <= 0) {
+    printf("Invalid --memory_shards: %d\n", FLAGS_memory_shards);
+    return 1;
+  }
+  if (!tiny_kv::ParseCachePolicy(FLAGS_cache_policy,
+                                 &storage_options.cache.policy)) {
+    printf("Invalid --cache_policy: %s\n", FLAGS_cache_policy.c_str());
+    return 1;
+  }
+  if (!tiny_kv::ParseValueCodec(FLAGS_value_codec,
+                                &storage_options.compression.codec)) {
+    printf("Invalid --value_codec: %s\n", FLAGS_value_codec.c_str());
+    return 1;
+  }
+  storage_options.compression.min_bytes = FLAGS_compress_min_bytes;
+  storage_options.memory_shards = FLAGS_memory_shards;
+  storage_options.memory_max_bytes = FLAGS_max_memory_bytes;
+  storage_options.wal.fsync_interval_ms = FLAGS_wal_fsync_interval_ms;
+  storage_options.checkpoint_interval_s = FLAGS_checkpoint_interval_s;
+  storage_options.on_checkpoint = [](bool ok,
+                                     const tiny_kv::CheckpointStats &stats) {
+    if (!ok) {
+      printf("Checkpoint of %s failed\n", FLAGS_storage_path.c_str());
+      return;
+    }
+    printf("Checkpoint of %s: %zu entries in %" PRIu64 " ms, paused %" PRIu64
+           " us, shard copies %" PRIu64 " us\n",
+           FLAGS_storage_path.c_str(), stats.entries, stats.duration_ms,
+           stats.pause_us, stats.copy_us);
+  };
+  storage_options.cache.entries = FLAGS_cache_entries;
+  storage_options.cache.write_through = FLAGS_cache_write_through;
+
   tiny_kv::AsyncGrpcKVServer server(server_address, FLAGS_storage_type,
-                                    FLAGS_storage_path);
+                                    FLAGS_storage_path, 4, storage_options);
   g_server = &server;
 
   std::signal(SIGINT, HandleSignal);
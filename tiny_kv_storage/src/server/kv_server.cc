@@ -3,16 +3,21 @@
 //
 
 #include "kv_server.h"
+#include "src/common/cached_storage.h"
 #include <arpa/inet.h>
 #include <asm-generic/socket.h>
 #include <cerrno>
+#include <charconv>
 #include <cstddef>
 #include <cstdio>
 #include <cstring>
 #include <fcntl.h>
+#include <limits>
+#include <memory>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <thread>
@@ -21,19 +26,37 @@
 
 namespace tiny_kv {
 
+namespace {
+
+// The server whose event loop runs on this thread, if any; its completions
+// are finished in place instead of going through the wake fd.
+thread_local const KVServer *event_loop_server = nullptr;
+
+} // namespace
+
 /************************************************************************/
 /* KVServer */
 /************************************************************************/
 KVServer::KVServer(const std::string &ip, int port,
                    const std::string &storage_type,
-                   const std::string &storage_path)
+                   const std::string &storage_path,
+                   const StorageOptions &storage_options)
     : ip_(ip), port_(port), server_fd_(-1), epoll_fd_(-1),
-      storage_(CreateStorageEngine(storage_type, storage_path)),
+      wake_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+      storage_(
+          CreateStorageEngine(storage_type, storage_path, storage_options)),
       running_(false) {
   InitHandlers();
 }
 
-KVServer::~KVServer() { Stop(); }
+KVServer::~KVServer() {
+  Stop();
+  // no write callback may signal the wake fd once it is closed
+  storage_.reset();
+  if (wake_fd_ >= 0) {
+    close(wake_fd_);
+  }
+}
 
 bool KVServer::Start() {
   if (running_) {
@@ -93,6 +116,10 @@ void KVServer::Stop() {
     close(client.first);
   }
   clients_.clear();
+  {
+    std::lock_guard<std::mutex> lock(completions_mutex_);
+    completions_.clear();
+  }
 
   if (epoll_fd_ >= 0) {
     close(epoll_fd_);
@@ -104,7 +131,11 @@ void KVServer::Stop() {
     server_fd_ = -1;
   }
 
-  auto *file_storage = dynamic_cast<FileStorage *>(storage_.get());
+  StorageEngine *engine = storage_.get();
+  if (auto *cached = dynamic_cast<CachedStorageEngine *>(engine)) {
+    engine = cached->wrapped();
+  }
+  auto *file_storage = dynamic_cast<FileStorage *>(engine);
   if (file_storage) {
     file_storage->Persist();
   }
@@ -125,10 +156,19 @@ bool KVServer::InitEpoll() {
     return false;
   }
 
+  // level-triggered: `HandleCompletions()` resets the counter itself
+  event.events = EPOLLIN;
+  event.data.fd = wake_fd_;
+  if (wake_fd_ < 0 || epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event)) {
+    close(epoll_fd_);
+    return false;
+  }
+
   return true;
 }
 
 void KVServer::EventLoop() {
+  event_loop_server = this;
   while (running_) {
     int nfds = epoll_wait(epoll_fd_, events_, MAX_EVENTS, 100);
     if (nfds < 0) {
@@ -141,6 +181,8 @@ void KVServer::EventLoop() {
     for (int i = 0; i < nfds; i++) {
       if (events_[i].data.fd == server_fd_) {
         HandleNewConnection();
+      } else if (events_[i].data.fd == wake_fd_) {
+        HandleCompletions();
       } else {
         if (!HandleClientData(events_[i].data.fd)) {
           HandleClientDisconnect(clients_[events_[i].data.fd]);
@@ -149,6 +191,7 @@ void KVServer::EventLoop() {
       }
     }
   }
+  event_loop_server = nullptr;
 }
 
 void KVServer::HandleNewConnection() {
@@ -200,35 +243,114 @@ bool KVServer::HandleClientData(int client_fd) {
 
     client.buffer.insert(client.buffer.end(), buf, buf + n);
 
-    auto it = std::search(client.buffer.begin(), client.buffer.end(),
-                          std::begin("\r\n"), std::end("\r\n") - 1);
-
-    while (it != client.buffer.end()) {
-      std::vector<char> msg(client.buffer.begin(), it);
-      ProcessClientRequest(client, msg);
-
-      client.buffer.erase(client.buffer.begin(), it + 2);
-
-      it = std::search(client.buffer.begin(), client.buffer.end(),
-                       std::begin("\r\n"), std::end("\r\n") - 1);
+    // handle every complete line in place, then drop them in one go
+    std::string_view pending(client.buffer.data(), client.buffer.size());
+    size_t consumed = 0;
+    size_t end = pending.find("\r\n");
+    while (end != std::string_view::npos) {
+      ProcessClientRequest(client, pending.substr(consumed, end - consumed));
+      consumed = end + 2;
+      end = pending.find("\r\n", consumed);
     }
+    client.buffer.erase(client.buffer.begin(),
+                        client.buffer.begin() + consumed);
   }
 
   return true;
 }
 
-void KVServer::ProcessClientRequest(ClientInfo &client,
-                                    const std::vector<char> &msg) {
-  std::string request(msg.begin(), msg.end());
-  Request req = ParseRequest(request);
+void KVServer::ProcessClientRequest(ClientInfo &client, std::string_view msg) {
+  Request req = ParseRequest(msg);
+  if (req.op == OperationType::KPut) {
+    HandlePut(client, req);
+    return;
+  }
+
+  std::string response;
   auto it = handlers_.find(req.op);
   if (it == handlers_.end()) {
-    Response resp{false, "unknown operation", "", {}};
-    SendResponse(client.fd, SerializeResponse(resp) + "\r\n");
+    SerializeResponse({false, "unknown operation", "", {}}, &response);
+  } else {
+    it->second(req, &response);
+  }
+  response += "\r\n";
+  if (client.replies.empty()) {
+    SendResponse(client.fd, response);
+  } else {
+    client.replies.push_back({std::move(response), true});
+  }
+}
+
+// A put that must reach the log answers from the log's flush thread, so it
+// holds a slot in the client's replies instead of blocking the event loop;
+// the responses behind it wait there until it is filled.
+void KVServer::HandlePut(ClientInfo &client, const Request &req) {
+  Durability durability = Durability::kDefault;
+  if (!req.durability.empty()) {
+    ParseDurability(std::string(req.durability), &durability);
+  }
+  uint64_t reply = client.first_reply + client.replies.size();
+  client.replies.push_back({"", false});
+  storage_->PutAsync(
+      req.key, req.value, req.ttl_ms, durability,
+      [this, fd = client.fd, id = client.id, reply](bool success) {
+        std::string response;
+        SerializeResponse({success, success ? "success" : "fail", "", {}},
+                          &response);
+        response += "\r\n";
+        CompleteReply({fd, id, reply, std::move(response)});
+      });
+}
+
+// Called from any thread; memory and async puts call back in place.
+void KVServer::CompleteReply(Completion completion) {
+  if (event_loop_server == this) {
+    FinishReply(&completion);
     return;
   }
-  Response resp = it->second(req);
-  SendResponse(client.fd, SerializeResponse(resp) + "\r\n");
+  bool wake = false;
+  {
+    std::lock_guard<std::mutex> lock(completions_mutex_);
+    wake = completions_.empty();
+    completions_.push_back(std::move(completion));
+  }
+  if (wake) {
+    uint64_t one = 1;
+    ssize_t n = write(wake_fd_, &one, sizeof(one));
+    (void)n;
+  }
+}
+
+void KVServer::HandleCompletions() {
+  // reset the counter before taking the queue, or a completion queued in
+  // between would lose its wake-up
+  uint64_t count = 0;
+  ssize_t n = read(wake_fd_, &count, sizeof(count));
+  (void)n;
+
+  std::vector<Completion> completions;
+  {
+    std::lock_guard<std::mutex> lock(completions_mutex_);
+    completions.swap(completions_);
+  }
+  for (auto &completion : completions) {
+    FinishReply(&completion);
+  }
+}
+
+void KVServer::FinishReply(Completion *completion) {
+  auto it = clients_.find(completion->fd);
+  if (it == clients_.end() || it->second.id != completion->client_id) {
+    return;  // the client is gone
+  }
+  ClientInfo &client = it->second;
+  client.replies[completion->reply - client.first_reply] = {
+      std::move(completion->data), true};
+  while (!client.replies.empty() && client.replies.front().ready) {
+    SendResponse(client.fd, client.replies.front().data);
+    client.replies.pop_front();
+    ++client.first_reply;
+  }
 }
 
 bool KVServer::SendResponse(int fd, const std::string &response) {
@@ -248,70 +370,137 @@ bool KVServer::SendResponse(int fd, const std::string &response) {
 }
 
 void KVServer::InitHandlers() {
-  handlers_[OperationType::KPut] = [this](const Request &req) -> Response {
-    bool success = storage_->Put(req.key, req.value);
-    return {success, success ? "success" : "fail", "", {}};
-  };
-
-  handlers_[OperationType::KGet] = [this](const Request &req) -> Response {
-    auto value = storage_->Get(req.key);
-    if (value.has_value()) {
-      return {true, "success", *value, {}};
-    } else {
-      return {false, "key not found", "", {}};
+  handlers_[OperationType::KGet] = [this](const Request &req,
+                                          std::string *out) {
+    // serialize straight from the stored bytes instead of copying them into
+    // a `Response` first
+    bool found = storage_->Visit(req.key, [out](std::string_view value) {
+      static constexpr std::string_view kPrefix = "SUCCESS success";
+      out->reserve(out->size() + kPrefix.size() + 1 + value.size() + 2);
+      out->append(kPrefix.data(), kPrefix.size());
+      if (!value.empty()) {
+        out->push_back(' ');
+        out->append(value.data(), value.size());
+      }
+    });
+    if (!found) {
+      SerializeResponse({false, "key not found", "", {}}, out);
     }
   };
 
-  handlers_[OperationType::KDelete] = [this](const Request &req) -> Response {
+  handlers_[OperationType::KDelete] = [this](const Request &req,
+                                             std::string *out) {
     bool success = storage_->Delete(req.key);
-    return {success, success ? "success" : "fail", "", {}};
+    SerializeResponse({success, success ? "success" : "fail", "", {}}, out);
   };
 
-  handlers_[OperationType::KMultiGet] = [this](const Request &req) -> Response {
-    Response resp{true, "success", "", {}};
-    resp.kvs.reserve(req.kvs.size());
-
+  handlers_[OperationType::KMultiGet] = [this](const Request &req,
+                                               std::string *out) {
+    KeyList keys;
+    keys.reserve(req.kvs.size());
     for (const auto &kv : req.kvs) {
-      auto value = storage_->Get(kv.key);
-      if (value.has_value()) {
-        resp.kvs.push_back({kv.key, *value});
-      } else {
-        resp.kvs.push_back({kv.key, ""});
-      }
+      keys.push_back(kv.key);
     }
 
-    return resp;
+    std::vector<std::optional<std::string>> values;
+    storage_->MultiGet(keys, &values);
+
+    // same layout as `SerializeResponse()`, without owning copies of the keys
+    out->append("SUCCESS success");
+    for (size_t i = 0; i < req.kvs.size(); ++i) {
+      out->append(" ").append(req.kvs[i].key).append(" ");
+      if (values[i]) {
+        out->append(*values[i]);
+      }
+    }
   };
 
-  handlers_[OperationType::KMultiPut] = [this](const Request &req) -> Response {
-    bool success = true;
+  handlers_[OperationType::KMultiPut] = [this](const Request &req,
+                                               std::string *out) {
+    KVPairList kvs;
+    kvs.reserve(req.kvs.size());
+    for (const auto &kv : req.kvs) {
+      kvs.emplace_back(kv.key, kv.value);
+    }
 
+    bool success = storage_->MultiPut(kvs);
+    SerializeResponse({success, success ? "success" : "fail", "", {}}, out);
+  };
+
+  handlers_[OperationType::KMultiDelete] = [this](const Request &req,
+                                                  std::string *out) {
+    KeyList keys;
+    keys.reserve(req.kvs.size());
     for (const auto &kv : req.kvs) {
-      if (!storage_->Put(kv.key, kv.value)) {
-        success = false;
-      }
+      keys.push_back(kv.key);
     }
 
-    return {success, success ? "success" : "fail", "", {}};
+    bool success = storage_->MultiDelete(keys);
+    SerializeResponse({success, success ? "success" : "fail", "", {}}, out);
   };
 
-  handlers_[OperationType::KMultiDelete] =
-      [this](const Request &req) -> Response {
-    bool success = true;
+  handlers_[OperationType::KScan] = [this](const Request &req,
+                                           std::string *out) {
+    ScanBatch batch;
+    storage_->Scan(req.key, req.value, req.limit, &batch);
 
-    for (const auto &kv : req.kvs) {
-      if (!storage_->Delete(kv.key)) {
-        success = false;
-      }
+    // same layout as MGET: the matching pairs in key order
+    out->append("SUCCESS success");
+    for (const auto & [ key, value ] : batch) {
+      out->append(" ").append(key).append(" ").append(value);
     }
+  };
 
-    return {success, success ? "success" : "fail", "", {}};
+  // the read-modify-write commands run atomically inside the engine
+  auto respond = [this](UpdateStatus status, std::string value,
+                        std::string *out) {
+    bool success = status == UpdateStatus::kOk;
+    SerializeResponse({success, UpdateStatusMessage(status),
+                       success ? std::move(value) : "", {}},
+                      out);
+  };
+
+  handlers_[OperationType::KCas] = [this, respond](const Request &req,
+                                                   std::string *out) {
+    respond(storage_->CompareAndSet(req.key, req.expected, req.value), "",
+            out);
+  };
+
+  handlers_[OperationType::KIncrBy] = [this, respond](const Request &req,
+                                                      std::string *out) {
+    int64_t result = 0;
+    UpdateStatus status = storage_->IncrementBy(req.key, req.delta, &result);
+    respond(status, std::to_string(result), out);
+  };
+
+  handlers_[OperationType::KAppend] = [this, respond](const Request &req,
+                                                      std::string *out) {
+    size_t length = 0;
+    UpdateStatus status = storage_->Append(req.key, req.value, &length);
+    respond(status, std::to_string(length), out);
+  };
+
+  handlers_[OperationType::KStats] = [this](const Request &,
+                                            std::string *out) {
+    auto *cached = dynamic_cast<CachedStorageEngine *>(storage_.get());
+    if (!cached) {
+      SerializeResponse({false, "no cache", "", {}}, out);
+      return;
+    }
+    CacheStats stats = cached->Stats();
+    SerializeResponse({true,
+                       "success",
+                       "",
+                       {{"hits", std::to_string(stats.hits)},
+                        {"misses", std::to_string(stats.misses)}}},
+                      out);
   };
 }
 
 KVServer::ClientInfo KVServer::GetClientInfo(int fd) {
   ClientInfo info;
   info.fd = fd;
+  info.id = next_client_id_++;
 
   struct sockaddr_in addr;
   socklen_t addr_len = sizeof(addr);
@@ -344,86 +533,136 @@ void KVServer::HandleClientDisconnect(const ClientInfo &client) {
   close(client.fd);
 }
 
-Request KVServer::ParseRequest(const std::string &request) {
-  std::string data = request;
-  size_t pos = data.find(' ');
-  if (pos == std::string::npos) {
-    return {OperationType::Invalid, "", "", {}};
+namespace {
+
+// Splits off the next space-separated token of `*data`; an absent separator
+// makes the rest of `*data` the token.
+std::string_view NextToken(std::string_view *data) {
+  size_t pos = data->find(' ');
+  std::string_view token = data->substr(0, pos);
+  data->remove_prefix(pos == std::string_view::npos ? data->size() : pos + 1);
+  return token;
+}
+
+// The value of a PUT runs to the end of the line, so trailing `EX <n>` or
+// `PX <n>` and `DURABILITY <level>` pairs, in either order, are taken off it
+// as the TTL and the durability. A TTL pair without a valid number stays in
+// the value. Returns false for a TTL of zero or one out of range, an
+// unknown level, or an option given twice.
+bool TakePutOptions(Request *req) {
+  bool has_ttl = false;
+  bool has_durability = false;
+  while (true) {
+    std::string_view value = req->value;
+    size_t arg_pos = value.rfind(' ');
+    if (arg_pos == std::string_view::npos || arg_pos == 0) {
+      return true;
+    }
+    size_t name_pos = value.rfind(' ', arg_pos - 1);
+    if (name_pos == std::string_view::npos) {
+      return true;
+    }
+    std::string_view name = value.substr(name_pos + 1, arg_pos - name_pos - 1);
+    std::string_view arg = value.substr(arg_pos + 1);
+
+    if (name == "DURABILITY") {
+      Durability parsed;
+      if (has_durability || !ParseDurability(std::string(arg), &parsed)) {
+        return false;
+      }
+      req->durability = arg;
+      has_durability = true;
+    } else if (name == "EX" || name == "PX") {
+      uint64_t ttl = 0;
+      auto result = std::from_chars(arg.data(), arg.data() + arg.size(), ttl);
+      if (result.ec == std::errc::invalid_argument ||
+          result.ptr != arg.data() + arg.size()) {
+        return true;
+      }
+      if (has_ttl || result.ec != std::errc() || ttl == 0 ||
+          (name == "EX" && ttl > std::numeric_limits<uint64_t>::max() / 1000)) {
+        return false;
+      }
+      req->ttl_ms = name == "EX" ? ttl * 1000 : ttl;
+      has_ttl = true;
+    } else {
+      return true;
+    }
+    req->value.remove_suffix(value.size() - name_pos);
   }
+}
+
+} // namespace
 
-  std::string op_str = data.substr(0, pos);
+// All keys and values are views into `request`; nothing is copied.
+Request KVServer::ParseRequest(std::string_view request) {
+  std::string_view data = request;
+  size_t pos = data.find(' ');
+  if (pos == std::string_view::npos) {
+    // `STATS` is the one command without arguments
+    OperationType op =
+        data == "STATS" ? OperationType::KStats : OperationType::Invalid;
+    return {op, {}, {}, {}};
+  }
 
-  static const std::unordered_map<std::string, OperationType> op_map = {
+  static constexpr std::pair<std::string_view, OperationType> kOps[] = {
       {"GET", OperationType::KGet},
       {"DEL", OperationType::KDelete},
       {"PUT", OperationType::KPut},
       {"MGET", OperationType::KMultiGet},
       {"MPUT", OperationType::KMultiPut},
-      {"MDEL", OperationType::KMultiDelete}};
-
-  auto it = op_map.find(op_str);
-  if (it == op_map.end()) {
-    return {OperationType::Invalid, "", "", {}};
+      {"MDEL", OperationType::KMultiDelete},
+      {"SCAN", OperationType::KScan},
+      {"CAS", OperationType::KCas},
+      {"INCRBY", OperationType::KIncrBy},
+      {"APPEND", OperationType::KAppend}};
+
+  std::string_view op_str = data.substr(0, pos);
+  OperationType op = OperationType::Invalid;
+  for (const auto & [ name, type ] : kOps) {
+    if (name == op_str) {
+      op = type;
+      break;
+    }
+  }
+  if (op == OperationType::Invalid) {
+    return {OperationType::Invalid, {}, {}, {}};
   }
 
-  OperationType op = it->second;
-  data = data.substr(pos + 1);
+  data.remove_prefix(pos + 1);
 
   switch (op) {
   case OperationType::KGet:
   case OperationType::KDelete:
-    return {op, data, "", {}};
+    return {op, data, {}, {}};
 
   case OperationType::KPut: {
-    pos = data.find(' ');
-    if (pos == std::string::npos) {
-      return {op, data, "", {}};
+    // `PUT <key> <value> [EX <seconds> | PX <milliseconds>]
+    //  [DURABILITY memory|async|sync]`, the options in either order
+    Request req{op, NextToken(&data), data, {}};
+    if (!TakePutOptions(&req)) {
+      return {OperationType::Invalid, {}, {}, {}};
     }
-    return {op, data.substr(0, pos), data.substr(pos + 1), {}};
+    return req;
   }
 
   case OperationType::KMultiGet:
   case OperationType::KMultiDelete: {
-    Request req{op, "", "", {}};
-    size_t start = 0;
-    while (start < data.length()) {
-      pos = data.find(' ', start);
-      std::string key;
-      if (pos == std::string::npos) {
-        key = data.substr(start);
-        start = data.length();
-      } else {
-        key = data.substr(start, pos - start);
-        start = pos + 1;
-      }
+    Request req{op, {}, {}, {}};
+    while (!data.empty()) {
+      std::string_view key = NextToken(&data);
       if (!key.empty()) {
-        req.kvs.push_back({key, ""});
+        req.kvs.push_back({key, {}});
       }
     }
     return req;
   }
 
   case OperationType::KMultiPut: {
-    Request req{op, "", "", {}};
-    size_t start = 0;
-    while (start < data.length()) {
-      size_t key_end = data.find(' ', start);
-      if (key_end == std::string::npos) {
-        break;
-      }
-      std::string key = data.substr(start, key_end - start);
-      start = key_end + 1;
-
-      size_t value_end = data.find(' ', start);
-      std::string value;
-      if (value_end == std::string::npos) {
-        value = data.substr(start);
-        start = data.length();
-      } else {
-        value = data.substr(start, value_end - start);
-        start = value_end + 1;
-      }
-
+    Request req{op, {}, {}, {}};
+    while (data.find(' ') != std::string_view::npos) {
+      std::string_view key = NextToken(&data);
+      std::string_view value = NextToken(&data);
       if (!key.empty()) {
         req.kvs.push_back({key, value});
       }
@@ -431,26 +670,59 @@ Request KVServer::ParseRequest(const std::string &request) {
     return req;
   }
 
+  case OperationType::KScan: {
+    // `SCAN <start> <end> [limit]`; an empty token is an open bound
+    Request req{op, NextToken(&data), NextToken(&data), {}};
+    if (!data.empty()) {
+      auto result =
+          std::from_chars(data.data(), data.data() + data.size(), req.limit);
+      if (result.ec != std::errc() || result.ptr != data.data() + data.size()) {
+        return {OperationType::Invalid, {}, {}, {}};
+      }
+    }
+    return req;
+  }
+
+  case OperationType::KCas: {
+    // `CAS <key> <expected> <new value>`; the new value runs to the end
+    Request req{op, NextToken(&data), {}, {}};
+    req.expected = NextToken(&data);
+    req.value = data;
+    return req;
+  }
+
+  case OperationType::KIncrBy: {
+    // `INCRBY <key> <delta>`
+    Request req{op, NextToken(&data), {}, {}};
+    auto result =
+        std::from_chars(data.data(), data.data() + data.size(), req.delta);
+    if (data.empty() || result.ec != std::errc() ||
+        result.ptr != data.data() + data.size()) {
+      return {OperationType::Invalid, {}, {}, {}};
+    }
+    return req;
+  }
+
+  case OperationType::KAppend:
+    // `APPEND <key> <suffix>`; the suffix runs to the end
+    return {op, NextToken(&data), data, {}};
+
   default:
-    return {OperationType::Invalid, "", "", {}};
+    return {OperationType::Invalid, {}, {}, {}};
   }
 }
 
-std::string KVServer::SerializeResponse(const Response &resp) {
-  std::string result = resp.success ? "SUCCESS" : "FAIL";
-  result += " " + resp.message;
+void KVServer::SerializeResponse(const Response &resp, std::string *out) {
+  out->append(resp.success ? "SUCCESS" : "FAIL");
+  out->append(" ").append(resp.message);
 
   if (!resp.value.empty()) {
-    result += " " + resp.value;
+    out->append(" ").append(resp.value);
   }
 
-  if (!resp.kvs.empty()) {
-    for (const auto &kv : resp.kvs) {
-      result += " " + kv.key + " " + kv.value;
-    }
+  for (const auto &kv : resp.kvs) {
+    out->append(" ").append(kv.key).append(" ").append(kv.value);
   }
-
-  return result;
 }
 
 std::unique_ptr<StorageEngine> &KVServer::GetStorageForBenchmark() {
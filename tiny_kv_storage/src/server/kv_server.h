@@ -6,9 +6,13 @@
 #include "src/common/kv_common.h"
 #include "src/common/storage_engine.h"
 #include <atomic>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <unordered_map>
 #include <sys/epoll.h>
@@ -16,7 +20,9 @@
 
 namespace tiny_kv {
 
-using RequestHandle = std::function<Response(const Request &)>;
+// Appends the serialized response (without the trailing "\r\n") to `out`.
+using RequestHandle =
+    std::function<void(const Request &req, std::string *out)>;
 
 /************************************************************************/
 /* KVServer */
@@ -25,7 +31,8 @@ class KVServer {
 public:
   KVServer(const std::string &ip, int port,
            const std::string &storage_type = "memory",
-           const std::string &storage_path = "");
+           const std::string &storage_path = "",
+           const StorageOptions &storage_options = StorageOptions());
 
   ~KVServer();
 
@@ -33,30 +40,55 @@ public:
   void Stop();
   std::unique_ptr<StorageEngine> &GetStorageForBenchmark();
 
+  // Parses one request line, without its "\r\n"; keys and values are views
+  // into `request`. A malformed line gives an `Invalid` operation.
+  static Request ParseRequest(std::string_view request);
+
 private:
   static constexpr int MAX_EVENTS = 1024;
   static constexpr int MAX_BUFFER_SIZE = 1024;
 
+  // A response slot; a put that waits for the log holds an empty one.
+  struct Reply {
+    std::string data;
+    bool ready;
+  };
+
   struct ClientInfo {
     int fd;
+    uint64_t id;  // tells a new connection on a reused fd apart
     std::string ip;
     int port;
     bool has_address;
     std::vector<char> buffer;
+    // responses in request order; only the ready ones at the front go out
+    std::deque<Reply> replies;
+    uint64_t first_reply = 0;  // request number of `replies.front()`
+  };
+
+  // A put's response, handed back to the event loop by the engine's callback.
+  struct Completion {
+    int fd;
+    uint64_t client_id;
+    uint64_t reply;
+    std::string data;
   };
 
   ClientInfo GetClientInfo(int fd);
   void LogClientEvent(const ClientInfo &client, const std::string &event);
   void HandleClientDisconnect(const ClientInfo &client);
-  void ProcessClientRequest(ClientInfo &client, const std::vector<char> &msg);
+  void ProcessClientRequest(ClientInfo &client, std::string_view msg);
+  void HandlePut(ClientInfo &client, const Request &req);
+  void CompleteReply(Completion completion);
+  void HandleCompletions();
+  void FinishReply(Completion *completion);
 
   void InitHandlers();
   bool InitEpoll();
   void EventLoop();
   void HandleNewConnection();
   bool HandleClientData(int client_fd);
-  Request ParseRequest(const std::string &request);
-  std::string SerializeResponse(const Response &resp);
+  void SerializeResponse(const Response &resp, std::string *out);
   bool SendResponse(int fd, const std::string &response);
 
 private:
@@ -64,11 +96,17 @@ private:
   int port_;
   int server_fd_;
   int epoll_fd_;
+  // wakes the event loop for completions; outlives `storage_`, whose
+  // callbacks signal it
+  int wake_fd_;
+  std::mutex completions_mutex_;
+  std::vector<Completion> completions_;
   std::unique_ptr<StorageEngine> storage_;
   std::atomic<bool> running_;
   std::thread event_thread_;
   std::unordered_map<OperationType, RequestHandle> handlers_;
   std::unordered_map<int, ClientInfo> clients_;
+  uint64_t next_client_id_ = 0;
   struct epoll_event events_[MAX_EVENTS];
 };
 } // namespace tiny_kv
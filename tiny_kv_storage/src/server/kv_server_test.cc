@@ -0,0 +1,128 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "kv_server.h"
+#include <arpa/inet.h>
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+namespace tiny_kv {
+
+namespace {
+
+constexpr int kPort = 18765;
+
+// Sends all of `requests` in one write and reads back one response line for
+// each, in order.
+std::vector<std::string> Pipeline(const std::vector<std::string> &requests) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  addr.sin_port = htons(kPort);
+  if (connect(fd, (const sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return {};
+  }
+
+  std::string batch;
+  for (const auto &request : requests) {
+    batch.append(request).append("\r\n");
+  }
+  size_t sent = 0;
+  while (sent < batch.size()) {
+    ssize_t n = write(fd, batch.data() + sent, batch.size() - sent);
+    if (n <= 0) {
+      break;
+    }
+    sent += n;
+  }
+
+  std::vector<std::string> responses;
+  std::string received;
+  char buf[4096];
+  while (responses.size() < requests.size()) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0) {
+      break;
+    }
+    received.append(buf, n);
+    size_t end;
+    while ((end = received.find("\r\n")) != std::string::npos) {
+      responses.push_back(received.substr(0, end));
+      received.erase(0, end + 2);
+    }
+  }
+  close(fd);
+  return responses;
+}
+
+} // namespace
+
+TEST(KVServerTest, ParsesPutOptionsInEitherOrder) {
+  for (const char *line : {"PUT k v DURABILITY sync EX 10",
+                           "PUT k v EX 10 DURABILITY sync"}) {
+    Request req = KVServer::ParseRequest(line);
+    EXPECT_EQ(req.op, OperationType::KPut) << line;
+    EXPECT_EQ(req.key, "k") << line;
+    EXPECT_EQ(req.value, "v") << line;
+    EXPECT_EQ(req.ttl_ms, 10000u) << line;
+    EXPECT_EQ(req.durability, "sync") << line;
+  }
+
+  // the value runs to the end of the line, spaces and all
+  Request req = KVServer::ParseRequest("PUT k a b PX 5");
+  EXPECT_EQ(req.value, "a b");
+  EXPECT_EQ(req.ttl_ms, 5u);
+  EXPECT_TRUE(req.durability.empty());
+  req = KVServer::ParseRequest("PUT k a EX soon");
+  EXPECT_EQ(req.value, "a EX soon");
+  EXPECT_EQ(req.ttl_ms, 0u);
+
+  // an option given twice, an unknown level or a bad TTL is rejected
+  for (const char *line :
+       {"PUT k v EX 10 EX 20", "PUT k v DURABILITY sync DURABILITY async",
+        "PUT k v DURABILITY never", "PUT k v EX 0",
+        "PUT k v EX 18446744073709552 DURABILITY sync"}) {
+    EXPECT_EQ(KVServer::ParseRequest(line).op, OperationType::Invalid)
+        << line;
+  }
+}
+
+// A put that waits for fsync must not hold up the event loop, yet every
+// response still comes back in request order.
+TEST(KVServerTest, PipelinedPutsAnswerInOrder) {
+  const std::string path = "kv_server_test.db";
+  std::filesystem::remove(path);
+  std::filesystem::remove(path + ".wal");
+  {
+    KVServer server("127.0.0.1", kPort, "file", path);
+    ASSERT_TRUE(server.Start());
+
+    std::vector<std::string> requests;
+    std::vector<std::string> expected;
+    for (int i = 0; i < 100; ++i) {
+      std::string n = std::to_string(i);
+      requests.push_back("PUT s" + n + " v" + n + " DURABILITY sync");
+      expected.push_back("SUCCESS success");
+      requests.push_back("GET s" + n);
+      expected.push_back("SUCCESS success v" + n);
+      requests.push_back("PUT m" + n + " w" + n + " DURABILITY memory");
+      expected.push_back("SUCCESS success");
+      requests.push_back("GET m" + n);
+      expected.push_back("SUCCESS success w" + n);
+    }
+    EXPECT_EQ(Pipeline(requests), expected);
+    server.Stop();
+  }
+  std::filesystem::remove(path);
+  std::filesystem::remove(path + ".wal");
+}
+
+} // namespace tiny_kv
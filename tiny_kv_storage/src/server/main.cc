@@ -7,6 +7,7 @@
 #include <assert.h>
 #include <atomic>
 #include <chrono>
+#include <cinttypes>
 #include <csignal>
 #include <exception>
 #include <future>
@@ -19,9 +20,40 @@ namespace tiny_kv {
 
 DEFINE_string(ip, "127.0.0.1", "The server ip");
 DEFINE_int32(port, 8080, "The server port");
-DEFINE_string(storage_type, "memory", "Storage type: 'memory' or 'file'");
+DEFINE_string(storage_type, "memory",
+              "Storage type: 'memory', 'file' or 'lsm'");
 DEFINE_string(storage_path, "test.db",
-              "Path to database file when using file storage");
+              "Path to database file (file storage) or directory (lsm "
+              "storage)");
+DEFINE_int32(memory_shards, 16,
+             "Number of independently locked shards of memory storage");
+DEFINE_uint64(max_memory_bytes, 0,
+              "Memory storage limit; writes evict approximately least "
+              "recently used keys to stay under it. 0 disables");
+DEFINE_string(value_codec, "none",
+              "Compression of large values in memory and file storage: "
+              "'none' or 'lz4'");
+DEFINE_uint64(compress_min_bytes, 256,
+              "Values shorter than this are never compressed");
+DEFINE_string(wal_fsync, "always",
+              "WAL fsync policy for file storage: 'always', 'interval' or "
+              "'never'");
+DEFINE_int32(wal_fsync_interval_ms, 100,
+             "fdatasync period of the WAL when --wal_fsync=interval");
+DEFINE_string(async_io, "auto",
+              "Backend of the WAL and snapshot writes of file and lsm "
+              "storage: 'auto' (io_uring where available) or 'threads'");
+DEFINE_int32(checkpoint_interval_s, 0,
+             "Seconds between background checkpoints of file storage, 0 "
+             "disables");
+DEFINE_uint64(cache_entries, 0,
+              "Entries of the read cache in front of file and lsm storage, "
+              "0 disables");
+DEFINE_string(cache_policy, "lru",
+              "Replacement policy of the read cache: 'lru', 'clock' or "
+              "'tinylfu'");
+DEFINE_bool(cache_write_through, false,
+            "Writes update cached values instead of dropping them");
 
 class KVServerApp;
 
@@ -40,8 +72,10 @@ public:
   }
 
   bool Start(const std::string &ip, int port, const std::string &storage_type,
-             const std::string &storage_path) {
-    server_ = std::make_unique<KVServer>(ip, port, storage_type, storage_path);
+             const std::string &storage_path,
+             const StorageOptions &storage_options) {
+    server_ = std::make_unique<KVServer>(ip, port, storage_type, storage_path,
+                                         storage_options);
 
     if (!server_->Start()) {
       printf("Failed to start server.\n");
@@ -51,8 +85,9 @@ public:
     printf("KV Storage Server started, listening on: %s:%d\n", ip.c_str(),
            port);
     printf("Storage engine: %s%s\n", storage_type.c_str(),
-           (storage_type == "file" ? (" (path: " + storage_path + ")").c_str()
-                                   : ""));
+           (storage_type != "memory"
+                ? (" (path: " + storage_path + ")").c_str()
+                : ""));
     return true;
   }
 
@@ -128,13 +163,45 @@ int main(int argc, char **argv) {
 
   google::ParseCommandLineFlags(&argc, &argv, true);
 
+  StorageOptions storage_options;
+  KV_ASSERT(
+      ParseFsyncPolicy(FLAGS_wal_fsync, &storage_options.wal.fsync_policy),
+      "Invalid --wal_fsync, expected 'always', 'interval' or 'never'.");
+  KV_ASSERT(ParseAsyncIoBackend(FLAGS_async_io, &storage_options.io.backend),
+            "Invalid --async_io, expected 'auto' or 'threads'.");
+  KV_ASSERT(FLAGS_memory_shards > 0, "--memory_shards must be positive.");
+  KV_ASSERT(ParseValueCodec(FLAGS_value_codec,
+                            &storage_options.compression.codec),
+            "Invalid --value_codec, expected 'none' or 'lz4'.");
+  KV_ASSERT(ParseCachePolicy(FLAGS_cache_policy,
+                             &storage_options.cache.policy),
+            "Invalid --cache_policy, expected 'lru', 'clock' or 'tinylfu'.");
+  storage_options.compression.min_bytes = FLAGS_compress_min_bytes;
+  storage_options.memory_shards = FLAGS_memory_shards;
+  storage_options.memory_max_bytes = FLAGS_max_memory_bytes;
+  storage_options.wal.fsync_interval_ms = FLAGS_wal_fsync_interval_ms;
+  storage_options.checkpoint_interval_s = FLAGS_checkpoint_interval_s;
+  storage_options.on_checkpoint = [](bool ok,
+                                     const CheckpointStats &stats) {
+    if (!ok) {
+      printf("Checkpoint of %s failed\n", FLAGS_storage_path.c_str());
+      return;
+    }
+    printf("Checkpoint of %s: %zu entries in %" PRIu64 " ms, paused %" PRIu64
+           " us, shard copies %" PRIu64 " us\n",
+           FLAGS_storage_path.c_str(), stats.entries, stats.duration_ms,
+           stats.pause_us, stats.copy_us);
+  };
+  storage_options.cache.entries = FLAGS_cache_entries;
+  storage_options.cache.write_through = FLAGS_cache_write_through;
+
   KVServerApp app;
 
   app.SetupSignalHandlers();
 
-  KV_ASSERT(
-      app.Start(FLAGS_ip, FLAGS_port, FLAGS_storage_type, FLAGS_storage_path),
-      "Failed to start KV server.");
+  KV_ASSERT(app.Start(FLAGS_ip, FLAGS_port, FLAGS_storage_type,
+                      FLAGS_storage_path, storage_options),
+            "Failed to start KV server.");
 
   app.Run();
 
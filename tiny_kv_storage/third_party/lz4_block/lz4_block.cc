@@ -0,0 +1,211 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#include "lz4_block.h"
+#include <cstdint>
+#include <cstring>
+
+namespace lz4_block {
+
+namespace {
+
+constexpr size_t kMinMatch = 4;
+constexpr size_t kLastLiterals = 5; // the block always ends in literals
+constexpr size_t kMatchLimit = 12;  // no match starts this close to the end
+constexpr size_t kMaxOffset = 65535;
+constexpr size_t kMaxHashBits = 12;
+constexpr size_t kMinHashBits = 8;
+constexpr unsigned kSkipShift = 6; // step grows by 1 every 64 misses
+
+uint32_t Load32(const char *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+uint32_t Hash(uint32_t sequence, size_t bits) {
+  return (sequence * 2654435761u) >> (32 - bits);
+}
+
+// Bytes taken by a length of `n` that did not fit in a nibble.
+size_t ExtraLengthBytes(size_t n) { return n < 15 ? 0 : (n - 15) / 255 + 1; }
+
+char *WriteExtraLength(char *op, size_t n) {
+  for (n -= 15; n >= 255; n -= 255) {
+    *op++ = static_cast<char>(255);
+  }
+  *op++ = static_cast<char>(n);
+  return op;
+}
+
+// Appends one sequence; a `match_length` of 0 writes the final literals.
+// Returns nullptr if it does not fit before `end`.
+char *WriteSequence(char *op, char *end, const char *literals,
+                    size_t literal_length, size_t offset,
+                    size_t match_length) {
+  const size_t match_code = match_length == 0 ? 0 : match_length - kMinMatch;
+  size_t need = 1 + ExtraLengthBytes(literal_length) + literal_length;
+  if (match_length != 0) {
+    need += 2 + ExtraLengthBytes(match_code);
+  }
+  if (static_cast<size_t>(end - op) < need) {
+    return nullptr;
+  }
+
+  char *token = op++;
+  uint8_t code = static_cast<uint8_t>(
+      (literal_length < 15 ? literal_length : 15) << 4);
+  if (literal_length >= 15) {
+    op = WriteExtraLength(op, literal_length);
+  }
+  memcpy(op, literals, literal_length);
+  op += literal_length;
+
+  if (match_length != 0) {
+    *op++ = static_cast<char>(offset & 0xff);
+    *op++ = static_cast<char>(offset >> 8);
+    code |= static_cast<uint8_t>(match_code < 15 ? match_code : 15);
+    if (match_code >= 15) {
+      op = WriteExtraLength(op, match_code);
+    }
+  }
+  *token = static_cast<char>(code);
+  return op;
+}
+
+// Reads a length continued past its nibble. False if the block ends first.
+bool ReadExtraLength(const uint8_t **ip, const uint8_t *end, size_t *length) {
+  uint8_t byte;
+  do {
+    if (*ip == end) {
+      return false;
+    }
+    byte = *(*ip)++;
+    *length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+} // namespace
+
+size_t CompressBound(size_t size) { return size + size / 255 + 16; }
+
+size_t Compress(const char *src, size_t size, char *dst, size_t capacity) {
+  if (size >= (size_t(1) << 32)) {
+    return 0;
+  }
+
+  char *op = dst;
+  char *const op_end = dst + capacity;
+  size_t anchor = 0;
+
+  if (size > kMatchLimit) {
+    // a table about the size of the input; clearing a large one would
+    // dominate small values
+    size_t bits = kMinHashBits;
+    while (bits < kMaxHashBits && (size_t(1) << bits) < size) {
+      ++bits;
+    }
+    uint32_t table[size_t(1) << kMaxHashBits];
+    memset(table, 0, sizeof(uint32_t) << bits);
+
+    const size_t search_end = size - kMatchLimit;
+    const size_t match_end = size - kLastLiterals;
+    size_t ip = 0;
+    while (ip < search_end) {
+      const uint32_t sequence = Load32(src + ip);
+      uint32_t &slot = table[Hash(sequence, bits)];
+      const size_t candidate = slot;
+      slot = static_cast<uint32_t>(ip);
+      if (candidate >= ip || ip - candidate > kMaxOffset ||
+          Load32(src + candidate) != sequence) {
+        ip += 1 + ((ip - anchor) >> kSkipShift);
+        continue;
+      }
+
+      size_t match = candidate;
+      while (ip > anchor && match > 0 && src[ip - 1] == src[match - 1]) {
+        --ip;
+        --match;
+      }
+      size_t length = kMinMatch;
+      while (ip + length < match_end &&
+             src[match + length] == src[ip + length]) {
+        ++length;
+      }
+
+      op = WriteSequence(op, op_end, src + anchor, ip - anchor, ip - match,
+                         length);
+      if (op == nullptr) {
+        return 0;
+      }
+      ip += length;
+      anchor = ip;
+      // seed the table with the end of the match for the next search
+      if (ip - 2 < search_end) {
+        table[Hash(Load32(src + ip - 2), bits)] =
+            static_cast<uint32_t>(ip - 2);
+      }
+    }
+  }
+
+  op = WriteSequence(op, op_end, src + anchor, size - anchor, 0, 0);
+  return op == nullptr ? 0 : static_cast<size_t>(op - dst);
+}
+
+bool Decompress(const char *src, size_t src_size, char *dst, size_t size) {
+  const uint8_t *ip = reinterpret_cast<const uint8_t *>(src);
+  const uint8_t *const ip_end = ip + src_size;
+  char *op = dst;
+  char *const op_end = dst + size;
+
+  while (ip != ip_end) {
+    const uint8_t token = *ip++;
+
+    size_t literal_length = token >> 4;
+    if (literal_length == 15 &&
+        !ReadExtraLength(&ip, ip_end, &literal_length)) {
+      return false;
+    }
+    if (literal_length > static_cast<size_t>(ip_end - ip) ||
+        literal_length > static_cast<size_t>(op_end - op)) {
+      return false;
+    }
+    memcpy(op, ip, literal_length);
+    ip += literal_length;
+    op += literal_length;
+    if (ip == ip_end) {
+      break; // the final, literals-only sequence
+    }
+
+    if (ip_end - ip < 2) {
+      return false;
+    }
+    const size_t offset = ip[0] | (size_t(ip[1]) << 8);
+    ip += 2;
+    size_t match_length = token & 15;
+    if (match_length == 15 && !ReadExtraLength(&ip, ip_end, &match_length)) {
+      return false;
+    }
+    match_length += kMinMatch;
+    if (offset == 0 || offset > static_cast<size_t>(op - dst) ||
+        match_length > static_cast<size_t>(op_end - op)) {
+      return false;
+    }
+
+    const char *match = op - offset;
+    if (offset >= match_length) {
+      memcpy(op, match, match_length);
+      op += match_length;
+    } else {
+      // the match overlaps the bytes it produces, e.g. a run
+      for (size_t i = 0; i < match_length; ++i) {
+        *op++ = match[i];
+      }
+    }
+  }
+  return op == op_end;
+}
+
+} // namespace lz4_block
@@ -0,0 +1,39 @@
+// Copyright 2025 Tobijah.lu Inc. All Rights Reserved.
+// Author: Tongjia Lu (tobijah@163.com)
+//
+
+#pragma once
+
+#include <cstddef>
+
+// A small, dependency-free codec for the LZ4 block format. Blocks are
+// interchangeable with LZ4_compress_default / LZ4_decompress_safe.
+//
+// A block is a series of sequences:
+//   [token][literal length+][literals][offset u16 le][match length+]
+// The high nibble of the token is the literal count and the low nibble the
+// match length minus 4; a nibble of 15 continues in extra bytes that are
+// added up until one is below 255. The last sequence holds only literals,
+// the last 5 bytes are always literals, and no match starts within the last
+// 12 bytes.
+//
+// The compressor is greedy with a single-entry hash table and skips ahead
+// faster the longer it finds nothing, so incompressible input costs little.
+// The block does not record the uncompressed size; callers keep it.
+
+namespace lz4_block {
+
+// Largest block `Compress` can produce for `size` input bytes.
+size_t CompressBound(size_t size);
+
+// Compresses `src` into `dst`. Returns the block size, or 0 if the block
+// would not fit in `capacity` bytes (the compressor gives up as soon as it
+// knows) or the input is 4 GiB or more.
+size_t Compress(const char *src, size_t size, char *dst, size_t capacity);
+
+// Decompresses a block into exactly `size` bytes at `dst`. Returns false if
+// the block is malformed or does not decode to `size` bytes; never reads or
+// writes out of bounds.
+bool Decompress(const char *src, size_t src_size, char *dst, size_t size);
+
+} // namespace lz4_block